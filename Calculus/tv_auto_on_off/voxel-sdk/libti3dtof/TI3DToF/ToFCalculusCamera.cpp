@@ -346,6 +346,9 @@ bool ToFCalculusCamera::_updateEasyConf()
   
   _set(INTG_DUTY_CYCLE_SET_FAILED, false);
   _set(TG_EN, false);
+  
+  // Timing registers are sent together while the timing generator is off
+  _programmer->beginBatch();
   // Set INTG_PHASE_PIX2 and RDOUT_PHASE_PIX2 to 50 cycles earlier than usual, and gate shutter at the usual point
   _programmer->writeRegister(TM_INTG_PHASE_PIX2_REG, tm_intg_phase_pix2_int - 50);
   _programmer->writeRegister(TM_RDOUT_PHASE_PIX2_REG, tm_intg_phase_pix2_int - 50);
@@ -357,6 +360,8 @@ bool ToFCalculusCamera::_updateEasyConf()
 
   _programmer->writeRegister(TM_PIX_CNT_MAX_REG, pix_cnt_max);
   _programmer->writeRegister(TM_UFRAME_CNT_MAX_REG, 4 + (sub_frame_cnt_max << 4));
+  _programmer->commit();
+  
   _set(TG_EN, tg_en_value);
 
   return true;
@@ -67,7 +67,7 @@ public:
   
 
 ToFCamera::ToFCamera(const String &name, DevicePtr device): ToFCameraBase(name, device),
-_tofFrameGenerator(new ToFFrameGenerator())
+_calibrationRevision(-1), _tofFrameGenerator(new ToFFrameGenerator())
 {
   _frameGenerators[0] = std::dynamic_pointer_cast<FrameGenerator>(_tofFrameGenerator);
   _tofDepthFrameGenerator->setProcessedFrameGenerator(_frameGenerators[0]);
@@ -329,7 +329,7 @@ bool ToFCamera::_getAmplitudeNormalizingFactor(float &factor)
 }
 
 
-bool ToFCamera::_processRawFrame(const RawFramePtr &rawFrameInput, RawFramePtr &rawFrameOutput)
+bool ToFCamera::_setToFFrameGeneratorParameters()
 {
   RegionOfInterest roi;
   uint rowsToMerge, columnsToMerge;
@@ -351,9 +351,11 @@ bool ToFCamera::_processRawFrame(const RawFramePtr &rawFrameInput, RawFramePtr &
     return false;
   }
   
-  if(!_tofFrameGenerator->setParameters(configFile.get("calib", "phasecorrection"), bytesPerPixel, 
+  const Calibration &calibration = _getCalibration();
+  
+  if(!_tofFrameGenerator->setParameters(calibration.phaseCorrection, bytesPerPixel, 
                                     dataArrangeMode, roi, maxFrameSize, rowsToMerge, columnsToMerge, _isHistogramEnabled(),
-                                    configFile.get("calib", "cross_talk_coeff"),
+                                    calibration.crossTalkCoefficients,
                                     type
                                    ))
   {
@@ -361,6 +363,14 @@ bool ToFCamera::_processRawFrame(const RawFramePtr &rawFrameInput, RawFramePtr &
     return false;
   }
   
+  return true;
+}
+
+bool ToFCamera::_processRawFrame(const RawFramePtr &rawFrameInput, RawFramePtr &rawFrameOutput)
+{
+  if(!_setToFFrameGeneratorParameters())
+    return false;
+  
   FramePtr p1 = std::dynamic_pointer_cast<Frame>(rawFrameInput);
   FramePtr p2 = std::dynamic_pointer_cast<Frame>(rawFrameOutput);
   
@@ -375,6 +385,76 @@ bool ToFCamera::_processRawFrame(const RawFramePtr &rawFrameInput, RawFramePtr &
     return false;
 }
 
+bool ToFCamera::_convertRawToPointCloudFrame(const RawFramePtr &rawFrame, PointCloudFramePtr &pointCloudFrame)
+{
+  if(!_setToFFrameGeneratorParameters())
+    return false;
+  
+  if(!_tofFrameGenerator->canGeneratePointCloud())
+    return _processRawFrame(rawFrame, _fusedProcessedFrame) && 
+      _convertToDepthFrame(_fusedProcessedFrame, _fusedDepthFrame) && 
+      _convertToPointCloudFrame(_fusedDepthFrame, pointCloudFrame);
+  
+  float amplitudeNormalizingFactor, depthScalingFactor;
+  
+  if(!_getAmplitudeNormalizingFactor(amplitudeNormalizingFactor) || !_getDepthScalingFactor(depthScalingFactor))
+    return false;
+  
+  // Keeps depth frame generator configuration current, as it is saved in frame streams
+  if(!_tofDepthFrameGenerator->setParameters(amplitudeNormalizingFactor, depthScalingFactor))
+  {
+    logger(LOG_ERROR) << "ToFCamera: Could not set parameters to ToFDepthFrameGenerator" << std::endl;
+    return false;
+  }
+  
+  const PointCloudTransformPtr &transform = _pointCloudFrameGenerator->getPointCloudTransform();
+  
+  if(!transform)
+  {
+    logger(LOG_ERROR) << "ToFCamera: Point cloud transform is not yet initialized" << std::endl;
+    return false;
+  }
+  
+  FramePtr p1 = std::dynamic_pointer_cast<Frame>(rawFrame);
+  FramePtr p2 = std::dynamic_pointer_cast<Frame>(pointCloudFrame);
+  
+  if(!_tofFrameGenerator->generatePointCloud(p1, *transform, amplitudeNormalizingFactor, depthScalingFactor, p2))
+    return false;
+  
+  pointCloudFrame = std::dynamic_pointer_cast<PointCloudFrame>(p2);
+  return true;
+}
+
+const ToFCamera::Calibration &ToFCamera::_getCalibration()
+{
+  if(_calibrationRevision == configFile.getRevision())
+    return _calibration;
+  
+  struct { const char *name; float &value; } floats[] = {
+    {"fx", _calibration.fx}, {"fy", _calibration.fy}, {"cx", _calibration.cx}, {"cy", _calibration.cy},
+    {"k1", _calibration.k1}, {"k2", _calibration.k2}, {"k3", _calibration.k3}, 
+    {"p1", _calibration.p1}, {"p2", _calibration.p2}
+  };
+  
+  for(auto &f: floats)
+  {
+    String s = configFile.get("calib", f.name);
+    char *end;
+    
+    f.value = s.size()?strtof(s.c_str(), &end):0.0f;
+    
+    if(s.size() && *end != 0)
+      logger(LOG_WARNING) << "ToFCamera: Invalid value '" << s << "' for calib." << f.name 
+        << " in profile '" << configFile.getCurrentProfileName() << "'. Using " << f.value << std::endl;
+  }
+  
+  _calibration.phaseCorrection = configFile.get("calib", "phasecorrection");
+  _calibration.crossTalkCoefficients = configFile.get("calib", "cross_talk_coeff");
+  
+  _calibrationRevision = configFile.getRevision();
+  return _calibration;
+}
+
 bool ToFCamera::_initStartParams()
 {
   RegionOfInterest roi;
@@ -384,18 +464,13 @@ bool ToFCamera::_initStartParams()
     !getROI(roi))
     return false;
   
+  const Calibration &calibration = _getCalibration();
+  
   if(!_pointCloudFrameGenerator->setParameters(
     roi.x, roi.y, roi.width, roi.height,
     rowsToMerge, columnsToMerge,
-    configFile.getFloat("calib", "fx"), // fx
-    configFile.getFloat("calib", "fy"), // fy
-    configFile.getFloat("calib", "cx"),// cx
-    configFile.getFloat("calib", "cy"),// cy
-    configFile.getFloat("calib", "k1"),// k1
-    configFile.getFloat("calib", "k2"),// k2
-    configFile.getFloat("calib", "k3"),// k3
-    configFile.getFloat("calib", "p1"),// p1
-    configFile.getFloat("calib", "p2") // p2
+    calibration.fx, calibration.fy, calibration.cx, calibration.cy,
+    calibration.k1, calibration.k2, calibration.k3, calibration.p1, calibration.p2
   ))
   {
     logger(LOG_ERROR) << "ToFCamera: Could not set parameters to PointCloudFrameGenerator" << std::endl;
@@ -79,6 +79,10 @@ protected:
   bool _init();
   
   virtual bool _processRawFrame(const RawFramePtr &rawFrameInput, RawFramePtr &rawFrameOutput); // here output raw frame will have processed data, like ToF data for ToF cameras
+  virtual bool _convertRawToPointCloudFrame(const RawFramePtr &rawFrame, PointCloudFramePtr &pointCloudFrame);
+  virtual bool _isFusedPointCloudSupported() const { return true; }
+  
+  bool _setToFFrameGeneratorParameters();
   
   virtual bool _getAmplitudeNormalizingFactor(float &factor);
   
@@ -109,8 +113,24 @@ protected:
   
   virtual bool _reset();
   
+  // Calibration of the current camera profile, read from 'configFile' once per change of its revision rather than on every use
+  struct Calibration
+  {
+    float fx, fy, cx, cy, k1, k2, k3, p1, p2;
+    String phaseCorrection, crossTalkCoefficients;
+  };
+  
+  Calibration _calibration;
+  uint32_t _calibrationRevision;
+  
+  const Calibration &_getCalibration();
+  
   Ptr<ToFFrameGenerator> _tofFrameGenerator;
   
+  // Intermediate frames for _convertRawToPointCloudFrame() when ToFFrameGenerator cannot generate point cloud directly
+  RawFramePtr _fusedProcessedFrame;
+  DepthFramePtr _fusedDepthFrame;
+  
 public:
   ToFCamera(const String &name, DevicePtr device);
   
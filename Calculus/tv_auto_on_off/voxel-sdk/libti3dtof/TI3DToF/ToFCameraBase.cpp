@@ -58,9 +58,12 @@ bool ToFCameraBase::_captureRawUnprocessedFrame(RawFramePtr &rawFrame)
   if(!isInitialized() || !_streamer->isRunning())
     return false;
   
-  if(_streamer->capture(_rawDataFrame))
+  // Capture into the frame held by 'rawFrame' so that each frame buffer keeps its own frame
+  RawDataFramePtr rawDataFrame = std::dynamic_pointer_cast<RawDataFrame>(rawFrame);
+  
+  if(_streamer->capture(rawDataFrame))
   {
-    rawFrame = std::dynamic_pointer_cast<RawFrame>(_rawDataFrame);
+    rawFrame = std::dynamic_pointer_cast<RawFrame>(rawDataFrame);
     return true;
   }
   
@@ -22,7 +22,6 @@ namespace TI
 class TI3DTOF_EXPORT ToFCameraBase : public DepthCamera
 {
 protected:
-  RawDataFramePtr _rawDataFrame; // Used by _captureDepthFrame(). This is not exposed to DepthCamera
   virtual bool _captureRawUnprocessedFrame(RawFramePtr &rawFrame);
   virtual bool _convertToDepthFrame(const RawFramePtr &rawFrame, DepthFramePtr &depthFrame);
   
@@ -5,14 +5,22 @@
  */
 
 #include "ToFCrossTalkFilter.h"
+#include "ToFFastMath.h"
+
+#include <ThreadPool.h>
 
 #include <iterator>
+#include <string.h>
+
+#define TOF_CROSS_TALK_MAX_TABLE_SIZE 0x10000 // Larger phase ranges compute sine and cosine per pixel
+#define TOF_CROSS_TALK_ROW_GRAIN 8 // Rows per task at least, on the processing thread pool
 
 namespace Voxel
 {
 
 ToFCrossTalkFilter::ToFCrossTalkFilter(): Filter("ToFCrossTalkFilter")
 {
+  setMaxPhaseRange(0x1000);
 }
 
 bool ToFCrossTalkFilter::_filter(const FramePtr &in, FramePtr &out)
@@ -56,14 +64,36 @@ bool ToFCrossTalkFilter::_filter(const FramePtr &in, FramePtr &out)
 
 bool ToFCrossTalkFilter::setMaxPhaseRange(uint32_t maxPhaseRange)
 {
+  if(!maxPhaseRange)
+    return false;
+  
   _maxPhaseRange = maxPhaseRange;
   _phaseToAngleFactor =  2*M_PI/_maxPhaseRange;
   _angleToPhaseFactor = _maxPhaseRange/(2*M_PI); 
+  
+  if(_maxPhaseRange <= TOF_CROSS_TALK_MAX_TABLE_SIZE)
+  {
+    _cosTable.resize(_maxPhaseRange);
+    _sinTable.resize(_maxPhaseRange);
+    
+    for(auto p = 0; p < _maxPhaseRange; p++)
+    {
+      double angle = 2*M_PI*p/_maxPhaseRange;
+      _cosTable[p] = cos(angle);
+      _sinTable[p] = sin(angle);
+    }
+  }
+  else
+  {
+    _cosTable.clear();
+    _sinTable.clear();
+  }
   return true;
 }
 
 bool ToFCrossTalkFilter::readCoefficients(const String &coefficients)
 {
+  _coefficients.clear();
   _coefficients.reserve(9);
   
   std::istringstream ss(coefficients);
@@ -85,124 +115,149 @@ bool ToFCrossTalkFilter::readCoefficients(const String &coefficients)
   _coefficients[4] /= magnitude;
   _coefficients[5] /= magnitude;
   _coefficients[7] /= magnitude;
+  
+  const int taps[5] = {1, 3, 4, 5, 7};
+  
+  for(auto k = 0; k < 5; k++)
+  {
+    _tapReal[k] = _coefficients[taps[k]].real();
+    _tapImag[k] = _coefficients[taps[k]].imag();
+  }
   return true;
 }
 
-
-#define ToF_CROSS_TALK_PROCESS_RESULT \
-*ao++ = abs(result); \
-phase = std::arg(result);\
-*po++ = ((phase < 0)?(2*M_PI + phase):phase)*_angleToPhaseFactor;\
-d++;
-
 template <typename T>
 bool ToFCrossTalkFilter::_filter(const T *amplitudeIn, const T *phaseIn, T *amplitudeOut, T *phaseOut)
 {
   if(_coefficients.size() != 9)
     return false;
   
-  uint s = _size.width*_size.height;
-  _amplitudePhase.resize(s);
+  const int width = _size.width, height = _size.height, stride = width + 2;
   
-  T *ao = amplitudeOut, *po = phaseOut;
-  const T *ai = amplitudeIn, *pi = phaseIn;
+  _real.resize((height + 2)*stride);
+  _imag.resize((height + 2)*stride);
   
-  int i = s, j;
+  // Missing neighbours of border pixels contribute nothing
+  memset(_real.data(), 0, stride*sizeof(float));
+  memset(_imag.data(), 0, stride*sizeof(float));
+  memset(_real.data() + (height + 1)*stride, 0, stride*sizeof(float));
+  memset(_imag.data() + (height + 1)*stride, 0, stride*sizeof(float));
   
-  Complex *d = _amplitudePhase.data();
+  const bool useTable = _cosTable.size() == _maxPhaseRange;
   
-  while(i--)
-    *d++ = std::polar<float>(*ai++, *pi++*_phaseToAngleFactor);
+  ThreadPoolPtr pool = ThreadPool::getProcessingPool();
   
-  d = _amplitudePhase.data();
+  pool->parallelFor(0, height, [&](IndexType rowBegin, IndexType rowEnd)
+  {
+    for(int j = rowBegin; j < rowEnd; j++)
+    {
+      const T *ai = amplitudeIn + j*width, *pi = phaseIn + j*width;
+      float *re = _real.data() + (j + 1)*stride, *im = _imag.data() + (j + 1)*stride;
+      
+      re[0] = im[0] = re[width + 1] = im[width + 1] = 0;
+      re++;
+      im++;
+      
+      for(auto i = 0; i < width; i++)
+      {
+        uint32_t p = pi[i];
+        float a = ai[i];
+        
+        if(p >= _maxPhaseRange) // Same angle, as phase wraps around at _maxPhaseRange
+          p %= _maxPhaseRange;
+        
+        if(useTable)
+        {
+          re[i] = a*_cosTable[p];
+          im[i] = a*_sinTable[p];
+        }
+        else
+        {
+          re[i] = a*cosf(p*_phaseToAngleFactor);
+          im[i] = a*sinf(p*_phaseToAngleFactor);
+        }
+      }
+    }
+  }, TOF_CROSS_TALK_ROW_GRAIN);
   
-  Complex result;
-  float phase;
+  // Rows read their neighbours above and below, so all rows are converted first
+  pool->parallelFor(0, height, [&](IndexType rowBegin, IndexType rowEnd)
+  {
+    for(int j = rowBegin; j < rowEnd; j++)
+      _filterRow<T>(j, amplitudeOut, phaseOut);
+  }, TOF_CROSS_TALK_ROW_GRAIN);
   
-  // Top-left corner
-  result = (*d)*_coefficients[4] + (*(d + 1))*_coefficients[5] + (*(d + _size.width))*_coefficients[7];
-  ToF_CROSS_TALK_PROCESS_RESULT
+  return true;
+}
+
+template <typename T>
+void ToFCrossTalkFilter::_filterRow(int row, T *amplitudeOut, T *phaseOut)
+{
+  const int width = _size.width, stride = width + 2;
+  const int offsets[5] = {-stride, -1, 0, 1, stride};
   
-  // Top row
-  i = _size.width - 2;
-  while(i--)
-  {
-    result = (*(d - 1))*_coefficients[3] + (*d)*_coefficients[4] + (*(d + 1))*_coefficients[5] + (*(d + _size.width))*_coefficients[7];
-    ToF_CROSS_TALK_PROCESS_RESULT
-  }
+  const float *re = _real.data() + (row + 1)*stride + 1, *im = _imag.data() + (row + 1)*stride + 1;
+  T *ao = amplitudeOut + row*width, *po = phaseOut + row*width;
   
-  // Top-right corner
-  result = (*(d - 1))*_coefficients[3] + (*d)*_coefficients[4] + (*(d + _size.width))*_coefficients[7];
-  ToF_CROSS_TALK_PROCESS_RESULT
+  int i = 0;
   
+#ifdef TOF_FAST_MATH_SSE2
+  __m128 tapReal[5], tapImag[5];
+  const __m128 angleToPhase = _mm_set1_ps(_angleToPhaseFactor);
   
-  // All the way till bottom row (excluding)
-  j = _size.height - 2;
+  for(auto k = 0; k < 5; k++)
+  {
+    tapReal[k] = _mm_set1_ps(_tapReal[k]);
+    tapImag[k] = _mm_set1_ps(_tapImag[k]);
+  }
   
-  #pragma omp parallel for
-  for(j = 1; j < _size.height - 1; j++)
+  for(; i + 4 <= width; i += 4)
   {
-    int i;
-    Complex result; // local variables for parallel looping
-    float phase;
-    int offset = _size.width*j;
-    Complex *d = _amplitudePhase.data() + offset;
-    T *ao = amplitudeOut + offset, *po = phaseOut + offset;
-    
-    // left corner
-    result =  (*(d - _size.width))*_coefficients[1] + (*d)*_coefficients[4] + (*(d + 1))*_coefficients[5] + (*(d + _size.width))*_coefficients[7];
-    ToF_CROSS_TALK_PROCESS_RESULT
+    __m128 sumReal = _mm_setzero_ps(), sumImag = _mm_setzero_ps();
     
-    // row
-    i = _size.width - 2;
-    while(i--)
+    for(auto k = 0; k < 5; k++)
     {
-      result = (*(d - _size.width))*_coefficients[1] + (*(d - 1))*_coefficients[3] + (*d)*_coefficients[4] + (*(d + 1))*_coefficients[5] + (*(d + _size.width))*_coefficients[7];
-      ToF_CROSS_TALK_PROCESS_RESULT
+      __m128 r = _mm_loadu_ps(re + i + offsets[k]), m = _mm_loadu_ps(im + i + offsets[k]);
+      
+      sumReal = _mm_add_ps(sumReal, _mm_sub_ps(_mm_mul_ps(r, tapReal[k]), _mm_mul_ps(m, tapImag[k])));
+      sumImag = _mm_add_ps(sumImag, _mm_add_ps(_mm_mul_ps(r, tapImag[k]), _mm_mul_ps(m, tapReal[k])));
     }
     
-    // right corner
-    result = (*(d - _size.width))*_coefficients[1] + (*(d - 1))*_coefficients[3] + (*d)*_coefficients[4] + (*(d + _size.width))*_coefficients[7];
-    ToF_CROSS_TALK_PROCESS_RESULT
+    float amplitude[4], phase[4];
+    
+    _mm_storeu_ps(amplitude, TI::fastMagnitudeSSE2(sumImag, sumReal));
+    _mm_storeu_ps(phase, _mm_mul_ps(TI::fastAngleSSE2(sumImag, sumReal), angleToPhase));
+    
+    for(auto k = 0; k < 4; k++)
+    {
+      ao[i + k] = amplitude[k];
+      po[i + k] = phase[k];
+    }
   }
+#endif
   
-  int offset = _size.width*(_size.height - 1);
-  ao = amplitudeOut + offset;
-  po = phaseOut + offset;
-  
-  // bottom-left corner
-  result =  (*(d - _size.width))*_coefficients[1] + (*d)*_coefficients[4] + (*(d + 1))*_coefficients[5];
-  ToF_CROSS_TALK_PROCESS_RESULT
-  
-  // bottom row
-  i = _size.width - 2;
-  while(i--)
+  for(; i < width; i++)
   {
-    result = (*(d - _size.width))*_coefficients[1] + (*(d - 1))*_coefficients[3] + (*d)*_coefficients[4] + (*(d + 1))*_coefficients[5];
-    ToF_CROSS_TALK_PROCESS_RESULT
+    float sumReal = 0, sumImag = 0;
+    
+    for(auto k = 0; k < 5; k++)
+    {
+      float r = re[i + offsets[k]], m = im[i + offsets[k]];
+      
+      sumReal += r*_tapReal[k] - m*_tapImag[k];
+      sumImag += r*_tapImag[k] + m*_tapReal[k];
+    }
+    
+    ao[i] = TI::fastMagnitude(sumImag, sumReal);
+    po[i] = TI::fastAngle(sumImag, sumReal)*_angleToPhaseFactor;
   }
-  
-  // bottom-right corner
-  result = (*(d - _size.width))*_coefficients[1] + (*(d - 1))*_coefficients[3] + (*d)*_coefficients[4];
-  ToF_CROSS_TALK_PROCESS_RESULT
-  
-  /*
-  for(auto j = 0; j < _size.height; j++)
-    for(auto i = 0; i < _size.width; i++)
-      if(phaseIn[i + j*_size.width] != phaseOut[i + j*_size.width])
-      {
-        std::cout << "(" << i << ", " << j << ") = " << phaseIn[i + j*_size.width] << " -> " << phaseOut[i + j*_size.width] 
-        << _amplitudePhase[i + j*_size.width] << std::endl;
-      }
-  */
-  
-  return true;
 }
 
 
 void ToFCrossTalkFilter::reset() 
 {
-  _amplitudePhase.clear();
+  _real.clear();
+  _imag.clear();
 }
 
 
@@ -4,18 +4,32 @@
  * Copyright (c) 2014 Texas Instruments Inc.
  */
 
+#ifndef VOXEL_TOF_CROSS_TALK_FILTER_H
+#define VOXEL_TOF_CROSS_TALK_FILTER_H
+
+#include <TI3DToFExports.h>
 #include "Filter/Filter.h"
 
 namespace Voxel
 {
 
-class ToFCrossTalkFilter: public Filter
+/**
+ * \brief Corrects cross talk between neighbouring pixels with a plus-shaped 3x3 complex filter on phase and amplitude.
+ *
+ * Phasors of the input are computed with a sine/cosine table over the phase range and kept as separate, zero-bordered
+ * real and imaginary planes, so that every pixel goes through the same 5-tap stencil, 4 pixels at a time with SSE2.
+ * Output phase and amplitude are within one of those computed with std::arg() and std::abs() (see ToFFastMath.h).
+ */
+class TI3DTOF_EXPORT ToFCrossTalkFilter: public Filter
 {
   virtual bool _filter(const FramePtr& in, FramePtr& out);
   
   template <typename T>
   bool _filter(const T *amplitudeIn, const T *phaseIn, T *amplitudeOut, T *phaseOut);
   
+  template <typename T>
+  void _filterRow(int row, T *amplitudeOut, T *phaseOut);
+  
   virtual void _onSet(const FilterParameterPtr& f) {} // No parameters
   
   FrameSize _size;
@@ -23,9 +37,13 @@ class ToFCrossTalkFilter: public Filter
   uint32_t _maxPhaseRange;
   float _phaseToAngleFactor, _angleToPhaseFactor;
   
-  Vector<Complex> _amplitudePhase;
+  Vector<float> _cosTable, _sinTable; // per phase value in [0, _maxPhaseRange)
+  
+  Vector<float> _real, _imag; // (height + 2) x (width + 2) planes, with a border of zeros
   
   Vector<Complex> _coefficients;
+  
+  float _tapReal[5], _tapImag[5]; // normalized coefficients of the plus sign: top, left, center, right, bottom
 
 public:
   ToFCrossTalkFilter();
@@ -40,4 +58,6 @@ public:
 
 typedef Ptr<ToFCrossTalkFilter> ToFCrossTalkFilterPtr;
   
-}
\ No newline at end of file
+}
+
+#endif // VOXEL_TOF_CROSS_TALK_FILTER_H
\ No newline at end of file
@@ -0,0 +1,112 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#ifndef VOXEL_TOF_FAST_MATH_H
+#define VOXEL_TOF_FAST_MATH_H
+
+#include <Common.h>
+
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TOF_FAST_MATH_SSE2 1
+#include <emmintrin.h>
+#endif
+
+// Coefficients of the minimax polynomial for atan(a), 0 <= a <= 1, from Abramowitz and Stegun 4.4.49.
+// Absolute error of the polynomial is below 1e-5 radians
+#define TOF_ATAN_A1 0.9998660f
+#define TOF_ATAN_A3 -0.3302995f
+#define TOF_ATAN_A5 0.1801410f
+#define TOF_ATAN_A7 -0.0851330f
+#define TOF_ATAN_A9 0.0208351f
+
+#define TOF_PI_F 3.14159265f
+#define TOF_HALF_PI_F 1.57079633f
+#define TOF_TWO_PI_F 6.28318531f
+
+namespace Voxel
+{
+
+namespace TI
+{
+
+/**
+ * Fast conversion of complex values (ToF I/Q or phasors) to phase and amplitude, used by the hot per-pixel loops.
+ *
+ * fastAngle() returns atan2(y, x) in [0, 2*pi) within 2e-5 radians of the exact value, which is well below one step of a
+ * 12-bit phase (1.5e-3 radians). Phase values computed from it and truncated to integers are within one of those
+ * computed with std::arg(). fastAngle(0, 0) is 0, as is std::arg(0).
+ *
+ * Scalar functions are written without branches so that compilers vectorize loops over them, e.g., with NEON.
+ */
+inline float fastAtan2(float y, float x)
+{
+  float ax = fabsf(x), ay = fabsf(y);
+  float mx = (ax > ay)?ax:ay, mn = (ax > ay)?ay:ax;
+  float a = (mx > 0)?(mn/mx):0.0f, s = a*a;
+
+  float r = ((((TOF_ATAN_A9*s + TOF_ATAN_A7)*s + TOF_ATAN_A5)*s + TOF_ATAN_A3)*s + TOF_ATAN_A1)*a;
+
+  r = (ay > ax)?(TOF_HALF_PI_F - r):r;
+  r = (x < 0)?(TOF_PI_F - r):r;
+  return (y < 0)?-r:r;
+}
+
+inline float fastAngle(float y, float x)
+{
+  float r = fastAtan2(y, x);
+  return (r < 0)?(r + TOF_TWO_PI_F):r;
+}
+
+inline float fastMagnitude(float y, float x)
+{
+  return sqrtf(x*x + y*y);
+}
+
+#ifdef TOF_FAST_MATH_SSE2
+inline __m128 fastAtan2SSE2(__m128 y, __m128 x)
+{
+  const __m128 signMask = _mm_set1_ps(-0.0f), zero = _mm_setzero_ps();
+
+  __m128 ax = _mm_andnot_ps(signMask, x), ay = _mm_andnot_ps(signMask, y);
+  __m128 mx = _mm_max_ps(ax, ay), mn = _mm_min_ps(ax, ay);
+
+  // mn/mx, with 0/0 taken as 0
+  __m128 a = _mm_and_ps(_mm_div_ps(mn, mx), _mm_cmpgt_ps(mx, zero)), s = _mm_mul_ps(a, a);
+
+  __m128 r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(TOF_ATAN_A9), s), _mm_set1_ps(TOF_ATAN_A7));
+  r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(TOF_ATAN_A5));
+  r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(TOF_ATAN_A3));
+  r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(TOF_ATAN_A1));
+  r = _mm_mul_ps(r, a);
+
+  __m128 m = _mm_cmpgt_ps(ay, ax);
+  r = _mm_or_ps(_mm_and_ps(m, _mm_sub_ps(_mm_set1_ps(TOF_HALF_PI_F), r)), _mm_andnot_ps(m, r));
+
+  m = _mm_cmplt_ps(x, zero);
+  r = _mm_or_ps(_mm_and_ps(m, _mm_sub_ps(_mm_set1_ps(TOF_PI_F), r)), _mm_andnot_ps(m, r));
+
+  // Sign of y, except for -0
+  return _mm_or_ps(r, _mm_and_ps(_mm_cmplt_ps(y, zero), signMask));
+}
+
+inline __m128 fastAngleSSE2(__m128 y, __m128 x)
+{
+  __m128 r = fastAtan2SSE2(y, x);
+  return _mm_add_ps(r, _mm_and_ps(_mm_cmplt_ps(r, _mm_setzero_ps()), _mm_set1_ps(TOF_TWO_PI_F)));
+}
+
+inline __m128 fastMagnitudeSSE2(__m128 y, __m128 x)
+{
+  return _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)));
+}
+#endif
+
+}
+}
+
+#endif // VOXEL_TOF_FAST_MATH_H
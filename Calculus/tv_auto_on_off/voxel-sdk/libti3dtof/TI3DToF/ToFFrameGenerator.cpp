@@ -7,15 +7,16 @@
 #include <ToFFrameGenerator.h>
 
 #include <ToFCamera.h>
+#include <ToFRawUnpacker.h>
 
 #define _MATH_DEFINES
 #include <math.h>
 
 #define MAX_PHASE_VALUE 0x0FFF
 #define MAX_PHASE_RANGE 0x1000
-#define TOF_ANGLE_TO_PHASE_FACTOR 4096/(2*M_PI)
 #define IQ_SIGN_BIT 0x0800
 #define IQ_SIGN_EXTEND 0xF000
+#define POINT_CLOUD_TILE_SIZE 128 // pixels per tile in generatePointCloud(). Needs to be a multiple of 8
 
 namespace Voxel
 {
@@ -246,6 +247,25 @@ bool ToFFrameGenerator::_readPhaseOffsetCorrection()
   return true;
 }
 
+// 'o' advances by 'step' for every element of 'd'
+static inline void correctPhaseOffset(uint16_t *d, const int16_t *o, int count, int step)
+{
+  int16_t v;
+  
+  while(count--)
+  {
+    v = *d - *o;
+    if(v < 0)
+      *d = 0;
+    else if(v >= MAX_PHASE_VALUE + 1)
+      *d = MAX_PHASE_VALUE;
+    else
+      *d = v;
+    d++;
+    o += step;
+  }
+}
+
 bool ToFFrameGenerator::_applyPhaseOffsetCorrection(Vector<uint16_t> &phaseData)
 {
   if(!_phaseOffsetCorrectionData.size())
@@ -255,31 +275,16 @@ bool ToFFrameGenerator::_applyPhaseOffsetCorrection(Vector<uint16_t> &phaseData)
     phaseData.size() != (_roi.width/_columnsToMerge)*(_roi.height/_rowsToMerge))
     return false;
   
-  int i = _roi.height/_rowsToMerge, j;
+  int i = _roi.height/_rowsToMerge;
   
-  int16_t v;
   uint16_t *d = phaseData.data();
-  int16_t *o = _phaseOffsetCorrectionData.data() + _roi.x + _roi.y*_maxFrameSize.width, *o1;
-  o1 = o;
-  
+  int16_t *o = _phaseOffsetCorrectionData.data() + _roi.x + _roi.y*_maxFrameSize.width;
   
   while(i--)
   {
-    j = _roi.width/_columnsToMerge;
-    while(j--)
-    {
-      v = *d - *o;
-      if(v < 0)
-        *d = 0;
-      else if(v >= MAX_PHASE_VALUE + 1)
-        *d = MAX_PHASE_VALUE;
-      else
-        *d = v;
-      d++;
-      o += _columnsToMerge;
-    }
-    o1 += _rowsToMerge*_maxFrameSize.width;
-    o = o1;
+    correctPhaseOffset(d, o, _roi.width/_columnsToMerge, _columnsToMerge);
+    d += _roi.width/_columnsToMerge;
+    o += _rowsToMerge*_maxFrameSize.width;
   }
   
   return true;
@@ -331,9 +336,9 @@ bool ToFFrameGenerator::_generateToFRawFrame(const FramePtr &in, FramePtr &out)
   
   if(_bytesPerPixel == 4)
   {
-    if(rawDataFrame->data.size() < _size.height*_size.width*4)
+    if(rawDataFrame->rawDataSize() < _size.height*_size.width*4)
     {
-      logger(LOG_ERROR) << "ToFFrameGenerator: Incomplete raw data size = " << rawDataFrame->data.size() << ". Required size = " << _size.height*_size.width*4 << std::endl;
+      logger(LOG_ERROR) << "ToFFrameGenerator: Incomplete raw data size = " << rawDataFrame->rawDataSize() << ". Required size = " << _size.height*_size.width*4 << std::endl;
       return false;
     }
     
@@ -348,52 +353,14 @@ bool ToFFrameGenerator::_generateToFRawFrame(const FramePtr &in, FramePtr &out)
     t->_phase.resize(_size.width*_size.height);
     t->_flags.resize(_size.width*_size.height);
     
+    const uint16_t *data = (const uint16_t *)rawDataFrame->rawData();
+    
     if(_dataArrangeMode == 2)
-    {
-      auto index1 = 0, index2 = 0;
-      
-      uint16_t *data = (uint16_t *)rawDataFrame->data.data();
-      
-      for (auto i = 0; i < _size.height; i++) 
-      {
-        for (auto j = 0; j < _size.width/8; j++) 
-        {
-          index1 = i*_size.width*2 + j*16;
-          index2 = i*_size.width + j*8;
-          
-          //logger(INFO) << "i = " << i << ", j = " << j << ", index1 = " << index1 << ", index2 = " << index2 << std::endl;
-          
-          for (auto k = 0; k < 8; k++) 
-          {
-            t->_amplitude[index2 + k] = data[index1 + k] & MAX_PHASE_VALUE;
-            t->_ambient[index2 + k] = (data[index1 + k] & 0xF000) >> 12;
-            
-            t->_phase[index2 + k] = data[index1 + k + 8] & MAX_PHASE_VALUE;
-            t->_flags[index2 + k] = (data[index1 + k + 8] & 0xF000) >> 12;
-          }
-        }
-      }
-    }
+      ToFRawUnpacker::unpack4ByteMode2(data, _size.width, _size.height,
+                                       t->_phase.data(), t->_amplitude.data(), t->_ambient.data(), t->_flags.data());
     else // dataArrangeMode == 0
-    {
-      auto index1 = 0, index2 = 0;
-      
-      uint16_t *data = (uint16_t *)rawDataFrame->data.data();
-      
-      for (auto i = 0; i < _size.height; i++) 
-      {
-        for (auto j = 0; j < _size.width; j++) 
-        {
-          index1 = i*_size.width*2 + j*2;
-          index2 = i*_size.width + j;
-          t->_amplitude[index2] = data[index1] & MAX_PHASE_VALUE;
-          t->_ambient[index2] = (data[index1] & 0xF000) >> 12;
-          
-          t->_phase[index2] = data[index1 + 1] & MAX_PHASE_VALUE;
-          t->_flags[index2] = (data[index1 + 1] & 0xF000) >> 12;
-        }
-      }
-    }
+      ToFRawUnpacker::unpack4ByteMode0(data, _size.width, _size.height,
+                                       t->_phase.data(), t->_amplitude.data(), t->_ambient.data(), t->_flags.data());
   }
   else if(_bytesPerPixel == 2)
   {
@@ -403,9 +370,9 @@ bool ToFFrameGenerator::_generateToFRawFrame(const FramePtr &in, FramePtr &out)
       return false;
     }
     
-    if(rawDataFrame->data.size() < _size.height*_size.width*2)
+    if(rawDataFrame->rawDataSize() < _size.height*_size.width*2)
     {
-      logger(LOG_ERROR) << "ToFFrameGenerator: Incomplete raw data size = " << rawDataFrame->data.size() << ". Required size = " << _size.height*_size.width*2 << std::endl;
+      logger(LOG_ERROR) << "ToFFrameGenerator: Incomplete raw data size = " << rawDataFrame->rawDataSize() << ". Required size = " << _size.height*_size.width*2 << std::endl;
       return false;
     }
     
@@ -414,22 +381,10 @@ bool ToFFrameGenerator::_generateToFRawFrame(const FramePtr &in, FramePtr &out)
     t->_phase.resize(_size.width*_size.height);
     t->_flags.resize(_size.width*_size.height);
     
-    auto index = 0;
+    const uint16_t *data = (const uint16_t *)rawDataFrame->rawData();
     
-    uint16_t *data = (uint16_t *)rawDataFrame->data.data();
-    
-    for (auto i = 0; i < _size.height; i++) 
-    {
-      for (auto j = 0; j < _size.width; j++) 
-      {
-        index = i*_size.width + j;
-        t->_phase[index] = data[index] & MAX_PHASE_VALUE;
-        t->_amplitude[index] = (data[index] & 0xF000) >> 4; // Amplitude information is MS 4-bits
-        
-        t->_ambient[index] = 0;
-        t->_flags[index] = 0;
-      }
-    }
+    ToFRawUnpacker::unpack2ByteMode0(data, _size.width, _size.height,
+                                     t->_phase.data(), t->_amplitude.data(), t->_ambient.data(), t->_flags.data());
   }
   else
   {
@@ -458,14 +413,14 @@ bool ToFFrameGenerator::_generateToFRawFrame(const FramePtr &in, FramePtr &out)
   if(!_histogramEnabled)
     return true; // No histogram data
     
-  if(rawDataFrame->data.size() < _size.height*_size.width*_bytesPerPixel + 96)
+  if(rawDataFrame->rawDataSize() < _size.height*_size.width*_bytesPerPixel + 96)
   {
-    logger(LOG_ERROR) << "ToFFrameGenerator: Histogram is enabled but raw data has less than 96 bytes at the end. Raw data size = " << rawDataFrame->data.size() 
+    logger(LOG_ERROR) << "ToFFrameGenerator: Histogram is enabled but raw data has less than 96 bytes at the end. Raw data size = " << rawDataFrame->rawDataSize() 
     << ", bytes in frame = " << _size.height*_size.width*_bytesPerPixel << std::endl;
     return false;
   }
   
-  uint8_t *data = rawDataFrame->data.data() + _size.height*_size.width*_bytesPerPixel;
+  const uint8_t *data = rawDataFrame->rawData() + _size.height*_size.width*_bytesPerPixel;
   
   t->_histogram.resize(48); // 48 elements of 16-bits each
   
@@ -474,6 +429,116 @@ bool ToFFrameGenerator::_generateToFRawFrame(const FramePtr &in, FramePtr &out)
   return true;
 }
 
+bool ToFFrameGenerator::generatePointCloud(const FramePtr &in, const PointCloudTransform &transform, 
+                                           float amplitudeScalingFactor, float depthScalingFactor, FramePtr &out)
+{
+  RawDataFramePtr rawDataFrame = std::dynamic_pointer_cast<RawDataFrame>(in);
+  
+  if(!rawDataFrame)
+  {
+    logger(LOG_ERROR) << "ToFFrameGenerator: Input data frame is not of raw data type." << std::endl;
+    return false;
+  }
+  
+  if(!canGeneratePointCloud())
+  {
+    logger(LOG_ERROR) << "ToFFrameGenerator: Point cloud cannot be generated directly for IQ frames or with cross talk filter" << std::endl;
+    return false;
+  }
+  
+  if(!(_bytesPerPixel == 4 && (_dataArrangeMode == 0 || _dataArrangeMode == 2)) && !(_bytesPerPixel == 2 && _dataArrangeMode == 0))
+  {
+    logger(LOG_ERROR) << "ToFFrameGenerator: Don't know to handle " << PIXEL_DATA_SIZE << " = " << _bytesPerPixel 
+      << " with " << OP_DATA_ARRANGE_MODE << " = " << _dataArrangeMode << std::endl;
+    return false;
+  }
+  
+  if(rawDataFrame->rawDataSize() < _size.height*_size.width*_bytesPerPixel)
+  {
+    logger(LOG_ERROR) << "ToFFrameGenerator: Incomplete raw data size = " << rawDataFrame->rawDataSize() << ". Required size = " << _size.height*_size.width*_bytesPerPixel << std::endl;
+    return false;
+  }
+  
+  if(transform.width/transform.columnsToMerge != _size.width || transform.height/transform.rowsToMerge != _size.height ||
+    transform.binnedDirectionsX.size() != _size.width*_size.height)
+  {
+    logger(LOG_ERROR) << "ToFFrameGenerator: Point cloud transform does not match frame size " << _size.width << "x" << _size.height << std::endl;
+    return false;
+  }
+  
+  const int16_t *offsets = 0;
+  
+  if(_phaseOffsetCorrectionData.size())
+  {
+    if(_phaseOffsetCorrectionData.size() != _maxFrameSize.height*_maxFrameSize.width)
+    {
+      logger(LOG_ERROR) << "ToFFrameGenerator: Failed to apply phase offset correction" << std::endl;
+      return false;
+    }
+    
+    offsets = _phaseOffsetCorrectionData.data() + _roi.x + _roi.y*_maxFrameSize.width;
+  }
+  
+  XYZIPointCloudFrame *f = dynamic_cast<XYZIPointCloudFrame *>(out.get());
+  
+  if(!f)
+  {
+    f = new XYZIPointCloudFrame();
+    out = FramePtr(f);
+  }
+  
+  f->id = rawDataFrame->id;
+  f->timestamp = rawDataFrame->timestamp;
+  f->points.resize(_size.width*_size.height);
+  
+  const uint16_t *data = (const uint16_t *)rawDataFrame->rawData();
+  
+  uint16_t phase[POINT_CLOUD_TILE_SIZE], amplitude[POINT_CLOUD_TILE_SIZE];
+  uint8_t ambient[POINT_CLOUD_TILE_SIZE], flags[POINT_CLOUD_TILE_SIZE]; // Not used for point cloud
+  float depth[POINT_CLOUD_TILE_SIZE], intensity[POINT_CLOUD_TILE_SIZE];
+  
+  for(auto i = 0; i < _size.height; i++)
+  {
+    IntensityPoint *points = f->points.data() + i*_size.width;
+    
+    for(auto j = 0; j < _size.width; j += POINT_CLOUD_TILE_SIZE)
+    {
+      int count = std::min<int>(POINT_CLOUD_TILE_SIZE, _size.width - j);
+      
+      if(_bytesPerPixel == 4 && _dataArrangeMode == 2)
+      {
+        // Pixels after the last complete group of 8 in a row are not present in raw data. Keep them at zero
+        int unpacked = (count/8)*8;
+        
+        if(unpacked < count)
+        {
+          memset(phase + unpacked, 0, (count - unpacked)*sizeof(uint16_t));
+          memset(amplitude + unpacked, 0, (count - unpacked)*sizeof(uint16_t));
+        }
+        
+        ToFRawUnpacker::unpack4ByteMode2(data + i*_size.width*2 + j*2, count, 1, phase, amplitude, ambient, flags);
+      }
+      else if(_bytesPerPixel == 4)
+        ToFRawUnpacker::unpack4ByteMode0(data + (i*_size.width + j)*2, count, 1, phase, amplitude, ambient, flags);
+      else
+        ToFRawUnpacker::unpack2ByteMode0(data + i*_size.width + j, count, 1, phase, amplitude, ambient, flags);
+      
+      if(offsets)
+        correctPhaseOffset(phase, offsets + i*_rowsToMerge*_maxFrameSize.width + j*_columnsToMerge, count, _columnsToMerge);
+      
+      for(auto k = 0; k < count; k++)
+      {
+        depth[k] = phase[k]*depthScalingFactor;
+        intensity[k] = amplitude[k]*amplitudeScalingFactor;
+      }
+      
+      transform.depthToPointCloud(depth, intensity, i*_size.width + j, count, points + j);
+    }
+  }
+  
+  return true;
+}
+
 bool ToFFrameGenerator::generate(const ToFRawIQFramePtr &in, FramePtr &out)
 {
   ToFRawIQFrameTemplate<int16_t> *input = dynamic_cast<ToFRawIQFrameTemplate<int16_t> *>(in.get());
@@ -519,35 +584,22 @@ bool ToFFrameGenerator::generate(const ToFRawIQFramePtr &in, FramePtr &out)
   t->id = input->id;
   t->timestamp = input->timestamp;
   
-  t->_ambient.resize(_size.width*_size.height);
-  t->_amplitude.resize(_size.width*_size.height);
-  t->_phase.resize(_size.width*_size.height);
-  t->_flags.resize(_size.width*_size.height);
+  SizeType count = _size.width*_size.height;
+  FramePtr &target = _crossTalkFilter?_filterInputFrame:out;
   
-  auto index = 0;
+  t->_amplitude.resize(count);
+  t->_phase.resize(count);
   
-  Complex c;
-  float phase;
-  
-  for (auto l = 0; l < _size.height; l++) 
+  // IQ sensors have no ambient and flags. These are zeroed only when the frame was not zeroed by an earlier call
+  if(t->_ambient.size() != count || t->_flags.size() != count || _zeroedIQFrame.lock() != target)
   {
-    for (auto j = 0; j < _size.width; j++) 
-    {
-      index = l*_size.width + j;
-      
-      c.real(input->_i[index]);
-      c.imag(input->_q[index]);
-      
-      phase = std::arg(c);
-      
-      t->_phase[index] = ((phase < 0)?(2*M_PI + phase):phase)*TOF_ANGLE_TO_PHASE_FACTOR;
-      t->_amplitude[index] = std::abs(c);
-      
-      t->_ambient[index] = 0;
-      t->_flags[index] = 0;
-    }
+    t->_ambient.assign(count, 0);
+    t->_flags.assign(count, 0);
+    _zeroedIQFrame = target;
   }
   
+  ToFRawUnpacker::convertIQ(input->_i.data(), input->_q.data(), count, t->_phase.data(), t->_amplitude.data());
+  
   if(!_applyCrossTalkFilter(out))
     return false;
   
@@ -602,9 +654,9 @@ bool ToFFrameGenerator::_generateToFRawIQFrame(const FramePtr &in, FramePtr &out
   t->id = rawDataFrame->id;
   t->timestamp = rawDataFrame->timestamp;
   
-  if(rawDataFrame->data.size() < _size.height*_size.width*2)
+  if(rawDataFrame->rawDataSize() < _size.height*_size.width*2)
   {
-    logger(LOG_ERROR) << "ToFFrameGenerator: Incomplete raw data size = " << rawDataFrame->data.size() << ". Required size = " << _size.height*_size.width*2 << std::endl;
+    logger(LOG_ERROR) << "ToFFrameGenerator: Incomplete raw data size = " << rawDataFrame->rawDataSize() << ". Required size = " << _size.height*_size.width*2 << std::endl;
     return false;
   }
   
@@ -613,7 +665,7 @@ bool ToFFrameGenerator::_generateToFRawIQFrame(const FramePtr &in, FramePtr &out
   
   auto index1 = 0, index2 = 0;
       
-  uint16_t *data = (uint16_t *)rawDataFrame->data.data();
+  const uint16_t *data = (const uint16_t *)rawDataFrame->rawData();
   
   for (auto i = 0; i < _size.height; i++) 
   {
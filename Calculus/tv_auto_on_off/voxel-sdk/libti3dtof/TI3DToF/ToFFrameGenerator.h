@@ -10,6 +10,7 @@
 #include <TI3DToFExports.h>
 #include "ToFCrossTalkFilter.h"
 #include <FrameGenerator.h>
+#include <PointCloudTransform.h>
 
 namespace Voxel
 {
@@ -36,6 +37,8 @@ class TI3DTOF_EXPORT ToFFrameGenerator: public FrameGenerator
   String _crossTalkCoefficients;
   FramePtr _filterInputFrame;
   
+  std::weak_ptr<Frame> _zeroedIQFrame; // Last output of IQ conversion, which has ambient and flags zeroed already
+  
 protected:
   virtual bool _writeConfiguration(SerializedObject &object);
   
@@ -60,6 +63,15 @@ public:
                      uint8_t histogramEnabled, 
                      const String &crossTalkCoefficients, ToFFrameType type);
   
+  // Fused conversion of raw data frame to XYZIPointCloudFrame. It is done in tiles of a row, with unpacking, phase offset
+  // correction, depth and amplitude scaling and multiplication by direction vectors done while the tile is in cache.
+  // Output is the same as generate() followed by ToFDepthFrameGenerator and PointCloudFrameGenerator.
+  bool generatePointCloud(const FramePtr &in, const PointCloudTransform &transform, 
+                          float amplitudeScalingFactor, float depthScalingFactor, FramePtr &out);
+  
+  // IQ frames and cross talk filter need the full ToF frame, and so cannot use generatePointCloud()
+  inline bool canGeneratePointCloud() const { return _frameType != ToF_I_Q && !_crossTalkFilter; }
+  
   virtual bool readConfiguration(SerializedObject &object);
   
   virtual ~ToFFrameGenerator() {}
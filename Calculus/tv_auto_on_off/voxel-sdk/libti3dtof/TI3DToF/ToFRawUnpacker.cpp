@@ -0,0 +1,521 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#include "ToFRawUnpacker.h"
+#include "ToFFastMath.h"
+
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TOF_UNPACK_SSE2 1
+#include <emmintrin.h>
+
+#if defined(__GNUC__) // AVX2 kernels are compiled with function level target attribute
+#define TOF_UNPACK_AVX2 1
+#include <immintrin.h>
+#define TOF_UNPACK_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define TOF_UNPACK_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define MAX_PHASE_VALUE 0x0FFF
+#define IQ_ANGLE_TO_PHASE_FACTOR (4096/(2*TOF_PI_F))
+
+namespace Voxel
+{
+
+namespace TI
+{
+
+typedef void (*UnpackKernel)(const uint16_t *data, SizeType width, SizeType height,
+                             uint16_t *phase, uint16_t *amplitude, uint8_t *ambient, uint8_t *flags);
+
+typedef void (*IQKernel)(const int16_t *i, const int16_t *q, SizeType count, uint16_t *phase, uint16_t *amplitude);
+
+/// Scalar kernels. These are the reference for all others.
+
+// 'count' pixels, two words per pixel
+static void unpack4ByteMode0Scalar(const uint16_t *data, SizeType count,
+                                   uint16_t *phase, uint16_t *amplitude, uint8_t *ambient, uint8_t *flags)
+{
+  for(SizeType index2 = 0; index2 < count; index2++)
+  {
+    SizeType index1 = index2*2;
+
+    amplitude[index2] = data[index1] & MAX_PHASE_VALUE;
+    ambient[index2] = (data[index1] & 0xF000) >> 12;
+
+    phase[index2] = data[index1 + 1] & MAX_PHASE_VALUE;
+    flags[index2] = (data[index1 + 1] & 0xF000) >> 12;
+  }
+}
+
+// One group of 8 pixels
+static inline void unpack4ByteMode2GroupScalar(const uint16_t *data,
+                                               uint16_t *phase, uint16_t *amplitude, uint8_t *ambient, uint8_t *flags)
+{
+  for (auto k = 0; k < 8; k++)
+  {
+    amplitude[k] = data[k] & MAX_PHASE_VALUE;
+    ambient[k] = (data[k] & 0xF000) >> 12;
+
+    phase[k] = data[k + 8] & MAX_PHASE_VALUE;
+    flags[k] = (data[k + 8] & 0xF000) >> 12;
+  }
+}
+
+static void unpack2ByteMode0Scalar(const uint16_t *data, SizeType count, uint16_t *phase, uint16_t *amplitude)
+{
+  for(SizeType index = 0; index < count; index++)
+  {
+    phase[index] = data[index] & MAX_PHASE_VALUE;
+    amplitude[index] = (data[index] & 0xF000) >> 4; // Amplitude information is MS 4-bits
+  }
+}
+
+static void convertIQScalarKernel(const int16_t *i, const int16_t *q, SizeType count, uint16_t *phase, uint16_t *amplitude)
+{
+  for(SizeType index = 0; index < count; index++)
+  {
+    float x = i[index], y = q[index];
+
+    phase[index] = fastAngle(y, x)*IQ_ANGLE_TO_PHASE_FACTOR;
+    amplitude[index] = fastMagnitude(y, x);
+  }
+}
+
+static void unpack4ByteMode0ScalarKernel(const uint16_t *data, SizeType width, SizeType height,
+                                         uint16_t *phase, uint16_t *amplitude, uint8_t *ambient, uint8_t *flags)
+{
+  unpack4ByteMode0Scalar(data, width*height, phase, amplitude, ambient, flags);
+}
+
+static void unpack4ByteMode2ScalarKernel(const uint16_t *data, SizeType width, SizeType height,
+                                         uint16_t *phase, uint16_t *amplitude, uint8_t *ambient, uint8_t *flags)
+{
+  for (SizeType i = 0; i < height; i++)
+  {
+    for (SizeType j = 0; j < width/8; j++)
+    {
+      SizeType index1 = i*width*2 + j*16, index2 = i*width + j*8;
+      unpack4ByteMode2GroupScalar(data + index1, phase + index2, amplitude + index2, ambient + index2, flags + index2);
+    }
+  }
+}
+
+static void unpack2ByteMode0ScalarKernel(const uint16_t *data, SizeType width, SizeType height,
+                                         uint16_t *phase, uint16_t *amplitude, uint8_t *ambient, uint8_t *flags)
+{
+  unpack2ByteMode0Scalar(data, width*height, phase, amplitude);
+  memset(ambient, 0, width*height);
+  memset(flags, 0, width*height);
+}
+
+#ifdef TOF_UNPACK_SSE2
+/// SSE2 kernels
+
+static void unpack4ByteMode0SSE2Kernel(const uint16_t *data, SizeType width, SizeType height,
+                                       uint16_t *phase, uint16_t *amplitude, uint8_t *ambient, uint8_t *flags)
+{
+  const __m128i mask = _mm_set1_epi32(MAX_PHASE_VALUE), low = _mm_set1_epi32(0xFFFF);
+
+  SizeType count = width*height, i = 0;
+
+  for(; i + 8 <= count; i += 8)
+  {
+    // Each 32-bit lane holds one pixel: low word is ambient/amplitude, high word is flags/phase
+    __m128i x0 = _mm_loadu_si128((const __m128i *)(data + 2*i));
+    __m128i x1 = _mm_loadu_si128((const __m128i *)(data + 2*i + 8));
+
+    __m128i e0 = _mm_and_si128(x0, low), e1 = _mm_and_si128(x1, low);
+    __m128i o0 = _mm_srli_epi32(x0, 16), o1 = _mm_srli_epi32(x1, 16);
+
+    __m128i amb = _mm_packs_epi32(_mm_srli_epi32(e0, 12), _mm_srli_epi32(e1, 12));
+    __m128i flg = _mm_packs_epi32(_mm_srli_epi32(o0, 12), _mm_srli_epi32(o1, 12));
+
+    _mm_storeu_si128((__m128i *)(amplitude + i), _mm_packs_epi32(_mm_and_si128(e0, mask), _mm_and_si128(e1, mask)));
+    _mm_storeu_si128((__m128i *)(phase + i), _mm_packs_epi32(_mm_and_si128(o0, mask), _mm_and_si128(o1, mask)));
+    _mm_storel_epi64((__m128i *)(ambient + i), _mm_packus_epi16(amb, amb));
+    _mm_storel_epi64((__m128i *)(flags + i), _mm_packus_epi16(flg, flg));
+  }
+
+  unpack4ByteMode0Scalar(data + 2*i, count - i, phase + i, amplitude + i, ambient + i, flags + i);
+}
+
+static inline void unpack4ByteMode2GroupSSE2(const uint16_t *data,
+                                             uint16_t *phase, uint16_t *amplitude, uint8_t *ambient, uint8_t *flags)
+{
+  const __m128i mask = _mm_set1_epi16(MAX_PHASE_VALUE), zero = _mm_setzero_si128();
+
+  __m128i a = _mm_loadu_si128((const __m128i *)data);
+  __m128i b = _mm_loadu_si128((const __m128i *)(data + 8));
+
+  _mm_storeu_si128((__m128i *)amplitude, _mm_and_si128(a, mask));
+  _mm_storeu_si128((__m128i *)phase, _mm_and_si128(b, mask));
+  _mm_storel_epi64((__m128i *)ambient, _mm_packus_epi16(_mm_srli_epi16(a, 12), zero));
+  _mm_storel_epi64((__m128i *)flags, _mm_packus_epi16(_mm_srli_epi16(b, 12), zero));
+}
+
+static void unpack4ByteMode2SSE2Kernel(const uint16_t *data, SizeType width, SizeType height,
+                                       uint16_t *phase, uint16_t *amplitude, uint8_t *ambient, uint8_t *flags)
+{
+  for (SizeType i = 0; i < height; i++)
+  {
+    for (SizeType j = 0; j < width/8; j++)
+    {
+      SizeType index1 = i*width*2 + j*16, index2 = i*width + j*8;
+      unpack4ByteMode2GroupSSE2(data + index1, phase + index2, amplitude + index2, ambient + index2, flags + index2);
+    }
+  }
+}
+
+static void unpack2ByteMode0SSE2Kernel(const uint16_t *data, SizeType width, SizeType height,
+                                       uint16_t *phase, uint16_t *amplitude, uint8_t *ambient, uint8_t *flags)
+{
+  const __m128i mask = _mm_set1_epi16(MAX_PHASE_VALUE);
+
+  SizeType count = width*height, i = 0;
+
+  for(; i + 8 <= count; i += 8)
+  {
+    __m128i x = _mm_loadu_si128((const __m128i *)(data + i));
+
+    _mm_storeu_si128((__m128i *)(phase + i), _mm_and_si128(x, mask));
+    _mm_storeu_si128((__m128i *)(amplitude + i), _mm_slli_epi16(_mm_srli_epi16(x, 12), 8));
+  }
+
+  unpack2ByteMode0Scalar(data + i, count - i, phase + i, amplitude + i);
+  memset(ambient, 0, count);
+  memset(flags, 0, count);
+}
+
+// Unsigned 16-bit saturation is not there in SSE2, so values are biased into the signed range around the pack
+static inline __m128i packUnsigned16SSE2(__m128i a, __m128i b)
+{
+  const __m128i bias32 = _mm_set1_epi32(0x8000), bias16 = _mm_set1_epi16((int16_t)0x8000);
+
+  return _mm_xor_si128(_mm_packs_epi32(_mm_sub_epi32(a, bias32), _mm_sub_epi32(b, bias32)), bias16);
+}
+
+static void convertIQSSE2Kernel(const int16_t *i, const int16_t *q, SizeType count, uint16_t *phase, uint16_t *amplitude)
+{
+  const __m128 angleToPhase = _mm_set1_ps(IQ_ANGLE_TO_PHASE_FACTOR);
+
+  SizeType index = 0;
+
+  for(; index + 8 <= count; index += 8)
+  {
+    __m128i x = _mm_loadu_si128((const __m128i *)(i + index)), y = _mm_loadu_si128((const __m128i *)(q + index));
+
+    // Sign extension to 32-bits
+    __m128 x0 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(x, x), 16));
+    __m128 x1 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(x, x), 16));
+    __m128 y0 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(y, y), 16));
+    __m128 y1 = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(y, y), 16));
+
+    __m128i p0 = _mm_cvttps_epi32(_mm_mul_ps(fastAngleSSE2(y0, x0), angleToPhase));
+    __m128i p1 = _mm_cvttps_epi32(_mm_mul_ps(fastAngleSSE2(y1, x1), angleToPhase));
+
+    __m128i a0 = _mm_cvttps_epi32(fastMagnitudeSSE2(y0, x0));
+    __m128i a1 = _mm_cvttps_epi32(fastMagnitudeSSE2(y1, x1));
+
+    _mm_storeu_si128((__m128i *)(phase + index), packUnsigned16SSE2(p0, p1));
+    _mm_storeu_si128((__m128i *)(amplitude + index), packUnsigned16SSE2(a0, a1));
+  }
+
+  convertIQScalarKernel(i + index, q + index, count - index, phase + index, amplitude + index);
+}
+#endif
+
+#ifdef TOF_UNPACK_AVX2
+/// AVX2 kernels
+
+// Packs 16 x 16-bit values (each < 256) to 16 bytes
+TOF_UNPACK_AVX2_TARGET static inline __m128i packBytesAVX2(__m256i v)
+{
+  return _mm_packus_epi16(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+}
+
+TOF_UNPACK_AVX2_TARGET static void unpack4ByteMode0AVX2Kernel(const uint16_t *data, SizeType width, SizeType height,
+                                                              uint16_t *phase, uint16_t *amplitude, uint8_t *ambient, uint8_t *flags)
+{
+  const __m256i mask = _mm256_set1_epi32(MAX_PHASE_VALUE), low = _mm256_set1_epi32(0xFFFF);
+
+  SizeType count = width*height, i = 0;
+
+  for(; i + 16 <= count; i += 16)
+  {
+    __m256i x0 = _mm256_loadu_si256((const __m256i *)(data + 2*i));
+    __m256i x1 = _mm256_loadu_si256((const __m256i *)(data + 2*i + 16));
+
+    __m256i e0 = _mm256_and_si256(x0, low), e1 = _mm256_and_si256(x1, low);
+    __m256i o0 = _mm256_srli_epi32(x0, 16), o1 = _mm256_srli_epi32(x1, 16);
+
+    // Packing works within 128-bit lanes. Reorder 64-bit blocks to restore pixel order
+    __m256i amp = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_and_si256(e0, mask), _mm256_and_si256(e1, mask)), 0xD8);
+    __m256i amb = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_srli_epi32(e0, 12), _mm256_srli_epi32(e1, 12)), 0xD8);
+    __m256i ph = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_and_si256(o0, mask), _mm256_and_si256(o1, mask)), 0xD8);
+    __m256i flg = _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_srli_epi32(o0, 12), _mm256_srli_epi32(o1, 12)), 0xD8);
+
+    _mm256_storeu_si256((__m256i *)(amplitude + i), amp);
+    _mm256_storeu_si256((__m256i *)(phase + i), ph);
+    _mm_storeu_si128((__m128i *)(ambient + i), packBytesAVX2(amb));
+    _mm_storeu_si128((__m128i *)(flags + i), packBytesAVX2(flg));
+  }
+
+  unpack4ByteMode0Scalar(data + 2*i, count - i, phase + i, amplitude + i, ambient + i, flags + i);
+}
+
+TOF_UNPACK_AVX2_TARGET static void unpack4ByteMode2AVX2Kernel(const uint16_t *data, SizeType width, SizeType height,
+                                                              uint16_t *phase, uint16_t *amplitude, uint8_t *ambient, uint8_t *flags)
+{
+  const __m256i mask = _mm256_set1_epi16(MAX_PHASE_VALUE);
+
+  SizeType groups = width/8;
+
+  for (SizeType i = 0; i < height; i++)
+  {
+    SizeType j = 0;
+
+    for (; j + 2 <= groups; j += 2) // Two groups of 8 pixels give 16 consecutive output pixels
+    {
+      const uint16_t *d = data + i*width*2 + j*16;
+      SizeType index2 = i*width + j*8;
+
+      __m256i a = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)d)),
+                                          _mm_loadu_si128((const __m128i *)(d + 16)), 1);
+      __m256i b = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(d + 8))),
+                                          _mm_loadu_si128((const __m128i *)(d + 24)), 1);
+
+      _mm256_storeu_si256((__m256i *)(amplitude + index2), _mm256_and_si256(a, mask));
+      _mm256_storeu_si256((__m256i *)(phase + index2), _mm256_and_si256(b, mask));
+      _mm_storeu_si128((__m128i *)(ambient + index2), packBytesAVX2(_mm256_srli_epi16(a, 12)));
+      _mm_storeu_si128((__m128i *)(flags + index2), packBytesAVX2(_mm256_srli_epi16(b, 12)));
+    }
+
+    for (; j < groups; j++)
+    {
+      SizeType index1 = i*width*2 + j*16, index2 = i*width + j*8;
+      unpack4ByteMode2GroupSSE2(data + index1, phase + index2, amplitude + index2, ambient + index2, flags + index2);
+    }
+  }
+}
+
+TOF_UNPACK_AVX2_TARGET static void unpack2ByteMode0AVX2Kernel(const uint16_t *data, SizeType width, SizeType height,
+                                                              uint16_t *phase, uint16_t *amplitude, uint8_t *ambient, uint8_t *flags)
+{
+  const __m256i mask = _mm256_set1_epi16(MAX_PHASE_VALUE);
+
+  SizeType count = width*height, i = 0;
+
+  for(; i + 16 <= count; i += 16)
+  {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(data + i));
+
+    _mm256_storeu_si256((__m256i *)(phase + i), _mm256_and_si256(x, mask));
+    _mm256_storeu_si256((__m256i *)(amplitude + i), _mm256_slli_epi16(_mm256_srli_epi16(x, 12), 8));
+  }
+
+  unpack2ByteMode0Scalar(data + i, count - i, phase + i, amplitude + i);
+  memset(ambient, 0, count);
+  memset(flags, 0, count);
+}
+#endif
+
+#ifdef TOF_UNPACK_NEON
+/// NEON kernels
+
+static void unpack4ByteMode0NEONKernel(const uint16_t *data, SizeType width, SizeType height,
+                                       uint16_t *phase, uint16_t *amplitude, uint8_t *ambient, uint8_t *flags)
+{
+  const uint16x8_t mask = vdupq_n_u16(MAX_PHASE_VALUE);
+
+  SizeType count = width*height, i = 0;
+
+  for(; i + 8 <= count; i += 8)
+  {
+    uint16x8x2_t x = vld2q_u16(data + 2*i); // De-interleaves ambient/amplitude and flags/phase words
+
+    vst1q_u16(amplitude + i, vandq_u16(x.val[0], mask));
+    vst1q_u16(phase + i, vandq_u16(x.val[1], mask));
+    vst1_u8(ambient + i, vmovn_u16(vshrq_n_u16(x.val[0], 12)));
+    vst1_u8(flags + i, vmovn_u16(vshrq_n_u16(x.val[1], 12)));
+  }
+
+  unpack4ByteMode0Scalar(data + 2*i, count - i, phase + i, amplitude + i, ambient + i, flags + i);
+}
+
+static void unpack4ByteMode2NEONKernel(const uint16_t *data, SizeType width, SizeType height,
+                                       uint16_t *phase, uint16_t *amplitude, uint8_t *ambient, uint8_t *flags)
+{
+  const uint16x8_t mask = vdupq_n_u16(MAX_PHASE_VALUE);
+
+  for (SizeType i = 0; i < height; i++)
+  {
+    for (SizeType j = 0; j < width/8; j++)
+    {
+      SizeType index1 = i*width*2 + j*16, index2 = i*width + j*8;
+
+      uint16x8_t a = vld1q_u16(data + index1), b = vld1q_u16(data + index1 + 8);
+
+      vst1q_u16(amplitude + index2, vandq_u16(a, mask));
+      vst1q_u16(phase + index2, vandq_u16(b, mask));
+      vst1_u8(ambient + index2, vmovn_u16(vshrq_n_u16(a, 12)));
+      vst1_u8(flags + index2, vmovn_u16(vshrq_n_u16(b, 12)));
+    }
+  }
+}
+
+static void unpack2ByteMode0NEONKernel(const uint16_t *data, SizeType width, SizeType height,
+                                       uint16_t *phase, uint16_t *amplitude, uint8_t *ambient, uint8_t *flags)
+{
+  const uint16x8_t mask = vdupq_n_u16(MAX_PHASE_VALUE);
+
+  SizeType count = width*height, i = 0;
+
+  for(; i + 8 <= count; i += 8)
+  {
+    uint16x8_t x = vld1q_u16(data + i);
+
+    vst1q_u16(phase + i, vandq_u16(x, mask));
+    vst1q_u16(amplitude + i, vshlq_n_u16(vshrq_n_u16(x, 12), 8));
+  }
+
+  unpack2ByteMode0Scalar(data + i, count - i, phase + i, amplitude + i);
+  memset(ambient, 0, count);
+  memset(flags, 0, count);
+}
+#endif
+
+enum UnpackLayout
+{
+  LAYOUT_4BYTE_MODE0 = 0,
+  LAYOUT_4BYTE_MODE2 = 1,
+  LAYOUT_2BYTE_MODE0 = 2,
+  LAYOUT_COUNT = 3
+};
+
+static const UnpackKernel unpackKernels[ToFRawUnpacker::IMPL_AUTO][LAYOUT_COUNT] =
+{
+  { unpack4ByteMode0ScalarKernel, unpack4ByteMode2ScalarKernel, unpack2ByteMode0ScalarKernel },
+#ifdef TOF_UNPACK_SSE2
+  { unpack4ByteMode0SSE2Kernel, unpack4ByteMode2SSE2Kernel, unpack2ByteMode0SSE2Kernel },
+#else
+  { 0, 0, 0 },
+#endif
+#ifdef TOF_UNPACK_AVX2
+  { unpack4ByteMode0AVX2Kernel, unpack4ByteMode2AVX2Kernel, unpack2ByteMode0AVX2Kernel },
+#else
+  { 0, 0, 0 },
+#endif
+#ifdef TOF_UNPACK_NEON
+  { unpack4ByteMode0NEONKernel, unpack4ByteMode2NEONKernel, unpack2ByteMode0NEONKernel },
+#else
+  { 0, 0, 0 },
+#endif
+};
+
+static const IQKernel iqKernels[ToFRawUnpacker::IMPL_AUTO] =
+{
+  convertIQScalarKernel,
+#ifdef TOF_UNPACK_SSE2
+  convertIQSSE2Kernel,
+  convertIQSSE2Kernel,
+#else
+  0,
+  0,
+#endif
+  convertIQScalarKernel
+};
+
+bool ToFRawUnpacker::isSupported(Implementation impl)
+{
+  switch(impl)
+  {
+    case IMPL_SCALAR:
+      return true;
+#ifdef TOF_UNPACK_SSE2
+    case IMPL_SSE2:
+      return true;
+#endif
+#ifdef TOF_UNPACK_AVX2
+    case IMPL_AVX2:
+      return __builtin_cpu_supports("avx2");
+#endif
+#ifdef TOF_UNPACK_NEON
+    case IMPL_NEON:
+      return true;
+#endif
+    default:
+      return false;
+  }
+}
+
+ToFRawUnpacker::Implementation ToFRawUnpacker::best()
+{
+  static const Implementation b =
+    isSupported(IMPL_AVX2)?IMPL_AVX2:
+    (isSupported(IMPL_SSE2)?IMPL_SSE2:
+    (isSupported(IMPL_NEON)?IMPL_NEON:IMPL_SCALAR));
+
+  return b;
+}
+
+const char *ToFRawUnpacker::name(Implementation impl)
+{
+  static const char *names[] = { "scalar", "sse2", "avx2", "neon", "auto" };
+
+  return (impl >= IMPL_SCALAR && impl <= IMPL_AUTO)?names[impl]:"unknown";
+}
+
+static inline ToFRawUnpacker::Implementation resolve(ToFRawUnpacker::Implementation impl)
+{
+  if(impl == ToFRawUnpacker::IMPL_AUTO)
+    return ToFRawUnpacker::best();
+  else if(!ToFRawUnpacker::isSupported(impl))
+    return ToFRawUnpacker::IMPL_SCALAR;
+
+  return impl;
+}
+
+static inline UnpackKernel getKernel(ToFRawUnpacker::Implementation impl, UnpackLayout layout)
+{
+  return unpackKernels[resolve(impl)][layout];
+}
+
+void ToFRawUnpacker::unpack4ByteMode0(const uint16_t *data, SizeType width, SizeType height,
+                                      uint16_t *phase, uint16_t *amplitude, uint8_t *ambient, uint8_t *flags,
+                                      Implementation impl)
+{
+  getKernel(impl, LAYOUT_4BYTE_MODE0)(data, width, height, phase, amplitude, ambient, flags);
+}
+
+void ToFRawUnpacker::unpack4ByteMode2(const uint16_t *data, SizeType width, SizeType height,
+                                      uint16_t *phase, uint16_t *amplitude, uint8_t *ambient, uint8_t *flags,
+                                      Implementation impl)
+{
+  getKernel(impl, LAYOUT_4BYTE_MODE2)(data, width, height, phase, amplitude, ambient, flags);
+}
+
+void ToFRawUnpacker::unpack2ByteMode0(const uint16_t *data, SizeType width, SizeType height,
+                                      uint16_t *phase, uint16_t *amplitude, uint8_t *ambient, uint8_t *flags,
+                                      Implementation impl)
+{
+  getKernel(impl, LAYOUT_2BYTE_MODE0)(data, width, height, phase, amplitude, ambient, flags);
+}
+
+void ToFRawUnpacker::convertIQ(const int16_t *i, const int16_t *q, SizeType count, uint16_t *phase, uint16_t *amplitude,
+                               Implementation impl)
+{
+  iqKernels[resolve(impl)](i, q, count, phase, amplitude);
+}
+
+}
+}
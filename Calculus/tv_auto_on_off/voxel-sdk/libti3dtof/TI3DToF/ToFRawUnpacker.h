@@ -0,0 +1,67 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#ifndef VOXEL_TOF_RAW_UNPACKER_H
+#define VOXEL_TOF_RAW_UNPACKER_H
+
+#include <TI3DToFExports.h>
+#include <Common.h>
+
+namespace Voxel
+{
+
+namespace TI
+{
+
+/**
+ * \brief Unpacks raw ToF words from the streamer into phase, amplitude, ambient and flags planes.
+ *
+ * Each layout has a scalar kernel and, where the CPU supports it, SSE2, AVX2 and NEON kernels. All
+ * kernels produce identical output. IMPL_AUTO picks the best kernel available on the running CPU.
+ */
+class TI3DTOF_EXPORT ToFRawUnpacker
+{
+public:
+  enum Implementation
+  {
+    IMPL_SCALAR = 0,
+    IMPL_SSE2 = 1,
+    IMPL_AVX2 = 2,
+    IMPL_NEON = 3,
+    IMPL_AUTO = 4 // Also the number of concrete implementations
+  };
+
+  static bool isSupported(Implementation impl);
+  static Implementation best(); // Detected once at first call
+  static const char *name(Implementation impl);
+
+  // pixel_data_size = 4, op_data_arrange_mode = 0. Per pixel: [ambient:4 | amplitude:12], [flags:4 | phase:12]
+  static void unpack4ByteMode0(const uint16_t *data, SizeType width, SizeType height,
+                               uint16_t *phase, uint16_t *amplitude, uint8_t *ambient, uint8_t *flags,
+                               Implementation impl = IMPL_AUTO);
+
+  // pixel_data_size = 4, op_data_arrange_mode = 2. Per 8 pixels: 8 x [ambient | amplitude], then 8 x [flags | phase].
+  // Pixels beyond the last complete group of 8 in a row are not written
+  static void unpack4ByteMode2(const uint16_t *data, SizeType width, SizeType height,
+                               uint16_t *phase, uint16_t *amplitude, uint8_t *ambient, uint8_t *flags,
+                               Implementation impl = IMPL_AUTO);
+
+  // pixel_data_size = 2, op_data_arrange_mode = 0. Per pixel: [amplitude:4 | phase:12]. Ambient and flags are zeroed
+  static void unpack2ByteMode0(const uint16_t *data, SizeType width, SizeType height,
+                               uint16_t *phase, uint16_t *amplitude, uint8_t *ambient, uint8_t *flags,
+                               Implementation impl = IMPL_AUTO);
+  
+  // I/Q samples to phase in [0, 4096] and amplitude. Unlike unpacking, kernels use a polynomial atan2 and may differ
+  // by one from each other and from conversion with std::arg() and std::abs() (see ToFFastMath.h). AVX2 uses the SSE2
+  // kernel and NEON the scalar one, which compilers vectorize
+  static void convertIQ(const int16_t *i, const int16_t *q, SizeType count, uint16_t *phase, uint16_t *amplitude,
+                        Implementation impl = IMPL_AUTO);
+};
+
+}
+}
+
+#endif
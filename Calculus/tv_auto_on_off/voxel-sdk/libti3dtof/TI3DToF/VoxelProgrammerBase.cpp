@@ -19,24 +19,15 @@ VoxelProgrammerBase::VoxelProgrammerBase(const SlaveAddressToByteMap &map, Devic
   _device = device;
 }
 
-bool VoxelProgrammerBase::readRegister(uint32_t address, uint32_t &value) const
+bool VoxelProgrammerBase::_getByteCount(uint32_t address, uint &byteCount) const
 {
-  //LogLevelChanger _(LOG_DEBUG);
-  
-  Lock<Mutex> _(_mutex);
-  
   if(!isInitialized())
   {
     logger(LOG_ERROR) << "VoxelProgrammerBase: Not initialized." << std::endl;
     return false;
   }
   
-  uint16_t slaveAddress, registerAddress;
-  
-  slaveAddress = (address & 0xFF00) >> 8; // I2C slave address
-  registerAddress = (address & 0xFF); // I2C register address
-  
-  auto x = _slaveAddressToByteMap.find(slaveAddress);
+  auto x = _slaveAddressToByteMap.find((address & 0xFF00) >> 8); // I2C slave address
   
   if(x == _slaveAddressToByteMap.end())
   {
@@ -44,9 +35,39 @@ bool VoxelProgrammerBase::readRegister(uint32_t address, uint32_t &value) const
     return false;
   }
   
-  uint byteCount = x->second;
+  byteCount = x->second;
+  return true;
+}
+
+bool VoxelProgrammerBase::_read(uint32_t address, uint32_t &value, bool useShadow) const
+{
+  auto b = _batchValues.find(address);
+  
+  if(b != _batchValues.end())
+  {
+    value = b->second;
+    return true;
+  }
+  
+  bool isVolatile = _volatileRegisters.find(address) != _volatileRegisters.end();
   
-  if(!_readRegister(slaveAddress, registerAddress, value, byteCount))
+  if(useShadow && _shadowEnabled && !isVolatile)
+  {
+    auto s = _shadow.find(address);
+    
+    if(s != _shadow.end())
+    {
+      value = s->second;
+      return true;
+    }
+  }
+  
+  uint byteCount;
+  
+  if(!_getByteCount(address, byteCount))
+    return false;
+  
+  if(!_readRegister((address & 0xFF00) >> 8, address & 0xFF, value, byteCount))
   {
     logger(LOG_ERROR) << "VoxelProgrammerBase: Could not read register for address 0x" << std::hex << address << std::endl;
     return false;
@@ -54,46 +75,103 @@ bool VoxelProgrammerBase::readRegister(uint32_t address, uint32_t &value) const
   
   logger(LOG_DEBUG) << "VoxelProgrammerBase: register read @0x" << std::hex << address << " = " << value << std::endl;
   
+  if(_shadowEnabled && !isVolatile)
+    _shadow[address] = value;
+  
   return true;
 }
 
-bool VoxelProgrammerBase::writeRegister(uint32_t address, uint32_t value)
+bool VoxelProgrammerBase::_writeThrough(uint32_t address, uint32_t value)
 {
-  //LogLevelChanger _(LOG_DEBUG);
-  Lock<Mutex> _(_mutex);
+  uint byteCount;
   
-  if(!isInitialized())
+  if(!_getByteCount(address, byteCount))
+    return false;
+  
+  if(!_writeRegister((address & 0xFF00) >> 8, address & 0xFF, value, byteCount))
   {
-    logger(LOG_ERROR) << "VoxelProgrammerBase: Not initialized." << std::endl;
+    logger(LOG_ERROR) << "VoxelProgrammerBase: Could not write register for address 0x" << std::hex << address << std::endl;
+    _shadow.erase(address); // Register may or may not have been written
     return false;
   }
   
-  uint16_t slaveAddress, registerAddress;
+  logger(LOG_DEBUG) << "VoxelProgrammerBase: register write @0x" << std::hex << address << " = " << value << std::endl;
   
-  slaveAddress = (address & 0xFF00) >> 8;
-  registerAddress = (address & 0xFF);
+  if(_shadowEnabled && _volatileRegisters.find(address) == _volatileRegisters.end())
+    _shadow[address] = value;
   
-  auto x = _slaveAddressToByteMap.find(slaveAddress);
+  return true;
+}
+
+bool VoxelProgrammerBase::_write(uint32_t address, uint32_t value)
+{
+  if(!_batchDepth)
+    return _writeThrough(address, value);
   
-  if(x == _slaveAddressToByteMap.end())
+  if(_volatileRegisters.find(address) != _volatileRegisters.end())
   {
-    logger(LOG_ERROR) << "VoxelProgrammerBase: Unknown slave address 0x" << std::hex << slaveAddress << std::endl;
-    return false;
+    bool ret = _flushBatch();
+    return _writeThrough(address, value) && ret;
   }
   
-  uint byteCount = x->second;
+  uint byteCount;
   
-  if(!_writeRegister(slaveAddress, registerAddress, value, byteCount))
-  {
-    logger(LOG_ERROR) << "VoxelProgrammerBase: Could not read register for address 0x" << std::hex << address << std::endl;
+  if(!_getByteCount(address, byteCount)) // Catch errors at the time of write rather than at commit
     return false;
-  }
   
-  logger(LOG_DEBUG) << "VoxelProgrammerBase: register write @0x" << std::hex << address << " = " << value << std::endl;
+  if(_batchValues.find(address) == _batchValues.end())
+    _batchOrder.push_back(address);
   
+  _batchValues[address] = value;
   return true;
 }
 
+bool VoxelProgrammerBase::_flushBatch()
+{
+  bool ret = true;
+  
+  for(auto address: _batchOrder)
+  {
+    uint32_t value = _batchValues[address];
+    
+    auto s = _shadow.find(address);
+    
+    if(_shadowEnabled && s != _shadow.end() && s->second == value)
+      continue; // Register already holds this value
+    
+    if(!_writeThrough(address, value))
+      ret = false;
+  }
+  
+  _batchOrder.clear();
+  _batchValues.clear();
+  return ret;
+}
+
+void VoxelProgrammerBase::_checkVolatile(const Parameter &param) const
+{
+  if(param.ioType() == Parameter::IO_READ_ONLY || dynamic_cast<const StrobeBoolParameter *>(&param))
+  {
+    if(_volatileRegisters.insert(param.address()).second)
+      _shadow.erase(param.address());
+  }
+}
+
+bool VoxelProgrammerBase::readRegister(uint32_t address, uint32_t &value) const
+{
+  //LogLevelChanger _(LOG_DEBUG);
+  
+  Lock<Mutex> _(_mutex);
+  return _read(address, value, false);
+}
+
+bool VoxelProgrammerBase::writeRegister(uint32_t address, uint32_t value)
+{
+  //LogLevelChanger _(LOG_DEBUG);
+  Lock<Mutex> _(_mutex);
+  return _write(address, value);
+}
+
 bool VoxelProgrammerBase::getValue(const Voxel::Parameter &param, uint32_t &value) const
 {
   uint32_t registerValue;
@@ -101,7 +179,11 @@ bool VoxelProgrammerBase::getValue(const Voxel::Parameter &param, uint32_t &valu
   if(param.mask() == -1)
     return false; // No way to read value
   
-  if(!readRegister(param.address(), registerValue))
+  Lock<Mutex> _(_mutex);
+  
+  _checkVolatile(param);
+  
+  if(!_read(param.address(), registerValue))
     return false;
   
   value = (registerValue & ~param.mask()) >> param.lsb();
@@ -115,13 +197,66 @@ bool VoxelProgrammerBase::setValue(const Parameter &param, uint32_t value)
   if(param.mask() == -1)
     return true; // Fictitiously accept set
   
-  if(!readRegister(param.address(), registerValue))
+  Lock<Mutex> _(_mutex);
+  
+  _checkVolatile(param);
+  
+  if(!_read(param.address(), registerValue))
     return false;
   
   registerValue = ((registerValue & param.mask()) | (value << param.lsb()));
   
-  return writeRegister(param.address(), registerValue);
+  return _write(param.address(), registerValue);
 }
+
+bool VoxelProgrammerBase::beginBatch()
+{
+  Lock<Mutex> _(_mutex);
+  _batchDepth++;
+  return true;
+}
+
+bool VoxelProgrammerBase::commit()
+{
+  Lock<Mutex> _(_mutex);
+  
+  if(!_batchDepth)
+  {
+    logger(LOG_ERROR) << "VoxelProgrammerBase: commit() without beginBatch()" << std::endl;
+    return false;
+  }
+  
+  if(--_batchDepth)
+    return true; // Outer batch commits
   
+  return _flushBatch();
+}
+
+void VoxelProgrammerBase::setShadowEnabled(bool enable)
+{
+  Lock<Mutex> _(_mutex);
+  _shadowEnabled = enable;
+  _shadow.clear();
+}
+
+void VoxelProgrammerBase::invalidateShadow()
+{
+  Lock<Mutex> _(_mutex);
+  _shadow.clear();
+}
+
+void VoxelProgrammerBase::setVolatile(uint32_t address, bool isVolatile)
+{
+  Lock<Mutex> _(_mutex);
+  
+  if(isVolatile)
+  {
+    _volatileRegisters.insert(address);
+    _shadow.erase(address);
+  }
+  else
+    _volatileRegisters.erase(address);
+}
+  
+}
 }
-}
\ No newline at end of file
@@ -30,19 +30,59 @@ protected:
   
   SlaveAddressToByteMap _slaveAddressToByteMap;
   
+  // Last known value of registers, keyed by register address. Every write goes through to the device and updates it
+  mutable Map<uint32_t, uint32_t> _shadow;
+  mutable Set<uint32_t> _volatileRegisters; // Never served from '_shadow', like status registers or ones with self-clearing strobe bits
+  bool _shadowEnabled = true;
+  
+  // Writes held back by the current batch, and their registers in the order of first write
+  int _batchDepth = 0;
+  Map<uint32_t, uint32_t> _batchValues;
+  Vector<uint32_t> _batchOrder;
+  
   virtual bool _readRegister(uint16_t slaveAddress, uint16_t registerAddress, uint32_t &value, uint8_t length) const = 0;
   virtual bool _writeRegister(uint16_t slaveAddress, uint16_t registerAddress, uint32_t value, uint8_t length) = 0;
   
+  // These expect '_mutex' to be locked
+  bool _getByteCount(uint32_t address, uint &byteCount) const;
+  bool _read(uint32_t address, uint32_t &value, bool useShadow = true) const; // from batch, shadow or device in that order
+  bool _write(uint32_t address, uint32_t value); // into the batch, if one is open
+  bool _writeThrough(uint32_t address, uint32_t value);
+  bool _flushBatch();
+  
+  void _checkVolatile(const Parameter &param) const;
+  
 public:
   VoxelProgrammerBase(const SlaveAddressToByteMap &map, DevicePtr device);
   
+  // Reads the device, or a pending value in a batch. Not served from the shadow, as registers not described by any
+  // parameter are not known to be non-volatile
   virtual bool readRegister(uint32_t address, uint32_t &value) const;
   virtual bool writeRegister(uint32_t address, uint32_t value);
   
-  // getValue() and setValue() are internally called readRegister() and writeRegister() which are thread-safe. So, no mutex locking in getValue() and setValue()
+  // Read-modify-write of a parameter is done under a single lock, so concurrent setValue() on fields of the same register do not clobber each other
   virtual bool getValue(const Parameter &param, uint32_t &value) const;
   virtual bool setValue(const Parameter &param, uint32_t value);
   
+  /**
+   * Writes within a batch are coalesced per register, so that setValue() on different fields of a register
+   * result in a single write. On commit(), registers are written in the order in which they were first written,
+   * skipping those which already hold the value. Writes to volatile registers are not held back, but flush the
+   * writes held back so far to preserve their order. A batch is shared by all threads using this programmer.
+   */
+  virtual bool beginBatch();
+  virtual bool commit();
+  
+  // Parameter reads of registers with a known value are served from the shadow, without a transfer. Disabling also clears it
+  void setShadowEnabled(bool enable);
+  inline bool isShadowEnabled() const { return _shadowEnabled; }
+  
+  // Forget all known register values, like after the device has been reset
+  void invalidateShadow();
+  
+  // Registers which the device may change on its own. Registers of read-only and strobe parameters are marked automatically
+  void setVolatile(uint32_t address, bool isVolatile = true);
+  
   virtual ~VoxelProgrammerBase() {}
 };
 
@@ -172,6 +172,8 @@ bool VoxelXUProgrammer::reset()
     logger(LOG_ERROR) << "VoxelXUProgrammer: Could not reset the device." << std::endl;
     return false;
   }
+  
+  invalidateShadow(); // Registers are back to their power-on values
   return true;
 }
 
@@ -0,0 +1,212 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#include "Common.h"
+#include "Timer.h"
+#include <ToFCrossTalkFilter.h>
+#include <ToFFastMath.h>
+
+#include <iostream>
+#include <random>
+#include <complex>
+#include <math.h>
+
+using namespace Voxel;
+using namespace Voxel::TI;
+
+#define MAX_PHASE_RANGE 0x1000
+#define COEFFICIENTS "(0.01,0.002) (0.05,0.01) (0.01,0.002) (0.05,0.01) (0.8,0) (0.05,0.01) (0.01,0.002) (0.05,0.01) (0.01,0.002)"
+
+typedef ToFRawFrameTemplate<uint16_t, uint8_t> ToFFrame;
+
+FramePtr makeFrame(int width, int height, std::mt19937 &rng)
+{
+  ToFFrame *t = new ToFFrame();
+  FramePtr p(t);
+
+  SizeType count = width*height;
+
+  t->size.width = width;
+  t->size.height = height;
+  t->_phase.resize(count);
+  t->_amplitude.resize(count);
+  t->_ambient.resize(count);
+  t->_flags.resize(count);
+
+  std::uniform_int_distribution<int> phase(0, MAX_PHASE_RANGE - 1), amplitude(0, 0xFFF), noise(-8, 8);
+
+  for(auto j = 0; j < height; j++)
+    for(auto i = 0; i < width; i++)
+    {
+      // Smooth areas, with phase wrapping around in a few, and random pixels in between
+      bool random = (i + j) % 7 == 0;
+      t->_phase[j*width + i] = random?phase(rng):((4000 + 20*i + j + noise(rng) + MAX_PHASE_RANGE) % MAX_PHASE_RANGE);
+      t->_amplitude[j*width + i] = random?amplitude(rng):(200 + noise(rng));
+    }
+
+  return p;
+}
+
+// Original per-pixel std::complex implementation, with missing neighbours of border pixels left out
+void referenceFilter(const ToFFrame &in, ToFFrame &out)
+{
+  std::istringstream ss(COEFFICIENTS);
+  Vector<Complex> c;
+  Complex v;
+
+  while(ss >> v)
+    c.push_back(v);
+
+  float magnitude = std::abs(c[1]) + std::abs(c[3]) + std::abs(c[4]) + std::abs(c[5]) + std::abs(c[7]);
+
+  for(auto k: {1, 3, 4, 5, 7})
+    c[k] /= magnitude;
+
+  int width = in.size.width, height = in.size.height;
+
+  Vector<Complex> d(width*height);
+
+  for(auto i = 0; i < width*height; i++)
+    d[i] = std::polar<float>(in._amplitude[i], in._phase[i]*(float)(2*M_PI/MAX_PHASE_RANGE));
+
+  out.size = in.size;
+  out._amplitude.resize(width*height);
+  out._phase.resize(width*height);
+
+  for(auto j = 0; j < height; j++)
+    for(auto i = 0; i < width; i++)
+    {
+      int index = j*width + i;
+      Complex result = d[index]*c[4];
+
+      if(j > 0) result += d[index - width]*c[1];
+      if(i > 0) result += d[index - 1]*c[3];
+      if(i < width - 1) result += d[index + 1]*c[5];
+      if(j < height - 1) result += d[index + width]*c[7];
+
+      float phase = std::arg(result);
+
+      out._amplitude[index] = std::abs(result);
+      out._phase[index] = ((phase < 0)?(2*M_PI + phase):phase)*(MAX_PHASE_RANGE/(2*M_PI));
+    }
+}
+
+bool checkFastAngle()
+{
+  float maxError = 0;
+
+  for(auto a = 0; a < 100000; a++)
+  {
+    double angle = 2*M_PI*a/100000;
+
+    for(auto r: {0.01f, 1.0f, 4095.0f})
+    {
+      float x = r*cos(angle), y = r*sin(angle);
+      double exact = atan2((double)y, (double)x);
+
+      if(exact < 0)
+        exact += 2*M_PI;
+
+      double e = fabs(fastAngle(y, x) - exact);
+
+      maxError = std::max<float>(maxError, std::min(e, 2*M_PI - e));
+
+#ifdef TOF_FAST_MATH_SSE2
+      float s;
+      _mm_store_ss(&s, fastAngleSSE2(_mm_set_ss(y), _mm_set_ss(x)));
+
+      e = fabs(s - exact);
+
+      maxError = std::max<float>(maxError, std::min(e, 2*M_PI - e));
+#endif
+    }
+  }
+
+  if(maxError > 2e-5f || fastAngle(0, 0) != 0 || fastAngle(0, -1) != TOF_PI_F)
+  {
+    std::cerr << "FAIL: fast angle error = " << maxError << " radians" << std::endl;
+    return false;
+  }
+
+  std::cout << "Fast angle max error = " << maxError << " radians" << std::endl;
+  return true;
+}
+
+// Phase is compared modulo the phase range, as values close to a full turn may wrap around to 0
+bool checkFilter(int width, int height, std::mt19937 &rng)
+{
+  FramePtr in = makeFrame(width, height, rng), out;
+  ToFFrame reference;
+
+  ToFCrossTalkFilter filter;
+
+  if(!filter.setMaxPhaseRange(MAX_PHASE_RANGE) || !filter.readCoefficients(COEFFICIENTS) || !filter.filter(in, out))
+  {
+    std::cerr << "FAIL: could not filter " << width << "x" << height << " frame" << std::endl;
+    return false;
+  }
+
+  Timer t;
+  TimeStampType start = t.getCurentRealTime();
+
+  referenceFilter(*dynamic_cast<ToFFrame *>(in.get()), reference);
+
+  TimeStampType referenceTime = t.getCurentRealTime() - start;
+
+  start = t.getCurentRealTime();
+
+  filter.filter(in, out);
+
+  TimeStampType filterTime = t.getCurentRealTime() - start;
+
+  ToFFrame *o = dynamic_cast<ToFFrame *>(out.get());
+  SizeType exact = 0, count = width*height;
+
+  for(auto i = 0; i < count; i++)
+  {
+    int phaseDifference = abs((int)o->_phase[i] - (int)reference._phase[i]) % MAX_PHASE_RANGE;
+    int amplitudeDifference = abs((int)o->_amplitude[i] - (int)reference._amplitude[i]);
+
+    if(std::min(phaseDifference, MAX_PHASE_RANGE - phaseDifference) > 1 || amplitudeDifference > 1)
+    {
+      std::cerr << "FAIL: " << width << "x" << height << " pixel (" << i % width << ", " << i/width << ") phase = "
+        << o->_phase[i] << ", amplitude = " << o->_amplitude[i] << ", expected " << reference._phase[i] << ", "
+        << reference._amplitude[i] << std::endl;
+      return false;
+    }
+
+    if(!phaseDifference && !amplitudeDifference)
+      exact++;
+  }
+
+  std::cout << width << "x" << height << ": " << exact*100.0f/count << "% pixels exact, " << filterTime << " us (reference "
+    << referenceTime << " us)" << std::endl;
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  std::mt19937 rng(7);
+
+  int failures = 0;
+
+  if(!checkFastAngle())
+    failures++;
+
+  // Odd sizes go through the scalar tail of rows, and 1 x 1 has no neighbours at all
+  for(auto s: {std::make_pair(320, 240), std::make_pair(83, 61), std::make_pair(3, 2), std::make_pair(1, 1)})
+    if(!checkFilter(s.first, s.second, rng))
+      failures++;
+
+  if(failures)
+  {
+    std::cerr << failures << " test(s) failed" << std::endl;
+    return -1;
+  }
+
+  std::cout << "All tests passed" << std::endl;
+  return 0;
+}
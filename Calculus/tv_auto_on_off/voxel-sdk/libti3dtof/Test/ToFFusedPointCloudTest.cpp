@@ -0,0 +1,174 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#include "Common.h"
+#include "Timer.h"
+#include <ToFFrameGenerator.h>
+#include <ToFDepthFrameGenerator.h>
+#include <PointCloudFrameGenerator.h>
+
+#include <iostream>
+#include <random>
+
+using namespace Voxel;
+using namespace Voxel::TI;
+
+#define AMPLITUDE_SCALING_FACTOR (1.0f/(1 << 12))
+#define DEPTH_SCALING_FACTOR (6.25f/4096)
+
+struct TestCase
+{
+  uint32_t bytesPerPixel, dataArrangeMode;
+  uint32_t roiWidth, roiHeight, rowsToMerge, columnsToMerge;
+};
+
+// Checks that ToFFrameGenerator::generatePointCloud() gives the same points as the
+// ToFFrameGenerator -> ToFDepthFrameGenerator -> PointCloudFrameGenerator chain
+bool runTest(const TestCase &t, std::mt19937 &rng, bool printTiming)
+{
+  RegionOfInterest roi;
+  roi.x = 0;
+  roi.y = 0;
+  roi.width = t.roiWidth;
+  roi.height = t.roiHeight;
+
+  FrameSize maxFrameSize;
+  maxFrameSize.width = t.roiWidth;
+  maxFrameSize.height = t.roiHeight;
+
+  FrameSize size;
+  size.width = t.roiWidth/t.columnsToMerge;
+  size.height = t.roiHeight/t.rowsToMerge;
+
+  ToFFrameGenerator tofGenerator;
+  ToFDepthFrameGenerator depthGenerator;
+  PointCloudFrameGenerator pointCloudGenerator;
+
+  if(!tofGenerator.setParameters("", t.bytesPerPixel, t.dataArrangeMode, roi, maxFrameSize,
+                                 t.rowsToMerge, t.columnsToMerge, 0, "", ToF_PHASE_AMPLITUDE) ||
+    !depthGenerator.setParameters(AMPLITUDE_SCALING_FACTOR, DEPTH_SCALING_FACTOR) ||
+    !pointCloudGenerator.setParameters(roi.x, roi.y, roi.width, roi.height, t.rowsToMerge, t.columnsToMerge,
+                                       t.roiWidth*0.9f, t.roiWidth*0.9f, t.roiWidth/2.0f, t.roiHeight/2.0f,
+                                       -0.1f, 0.01f, 0, 0.001f, -0.001f))
+  {
+    std::cerr << "Failed to set generator parameters" << std::endl;
+    return false;
+  }
+
+  RawDataFrame *raw = new RawDataFrame();
+  FramePtr rawFrame(raw);
+
+  raw->id = 7;
+  raw->timestamp = 1234;
+  raw->data.resize(size.width*size.height*t.bytesPerPixel);
+
+  std::uniform_int_distribution<int> dist(0, 255);
+
+  for(auto &b: raw->data)
+    b = dist(rng);
+
+  FramePtr tofFrame, depthFrame, expectedFrame, actualFrame;
+
+  if(!tofGenerator.generate(rawFrame, tofFrame) || !depthGenerator.generate(tofFrame, depthFrame) ||
+    !pointCloudGenerator.generate(depthFrame, expectedFrame))
+  {
+    std::cerr << "Failed to generate point cloud through intermediate frames" << std::endl;
+    return false;
+  }
+
+  if(!tofGenerator.generatePointCloud(rawFrame, *pointCloudGenerator.getPointCloudTransform(),
+                                      AMPLITUDE_SCALING_FACTOR, DEPTH_SCALING_FACTOR, actualFrame))
+  {
+    std::cerr << "Failed to generate point cloud directly" << std::endl;
+    return false;
+  }
+
+  XYZIPointCloudFrame *expected = dynamic_cast<XYZIPointCloudFrame *>(expectedFrame.get());
+  XYZIPointCloudFrame *actual = dynamic_cast<XYZIPointCloudFrame *>(actualFrame.get());
+
+  if(!expected || !actual || expected->points.size() != actual->points.size() ||
+    actual->id != raw->id || actual->timestamp != raw->timestamp)
+  {
+    std::cerr << "Point cloud frames differ in type, size, id or timestamp" << std::endl;
+    return false;
+  }
+
+  for(auto i = 0; i < expected->points.size(); i++)
+  {
+    IntensityPoint &e = expected->points[i], &a = actual->points[i];
+
+    if(e.x != a.x || e.y != a.y || e.z != a.z || e.i != a.i)
+    {
+      std::cerr << "Point " << i << " differs. Expected = (" << e.x << ", " << e.y << ", " << e.z << ", " << e.i
+        << "), actual = (" << a.x << ", " << a.y << ", " << a.z << ", " << a.i << ")" << std::endl;
+      return false;
+    }
+  }
+
+  if(printTiming)
+  {
+    const int iterations = 200;
+    Timer timer;
+
+    TimeStampType start = timer.getCurentRealTime();
+
+    for(auto i = 0; i < iterations; i++)
+    {
+      tofGenerator.generate(rawFrame, tofFrame);
+      depthGenerator.generate(tofFrame, depthFrame);
+      pointCloudGenerator.generate(depthFrame, expectedFrame);
+    }
+
+    TimeStampType middle = timer.getCurentRealTime();
+
+    for(auto i = 0; i < iterations; i++)
+      tofGenerator.generatePointCloud(rawFrame, *pointCloudGenerator.getPointCloudTransform(),
+                                      AMPLITUDE_SCALING_FACTOR, DEPTH_SCALING_FACTOR, actualFrame);
+
+    TimeStampType end = timer.getCurentRealTime();
+
+    std::cout << size.width << "x" << size.height << ": through intermediate frames = " << (float)(middle - start)/iterations
+      << " us/frame, fused = " << (float)(end - middle)/iterations << " us/frame" << std::endl;
+  }
+
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  TestCase testCases[] =
+  {
+    { 4, 0, 320, 240, 1, 1 },
+    { 4, 2, 320, 240, 1, 1 },
+    { 2, 0, 320, 240, 1, 1 },
+    { 4, 0, 320, 240, 2, 2 },
+    { 4, 2, 100, 30, 1, 1 }, // Width not a multiple of 8
+    { 4, 0, 300, 20, 1, 1 }, // Width not a multiple of tile size
+    { 2, 0, 180, 40, 2, 3 },
+  };
+
+  std::mt19937 rng(4321);
+
+  int failures = 0;
+
+  for(auto i = 0; i < sizeof(testCases)/sizeof(TestCase); i++)
+  {
+    if(!runTest(testCases[i], rng, i == 0))
+    {
+      std::cerr << "FAIL: test case " << i << std::endl;
+      failures++;
+    }
+  }
+
+  if(failures)
+  {
+    std::cerr << failures << " test(s) failed" << std::endl;
+    return -1;
+  }
+
+  std::cout << "All tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,278 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#include "Common.h"
+#include "Timer.h"
+#include <ToFRawUnpacker.h>
+
+#include <iostream>
+#include <random>
+#include <complex>
+#include <string.h>
+
+using namespace Voxel;
+using namespace Voxel::TI;
+
+#define MAX_PHASE_VALUE 0x0FFF
+
+struct Planes
+{
+  Vector<uint16_t> phase, amplitude;
+  Vector<uint8_t> ambient, flags;
+
+  Planes(SizeType count): phase(count, 0xABCD), amplitude(count, 0xABCD), ambient(count, 0xA5), flags(count, 0xA5) {}
+
+  bool operator ==(const Planes &other) const
+  {
+    return phase == other.phase && amplitude == other.amplitude && ambient == other.ambient && flags == other.flags;
+  }
+};
+
+// Loops as they were in ToFFrameGenerator before unpacking was moved to ToFRawUnpacker
+void referenceUnpack(int layout, const uint16_t *data, int width, int height, Planes &p)
+{
+  if(layout == 0)
+  {
+    for (auto i = 0; i < height; i++)
+      for (auto j = 0; j < width; j++)
+      {
+        auto index1 = i*width*2 + j*2, index2 = i*width + j;
+        p.amplitude[index2] = data[index1] & MAX_PHASE_VALUE;
+        p.ambient[index2] = (data[index1] & 0xF000) >> 12;
+        p.phase[index2] = data[index1 + 1] & MAX_PHASE_VALUE;
+        p.flags[index2] = (data[index1 + 1] & 0xF000) >> 12;
+      }
+  }
+  else if(layout == 1)
+  {
+    for (auto i = 0; i < height; i++)
+      for (auto j = 0; j < width/8; j++)
+      {
+        auto index1 = i*width*2 + j*16, index2 = i*width + j*8;
+        for (auto k = 0; k < 8; k++)
+        {
+          p.amplitude[index2 + k] = data[index1 + k] & MAX_PHASE_VALUE;
+          p.ambient[index2 + k] = (data[index1 + k] & 0xF000) >> 12;
+          p.phase[index2 + k] = data[index1 + k + 8] & MAX_PHASE_VALUE;
+          p.flags[index2 + k] = (data[index1 + k + 8] & 0xF000) >> 12;
+        }
+      }
+  }
+  else
+  {
+    for (auto index = 0; index < width*height; index++)
+    {
+      p.phase[index] = data[index] & MAX_PHASE_VALUE;
+      p.amplitude[index] = (data[index] & 0xF000) >> 4;
+      p.ambient[index] = 0;
+      p.flags[index] = 0;
+    }
+  }
+}
+
+void unpack(int layout, const uint16_t *data, int width, int height, Planes &p, ToFRawUnpacker::Implementation impl)
+{
+  if(layout == 0)
+    ToFRawUnpacker::unpack4ByteMode0(data, width, height, p.phase.data(), p.amplitude.data(), p.ambient.data(), p.flags.data(), impl);
+  else if(layout == 1)
+    ToFRawUnpacker::unpack4ByteMode2(data, width, height, p.phase.data(), p.amplitude.data(), p.ambient.data(), p.flags.data(), impl);
+  else
+    ToFRawUnpacker::unpack2ByteMode0(data, width, height, p.phase.data(), p.amplitude.data(), p.ambient.data(), p.flags.data(), impl);
+}
+
+// Conversion as it was in ToFFrameGenerator before it was moved to ToFRawUnpacker
+void referenceConvertIQ(const Vector<int16_t> &i, const Vector<int16_t> &q, Vector<uint16_t> &phase, Vector<uint16_t> &amplitude)
+{
+  for(auto index = 0; index < i.size(); index++)
+  {
+    Complex c(i[index], q[index]);
+    float p = std::arg(c);
+
+    phase[index] = ((p < 0)?(2*M_PI + p):p)*4096/(2*M_PI);
+    amplitude[index] = std::abs(c);
+  }
+}
+
+// Phase and amplitude need to be within one of the reference. Phase is compared modulo 4096, as values close to a full
+// turn may wrap around to 0
+int checkConvertIQ(std::mt19937 &rng)
+{
+  std::uniform_int_distribution<int> full(-32768, 32767), small(-4, 4);
+
+  int failures = 0;
+
+  for(auto count: {320*240, 1, 7, 13})
+  {
+    Vector<int16_t> i(count), q(count);
+
+    // Full range samples, and small ones where the angle is coarse
+    for(auto index = 0; index < count; index++)
+    {
+      bool isSmall = index % 5 == 0;
+      i[index] = isSmall?small(rng):full(rng);
+      q[index] = isSmall?small(rng):full(rng);
+    }
+
+    Vector<uint16_t> expectedPhase(count), expectedAmplitude(count);
+    referenceConvertIQ(i, q, expectedPhase, expectedAmplitude);
+
+    for(auto k = 0; k <= ToFRawUnpacker::IMPL_AUTO; k++)
+    {
+      ToFRawUnpacker::Implementation impl = (ToFRawUnpacker::Implementation)k;
+
+      if(impl != ToFRawUnpacker::IMPL_AUTO && !ToFRawUnpacker::isSupported(impl))
+        continue;
+
+      Vector<uint16_t> phase(count), amplitude(count);
+      ToFRawUnpacker::convertIQ(i.data(), q.data(), count, phase.data(), amplitude.data(), impl);
+
+      for(auto index = 0; index < count; index++)
+      {
+        int phaseDifference = abs((int)phase[index] - (int)expectedPhase[index]) % 4096;
+
+        if(std::min(phaseDifference, 4096 - phaseDifference) > 1 || abs((int)amplitude[index] - (int)expectedAmplitude[index]) > 1)
+        {
+          std::cerr << "FAIL: IQ conversion, count = " << count << ", implementation = " << ToFRawUnpacker::name(impl)
+            << ", (" << i[index] << ", " << q[index] << ") gave phase = " << phase[index] << ", amplitude = " << amplitude[index]
+            << ", expected " << expectedPhase[index] << ", " << expectedAmplitude[index] << std::endl;
+          failures++;
+          break;
+        }
+      }
+    }
+  }
+  return failures;
+}
+
+int main(int argc, char *argv[])
+{
+  const char *layoutNames[] = { "4-byte mode 0", "4-byte mode 2", "2-byte mode 0" };
+
+  struct { int width, height; } sizes[] = { {320, 240}, {80, 60}, {1, 1}, {7, 3}, {13, 5}, {25, 2}, {41, 9} };
+
+  std::mt19937 rng(1234);
+  std::uniform_int_distribution<int> dist(0, 0xFFFF);
+
+  int failures = 0;
+
+  for(auto &s: sizes)
+  {
+    SizeType count = s.width*s.height;
+    Vector<uint16_t> data(count*2);
+
+    for(auto &d: data)
+      d = dist(rng);
+
+    for(auto layout = 0; layout < 3; layout++)
+    {
+      Planes expected(count);
+      referenceUnpack(layout, data.data(), s.width, s.height, expected);
+
+      for(auto i = 0; i <= ToFRawUnpacker::IMPL_AUTO; i++)
+      {
+        ToFRawUnpacker::Implementation impl = (ToFRawUnpacker::Implementation)i;
+
+        if(impl != ToFRawUnpacker::IMPL_AUTO && !ToFRawUnpacker::isSupported(impl))
+          continue;
+
+        Planes actual(count);
+        unpack(layout, data.data(), s.width, s.height, actual, impl);
+
+        if(!(actual == expected))
+        {
+          std::cerr << "FAIL: " << layoutNames[layout] << ", " << s.width << "x" << s.height
+            << ", implementation = " << ToFRawUnpacker::name(impl) << std::endl;
+          failures++;
+        }
+      }
+    }
+  }
+
+  failures += checkConvertIQ(rng);
+
+  // Rough timing of each implementation on a QVGA frame
+  {
+    const int width = 320, height = 240, iterations = 500;
+    Vector<uint16_t> data(width*height*2);
+    for(auto &d: data)
+      d = dist(rng);
+
+    Planes p(width*height);
+    Timer timer;
+
+    for(auto layout = 0; layout < 3; layout++)
+      for(auto i = 0; i < ToFRawUnpacker::IMPL_AUTO; i++)
+      {
+        ToFRawUnpacker::Implementation impl = (ToFRawUnpacker::Implementation)i;
+
+        if(!ToFRawUnpacker::isSupported(impl))
+          continue;
+
+        TimeStampType start = timer.getCurentRealTime();
+
+        for(auto k = 0; k < iterations; k++)
+          unpack(layout, data.data(), width, height, p, impl);
+
+        TimeStampType elapsed = timer.getCurentRealTime() - start;
+
+        std::cout << layoutNames[layout] << ", " << ToFRawUnpacker::name(impl) << ": "
+          << (float)elapsed/iterations << " us/frame" << std::endl;
+      }
+
+    Vector<int16_t> i(width*height), q(width*height);
+
+    for(auto index = 0; index < width*height; index++)
+    {
+      i[index] = dist(rng) - 0x8000;
+      q[index] = dist(rng) - 0x8000;
+    }
+
+    TimeStampType start = timer.getCurentRealTime();
+
+    // Averaged too, so that it compares with the kernels below
+    const int referenceIterations = iterations/25;
+
+    for(auto n = 0; n < referenceIterations; n++)
+      referenceConvertIQ(i, q, p.phase, p.amplitude);
+
+    std::cout << "IQ conversion, std::arg: " << (float)(timer.getCurentRealTime() - start)/referenceIterations
+      << " us/frame" << std::endl;
+
+    for(auto k = 0; k < ToFRawUnpacker::IMPL_AUTO; k++)
+    {
+      ToFRawUnpacker::Implementation impl = (ToFRawUnpacker::Implementation)k;
+
+      if(!ToFRawUnpacker::isSupported(impl))
+        continue;
+
+      if(impl == ToFRawUnpacker::IMPL_AVX2) // Not a kernel of its own
+      {
+        std::cout << "IQ conversion, " << ToFRawUnpacker::name(impl) << ": same as "
+          << ToFRawUnpacker::name(ToFRawUnpacker::IMPL_SSE2) << " kernel" << std::endl;
+        continue;
+      }
+
+      start = timer.getCurentRealTime();
+
+      for(auto n = 0; n < iterations; n++)
+        ToFRawUnpacker::convertIQ(i.data(), q.data(), width*height, p.phase.data(), p.amplitude.data(), impl);
+
+      std::cout << "IQ conversion, " << ToFRawUnpacker::name(impl) << ": "
+        << (float)(timer.getCurentRealTime() - start)/iterations << " us/frame" << std::endl;
+    }
+  }
+
+  std::cout << "Best implementation = " << ToFRawUnpacker::name(ToFRawUnpacker::best()) << std::endl;
+
+  if(failures)
+  {
+    std::cerr << failures << " test(s) failed" << std::endl;
+    return -1;
+  }
+
+  std::cout << "All tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,545 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#include "SimpleOpt.h"
+#include "Common.h"
+#include "Logger.h"
+#include "CameraSystem.h"
+#include <ToFFrameGenerator.h>
+#include <ToFDepthFrameGenerator.h>
+#include <ToFCrossTalkFilter.h>
+#include <PointCloudFrameGenerator.h>
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+using namespace Voxel;
+using namespace Voxel::TI;
+
+// Every heap allocation, including those made inside the libraries, goes through these
+static std::atomic<SizeType> allocationCount(0);
+
+void *operator new(std::size_t size)
+{
+  allocationCount++;
+
+  void *p = malloc(size?size:1);
+
+  if(!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, std::size_t) noexcept { free(p); }
+void operator delete[](void *p, std::size_t) noexcept { free(p); }
+
+#define AMPLITUDE_SCALING_FACTOR (1.0f/(1 << 12))
+#define DEPTH_SCALING_FACTOR (6.25f/4096)
+#define WARM_UP_ITERATIONS 3
+
+enum Options
+{
+  ITERATIONS = 0,
+  FILTER = 1,
+  OUTPUT = 2,
+  BASELINE = 3,
+  TOLERANCE = 4,
+  STREAM = 5
+};
+
+Vector<CSimpleOpt::SOption> argumentSpecifications =
+{
+  { ITERATIONS, "-n", SO_REQ_SEP, "Number of frames per measurement [default = 50]"},
+  { FILTER,     "-f", SO_REQ_SEP, "Run only benchmarks whose name contains this string"},
+  { OUTPUT,     "-o", SO_REQ_SEP, "Write results as JSON to this file"},
+  { BASELINE,   "-b", SO_REQ_SEP, "Compare against the results in this JSON file (as written by -o)"},
+  { TOLERANCE,  "-t", SO_REQ_SEP, "Allowed slow down over baseline in percent [default = 10]"},
+  { STREAM,     "-s", SO_REQ_SEP, "Also benchmark with the first frame of this recorded stream (.vxl)"},
+  SO_END_OF_OPTIONS
+};
+
+void help()
+{
+  std::cout << "voxel-bench v1.0" << std::endl;
+
+  CSimpleOpt::SOption *option = argumentSpecifications.data();
+
+  while(option->nId >= 0)
+  {
+    std::cout << option->pszArg << " " << option->helpInfo << std::endl;
+    option++;
+  }
+}
+
+struct Result
+{
+  String name;
+  FrameSize size;
+  int iterations;
+  double nsPerPixel, framesPerSecond, allocationsPerFrame;
+  double p50, p99; // in micro-seconds
+};
+
+class Bench
+{
+  int _iterations;
+  String _filter;
+
+public:
+  Vector<Result> results;
+  int failures = 0;
+
+  Bench(int iterations, const String &filter): _iterations(iterations), _filter(filter) {}
+
+  // 'f' processes one frame and returns false on failure
+  template <typename F>
+  void run(const String &name, const FrameSize &size, F f)
+  {
+    if(_filter.size() && name.find(_filter) == String::npos)
+      return;
+
+    for(auto i = 0; i < WARM_UP_ITERATIONS; i++) // Lets outputs and internal buffers get allocated
+    {
+      if(!f())
+      {
+        logger(LOG_ERROR) << "voxel-bench: '" << name << "' failed" << std::endl;
+        failures++;
+        return;
+      }
+    }
+
+    Vector<int64_t> latencies(_iterations);
+
+    SizeType allocations = allocationCount;
+
+    for(auto i = 0; i < _iterations; i++)
+    {
+      auto start = std::chrono::steady_clock::now();
+
+      if(!f())
+      {
+        logger(LOG_ERROR) << "voxel-bench: '" << name << "' failed at iteration " << i << std::endl;
+        failures++;
+        return;
+      }
+
+      latencies[i] = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    allocations = allocationCount - allocations;
+
+    double total = 0;
+    for(auto l: latencies)
+      total += l;
+
+    std::sort(latencies.begin(), latencies.end());
+
+    Result r;
+    r.name = name;
+    r.size = size;
+    r.iterations = _iterations;
+    r.nsPerPixel = total/_iterations/(size.width*size.height);
+    r.framesPerSecond = 1e9*_iterations/total;
+    r.allocationsPerFrame = (double)allocations/_iterations;
+    r.p50 = latencies[latencies.size()/2]/1000.0;
+    r.p99 = latencies[std::min<SizeType>(latencies.size() - 1, (latencies.size()*99 + 99)/100 - 1)]/1000.0;
+
+    std::cout << std::left << std::setw(48) << name << std::right << std::fixed << std::setprecision(2)
+      << std::setw(10) << r.nsPerPixel << " ns/px"
+      << std::setw(11) << r.framesPerSecond << " fps"
+      << std::setw(9) << r.allocationsPerFrame << " allocs/frame"
+      << "  p50 = " << r.p50 << " us, p99 = " << r.p99 << " us" << std::endl;
+
+    results.push_back(r);
+  }
+};
+
+// Smooth surface with a step and noise, similar to a depth scene
+FramePtr makeToFFrame(const FrameSize &size, std::mt19937 &rng)
+{
+  ToFRawFrameTemplate<uint16_t, uint8_t> *t = new ToFRawFrameTemplate<uint16_t, uint8_t>();
+  FramePtr p(t);
+
+  SizeType count = size.width*size.height;
+
+  t->size = size;
+  t->_phase.resize(count);
+  t->_amplitude.resize(count);
+  t->_ambient.resize(count);
+  t->_flags.resize(count);
+
+  std::uniform_int_distribution<int> noise(-8, 8);
+
+  for(auto j = 0; j < size.height; j++)
+    for(auto i = 0; i < size.width; i++)
+    {
+      t->_phase[j*size.width + i] = 1000 + ((i > size.width/2)?400:0) + j + noise(rng);
+      t->_amplitude[j*size.width + i] = 200 + noise(rng);
+    }
+
+  return p;
+}
+
+// Benchmarks for processed (ToF) frames and everything after them. Common to synthetic and recorded frames
+void runFrameBenchmarks(Bench &bench, CameraSystem &sys, const String &suffix, const FrameSize &size,
+                        const FramePtr &tofFrame, FrameGenerator &depthGenerator, FrameGenerator &pointCloudGenerator)
+{
+  FramePtr depthFrame, out, out2;
+
+  bench.run("ToFDepthFrameGenerator" + suffix, size, [&]() { return depthGenerator.generate(tofFrame, depthFrame); });
+
+  // Depth frame is needed below even when the benchmark above is filtered out
+  if(!depthFrame && !depthGenerator.generate(tofFrame, depthFrame))
+  {
+    logger(LOG_ERROR) << "voxel-bench: Could not generate depth frame for '" << suffix << "'" << std::endl;
+    bench.failures++;
+    return;
+  }
+
+  const char *filters[] = { "IIRFilter", "MedianFilter", "TemporalMedianFilter", "SmoothFilter", "BilateralFilter" };
+
+  for(auto name: filters)
+  {
+    FilterPtr f1 = sys.createFilter(String("Voxel::") + name, DepthCamera::FRAME_RAW_FRAME_PROCESSED);
+    FilterPtr f2 = sys.createFilter(String("Voxel::") + name, DepthCamera::FRAME_DEPTH_FRAME);
+
+    if(!f1 || !f2)
+    {
+      logger(LOG_ERROR) << "voxel-bench: Could not create filter '" << name << "'" << std::endl;
+      bench.failures++;
+      continue;
+    }
+
+    bench.run(String(name) + "/tof" + suffix, size, [&]() { return f1->filter(tofFrame, out); });
+    bench.run(String(name) + "/depth" + suffix, size, [&]() { return f2->filter(depthFrame, out2); });
+  }
+
+  FramePtr pointCloudFrame, soaFrame(new XYZIPointCloudSoAFrame());
+
+  bench.run("PointCloudTransform/xyzi" + suffix, size, [&]() { return pointCloudGenerator.generate(depthFrame, pointCloudFrame); });
+  bench.run("PointCloudTransform/soa" + suffix, size, [&]() { return pointCloudGenerator.generate(depthFrame, soaFrame); });
+}
+
+void runSyntheticBenchmarks(Bench &bench, CameraSystem &sys, const String &resolution, const FrameSize &size, std::mt19937 &rng)
+{
+  String suffix = "/" + resolution;
+
+  RegionOfInterest roi;
+  roi.x = roi.y = 0;
+  roi.width = size.width;
+  roi.height = size.height;
+
+  struct { const char *name; uint32_t bytesPerPixel, dataArrangeMode; } decodes[] =
+  {
+    { "ToFFrameGenerator/2bpp", 2, 0 },
+    { "ToFFrameGenerator/4bpp", 4, 0 },
+    { "ToFFrameGenerator/4bpp-arranged", 4, 2 },
+  };
+
+  std::uniform_int_distribution<int> byte(0, 255);
+
+  PointCloudFrameGenerator pointCloudGenerator;
+
+  if(!pointCloudGenerator.setParameters(0, 0, size.width, size.height, 1, 1, size.width*0.9f, size.width*0.9f,
+                                        size.width/2.0f, size.height/2.0f, -0.1f, 0.01f, 0, 0.001f, -0.001f))
+  {
+    logger(LOG_ERROR) << "voxel-bench: Failed to set point cloud parameters" << std::endl;
+    bench.failures++;
+    return;
+  }
+
+  for(auto &d: decodes)
+  {
+    ToFFrameGenerator generator;
+
+    if(!generator.setParameters("", d.bytesPerPixel, d.dataArrangeMode, roi, size, 1, 1, 0, "", ToF_PHASE_AMPLITUDE))
+    {
+      logger(LOG_ERROR) << "voxel-bench: Failed to set parameters for '" << d.name << "'" << std::endl;
+      bench.failures++;
+      continue;
+    }
+
+    RawDataFrame *raw = new RawDataFrame();
+    FramePtr rawFrame(raw), out;
+
+    raw->data.resize(size.width*size.height*d.bytesPerPixel);
+
+    for(auto &b: raw->data)
+      b = byte(rng);
+
+    bench.run(d.name + suffix, size, [&]() { return generator.generate(rawFrame, out); });
+
+    if(d.bytesPerPixel == 4 && d.dataArrangeMode == 0)
+      bench.run("ToFFrameGenerator/fused-point-cloud" + suffix, size, [&]() {
+        return generator.generatePointCloud(rawFrame, *pointCloudGenerator.getPointCloudTransform(),
+                                            AMPLITUDE_SCALING_FACTOR, DEPTH_SCALING_FACTOR, out);
+      });
+  }
+
+  FramePtr tofFrame = makeToFFrame(size, rng), out;
+
+  ToFCrossTalkFilter crossTalkFilter;
+  crossTalkFilter.setMaxPhaseRange(4096);
+
+  if(crossTalkFilter.readCoefficients("(0.01,0.002) (0.05,0.01) (0.01,0.002) (0.05,0.01) (0.8,0) (0.05,0.01) (0.01,0.002) (0.05,0.01) (0.01,0.002)"))
+    bench.run("ToFCrossTalkFilter" + suffix, size, [&]() { return crossTalkFilter.filter(tofFrame, out); });
+  else
+  {
+    logger(LOG_ERROR) << "voxel-bench: Failed to set cross talk coefficients" << std::endl;
+    bench.failures++;
+  }
+
+  ToFDepthFrameGenerator depthGenerator;
+
+  if(!depthGenerator.setParameters(AMPLITUDE_SCALING_FACTOR, DEPTH_SCALING_FACTOR))
+  {
+    logger(LOG_ERROR) << "voxel-bench: Failed to set depth frame parameters" << std::endl;
+    bench.failures++;
+    return;
+  }
+
+  runFrameBenchmarks(bench, sys, suffix, size, tofFrame, depthGenerator, pointCloudGenerator);
+}
+
+void runRecordedBenchmarks(Bench &bench, CameraSystem &sys, const String &fileName)
+{
+  FrameStreamReader reader(fileName, sys);
+
+  if(!reader.isStreamGood() || !reader.size() || !reader.readNext())
+  {
+    logger(LOG_ERROR) << "voxel-bench: Could not read a frame from '" << fileName << "'" << std::endl;
+    bench.failures++;
+    return;
+  }
+
+  ToFRawFrame *tofFrame = dynamic_cast<ToFRawFrame *>(reader.frames[DepthCamera::FRAME_RAW_FRAME_PROCESSED].get());
+
+  if(!tofFrame)
+  {
+    logger(LOG_ERROR) << "voxel-bench: Recorded stream does not have ToF frames" << std::endl;
+    bench.failures++;
+    return;
+  }
+
+  FrameSize size = tofFrame->size;
+  FramePtr rawFrame = reader.frames[DepthCamera::FRAME_RAW_FRAME_UNPROCESSED], out;
+
+  FrameGenerator &processedGenerator = *reader.getFrameGenerator(0);
+
+  bench.run("ToFFrameGenerator/recorded", size, [&]() { return processedGenerator.generate(rawFrame, out); });
+
+  runFrameBenchmarks(bench, sys, "/recorded", size, reader.frames[DepthCamera::FRAME_RAW_FRAME_PROCESSED],
+                     *reader.getFrameGenerator(1), *reader.getFrameGenerator(2));
+}
+
+bool writeJSON(const String &fileName, const Vector<Result> &results)
+{
+  OutputFileStream out(fileName, std::ios::out);
+
+  if(!out.good())
+    return false;
+
+  // One benchmark per line, so that baselines can be compared and diffed line by line
+  out << "{" << std::endl << "  \"version\": 1," << std::endl << "  \"benchmarks\": [" << std::endl;
+
+  out << std::fixed << std::setprecision(3);
+
+  for(auto i = 0; i < results.size(); i++)
+  {
+    const Result &r = results[i];
+
+    out << "    {\"name\": \"" << r.name << "\", \"width\": " << r.size.width << ", \"height\": " << r.size.height
+      << ", \"iterations\": " << r.iterations << ", \"ns_per_pixel\": " << r.nsPerPixel
+      << ", \"fps\": " << r.framesPerSecond << ", \"allocations_per_frame\": " << r.allocationsPerFrame
+      << ", \"p50_us\": " << r.p50 << ", \"p99_us\": " << r.p99 << "}" << ((i + 1 < results.size())?",":"") << std::endl;
+  }
+
+  out << "  ]" << std::endl << "}" << std::endl;
+
+  return out.good();
+}
+
+bool getJSONString(const String &line, const String &key, String &value)
+{
+  SizeType p = line.find("\"" + key + "\": \"");
+
+  if(p == String::npos)
+    return false;
+
+  p += key.size() + 5;
+
+  SizeType e = line.find('"', p);
+
+  if(e == String::npos)
+    return false;
+
+  value = line.substr(p, e - p);
+  return true;
+}
+
+bool getJSONNumber(const String &line, const String &key, double &value)
+{
+  SizeType p = line.find("\"" + key + "\": ");
+
+  if(p == String::npos)
+    return false;
+
+  value = atof(line.c_str() + p + key.size() + 4);
+  return true;
+}
+
+// Returns the number of benchmarks which regressed against the baseline, in median latency or in allocations
+int compareWithBaseline(const String &fileName, const Vector<Result> &results, float tolerance)
+{
+  InputFileStream in(fileName, std::ios::in);
+
+  if(!in.good())
+  {
+    logger(LOG_ERROR) << "voxel-bench: Could not open baseline '" << fileName << "'" << std::endl;
+    return 1;
+  }
+
+  Map<String, Result> baseline;
+  String line;
+
+  while(std::getline(in, line))
+  {
+    Result r;
+
+    if(getJSONString(line, "name", r.name) && getJSONNumber(line, "p50_us", r.p50) &&
+      getJSONNumber(line, "allocations_per_frame", r.allocationsPerFrame))
+      baseline[r.name] = r;
+  }
+
+  int regressions = 0;
+
+  std::cout << std::endl << "Comparison with baseline '" << fileName << "' (tolerance = " << tolerance << "%):" << std::endl;
+
+  for(auto &r: results)
+  {
+    auto b = baseline.find(r.name);
+
+    if(b == baseline.end())
+    {
+      std::cout << std::left << std::setw(48) << r.name << " not in baseline" << std::endl;
+      continue;
+    }
+
+    double change = (r.p50/b->second.p50 - 1)*100; // Median is less affected by other load on the machine than the mean
+    bool slower = change > tolerance;
+    bool moreAllocations = r.allocationsPerFrame > b->second.allocationsPerFrame + 0.5;
+
+    std::cout << std::left << std::setw(48) << r.name << std::right << std::showpos << std::setw(9) << change << "%" << std::noshowpos
+      << (slower?"  REGRESSION":"") << (moreAllocations?"  MORE ALLOCATIONS":"") << std::endl;
+
+    if(slower || moreAllocations)
+      regressions++;
+  }
+
+  return regressions;
+}
+
+int main(int argc, char *argv[])
+{
+  CSimpleOpt s(argc, argv, argumentSpecifications);
+
+  int iterations = 50;
+  float tolerance = 10;
+  String filter, outputFileName, baselineFileName, streamFileName;
+
+  while (s.Next())
+  {
+    if (s.LastError() != SO_SUCCESS)
+    {
+      std::cout << s.GetLastErrorText(s.LastError()) << ": '" << s.OptionText() << "'" << std::endl;
+      help();
+      return -1;
+    }
+
+    switch (s.OptionId())
+    {
+      case ITERATIONS:
+        iterations = atoi(s.OptionArg());
+        break;
+
+      case FILTER:
+        filter = s.OptionArg();
+        break;
+
+      case OUTPUT:
+        outputFileName = s.OptionArg();
+        break;
+
+      case BASELINE:
+        baselineFileName = s.OptionArg();
+        break;
+
+      case TOLERANCE:
+        tolerance = atof(s.OptionArg());
+        break;
+
+      case STREAM:
+        streamFileName = s.OptionArg();
+        break;
+
+      default:
+        help();
+        return -1;
+    };
+  }
+
+  if(iterations < 1)
+  {
+    logger(LOG_ERROR) << "voxel-bench: Number of iterations needs to be positive" << std::endl;
+    return -1;
+  }
+
+  CameraSystem sys;
+  Bench bench(iterations, filter);
+
+  struct { const char *name; uint32_t width, height; } resolutions[] = { {"QQVGA", 160, 120}, {"QVGA", 320, 240}, {"VGA", 640, 480} };
+
+  std::mt19937 rng(42);
+
+  for(auto &r: resolutions)
+  {
+    FrameSize size;
+    size.width = r.width;
+    size.height = r.height;
+
+    runSyntheticBenchmarks(bench, sys, r.name, size, rng);
+  }
+
+  if(streamFileName.size())
+    runRecordedBenchmarks(bench, sys, streamFileName);
+
+  if(outputFileName.size() && !writeJSON(outputFileName, bench.results))
+  {
+    logger(LOG_ERROR) << "voxel-bench: Could not write results to '" << outputFileName << "'" << std::endl;
+    return -1;
+  }
+
+  if(bench.failures)
+  {
+    logger(LOG_ERROR) << "voxel-bench: " << bench.failures << " benchmark(s) failed to run" << std::endl;
+    return -1;
+  }
+
+  if(baselineFileName.size() && compareWithBaseline(baselineFileName, bench.results, tolerance))
+    return -1;
+
+  return 0;
+}
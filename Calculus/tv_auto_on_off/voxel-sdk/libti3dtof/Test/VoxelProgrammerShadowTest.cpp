@@ -0,0 +1,195 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#include "Common.h"
+#include "Logger.h"
+#include "Parameter.h"
+#include <VoxelProgrammerBase.h>
+
+#include <iostream>
+
+using namespace Voxel;
+using namespace Voxel::TI;
+
+// Keeps registers in memory and counts the transfers which would have gone to the device
+class MockVoxelProgrammer: public VoxelProgrammerBase
+{
+protected:
+  virtual bool _readRegister(uint16_t slaveAddress, uint16_t registerAddress, uint32_t &value, uint8_t length) const
+  {
+    reads++;
+    value = registers[(slaveAddress << 8) | registerAddress];
+    return true;
+  }
+  
+  virtual bool _writeRegister(uint16_t slaveAddress, uint16_t registerAddress, uint32_t value, uint8_t length)
+  {
+    writes++;
+    registers[(slaveAddress << 8) | registerAddress] = value;
+    writeLog.push_back((slaveAddress << 8) | registerAddress);
+    return true;
+  }
+  
+public:
+  mutable Map<uint32_t, uint32_t> registers;
+  mutable SizeType reads = 0;
+  SizeType writes = 0;
+  Vector<uint32_t> writeLog;
+  
+  MockVoxelProgrammer(): VoxelProgrammerBase({{0x58, 3}, {0x5C, 3}}, nullptr) {}
+  
+  virtual bool isInitialized() const { return true; }
+  virtual bool reset() { invalidateShadow(); return true; }
+  
+  inline void resetCounts() { reads = writes = 0; writeLog.clear(); }
+  
+  virtual ~MockVoxelProgrammer() {}
+};
+
+#define CHECK(condition, message) \
+  if(!(condition)) \
+  { \
+    std::cerr << "FAIL: " << message << " (reads = " << programmer.reads << ", writes = " << programmer.writes << ")" << std::endl; \
+    failures++; \
+  }
+
+int main(int argc, char *argv[])
+{
+  logger.setDefaultLogLevel(LOG_ERROR);
+  
+  MockVoxelProgrammer programmer;
+  
+  int failures = 0;
+  uint32_t value;
+  uint s;
+  
+  programmer.registers[0x5800] = 0x123456;
+  programmer.registers[0x5801] = 0xFF0000;
+  
+  UnsignedIntegerParameter low(programmer, "low", "", 0x5801, 24, 7, 0, 0, 255, 0, "", "");
+  UnsignedIntegerParameter mid(programmer, "mid", "", 0x5801, 24, 15, 8, 0, 255, 0, "", "");
+  UnsignedIntegerParameter status(programmer, "status", "", 0x5802, 24, 7, 0, 0, 255, 0, "", "", Parameter::IO_READ_ONLY);
+  StrobeBoolParameter strobe(programmer, "strobe", 0x5803, 24, 0, {"", ""}, {"", ""}, false, "", "");
+  
+  // Raw register reads always go to the device, as nothing is known about the register
+  for(auto i = 0; i < 10; i++)
+    programmer.readRegister(0x5800, value);
+  
+  CHECK(value == 0x123456 && programmer.reads == 10, "repeated register reads");
+  
+  // Writes go through
+  programmer.resetCounts();
+  programmer.writeRegister(0x5800, 0x654321);
+  programmer.readRegister(0x5800, value);
+  
+  CHECK(value == 0x654321 && programmer.registers[0x5800] == 0x654321 && programmer.reads == 1 && programmer.writes == 1, "write through");
+  
+  // Read-modify-write of a parameter reads the device only on first access
+  programmer.resetCounts();
+  low.set(0x11);
+  low.set(0x22);
+  mid.set(0x33);
+  
+  CHECK(programmer.reads == 1 && programmer.writes == 3 && programmer.registers[0x5801] == 0xFF3322, "parameter read-modify-write");
+  
+  // Repeated parameter reads are served from the shadow
+  programmer.resetCounts();
+  
+  for(auto i = 0; i < 10; i++)
+    low.get(s, true);
+  
+  CHECK(s == 0x22 && programmer.reads == 0, "repeated parameter reads");
+  
+  // Batch coalesces writes to a register, merging fields of different parameters, in the order of first write
+  programmer.resetCounts();
+  programmer.beginBatch();
+  low.set(0x44);
+  programmer.writeRegister(0x5C10, 1);
+  mid.set(0x55);
+  low.set(0x66);
+  programmer.writeRegister(0x5C10, 2);
+  
+  CHECK(programmer.writes == 0, "writes held back in batch");
+  
+  CHECK(programmer.readRegister(0x5801, value) && value == 0xFF5566 && programmer.reads == 0, "read of pending value in batch");
+  
+  programmer.beginBatch(); // nested
+  programmer.writeRegister(0x5C11, 3);
+  programmer.commit();
+  
+  CHECK(programmer.writes == 0, "nested commit writes nothing");
+  
+  programmer.commit();
+  
+  CHECK(programmer.writes == 3 && programmer.writeLog == Vector<uint32_t>({0x5801, 0x5C10, 0x5C11}) &&
+    programmer.registers[0x5801] == 0xFF5566 && programmer.registers[0x5C10] == 2 && programmer.registers[0x5C11] == 3, "batch commit");
+  
+  CHECK(!programmer.commit(), "commit without batch");
+  
+  // Registers already holding the value are not written on commit
+  programmer.resetCounts();
+  programmer.beginBatch();
+  low.set(0x66);
+  programmer.writeRegister(0x5C10, 2);
+  programmer.writeRegister(0x5800, 0x654321);
+  programmer.commit();
+  
+  CHECK(programmer.writes == 0, "unchanged registers skipped on commit");
+  
+  // Read-only and strobe parameters always go to the device
+  programmer.resetCounts();
+  bool b;
+  
+  for(auto i = 0; i < 3; i++)
+  {
+    programmer.registers[0x5802] = i;
+    status.get(s, true);
+    strobe.get(b);
+  }
+  
+  CHECK(s == 2 && programmer.reads == 6, "volatile registers");
+  
+  // Writes to volatile registers in a batch are not held back, and keep their order with respect to other writes
+  programmer.resetCounts();
+  programmer.beginBatch();
+  programmer.writeRegister(0x5C10, 4);
+  strobe.set(true);
+  programmer.writeRegister(0x5C10, 5);
+  programmer.commit();
+  
+  CHECK(programmer.writeLog == Vector<uint32_t>({0x5C10, 0x5803, 0x5C10}) && programmer.registers[0x5C10] == 5, "volatile write in batch");
+  
+  // Device changing registers on its own is seen by raw reads, which also refresh the shadow
+  programmer.registers[0x5801] = 0xFF7766;
+  programmer.resetCounts();
+  programmer.readRegister(0x5801, value);
+  low.get(s, true);
+  
+  CHECK(value == 0xFF7766 && s == 0x66 && programmer.reads == 1, "raw read of changed register");
+  
+  programmer.registers[0x5801] = 0xFF8877;
+  programmer.reset();
+  programmer.resetCounts();
+  low.get(s, true);
+  
+  CHECK(s == 0x77 && programmer.reads == 1, "shadow invalidation");
+  
+  programmer.setShadowEnabled(false);
+  programmer.resetCounts();
+  low.get(s, true);
+  low.get(s, true);
+  
+  CHECK(programmer.reads == 2, "shadow disabled");
+  
+  if(failures)
+  {
+    std::cerr << failures << " test(s) failed" << std::endl;
+    return -1;
+  }
+  
+  std::cout << "All tests passed" << std::endl;
+  return 0;
+}
@@ -17,6 +17,7 @@
 #include <string.h>
 
 #include <fstream>
+#include <iomanip>
 
 using namespace LineNoise;
 
@@ -45,6 +46,7 @@ CLIManager::CLIManager(CameraSystem &sys): _sys(sys)
     {"addfilter",      Command(_H(&CLIManager::_addFilterHelp),     _P(&CLIManager::_addFilter),     _C(&CLIManager::_addFilterCompletion))},
     {"removefilter",   Command(_H(&CLIManager::_removeFilterHelp),  _P(&CLIManager::_removeFilter),  _C(&CLIManager::_removeFilterCompletion))},
     {"setfilterparam", Command(_H(&CLIManager::_setFilterParamHelp),_P(&CLIManager::_setFilterParam),_C(&CLIManager::_setFilterParamCompletion))},
+    {"stats",          Command(_H(&CLIManager::_statsHelp),         _P(&CLIManager::_stats),         nullptr)},
   });
   
   _specialParameters = Map<String, Command>({
@@ -246,6 +248,8 @@ void CLIManager::_saveHelp()          { std::cout << "save type count filename
                                                   <<  "\t\t\t  'type' = raw/raw_processed/depth/pointcloud" << std::endl; }
 void CLIManager::_disconnectHelp()    { std::cout << "disconnect\t\t  Disconnect the currently connected depth camera" << std::endl; }
 void CLIManager::_resetHelp()         { std::cout << "reset\t\t\t  Reset and disconnect the currently connected depth camera" << std::endl; }
+void CLIManager::_statsHelp()         { std::cout << "stats [on/off/reset]\t  Show per-stage frame counters and latencies (in us) of the current depth camera.\n"
+                                                  << "\t\t\t  Latencies are recorded only after 'stats on'" << std::endl; }
 
 
 void CLIManager::_help(const Vector<String> &tokens)
@@ -1119,7 +1123,7 @@ void CLIManager::_save(const Vector<String> &tokens)
       _saveFile.write((char *)&d->id, sizeof(d->id));
       _saveFile.write((char *)&d->timestamp, sizeof(d->timestamp));
       
-      _saveFile.write((char *)d->data.data(), d->data.size());
+      _saveFile.write((const char *)d->rawData(), d->rawDataSize());
       
       _currentCount++;
       
@@ -1960,7 +1964,73 @@ void CLIManager::_setFilterParamCompletion(const Vector<String> &tokens, linenoi
   }
 }
 
-
-
+void CLIManager::_stats(const Vector<String> &tokens)
+{
+  if(!_currentDepthCamera)
+  {
+    logger(LOG_ERROR) << "No depth camera is current connected" << std::endl;
+    return;
+  }
+  
+  if(tokens.size() == 2)
+  {
+    if(tokens[1] == "on")
+      _currentDepthCamera->enableStatistics(true);
+    else if(tokens[1] == "off")
+      _currentDepthCamera->enableStatistics(false);
+    else if(tokens[1] == "reset")
+      _currentDepthCamera->resetStatistics();
+    else
+    {
+      logger(LOG_ERROR) << "Unknown option '" << tokens[1] << "'. Expected on/off/reset" << std::endl;
+      _statsHelp();
+    }
+    return;
+  }
+  else if(tokens.size() > 2)
+  {
+    _statsHelp();
+    return;
+  }
   
-}
\ No newline at end of file
+  DepthCameraStatistics stats;
+  
+  if(!_currentDepthCamera->getStatistics(stats))
+  {
+    logger(LOG_ERROR) << "Failed to get statistics of " << _currentDepthCamera->id() << std::endl;
+    return;
+  }
+  
+  std::cout << "Statistics are " << (_currentDepthCamera->isStatisticsEnabled()?"on":"off") << std::endl;
+  std::cout << "Frames: captured = " << stats.framesCaptured << ", dropped = " << stats.framesDropped
+    << ", failed = " << stats.framesFailed << std::endl;
+  
+  std::cout << std::left << std::setw(40) << "stage" << std::right
+    << std::setw(10) << "count" << std::setw(10) << "avg" << std::setw(10) << "p50"
+    << std::setw(10) << "p99" << std::setw(10) << "max" << std::endl;
+  
+  for(auto &s: stats.stages)
+  {
+    if(!s.count)
+      continue;
+    
+    std::cout << std::left << std::setw(40) << s.name << std::right
+      << std::setw(10) << s.count << std::setw(10) << s.average() << std::setw(10) << s.p50
+      << std::setw(10) << s.p99 << std::setw(10) << s.max << std::endl;
+  }
+  
+  std::cout << std::left << std::setw(40) << "pipeline stage" << std::right
+    << std::setw(10) << "frames" << std::setw(10) << "dropped" << std::setw(10) << "failed"
+    << std::setw(10) << "queue" << std::setw(10) << "max" << std::endl;
+  
+  for(auto i = 0; i < stats.pipelineStages.size(); i++)
+  {
+    auto &s = stats.pipelineStages[i];
+    
+    std::cout << std::left << std::setw(40) << stats.stages[i].name << std::right
+      << std::setw(10) << s.frameCount << std::setw(10) << s.dropCount << std::setw(10) << s.errorCount
+      << std::setw(10) << s.queueDepth << std::setw(10) << s.maxQueueDepth << std::endl;
+  }
+}
+
+}
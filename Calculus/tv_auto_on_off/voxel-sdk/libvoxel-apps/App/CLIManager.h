@@ -144,6 +144,9 @@ protected:
   void _setFilterParamCompletion(const Vector<String> &tokens, linenoiseCompletions *lc);
   void _setFilterParamHelp();
   
+  void _stats(const Vector<String> &tokens);
+  void _statsHelp();
+  
 public:
   CLIManager(CameraSystem &sys);
   
@@ -5,6 +5,7 @@
  */
 #include <cstdlib>
 #include <deque>
+#include <mutex>
 #include <CameraSystem.h>
 #include <Common.h>
 #include <unistd.h>
@@ -22,8 +23,10 @@ using namespace pcl::visualization;
 #define FIFO_SIZE	(3)
 #define DELAY_COUNT	(250)
 
-deque < DepthFrame > qFrame;
-DepthFrame *frm;
+// Frames are shared with the camera's buffer pool, so queueing them does not copy them
+deque < Ptr<const DepthFrame> > qFrame;
+mutex qFrameMutex;
+Ptr<const DepthFrame> frm;
 DepthFrame *frmbuf;
 DepthFrame *frmbknd;
 
@@ -54,13 +57,17 @@ int getkey() {
 }
 
 
-void frameCallback(DepthCamera &dc, const Frame &frame, 
+void frameCallback(DepthCamera &dc, const ConstFramePtr &frame, 
                    DepthCamera::FrameType c)
 {
+   lock_guard<mutex> lock(qFrameMutex);
+
    if (qFrame.size() < FIFO_SIZE) 
    {
-      const DepthFrame* f = dynamic_cast< const DepthFrame* > (&frame);
-      qFrame.push_back(*f);
+      Ptr<const DepthFrame> f = dynamic_pointer_cast<const DepthFrame>(frame);
+
+      if (f)
+         qFrame.push_back(f);
    }
 }
 
@@ -77,7 +84,7 @@ DepthFrame *InitDepthFrame(DepthFrame *f, int x_sz, int y_sz)
 }
 
 
-DepthFrame *iirFilter(DepthFrame *f, float coef)
+DepthFrame *iirFilter(const DepthFrame *f, float coef)
 {
    for (int i = 0; i < f->size.width * f->size.height; i++) 
    {
@@ -150,7 +157,7 @@ int main (int argc, char* argv[])
   frmbuf = InitDepthFrame(new DepthFrame(), XDIM, YDIM);
   frmbknd = InitDepthFrame(new DepthFrame(), XDIM, YDIM);
 
-  depthCamera->registerCallback(DepthCamera::FRAME_DEPTH_FRAME, frameCallback);
+  depthCamera->registerSharedCallback(DepthCamera::FRAME_DEPTH_FRAME, frameCallback);
 
   iv = new pcl::visualization::ImageViewer("Depth");
   iv->setSize(320, 240); 
@@ -169,11 +176,21 @@ int main (int argc, char* argv[])
       int key = getkey();
       if (key == 'q') done = true;
 
-      if (!qFrame.empty()) {
+      frm = nullptr;
+
+      {
+         lock_guard<mutex> lock(qFrameMutex);
+
+         if (!qFrame.empty()) {
+            frm = qFrame.front();
+            qFrame.pop_front();
+         }
+      }
+
+      if (frm) {
 
-         frm = &qFrame.front(); 
          int index = YDIM*(XDIM/2)+YDIM/2;
-         iirFilter(frm, 0.1f);
+         iirFilter(frm.get(), 0.1f);
          cout << frmbuf->depth.data()[index] << endl;
 
          unsigned char *rgb = FloatImageUtils::getVisualImage(
@@ -192,8 +209,6 @@ int main (int argc, char* argv[])
          }
          else 
             count++; 
-
-         qFrame.pop_front();
       }
 
       if (background_init) {
@@ -219,5 +234,9 @@ int main (int argc, char* argv[])
 
   delete iv;
   depthCamera->stop();
+
+  // Shared frames need to go back to the camera before it is destroyed
+  frm = nullptr;
+  qFrame.clear();
   return 0;
 }
@@ -0,0 +1,206 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#include "SimpleOpt.h"
+#include "Common.h"
+#include "Logger.h"
+#include "Timer.h"
+#include "CameraSystem.h"
+
+#include <random>
+#include <iomanip>
+
+using namespace Voxel;
+
+enum Options
+{
+  ITERATIONS = 0,
+  SIGMA = 1
+};
+
+Vector<CSimpleOpt::SOption> argumentSpecifications =
+{
+  { ITERATIONS, "-n", SO_REQ_SEP, "Number of frames to filter per measurement [default = 20]"},
+  { SIGMA,      "-s", SO_REQ_SEP, "Sigma of the filter [default = 0.5]"},
+  SO_END_OF_OPTIONS
+};
+
+void help()
+{
+  std::cout << "BilateralFilterBenchmark v1.0" << std::endl;
+
+  CSimpleOpt::SOption *option = argumentSpecifications.data();
+
+  while(option->nId >= 0)
+  {
+    std::cout << option->pszArg << " " << option->helpInfo << std::endl;
+    option++;
+  }
+}
+
+// Smooth surface with steps and noise, similar to a depth scene
+FramePtr makeDepthFrame(int width, int height, std::mt19937 &rng)
+{
+  DepthFrame *d = new DepthFrame();
+  d->size.width = width;
+  d->size.height = height;
+  d->depth.resize(width*height);
+  d->amplitude.resize(width*height);
+
+  std::normal_distribution<float> noise(0, 0.01f);
+
+  for(auto j = 0; j < height; j++)
+    for(auto i = 0; i < width; i++)
+    {
+      d->depth[j*width + i] = 1.0f + ((i > width/2)?0.5f:0.0f) + 0.001f*j + noise(rng);
+      d->amplitude[j*width + i] = 4.0f*(1.0f + noise(rng)*10);
+    }
+
+  return FramePtr(d);
+}
+
+FramePtr makeToFFrame(int width, int height, std::mt19937 &rng)
+{
+  ToFRawFrameTemplate<uint16_t, uint8_t> *t = new ToFRawFrameTemplate<uint16_t, uint8_t>();
+  t->size.width = width;
+  t->size.height = height;
+  t->_phase.resize(width*height);
+  t->_amplitude.resize(width*height);
+  t->_ambient.resize(width*height);
+  t->_flags.resize(width*height);
+
+  std::uniform_int_distribution<int> noise(-3, 3);
+
+  for(auto j = 0; j < height; j++)
+    for(auto i = 0; i < width; i++)
+    {
+      t->_phase[j*width + i] = 1000 + ((i > width/2)?400:0) + j + noise(rng);
+      t->_amplitude[j*width + i] = 200 + noise(rng);
+    }
+
+  return FramePtr(t);
+}
+
+// Returns time per frame in micro-seconds
+float run(const FilterPtr &filter, const FramePtr &in, FramePtr &out, int iterations)
+{
+  Timer t;
+
+  filter->filter(in, out); // Warm up and allocate output
+
+  TimeStampType start = t.getCurentRealTime();
+
+  for(auto i = 0; i < iterations; i++)
+    filter->filter(in, out);
+
+  return (float)(t.getCurentRealTime() - start)/iterations;
+}
+
+float maxDifference(const FramePtr &a, const FramePtr &b)
+{
+  DepthFrame *d1 = dynamic_cast<DepthFrame *>(a.get()), *d2 = dynamic_cast<DepthFrame *>(b.get());
+  ToFRawFrameTemplate<uint16_t, uint8_t> *t1 = dynamic_cast<ToFRawFrameTemplate<uint16_t, uint8_t> *>(a.get()),
+    *t2 = dynamic_cast<ToFRawFrameTemplate<uint16_t, uint8_t> *>(b.get());
+
+  float m = 0;
+
+  if(d1 && d2)
+  {
+    for(auto i = 0; i < d1->depth.size(); i++)
+      m = std::max(m, fabsf(d1->depth[i] - d2->depth[i]));
+  }
+  else if(t1 && t2)
+  {
+    for(auto i = 0; i < t1->_phase.size(); i++)
+      m = std::max(m, fabsf((float)t1->_phase[i] - t2->_phase[i]));
+  }
+  else
+    m = -1;
+
+  return m;
+}
+
+int main(int argc, char *argv[])
+{
+  CSimpleOpt s(argc, argv, argumentSpecifications);
+
+  int iterations = 20;
+  float sigma = 0.5f;
+
+  while (s.Next())
+  {
+    if (s.LastError() != SO_SUCCESS)
+    {
+      std::cout << s.GetLastErrorText(s.LastError()) << ": '" << s.OptionText() << "' (-h for help)" << std::endl;
+      return -1;
+    }
+
+    switch (s.OptionId())
+    {
+      case ITERATIONS:
+        iterations = atoi(s.OptionArg());
+        break;
+
+      case SIGMA:
+        sigma = atof(s.OptionArg());
+        break;
+
+      default:
+        help();
+        return -1;
+    };
+  }
+
+  CameraSystem sys;
+
+  FilterPtr reference = sys.createFilter("Voxel::BilateralFilter", DepthCamera::FRAME_DEPTH_FRAME);
+  FilterPtr fast = sys.createFilter("Voxel::BilateralFilter", DepthCamera::FRAME_DEPTH_FRAME);
+
+  if(!reference || !fast || !reference->set("sigma", sigma) || !fast->set("sigma", sigma) ||
+    !reference->set("fast", false) || !fast->set("fast", true))
+  {
+    logger(LOG_ERROR) << "Could not create and configure BilateralFilter" << std::endl;
+    return -1;
+  }
+
+  struct { const char *name; int width, height; } sizes[] = { {"QVGA", 320, 240}, {"VGA", 640, 480} };
+
+  std::mt19937 rng(42);
+
+  bool mismatch = false;
+
+  std::cout << std::fixed << std::setprecision(1);
+
+  for(auto &sz: sizes)
+  {
+    FramePtr inputs[2] = { makeDepthFrame(sz.width, sz.height, rng), makeToFFrame(sz.width, sz.height, rng) };
+    const char *frameNames[2] = { "depth", "ToF phase" };
+
+    for(auto k = 0; k < 2; k++)
+    {
+      FramePtr out1, out2;
+
+      float t1 = run(reference, inputs[k], out1, iterations);
+      float t2 = run(fast, inputs[k], out2, iterations);
+      float diff = maxDifference(out1, out2);
+
+      std::cout << sz.name << " " << frameNames[k] << ": reference = " << t1 << " us/frame, fast = " << t2
+        << " us/frame, speed up = " << std::setprecision(2) << t1/t2 << "x, max difference = "
+        << diff << std::setprecision(1) << std::endl;
+
+      if(diff != 0)
+        mismatch = true;
+    }
+  }
+
+  if(mismatch)
+  {
+    logger(LOG_ERROR) << "Fast and reference outputs differ" << std::endl;
+    return -1;
+  }
+
+  return 0;
+}
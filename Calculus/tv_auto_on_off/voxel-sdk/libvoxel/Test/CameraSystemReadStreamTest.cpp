@@ -114,7 +114,7 @@ int main(int argc, char *argv[])
     }
     
     std::cout << rawFrame->id << "@" << rawFrame->timestamp << std::endl;
-    std::cout << "Raw data frame size = " << rawFrame->data.size() << " bytes" << std::endl;
+    std::cout << "Raw data frame size = " << rawFrame->rawDataSize() << " bytes" << std::endl;
     std::cout << "ToF frame size = " << tofFrame->size.width << "x" << tofFrame->size.height << std::endl;
     std::cout << "Depth frame size = " << depthFrame->size.width << "x" << depthFrame->size.height << std::endl;
     std::cout << "Point cloud frame points = " << pointCloudFrame->size() << std::endl;
@@ -0,0 +1,167 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#include "Common.h"
+#include "Logger.h"
+#include "Configuration.h"
+
+#include <iostream>
+#include <fstream>
+#include <stdio.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+using namespace Voxel;
+
+#define MAIN_FILE "ConfigurationCacheTest.conf"
+#define PROFILE_FILE "ConfigurationCacheTestProfile.conf"
+
+// Exposes the cache file functions
+class TestConfigurationFile: public ConfigurationFile
+{
+public:
+  using ConfigurationFile::_readCache;
+};
+
+bool writeFile(const String &name, const String &contents)
+{
+  OutputFileStream f(name, std::ios::binary | std::ios::out | std::ios::trunc);
+  f << contents;
+  return f.good();
+}
+
+// As in ConfigurationFile
+bool getFileInfo(const String &name, uint64_t &size, int64_t &time)
+{
+#ifdef WINDOWS
+  struct _stat64 s;
+  
+  if(_stat64(name.c_str(), &s) != 0)
+    return false;
+  
+  time = (int64_t)s.st_mtime;
+#else
+  struct stat s;
+  
+  if(stat(name.c_str(), &s) != 0)
+    return false;
+  
+  time = (int64_t)s.st_mtim.tv_sec*1000000000LL + s.st_mtim.tv_nsec;
+#endif
+  size = (uint64_t)s.st_size;
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  logger.setDefaultLogLevel(LOG_ERROR);
+  
+  Configuration::addConfPath(".");
+  
+  int failures = 0;
+  
+  remove(MAIN_FILE CONFIGURATION_CACHE_SUFFIX);
+  remove(PROFILE_FILE CONFIGURATION_CACHE_SUFFIX);
+  
+  if(!writeFile(MAIN_FILE, "[core]\ndml = a.dml\n\n[camera_profiles]\ndefault = Normal\nNormal = " PROFILE_FILE "\n") ||
+    !writeFile(PROFILE_FILE, "# Profile\n[calib]\nfx = 1.5\ncx = 80\nfx = 2.5\n\n[params]\n0x5801 = 0x12\n"))
+  {
+    std::cerr << "FAIL: could not write configuration files" << std::endl;
+    return -1;
+  }
+  
+  // Parsed and written to cache
+  ConfigurationFile parsed;
+  
+  if(!parsed.read(PROFILE_FILE) || parsed.getFloat("calib", "fx") != 2.5f || parsed.getInteger("calib", "cx") != 80 ||
+    parsed.get("params", "0x5801") != "0x12" || parsed.configs["calib"].paramNames.size() != 3)
+  {
+    std::cerr << "FAIL: parse" << std::endl;
+    failures++;
+  }
+  
+  // Cache file holds the same contents, and is valid only for the file it was made from
+  uint64_t size;
+  int64_t time;
+  TestConfigurationFile cached;
+  
+  if(!getFileInfo(PROFILE_FILE, size, time) || !cached._readCache(PROFILE_FILE CONFIGURATION_CACHE_SUFFIX, size, time) ||
+    cached.hash() != parsed.hash() || cached.configs["calib"].paramNames != parsed.configs["calib"].paramNames)
+  {
+    std::cerr << "FAIL: cache file" << std::endl;
+    failures++;
+  }
+  
+  if(cached._readCache(PROFILE_FILE CONFIGURATION_CACHE_SUFFIX, size + 1, time))
+  {
+    std::cerr << "FAIL: stale cache file accepted" << std::endl;
+    failures++;
+  }
+  
+  // Changed file is parsed again
+  writeFile(PROFILE_FILE, "[calib]\nfx = 3.5\n");
+  
+  ConfigurationFile changed;
+  
+  if(!changed.read(PROFILE_FILE) || changed.getFloat("calib", "fx") != 3.5f || changed.isPresent("params", "0x5801") ||
+    changed.hash() == parsed.hash())
+  {
+    std::cerr << "FAIL: changed file" << std::endl;
+    failures++;
+  }
+  
+  // Corrupt cache file is ignored
+  {
+    std::fstream f(PROFILE_FILE CONFIGURATION_CACHE_SUFFIX, std::ios::binary | std::ios::in | std::ios::out);
+    f.seekp(-1, std::ios::end);
+    f.put('X');
+  }
+  
+  ConfigurationFile::setCacheEnabled(false); // clears files cached in memory
+  ConfigurationFile::setCacheEnabled(true);
+  
+  ConfigurationFile corrupt;
+  
+  if(!corrupt.read(PROFILE_FILE) || corrupt.hash() != changed.hash())
+  {
+    std::cerr << "FAIL: corrupt cache file" << std::endl;
+    failures++;
+  }
+  
+  // Profile switch changes revision
+  MainConfigurationFile main;
+  
+  uint32_t revision = main.getRevision();
+  
+  if(!main.read(MAIN_FILE) || main.getRevision() == revision || main.getFloat("calib", "fx") != 3.5f)
+  {
+    std::cerr << "FAIL: main configuration" << std::endl;
+    failures++;
+  }
+  
+  revision = main.getRevision();
+  
+  if(!main.setCurrentCameraProfile("Normal") || main.getRevision() == revision)
+  {
+    std::cerr << "FAIL: revision on profile change" << std::endl;
+    failures++;
+  }
+  
+  remove(MAIN_FILE);
+  remove(PROFILE_FILE);
+  remove(MAIN_FILE CONFIGURATION_CACHE_SUFFIX);
+  remove(PROFILE_FILE CONFIGURATION_CACHE_SUFFIX);
+  
+  if(failures)
+  {
+    std::cerr << failures << " test(s) failed" << std::endl;
+    return -1;
+  }
+  
+  std::cout << "All tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#include "SimpleOpt.h"
+#include "Common.h"
+#include "Logger.h"
+#include "Timer.h"
+#include "ParameterDMLParser.h"
+
+#include <iostream>
+#include <sstream>
+#include <typeinfo>
+#include <stdio.h>
+
+using namespace Voxel;
+
+class DummyRegisterProgrammer: public RegisterProgrammer
+{
+  virtual bool getValue(const Parameter &param, uint32_t &value) const { return false; }
+  virtual bool isInitialized() const { return false; }
+  virtual bool readRegister(uint32_t address, uint32_t &value) const { return false; }
+  virtual bool reset() { return false; }
+  virtual bool setValue(const Parameter &param, uint32_t value) { return false; }
+  virtual bool writeRegister(uint32_t address, uint32_t value) { return false; }
+};
+
+enum Options
+{
+  XML_FILE = 0,
+  ITERATIONS = 1
+};
+
+Vector<CSimpleOpt::SOption> argumentSpecifications = 
+{
+  { XML_FILE,   "-x", SO_REQ_SEP, "DML file name"},
+  { ITERATIONS, "-n", SO_REQ_SEP, "Number of loads per measurement [default = 10]"},
+  SO_END_OF_OPTIONS
+};
+
+void help()
+{
+  std::cout << "DMLLoadBenchmark v1.0" << std::endl;
+  
+  CSimpleOpt::SOption *option = argumentSpecifications.data();
+  
+  while(option->nId >= 0)
+  {
+    std::cout << option->pszArg << " " << option->helpInfo << std::endl;
+    option++;
+  }
+}
+
+// Everything about a parameter which comes from the DML
+String describe(const ParameterPtr &p)
+{
+  std::ostringstream s;
+  
+  s << typeid(*p).name() << " " << p->name() << " " << p->address() << " " << (int)p->msb() << " " << (int)p->lsb() << " " << p->mask() 
+    << " " << p->ioType() << " " << p->description();
+  
+  if(BoolParameter *b = dynamic_cast<BoolParameter *>(p.get()))
+  {
+    bool v;
+    b->get(v, false);
+    s << " " << v;
+    
+    for(auto i = 0; i < 2; i++)
+      s << " " << b->valueMeaning()[i] << "/" << b->valueDescription()[i];
+  }
+  else if(EnumParameter *e = dynamic_cast<EnumParameter *>(p.get()))
+  {
+    int v;
+    e->get(v, false);
+    s << " " << v;
+    
+    for(auto i = 0; i < e->allowedValues().size(); i++)
+      s << " " << e->allowedValues()[i] << ":" << e->valueMeaning()[i] << "/" << e->valueDescription()[i];
+  }
+  else if(IntegerParameter *i = dynamic_cast<IntegerParameter *>(p.get()))
+  {
+    int v;
+    i->get(v, false);
+    s << " " << v << " " << i->lowerLimit() << " " << i->upperLimit() << " " << i->unit();
+  }
+  else if(UnsignedIntegerParameter *u = dynamic_cast<UnsignedIntegerParameter *>(p.get()))
+  {
+    uint v;
+    u->get(v, false);
+    s << " " << v << " " << u->lowerLimit() << " " << u->upperLimit() << " " << u->unit();
+  }
+  
+  return s.str();
+}
+
+// Loads parameters 'iterations' times and returns the average time per load in micro-seconds
+bool load(RegisterProgrammer &r, const String &xmlFile, int iterations, bool fromCache, Vector<ParameterPtr> &params, TimeStampType &time)
+{
+  Timer timer;
+  TimeStampType start = timer.getCurentRealTime();
+  
+  for(auto i = 0; i < iterations; i++)
+  {
+    ParameterDMLParser p(r, xmlFile);
+    
+    params.clear();
+    
+    if(!p.getParameters(params) || p.isFromCache() != fromCache)
+    {
+      logger(LOG_ERROR) << "Failed to load parameters" << (fromCache?" from cache":"") << std::endl;
+      return false;
+    }
+  }
+  
+  time = (timer.getCurentRealTime() - start)/iterations;
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  CSimpleOpt s(argc, argv, argumentSpecifications);
+  
+  logger.setDefaultLogLevel(LOG_ERROR);
+  
+  String xmlFile;
+  int iterations = 10;
+  
+  while (s.Next())
+  {
+    if (s.LastError() != SO_SUCCESS)
+    {
+      std::cout << s.GetLastErrorText(s.LastError()) << ": '" << s.OptionText() << "' (use -h to get command line help)" << std::endl;
+      help();
+      return -1;
+    }
+    
+    switch (s.OptionId())
+    {
+      case XML_FILE:
+        xmlFile = s.OptionArg();
+        break;
+        
+      case ITERATIONS:
+        iterations = atoi(s.OptionArg());
+        break;
+        
+      default:
+        help();
+        break;
+    };
+  }
+  
+  if(xmlFile.size() == 0 || iterations < 1)
+  {
+    logger(LOG_ERROR) << "Required argument missing." << std::endl;
+    help();
+    return -1;
+  }
+  
+  DummyRegisterProgrammer r;
+  
+  Vector<ParameterPtr> fromXML, fromCache;
+  TimeStampType xmlTime, cacheTime;
+  
+  ParameterDMLParser::setCacheEnabled(false);
+  
+  if(!load(r, xmlFile, iterations, false, fromXML, xmlTime))
+    return -1;
+  
+  // Writes the cache
+  ParameterDMLParser::setCacheEnabled(true);
+  remove((xmlFile + PARAMETER_DML_CACHE_SUFFIX).c_str());
+  
+  {
+    ParameterDMLParser p(r, xmlFile);
+    Vector<ParameterPtr> params;
+    
+    if(!p.getParameters(params) || p.isFromCache())
+    {
+      logger(LOG_ERROR) << "Failed to load parameters to write cache" << std::endl;
+      return -1;
+    }
+  }
+  
+  if(!load(r, xmlFile, iterations, true, fromCache, cacheTime))
+    return -1;
+  
+  if(fromXML.size() != fromCache.size())
+  {
+    logger(LOG_ERROR) << "Got " << fromCache.size() << " parameters from cache but " << fromXML.size() << " from DML" << std::endl;
+    return -1;
+  }
+  
+  for(auto i = 0; i < fromXML.size(); i++)
+  {
+    if(describe(fromXML[i]) != describe(fromCache[i]))
+    {
+      logger(LOG_ERROR) << "Parameter " << i << " differs. From DML: '" << describe(fromXML[i]) << "', from cache: '" << describe(fromCache[i]) << "'" << std::endl;
+      return -1;
+    }
+  }
+  
+  std::cout << fromXML.size() << " parameters. DML: " << xmlTime << " us, cache: " << cacheTime << " us per load (" 
+    << (float)xmlTime/std::max<TimeStampType>(cacheTime, 1) << "x)" << std::endl;
+  
+  return 0;
+}
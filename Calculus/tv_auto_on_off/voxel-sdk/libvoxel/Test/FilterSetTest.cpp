@@ -0,0 +1,233 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#include "Common.h"
+#include "Logger.h"
+#include "Timer.h"
+#include "CameraSystem.h"
+
+#include <random>
+
+using namespace Voxel;
+
+typedef ToFRawFrameTemplate<uint16_t, uint8_t> ToFFrame;
+
+#define FRAME_COUNT 4
+
+FramePtr makeDepthFrame(int width, int height, std::mt19937 &rng)
+{
+  DepthFrame *d = new DepthFrame();
+  d->size.width = width;
+  d->size.height = height;
+  d->depth.resize(width*height);
+  d->amplitude.resize(width*height);
+
+  std::normal_distribution<float> noise(0, 0.01f);
+  std::uniform_real_distribution<float> amplitude(0, 1);
+
+  for(auto j = 0; j < height; j++)
+    for(auto i = 0; i < width; i++)
+    {
+      d->depth[j*width + i] = 1.0f + ((i > width/2)?0.5f:0.0f) + noise(rng);
+      d->amplitude[j*width + i] = amplitude(rng);
+    }
+
+  return FramePtr(d);
+}
+
+FramePtr makeToFFrame(int width, int height, std::mt19937 &rng)
+{
+  ToFFrame *t = new ToFFrame();
+  t->size.width = width;
+  t->size.height = height;
+  t->_phase.resize(width*height);
+  t->_amplitude.resize(width*height);
+  t->_ambient.resize(width*height);
+  t->_flags.resize(width*height);
+
+  std::uniform_int_distribution<int> noise(-4, 4), spike(0, 50), full(0, 4095), small(0, 15);
+
+  for(auto j = 0; j < height; j++)
+    for(auto i = 0; i < width; i++)
+    {
+      int v = 1000 + ((i > width/2)?1500:0) + j + noise(rng);
+      t->_phase[j*width + i] = spike(rng)?v:full(rng);
+      t->_amplitude[j*width + i] = small(rng);
+      t->_ambient[j*width + i] = small(rng);
+      t->_flags[j*width + i] = small(rng);
+    }
+
+  return FramePtr(t);
+}
+
+bool equal(const FramePtr &a, const FramePtr &b)
+{
+  DepthFrame *d1 = dynamic_cast<DepthFrame *>(a.get()), *d2 = dynamic_cast<DepthFrame *>(b.get());
+  ToFFrame *t1 = dynamic_cast<ToFFrame *>(a.get()), *t2 = dynamic_cast<ToFFrame *>(b.get());
+
+  if(d1 && d2)
+    return d1->size == d2->size && d1->depth == d2->depth && d1->amplitude == d2->amplitude;
+  else if(t1 && t2)
+    return t1->size == t2->size && t1->_phase == t2->_phase && t1->_amplitude == t2->_amplitude &&
+      t1->_ambient == t2->_ambient && t1->_flags == t2->_flags;
+  else
+    return false;
+}
+
+// Filter names, with half kernel size of MedianFilter as suffix
+typedef Vector<String> Chain;
+
+template <typename FrameType>
+bool makeFilterSet(CameraSystem &sys, const Chain &chain, DepthCamera::FrameType type, FilterSet<FrameType> &filterSet)
+{
+  for(auto &name: chain)
+  {
+    String filterName = name;
+    uint halfKernelSize = 0;
+
+    if(name.compare(0, 12, "MedianFilter") == 0 && name.size() > 12)
+    {
+      filterName = "MedianFilter";
+      halfKernelSize = atoi(name.c_str() + 12);
+    }
+
+    FilterPtr filter = sys.createFilter("Voxel::" + filterName, type);
+
+    if(!filter || (halfKernelSize && !filter->set("halfKernelSize", halfKernelSize)))
+    {
+      logger(LOG_ERROR) << "Could not create " << name << std::endl;
+      return false;
+    }
+
+    filterSet.addFilter(filter);
+  }
+  return true;
+}
+
+// Runs 'chain' on 'inputs' with a new set of filters, as filters keep state of previous frames
+template <typename FrameType>
+bool run(CameraSystem &sys, const Chain &chain, DepthCamera::FrameType type, SizeType bandBytes,
+         const Vector<FramePtr> &inputs, Vector<FramePtr> &outputs, TimeStampType &elapsed)
+{
+  FrameBufferManager<FrameType> buffers(1);
+  FilterSet<FrameType> filterSet(buffers);
+
+  if(!makeFilterSet(sys, chain, type, filterSet))
+    return false;
+
+  filterSet.setBandBytes(bandBytes);
+
+  Timer t;
+  elapsed = 0;
+  outputs.clear();
+
+  for(auto &in: inputs)
+  {
+    typename FilterSet<FrameType>::FrameSequence seq;
+
+    auto g = buffers.get();
+    *g = std::dynamic_pointer_cast<FrameType>(in);
+    seq.push_front(g);
+
+    TimeStampType start = t.getCurentRealTime();
+
+    if(!filterSet.applyFilter(seq))
+      return false;
+
+    elapsed += t.getCurentRealTime() - start;
+
+    outputs.push_back((**seq.begin())->copy());
+  }
+  return true;
+}
+
+template <typename FrameType>
+bool check(CameraSystem &sys, const Chain &chain, DepthCamera::FrameType type, const Vector<FramePtr> &inputs,
+           const String &description)
+{
+  Vector<FramePtr> expected, outputs;
+  TimeStampType referenceTime, fusedTime;
+
+  if(!run<FrameType>(sys, chain, type, 0, inputs, expected, referenceTime))
+  {
+    std::cerr << "FAIL: could not apply unfused filters on " << description << std::endl;
+    return false;
+  }
+
+  // Suggested band size and bands of a single row
+  for(auto bandBytes: { (SizeType)FILTER_SET_BAND_BYTES, (SizeType)1 })
+  {
+    if(!run<FrameType>(sys, chain, type, bandBytes, inputs, outputs, fusedTime))
+    {
+      std::cerr << "FAIL: could not apply fused filters on " << description << std::endl;
+      return false;
+    }
+
+    for(auto i = 0; i < inputs.size(); i++)
+    {
+      if(!equal(expected[i], outputs[i]))
+      {
+        std::cerr << "FAIL: " << description << ", band bytes = " << bandBytes << ", frame " << i
+          << ": fused output differs" << std::endl;
+        return false;
+      }
+    }
+
+    if(bandBytes == FILTER_SET_BAND_BYTES)
+      std::cout << description << ": fused = " << fusedTime/inputs.size() << " us, unfused = "
+        << referenceTime/inputs.size() << " us per frame" << std::endl;
+  }
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  CameraSystem sys;
+
+  // TemporalMedianFilter does not support bands and splits the chain into fused groups
+  Vector<Chain> chains = {
+    { "MedianFilter2", "BilateralFilter", "IIRFilter" },
+    { "IIRFilter", "SmoothFilter" },
+    { "SmoothFilter", "MedianFilter1", "TemporalMedianFilter", "MedianFilter3", "IIRFilter", "BilateralFilter" },
+  };
+
+  struct { int width, height; } sizes[] = { {320, 240}, {17, 9}, {3, 5}, {1, 1} };
+
+  std::mt19937 rng(2014);
+
+  int failures = 0;
+
+  for(auto &sz: sizes)
+  {
+    Vector<FramePtr> tofFrames, depthFrames;
+
+    for(auto i = 0; i < FRAME_COUNT; i++)
+    {
+      tofFrames.push_back(makeToFFrame(sz.width, sz.height, rng));
+      depthFrames.push_back(makeDepthFrame(sz.width, sz.height, rng));
+    }
+
+    for(auto c = 0; c < chains.size(); c++)
+    {
+      String description = std::to_string(sz.width) + "x" + std::to_string(sz.height) + " chain " + std::to_string(c);
+
+      if(!check<RawFrame>(sys, chains[c], DepthCamera::FRAME_RAW_FRAME_PROCESSED, tofFrames, description + " ToF"))
+        failures++;
+
+      if(!check<DepthFrame>(sys, chains[c], DepthCamera::FRAME_DEPTH_FRAME, depthFrames, description + " depth"))
+        failures++;
+    }
+  }
+
+  if(failures)
+  {
+    std::cerr << failures << " test(s) failed" << std::endl;
+    return -1;
+  }
+
+  std::cout << "All tests passed" << std::endl;
+  return 0;
+}
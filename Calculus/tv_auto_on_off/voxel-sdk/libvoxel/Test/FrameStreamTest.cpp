@@ -0,0 +1,519 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#include "Common.h"
+#include "Logger.h"
+#include "Timer.h"
+#include "CameraSystem.h"
+#include "FrameStream.h"
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+
+using namespace Voxel;
+
+#define TEST_PROCESSED_GENERATOR_ID 0x7F00
+#define TEST_DEPTH_GENERATOR_ID 0x7F01
+
+#define WIDTH 16
+#define HEIGHT 4
+#define FRAME_COUNT 1000
+#define CONFIG_CHANGE_AT 600 // frame from which the processed frames are twice as wide
+
+// Raw data is phase as uint16_t per pixel
+class TestProcessedGenerator: public FrameGenerator
+{
+protected:
+  FrameSize _size;
+
+  virtual bool _writeConfiguration(SerializedObject &object)
+  {
+    object.resize(_sizeOfVersion() + sizeof(_size));
+    return _writeVersion(object) && object.put((const char *)&_size, sizeof(_size)) == sizeof(_size);
+  }
+
+public:
+  TestProcessedGenerator(): FrameGenerator(TEST_PROCESSED_GENERATOR_ID, DepthCamera::FRAME_RAW_FRAME_PROCESSED, 0, 1)
+  {
+    _size.width = _size.height = 0;
+  }
+
+  inline void setSize(const FrameSize &s) { _size = s; }
+
+  virtual bool readConfiguration(SerializedObject &object)
+  {
+    return _readVersion(object) && object.get((char *)&_size, sizeof(_size)) == sizeof(_size);
+  }
+
+  virtual bool generate(const FramePtr &in, FramePtr &out)
+  {
+    const RawDataFrame *r = dynamic_cast<const RawDataFrame *>(in.get());
+
+    if(!r || r->rawDataSize() != _size.width*_size.height*sizeof(uint16_t))
+      return false;
+
+    ToFRawFrameTemplate<uint16_t, uint8_t> *t = dynamic_cast<ToFRawFrameTemplate<uint16_t, uint8_t> *>(out.get());
+
+    if(!t)
+    {
+      t = new ToFRawFrameTemplate<uint16_t, uint8_t>();
+      out = FramePtr(t);
+    }
+
+    t->id = r->id;
+    t->timestamp = r->timestamp;
+    t->size = _size;
+    t->_phase.resize(_size.width*_size.height);
+    t->_amplitude.assign(_size.width*_size.height, 1);
+    t->_ambient.assign(_size.width*_size.height, 0);
+    t->_flags.assign(_size.width*_size.height, 0);
+    memcpy(t->_phase.data(), r->rawData(), r->rawDataSize());
+    return true;
+  }
+};
+
+class TestDepthGenerator: public DepthFrameGenerator
+{
+protected:
+  virtual bool _writeConfiguration(SerializedObject &object)
+  {
+    object.resize(_sizeOfVersion());
+    return _writeVersion(object);
+  }
+
+public:
+  TestDepthGenerator(): DepthFrameGenerator(TEST_DEPTH_GENERATOR_ID, DepthCamera::FRAME_DEPTH_FRAME, 0, 1) {}
+
+  virtual bool setProcessedFrameGenerator(FrameGeneratorPtr &p) { return true; }
+
+  virtual bool readConfiguration(SerializedObject &object) { return _readVersion(object); }
+
+  virtual bool generate(const FramePtr &in, FramePtr &out)
+  {
+    const ToFRawFrameTemplate<uint16_t, uint8_t> *t = dynamic_cast<const ToFRawFrameTemplate<uint16_t, uint8_t> *>(in.get());
+
+    if(!t)
+      return false;
+
+    DepthFrame *d = dynamic_cast<DepthFrame *>(out.get());
+
+    if(!d)
+    {
+      d = new DepthFrame();
+      out = FramePtr(d);
+    }
+
+    d->id = t->id;
+    d->timestamp = t->timestamp;
+    d->size = t->size;
+    d->depth.resize(t->_phase.size());
+    d->amplitude.resize(t->_phase.size());
+
+    for(auto i = 0; i < t->_phase.size(); i++)
+    {
+      d->depth[i] = t->_phase[i]*0.001f;
+      d->amplitude[i] = t->_amplitude[i];
+    }
+    return true;
+  }
+};
+
+class TestFactory: public DepthCameraFactory
+{
+public:
+  TestFactory(): DepthCameraFactory("Test::Factory")
+  {
+    _addSupportedDevices({ DevicePtr(new USBDevice(0xFFFF, 0xFFFE, "")) });
+  }
+
+  virtual bool getChannels(Device &device, Vector<int> &channels) { channels = { 0 }; return true; }
+  virtual DepthCameraPtr getDepthCamera(DevicePtr device) { return nullptr; }
+
+  virtual bool getFrameGenerator(uint8_t frameType, GeneratorIDType generatorID, FrameGeneratorPtr &frameGenerator)
+  {
+    if(frameType == DepthCamera::FRAME_RAW_FRAME_PROCESSED && generatorID == TEST_PROCESSED_GENERATOR_ID)
+      frameGenerator = FrameGeneratorPtr(new TestProcessedGenerator());
+    else if(frameType == DepthCamera::FRAME_DEPTH_FRAME && generatorID == TEST_DEPTH_GENERATOR_ID)
+      frameGenerator = FrameGeneratorPtr(new TestDepthGenerator());
+    else
+      return false;
+    return true;
+  }
+
+  virtual Vector<GeneratorIDType> getSupportedGeneratorTypes() { return { TEST_PROCESSED_GENERATOR_ID, TEST_DEPTH_GENERATOR_ID }; }
+};
+
+uint16_t phaseOf(int frame, int pixel) { return 100*frame + pixel; }
+
+inline int widthOf(int frame) { return (frame < CONFIG_CHANGE_AT)?WIDTH:2*WIDTH; }
+
+bool writeStream(const String &fileName)
+{
+  FrameSize size;
+  size.width = WIDTH;
+  size.height = HEIGHT;
+
+  TestProcessedGenerator processed;
+  TestDepthGenerator depth;
+  PointCloudFrameGenerator pointCloud;
+
+  processed.setSize(size);
+
+  if(!pointCloud.setParameters(0, 0, WIDTH, HEIGHT, 1, 1, WIDTH, WIDTH, WIDTH/2.0f, HEIGHT/2.0f, 0, 0, 0, 0, 0))
+    return false;
+
+  FrameStreamWriterPtr w(new FrameStreamWriter(fileName, processed.id(), depth.id(), pointCloud.id()));
+
+  processed.setFrameStreamWriter(w);
+  depth.setFrameStreamWriter(w);
+  pointCloud.setFrameStreamWriter(w);
+
+  if(!processed.writeConfiguration() || !depth.writeConfiguration() || !pointCloud.writeConfiguration())
+    return false;
+
+  for(auto f = 0; f < FRAME_COUNT; f++)
+  {
+    if(f == CONFIG_CHANGE_AT)
+    {
+      size.width = widthOf(f);
+      processed.setSize(size);
+
+      if(!pointCloud.setParameters(0, 0, size.width, HEIGHT, 1, 1, size.width, size.width, size.width/2.0f, HEIGHT/2.0f, 0, 0, 0, 0, 0) ||
+        !processed.writeConfiguration() || !pointCloud.writeConfiguration())
+        return false;
+    }
+
+    RawDataFrame *r = new RawDataFrame();
+    FramePtr p(r);
+
+    r->id = f;
+    r->timestamp = 1000000 + f*33333;
+    r->data.resize(widthOf(f)*HEIGHT*sizeof(uint16_t));
+
+    uint16_t *phase = (uint16_t *)r->data.data();
+
+    for(auto i = 0; i < widthOf(f)*HEIGHT; i++)
+      phase[i] = phaseOf(f, i);
+
+    if(!w->write(p))
+      return false;
+  }
+
+  return w->close();
+}
+
+bool readFile(const String &fileName, Vector<char> &bytes)
+{
+  InputFileStream in(fileName, std::ios::binary | std::ios::in);
+
+  if(!in.good())
+    return false;
+
+  in.seekg(0, std::ios::end);
+  bytes.resize(in.tellg());
+  in.seekg(0, std::ios::beg);
+  in.read(bytes.data(), bytes.size());
+  return in.good();
+}
+
+bool writeFile(const String &fileName, const char *bytes, SizeType size)
+{
+  OutputFileStream out(fileName, std::ios::binary | std::ios::out);
+  out.write(bytes, size);
+  return out.good();
+}
+
+// Rewrites a stream in the version 0.1 layout, i.e., without padding and index packets
+bool writeVersion1Stream(const String &fromFileName, const String &toFileName)
+{
+  Vector<char> in, out;
+
+  if(!readFile(fromFileName, in))
+    return false;
+
+  out.insert(out.end(), in.begin(), in.begin() + FRAME_STREAM_HEADER_SIZE);
+  out[1] = 1;
+
+  SizeType offset = FRAME_STREAM_HEADER_SIZE;
+
+  while(offset + FRAME_STREAM_PACKET_HEADER_SIZE <= in.size())
+  {
+    uint8_t type = in[offset + 5];
+    uint32_t size;
+    memcpy(&size, &in[offset + 6], sizeof(size));
+
+    SizeType packetSize = FRAME_STREAM_PACKET_HEADER_SIZE + size;
+
+    if(type == FrameStreamPacket::PACKET_DATA || type == FrameStreamPacket::PACKET_GENERATOR_CONFIG)
+      out.insert(out.end(), in.begin() + offset, in.begin() + offset + packetSize);
+
+    offset += packetSize;
+  }
+
+  return writeFile(toFileName, out.data(), out.size());
+}
+
+// Frames read from a mapped stream of version 0.2 are expected to refer to the mapping
+bool checkFrame(FrameStreamReader &reader, int expectedID, bool borrowed)
+{
+  const RawDataFrame *r = dynamic_cast<const RawDataFrame *>(reader.frames[DepthCamera::FRAME_RAW_FRAME_UNPROCESSED].get());
+  const ToFRawFrame *t = dynamic_cast<const ToFRawFrame *>(reader.frames[DepthCamera::FRAME_RAW_FRAME_PROCESSED].get());
+  const DepthFrame *d = dynamic_cast<const DepthFrame *>(reader.frames[DepthCamera::FRAME_DEPTH_FRAME].get());
+
+  int width = widthOf(expectedID);
+
+  if(!r || !t || !d || r->id != expectedID || r->timestamp != 1000000 + expectedID*33333 || (borrowed && !r->isBorrowed()) ||
+    r->rawDataSize() != width*HEIGHT*sizeof(uint16_t) || t->size.width != width || d->depth.size() != width*HEIGHT)
+  {
+    std::cerr << "FAIL: frame " << expectedID << " is not as recorded" << std::endl;
+    return false;
+  }
+
+  if(r->isBorrowed() && ((uintptr_t)r->rawData() % FRAME_STREAM_DATA_ALIGNMENT))
+  {
+    std::cerr << "FAIL: data of frame " << expectedID << " is not aligned" << std::endl;
+    return false;
+  }
+
+  const uint16_t *phase = (const uint16_t *)r->rawData();
+
+  for(auto i = 0; i < width*HEIGHT; i++)
+  {
+    if(phase[i] != phaseOf(expectedID, i) || d->depth[i] != phaseOf(expectedID, i)*0.001f)
+    {
+      std::cerr << "FAIL: contents of frame " << expectedID << " are not as recorded" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+// Reads all frames in sequence and then at random positions
+bool checkReader(FrameStreamReader &reader, const String &name, bool mapped, bool indexed)
+{
+  bool borrowed = mapped && reader.isZeroCopy() && reader.getHeader().version[1] >= 2;
+
+  if(!reader.isStreamGood() || reader.isMapped() != mapped || reader.isIndexed() != indexed || reader.size() != FRAME_COUNT)
+  {
+    std::cerr << "FAIL: " << name << " opened with mapped = " << reader.isMapped() << ", indexed = " << reader.isIndexed()
+      << ", frames = " << reader.size() << std::endl;
+    return false;
+  }
+
+  for(auto f = 0; f < FRAME_COUNT; f++)
+    if(!reader.readNext() || !checkFrame(reader, f, borrowed))
+      return false;
+
+  if(reader.readNext())
+  {
+    std::cerr << "FAIL: " << name << " read past the last frame" << std::endl;
+    return false;
+  }
+
+  srand(1);
+
+  // Seeks across the configuration change in both directions
+  for(auto i = 0; i < 50; i++)
+  {
+    int f = rand() % FRAME_COUNT;
+
+    if(!reader.seekTo(f) || !reader.readNext() || !checkFrame(reader, f, borrowed) || reader.currentPosition() != f + 1)
+    {
+      std::cerr << "FAIL: " << name << " seek to frame " << f << std::endl;
+      return false;
+    }
+  }
+
+  std::cout << name << ": OK" << std::endl;
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  logger.setDefaultLogLevel(LOG_ERROR);
+
+  CameraSystem sys;
+
+  String fileName = "FrameStreamTest.vxl", v1FileName = "FrameStreamTestV1.vxl", unclosedFileName = "FrameStreamTestUnclosed.vxl";
+
+  if(!sys.addDepthCameraFactory(DepthCameraFactoryPtr(new TestFactory())) || !writeStream(fileName) || !writeVersion1Stream(fileName, v1FileName))
+  {
+    std::cerr << "Failed to write test streams" << std::endl;
+    return -1;
+  }
+
+  // Stream whose writer did not get to write the index
+  {
+    Vector<char> bytes;
+
+    if(!readFile(fileName, bytes) || !writeFile(unclosedFileName, bytes.data(), bytes.size() - 5))
+    {
+      std::cerr << "Failed to write test streams" << std::endl;
+      return -1;
+    }
+  }
+
+  int failures = 0;
+  Timer timer;
+
+  {
+    TimeStampType start = timer.getCurentRealTime();
+    FrameStreamReader reader(fileName, sys);
+    std::cout << "Indexed open: " << timer.getCurentRealTime() - start << " us" << std::endl;
+
+    reader.setZeroCopy(true);
+
+    if(reader.getHeader().version[1] != FRAME_STREAM_VERSION_MINOR || !checkReader(reader, "version 0.2, mapped", true, true))
+      failures++;
+
+    // Borrowed frames stay valid after the reader is closed
+    RawFramePtr raw;
+
+    if(!reader.seekTo(FRAME_COUNT - 1) || !reader.readNextRaw(raw))
+      failures++;
+
+    reader.close();
+
+    RawDataFrame *r = dynamic_cast<RawDataFrame *>(raw.get());
+
+    if(!r || !r->isBorrowed() || ((const uint16_t *)r->rawData())[1] != phaseOf(FRAME_COUNT - 1, 1))
+    {
+      std::cerr << "FAIL: borrowed frame after close" << std::endl;
+      failures++;
+    }
+  }
+
+  {
+    FrameStreamReader reader(fileName, sys); // Copies by default, so that raw frames have their 'data'
+
+    if(reader.isZeroCopy() || !checkReader(reader, "version 0.2, mapped, copied", true, true))
+      failures++;
+  }
+
+  {
+    InputFileStream in(fileName, std::ios::binary | std::ios::in);
+    FrameStreamReader reader(in, sys);
+
+    if(!checkReader(reader, "version 0.2, from stream", false, true))
+      failures++;
+  }
+
+  {
+    FrameStreamReader reader(fileName, sys);
+    uint64_t hits, misses, scrubMisses;
+
+    reader.setZeroCopy(true);
+
+    if(!reader.setReadAhead(8, 32, 4) || !checkReader(reader, "version 0.2, read-ahead", true, true) ||
+      !reader.getCacheStatistics(hits, misses) || !hits)
+    {
+      std::cerr << "FAIL: read-ahead" << std::endl;
+      failures++;
+    }
+
+    // Scrubbing back over recently read frames is served from the cache
+    reader.seekTo(0);
+
+    for(auto f = 0; f < 100; f++)
+      if(!reader.readNext())
+        failures++;
+
+    reader.getCacheStatistics(hits, scrubMisses);
+
+    for(auto f = 99; f >= 80; f--)
+    {
+      if(!reader.seekTo(f) || !reader.readNext() || !checkFrame(reader, f, true))
+      {
+        std::cerr << "FAIL: scrubbing back to frame " << f << std::endl;
+        failures++;
+        break;
+      }
+    }
+
+    reader.getCacheStatistics(hits, misses);
+
+    if(misses != scrubMisses)
+    {
+      std::cerr << "FAIL: scrubbing back generated " << misses - scrubMisses << " frames again" << std::endl;
+      failures++;
+    }
+
+    // SoA point cloud is generated only when asked for
+    if(reader.frames[DepthCamera::FRAME_XYZI_POINT_CLOUD_SOA_FRAME])
+    {
+      std::cerr << "FAIL: SoA point cloud generated by default" << std::endl;
+      failures++;
+    }
+
+    reader.setFrameTypes(reader.getFrameTypes() | (1 << DepthCamera::FRAME_XYZI_POINT_CLOUD_SOA_FRAME));
+
+    if(!reader.seekTo(2) || !reader.readNext() || !reader.frames[DepthCamera::FRAME_XYZI_POINT_CLOUD_SOA_FRAME] ||
+      !reader.frames[DepthCamera::FRAME_XYZI_POINT_CLOUD_FRAME])
+    {
+      std::cerr << "FAIL: SoA point cloud frame type" << std::endl;
+      failures++;
+    }
+
+    // Depth only: point clouds are not generated
+    reader.setFrameTypes(1 << DepthCamera::FRAME_DEPTH_FRAME);
+
+    if(!reader.seekTo(CONFIG_CHANGE_AT) || !reader.readNext() || !checkFrame(reader, CONFIG_CHANGE_AT, true) ||
+      reader.frames[DepthCamera::FRAME_XYZI_POINT_CLOUD_FRAME] || reader.frames[DepthCamera::FRAME_XYZI_POINT_CLOUD_SOA_FRAME])
+    {
+      std::cerr << "FAIL: depth only frame types with read-ahead" << std::endl;
+      failures++;
+    }
+
+    if(!reader.setReadAhead(0) || !reader.seekTo(1) || !reader.readNext() || !checkFrame(reader, 1, true) ||
+      reader.frames[DepthCamera::FRAME_XYZI_POINT_CLOUD_FRAME] || reader.frames[DepthCamera::FRAME_XYZI_POINT_CLOUD_SOA_FRAME])
+    {
+      std::cerr << "FAIL: depth only frame types" << std::endl;
+      failures++;
+    }
+    else
+      std::cout << "Read-ahead: OK" << std::endl;
+  }
+
+  {
+    TimeStampType start = timer.getCurentRealTime();
+    FrameStreamReader reader(v1FileName, sys);
+    std::cout << "Scanned open: " << timer.getCurentRealTime() - start << " us" << std::endl;
+
+    if(reader.getHeader().version[1] != 1 || !checkReader(reader, "version 0.1, mapped", true, false))
+      failures++;
+  }
+
+  {
+    InputFileStream in(v1FileName, std::ios::binary | std::ios::in);
+    FrameStreamReader reader(in, sys);
+
+    if(!checkReader(reader, "version 0.1, from stream", false, false))
+      failures++;
+  }
+
+  {
+    FrameStreamReader reader(unclosedFileName, sys);
+    reader.setZeroCopy(true);
+
+    if(!checkReader(reader, "version 0.2 without index", true, false))
+      failures++;
+  }
+
+  std::remove(fileName.c_str());
+  std::remove(v1FileName.c_str());
+  std::remove(unclosedFileName.c_str());
+
+  if(failures)
+  {
+    std::cerr << failures << " test(s) failed" << std::endl;
+    return -1;
+  }
+
+  std::cout << "All tests passed" << std::endl;
+  return 0;
+}
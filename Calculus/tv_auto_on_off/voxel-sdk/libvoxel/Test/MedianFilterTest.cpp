@@ -0,0 +1,152 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#include "Common.h"
+#include "Logger.h"
+#include "Timer.h"
+#include "CameraSystem.h"
+
+#include <random>
+#include <iomanip>
+
+using namespace Voxel;
+
+// Must match MedianFilter::Mode
+const char *modeNames[] = { "select", "sorting network", "histogram", "auto" };
+
+FramePtr makeDepthFrame(int width, int height, std::mt19937 &rng)
+{
+  DepthFrame *d = new DepthFrame();
+  d->size.width = width;
+  d->size.height = height;
+  d->depth.resize(width*height);
+  d->amplitude.resize(width*height);
+
+  std::normal_distribution<float> noise(0, 0.01f);
+
+  for(auto j = 0; j < height; j++)
+    for(auto i = 0; i < width; i++)
+    {
+      d->depth[j*width + i] = 1.0f + ((i > width/2)?0.5f:0.0f) + noise(rng);
+      d->amplitude[j*width + i] = 1.0f;
+    }
+
+  return FramePtr(d);
+}
+
+// 12-bit phase with few distinct values so that ties are common
+FramePtr makeToFFrame(int width, int height, std::mt19937 &rng)
+{
+  ToFRawFrameTemplate<uint16_t, uint8_t> *t = new ToFRawFrameTemplate<uint16_t, uint8_t>();
+  t->size.width = width;
+  t->size.height = height;
+  t->_phase.resize(width*height);
+  t->_amplitude.resize(width*height);
+  t->_ambient.resize(width*height);
+  t->_flags.resize(width*height);
+
+  std::uniform_int_distribution<int> noise(-4, 4), spike(0, 50), full(0, 4095);
+
+  for(auto j = 0; j < height; j++)
+    for(auto i = 0; i < width; i++)
+    {
+      int v = 1000 + ((i > width/2)?1500:0) + j + noise(rng);
+      t->_phase[j*width + i] = spike(rng)?v:full(rng); // Occasional outliers across the full range
+    }
+
+  return FramePtr(t);
+}
+
+bool equal(const FramePtr &a, const FramePtr &b)
+{
+  DepthFrame *d1 = dynamic_cast<DepthFrame *>(a.get()), *d2 = dynamic_cast<DepthFrame *>(b.get());
+  ToFRawFrameTemplate<uint16_t, uint8_t> *t1 = dynamic_cast<ToFRawFrameTemplate<uint16_t, uint8_t> *>(a.get()),
+    *t2 = dynamic_cast<ToFRawFrameTemplate<uint16_t, uint8_t> *>(b.get());
+
+  if(d1 && d2)
+    return d1->depth == d2->depth;
+  else if(t1 && t2)
+    return t1->_phase == t2->_phase;
+  else
+    return false;
+}
+
+int main(int argc, char *argv[])
+{
+  CameraSystem sys;
+
+  struct { int width, height; } sizes[] = { {320, 240}, {17, 9}, {3, 5}, {1, 1} };
+  uint halfKernelSizes[] = { 1, 2, 3, 4 };
+
+  std::mt19937 rng(2014);
+
+  int failures = 0;
+
+  std::cout << std::fixed << std::setprecision(1);
+
+  for(auto &sz: sizes)
+  {
+    FramePtr inputs[2] = { makeToFFrame(sz.width, sz.height, rng), makeDepthFrame(sz.width, sz.height, rng) };
+    const char *frameNames[2] = { "ToF phase", "depth" };
+
+    for(auto k: halfKernelSizes)
+      for(auto f = 0; f < 2; f++)
+      {
+        FramePtr expected;
+        float reference = 0;
+
+        for(auto mode = 0; mode < 4; mode++)
+        {
+          // New filter for each run as the output depends on previous frames through the deadband
+          FilterPtr filter = sys.createFilter("Voxel::MedianFilter", DepthCamera::FRAME_RAW_FRAME_PROCESSED);
+
+          if(!filter || !filter->set("halfKernelSize", k) || !filter->set("mode", mode))
+          {
+            logger(LOG_ERROR) << "Could not create and configure MedianFilter" << std::endl;
+            return -1;
+          }
+
+          FramePtr out;
+          Timer t;
+
+          TimeStampType start = t.getCurentRealTime();
+
+          if(!filter->filter(inputs[f], out))
+          {
+            logger(LOG_ERROR) << "MedianFilter failed on " << frameNames[f] << " frame" << std::endl;
+            return -1;
+          }
+
+          float elapsed = (float)(t.getCurentRealTime() - start);
+
+          if(mode == 0)
+          {
+            expected = out;
+            reference = elapsed;
+          }
+          else if(!equal(expected, out))
+          {
+            std::cerr << "FAIL: " << sz.width << "x" << sz.height << " " << frameNames[f] << ", half kernel size = " << k
+              << ", mode = " << modeNames[mode] << std::endl;
+            failures++;
+          }
+
+          if(sz.width == 320 && mode > 0)
+            std::cout << sz.width << "x" << sz.height << " " << frameNames[f] << ", half kernel size = " << k << ": "
+              << modeNames[mode] << " = " << elapsed << " us, select = " << reference << " us" << std::endl;
+        }
+      }
+  }
+
+  if(failures)
+  {
+    std::cerr << failures << " test(s) failed" << std::endl;
+    return -1;
+  }
+
+  std::cout << "All tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,479 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#include "Common.h"
+#include "Logger.h"
+#include "CameraSystem.h"
+#include "VirtualDepthCamera.h"
+#include "MultiCameraSession.h"
+
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+
+using namespace Voxel;
+
+#define TEST_PROCESSED_GENERATOR_ID 0x7F00
+#define TEST_DEPTH_GENERATOR_ID 0x7F01
+
+#define WIDTH 16
+#define HEIGHT 4
+#define FRAME_COUNT 20
+#define CAMERA_COUNT 4
+#define FRAME_INTERVAL 20000 // in micro-seconds, as recorded
+
+// Raw data is phase as uint16_t per pixel
+class TestProcessedGenerator: public FrameGenerator
+{
+protected:
+  FrameSize _size;
+
+  virtual bool _writeConfiguration(SerializedObject &object)
+  {
+    object.resize(_sizeOfVersion() + sizeof(_size));
+    return _writeVersion(object) && object.put((const char *)&_size, sizeof(_size)) == sizeof(_size);
+  }
+
+public:
+  TestProcessedGenerator(): FrameGenerator(TEST_PROCESSED_GENERATOR_ID, DepthCamera::FRAME_RAW_FRAME_PROCESSED, 0, 1)
+  {
+    _size.width = _size.height = 0;
+  }
+
+  inline void setSize(const FrameSize &s) { _size = s; }
+
+  virtual bool readConfiguration(SerializedObject &object)
+  {
+    return _readVersion(object) && object.get((char *)&_size, sizeof(_size)) == sizeof(_size);
+  }
+
+  virtual bool generate(const FramePtr &in, FramePtr &out)
+  {
+    const RawDataFrame *r = dynamic_cast<const RawDataFrame *>(in.get());
+
+    if(!r || r->data.size() != _size.width*_size.height*sizeof(uint16_t))
+      return false;
+
+    ToFRawFrameTemplate<uint16_t, uint8_t> *t = dynamic_cast<ToFRawFrameTemplate<uint16_t, uint8_t> *>(out.get());
+
+    if(!t)
+    {
+      t = new ToFRawFrameTemplate<uint16_t, uint8_t>();
+      out = FramePtr(t);
+    }
+
+    t->id = r->id;
+    t->timestamp = r->timestamp;
+    t->size = _size;
+    t->_phase.resize(_size.width*_size.height);
+    t->_amplitude.assign(_size.width*_size.height, 1);
+    t->_ambient.assign(_size.width*_size.height, 0);
+    t->_flags.assign(_size.width*_size.height, 0);
+    memcpy(t->_phase.data(), r->data.data(), r->data.size());
+    return true;
+  }
+};
+
+class TestDepthGenerator: public DepthFrameGenerator
+{
+protected:
+  virtual bool _writeConfiguration(SerializedObject &object)
+  {
+    object.resize(_sizeOfVersion());
+    return _writeVersion(object);
+  }
+
+public:
+  TestDepthGenerator(): DepthFrameGenerator(TEST_DEPTH_GENERATOR_ID, DepthCamera::FRAME_DEPTH_FRAME, 0, 1) {}
+
+  virtual bool setProcessedFrameGenerator(FrameGeneratorPtr &p) { return true; }
+
+  virtual bool readConfiguration(SerializedObject &object) { return _readVersion(object); }
+
+  virtual bool generate(const FramePtr &in, FramePtr &out)
+  {
+    const ToFRawFrameTemplate<uint16_t, uint8_t> *t = dynamic_cast<const ToFRawFrameTemplate<uint16_t, uint8_t> *>(in.get());
+
+    if(!t)
+      return false;
+
+    DepthFrame *d = dynamic_cast<DepthFrame *>(out.get());
+
+    if(!d)
+    {
+      d = new DepthFrame();
+      out = FramePtr(d);
+    }
+
+    d->id = t->id;
+    d->timestamp = t->timestamp;
+    d->size = t->size;
+    d->depth.resize(t->_phase.size());
+    d->amplitude.resize(t->_phase.size());
+
+    for(auto i = 0; i < t->_phase.size(); i++)
+    {
+      d->depth[i] = t->_phase[i]*0.001f;
+      d->amplitude[i] = t->_amplitude[i];
+    }
+    return true;
+  }
+};
+
+class TestFactory: public DepthCameraFactory
+{
+public:
+  TestFactory(): DepthCameraFactory("Test::Factory")
+  {
+    _addSupportedDevices({ DevicePtr(new USBDevice(0xFFFF, 0xFFFE, "")) });
+  }
+
+  virtual bool getChannels(Device &device, Vector<int> &channels) { channels = { 0 }; return true; }
+  virtual DepthCameraPtr getDepthCamera(DevicePtr device) { return nullptr; }
+
+  virtual bool getFrameGenerator(uint8_t frameType, GeneratorIDType generatorID, FrameGeneratorPtr &frameGenerator)
+  {
+    if(frameType == DepthCamera::FRAME_RAW_FRAME_PROCESSED && generatorID == TEST_PROCESSED_GENERATOR_ID)
+      frameGenerator = FrameGeneratorPtr(new TestProcessedGenerator());
+    else if(frameType == DepthCamera::FRAME_DEPTH_FRAME && generatorID == TEST_DEPTH_GENERATOR_ID)
+      frameGenerator = FrameGeneratorPtr(new TestDepthGenerator());
+    else
+      return false;
+    return true;
+  }
+
+  virtual Vector<GeneratorIDType> getSupportedGeneratorTypes() { return { TEST_PROCESSED_GENERATOR_ID, TEST_DEPTH_GENERATOR_ID }; }
+};
+
+// Frames are recorded with the same timestamps in all streams, except for those in 'skip' which are left out
+bool writeStream(const String &fileName, const Set<int> &skip)
+{
+  FrameSize size;
+  size.width = WIDTH;
+  size.height = HEIGHT;
+
+  TestProcessedGenerator processed;
+  TestDepthGenerator depth;
+  PointCloudFrameGenerator pointCloud;
+
+  processed.setSize(size);
+
+  if(!pointCloud.setParameters(0, 0, WIDTH, HEIGHT, 1, 1, WIDTH, WIDTH, WIDTH/2.0f, HEIGHT/2.0f, 0, 0, 0, 0, 0))
+    return false;
+
+  FrameStreamWriterPtr w(new FrameStreamWriter(fileName, processed.id(), depth.id(), pointCloud.id()));
+
+  processed.setFrameStreamWriter(w);
+  depth.setFrameStreamWriter(w);
+  pointCloud.setFrameStreamWriter(w);
+
+  if(!processed.writeConfiguration() || !depth.writeConfiguration() || !pointCloud.writeConfiguration())
+    return false;
+
+  for(auto f = 0; f < FRAME_COUNT; f++)
+  {
+    if(skip.count(f))
+      continue;
+
+    RawDataFrame *r = new RawDataFrame();
+    FramePtr p(r);
+
+    r->id = f;
+    r->timestamp = 1000000 + f*FRAME_INTERVAL;
+    r->data.assign(WIDTH*HEIGHT*sizeof(uint16_t), 0);
+
+    if(!w->write(p))
+      return false;
+  }
+
+  return w->close();
+}
+
+// Runs the session till all streams end and checks that every frame set holds one frame per camera with the same id
+bool run(MultiCameraSession &session, Vector<int> &ids, bool &onPool)
+{
+  bool valid = true;
+  ids.clear();
+  onPool = true;
+
+  session.registerCallback(DepthCamera::FRAME_DEPTH_FRAME, [&](MultiCameraSession &s, const MultiCameraFrameSet &frameSet) {
+    if(frameSet.frames.size() != CAMERA_COUNT)
+    {
+      valid = false;
+      return;
+    }
+
+    for(auto &f: frameSet.frames)
+      if(!f || !dynamic_cast<const DepthFrame *>(f.get()) || f->id != frameSet.frames[0]->id ||
+        f->timestamp != frameSet.timestamp)
+        valid = false;
+
+    if(!s.getThreadPool()->isWorkerThread())
+      onPool = false;
+
+    // Session's lock is not held during the callback
+    if(s.getFrameSetCount() < ids.size() + 1)
+      valid = false;
+
+    ids.push_back(frameSet.frames[0]->id);
+  });
+
+  session.resetStatistics();
+
+  if(!session.start())
+    return false;
+
+  session.wait();
+  session.stop();
+
+  return valid;
+}
+
+bool inOrder(const Vector<int> &ids)
+{
+  for(auto i = 1; i < ids.size(); i++)
+    if(ids[i] <= ids[i - 1])
+      return false;
+  return true;
+}
+
+bool checkThreadPool()
+{
+  ThreadPool pool(4);
+  Atomic<int> count;
+  count = 0;
+
+  // Tasks submitting more tasks, as done by camera pipelines
+  for(auto i = 0; i < 100; i++)
+    pool.submit([&]() {
+      count++;
+
+      for(auto j = 0; j < 10; j++)
+        pool.submit([&]() { count++; });
+    });
+
+  pool.wait();
+
+  if(pool.size() != 4 || count != 1100 || pool.isWorkerThread())
+  {
+    std::cerr << "FAIL: thread pool ran " << count << " of 1100 tasks" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool checkParallelFor()
+{
+  ThreadPool pool(3, 1); // on CPU 0, which is always there
+  Vector<Atomic<int>> hits(1000);
+
+  for(auto &h: hits)
+    h = 0;
+
+  for(auto grain: {1, 7, 1000, 5000})
+    pool.parallelFor(0, hits.size(), [&](IndexType begin, IndexType end) {
+      for(auto i = begin; i < end; i++)
+        hits[i]++;
+    }, grain);
+
+  // Loops from tasks of the same pool, as filters running on a pipeline pool do
+  for(auto t = 0; t < 4; t++)
+    pool.submit([&]() {
+      pool.parallelFor(100, 200, [&](IndexType begin, IndexType end) {
+        for(auto i = begin; i < end; i++)
+          hits[i]++;
+      });
+    });
+
+  pool.wait();
+
+  bool called = false;
+  pool.parallelFor(5, 5, [&](IndexType, IndexType) { called = true; });
+
+  Atomic<IndexType> smallest(1000);
+
+  for(auto count: {5, 13, 1000})
+    pool.parallelFor(0, count, [&](IndexType begin, IndexType end) {
+      IndexType s = smallest;
+
+      while(end - begin < s && !smallest.compare_exchange_weak(s, end - begin));
+    }, 7);
+
+  if(smallest != 5)
+  {
+    std::cerr << "FAIL: parallelFor gave a sub-range of " << smallest << " indices for grain 7" << std::endl;
+    return false;
+  }
+
+  for(auto i = 0; i < hits.size(); i++)
+  {
+    if(hits[i] != ((i >= 100 && i < 200)?8:4))
+    {
+      std::cerr << "FAIL: parallelFor ran index " << i << " " << hits[i] << " times" << std::endl;
+      return false;
+    }
+  }
+
+  CPUAffinityMask mask;
+
+  if(called || pool.getAffinity() != 1 || !parseCPUList(" 0, 2-3,8 ", mask) || mask != 0x10D || !parseCPUList("", mask) || mask ||
+    parseCPUList("1-", mask) || parseCPUList("3-2", mask) || parseCPUList("64", mask) || parseCPUList("a", mask))
+  {
+    std::cerr << "FAIL: empty parallelFor range, pool affinity or CPU list parsing" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  logger.setDefaultLogLevel(LOG_ERROR);
+
+  CameraSystem sys;
+
+  if(!sys.addDepthCameraFactory(DepthCameraFactoryPtr(new TestFactory())))
+    return -1;
+
+  int failures = 0;
+
+  if(!checkThreadPool() || !checkParallelFor())
+    failures++;
+
+  // Applies to cameras connected hereafter
+  DepthCamera::ThreadSettings threadSettings;
+  threadSettings.captureAffinity = 1;
+
+  if(!sys.setThreadSettings(threadSettings))
+    failures++;
+
+  // Last camera misses two frames, whose sets cannot be completed
+  Set<int> missing = { 3, 7 };
+
+  Vector<String> fileNames;
+  Vector<DepthCameraPtr> cameras;
+
+  for(auto c = 0; c < CAMERA_COUNT; c++)
+  {
+    fileNames.push_back("MultiCameraSessionTest" + std::to_string(c) + ".vxl");
+
+    if(!writeStream(fileNames[c], (c == CAMERA_COUNT - 1)?missing:Set<int>()))
+    {
+      std::cerr << "Failed to write test stream" << std::endl;
+      return -1;
+    }
+
+    DepthCameraPtr depthCamera = sys.connect(DevicePtr(new VirtualDevice(fileNames[c])));
+    VirtualDepthCameraPtr camera = std::dynamic_pointer_cast<VirtualDepthCamera>(depthCamera);
+
+    if(!camera || !camera->isInitialized())
+    {
+      std::cerr << "Virtual camera could not be created" << std::endl;
+      return -1;
+    }
+
+    if(camera->getThreadSettings().captureAffinity != 1)
+    {
+      std::cerr << "FAIL: thread settings of camera system not applied to " << camera->id() << std::endl;
+      failures++;
+    }
+
+    camera->setLoop(false);
+    camera->setPlaybackMode(VirtualDepthCamera::PLAYBACK_MAX_SPEED);
+    cameras.push_back(depthCamera);
+  }
+
+  MultiCameraSessionPtr session = sys.createSession(cameras, 2);
+
+  if(!session || session->getThreadPool()->size() != 2)
+  {
+    std::cerr << "FAIL: session could not be created" << std::endl;
+    return -1;
+  }
+
+  Vector<int> ids;
+  Vector<MultiCameraStatistics> stats;
+  bool onPool;
+
+  // Nothing dropped: capture blocks on the pool and every stream fits in the pending frames
+  session->setQueueDepth(2, DepthCamera::PIPELINE_BLOCK);
+  session->setMaxPendingFrames(FRAME_COUNT);
+
+  bool valid = run(*session, ids, onPool);
+
+  if(!valid || !onPool || ids.size() != FRAME_COUNT - missing.size() || !inOrder(ids) ||
+    session->getFrameSetCount() != ids.size() || !session->getStatistics(stats) || stats.size() != CAMERA_COUNT)
+  {
+    std::cerr << "FAIL: aligned frame sets. Valid = " << valid << ", on pool = " << onPool << ", sets = " << ids.size() << std::endl;
+    failures++;
+  }
+  else
+  {
+    for(auto c = 0; c < CAMERA_COUNT; c++)
+    {
+      SizeType expected = (c == CAMERA_COUNT - 1)?0:missing.size();
+
+      if(stats[c].framesReceived != FRAME_COUNT - ((c == CAMERA_COUNT - 1)?missing.size():0) ||
+        stats[c].framesUnmatched != expected || stats[c].framesOverflowed)
+      {
+        std::cerr << "FAIL: camera " << c << " received = " << stats[c].framesReceived << ", unmatched = " << stats[c].framesUnmatched
+          << ", overflowed = " << stats[c].framesOverflowed << std::endl;
+        failures++;
+      }
+    }
+
+    for(auto i: ids)
+      if(missing.count(i))
+      {
+        std::cerr << "FAIL: frame set " << i << " was delivered without the last camera" << std::endl;
+        failures++;
+      }
+  }
+
+  // Backpressure: with one camera paced as recorded and the others at full speed, the fast ones overflow their pending frames
+  std::dynamic_pointer_cast<VirtualDepthCamera>(cameras[0])->setPlaybackMode(VirtualDepthCamera::PLAYBACK_ORIGINAL_TIMING);
+  session->setMaxPendingFrames(2);
+
+  valid = run(*session, ids, onPool);
+  session->getStatistics(stats);
+
+  uint64_t overflowed = 0;
+
+  for(auto c = 1; c < CAMERA_COUNT; c++)
+    overflowed += stats[c].framesOverflowed;
+
+  if(!valid || !inOrder(ids) || !overflowed || stats[0].framesOverflowed || stats[0].framesReceived != FRAME_COUNT)
+  {
+    std::cerr << "FAIL: backpressure. Valid = " << valid << ", sets = " << ids.size() << ", overflowed = " << overflowed << std::endl;
+    failures++;
+  }
+  else
+    std::cout << "Backpressure: " << ids.size() << " frame sets, " << overflowed << " frames overflowed" << std::endl;
+
+  session = nullptr;
+
+  for(auto c = 0; c < CAMERA_COUNT; c++)
+  {
+    if(cameras[c]->getPipelineThreadPool() || cameras[c]->isPipelineModeEnabled())
+    {
+      std::cerr << "FAIL: camera " << c << " still set up for the session" << std::endl;
+      failures++;
+    }
+
+    sys.disconnect(cameras[c]);
+    std::remove(fileNames[c].c_str());
+  }
+
+  cameras.clear();
+
+  if(failures)
+  {
+    std::cerr << failures << " test(s) failed" << std::endl;
+    return -1;
+  }
+
+  std::cout << "All tests passed" << std::endl;
+  return 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#include "Common.h"
+#include "Logger.h"
+#include "PointCloudFrameGenerator.h"
+
+#include <iostream>
+#include <random>
+
+using namespace Voxel;
+
+bool isAligned(const float *p) { return ((uintptr_t)p % VOXEL_CACHE_LINE_SIZE) == 0; }
+
+bool equal(const XYZIPointCloudFrame &a, const XYZIPointCloudSoAFrame &b)
+{
+  if(a.id != b.id || a.timestamp != b.timestamp || a.points.size() != b.size())
+    return false;
+  
+  for(auto k = 0; k < a.points.size(); k++)
+  {
+    const IntensityPoint &p = a.points[k];
+    
+    if(p.x != b.x[k] || p.y != b.y[k] || p.z != b.z[k] || p.i != b.i[k])
+      return false;
+  }
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  const int width = 81, height = 7;
+  
+  PointCloudFrameGenerator generator;
+  
+  if(!generator.setParameters(0, 0, width, height, 1, 1, width*0.9f, width*0.9f, width/2.0f, height/2.0f, -0.1f, 0.01f, 0, 0.001f, -0.001f))
+  {
+    std::cerr << "Failed to set generator parameters" << std::endl;
+    return -1;
+  }
+  
+  DepthFrame *d = new DepthFrame();
+  FramePtr depthFrame(d);
+  
+  d->id = 11;
+  d->timestamp = 12345;
+  d->size.width = width;
+  d->size.height = height;
+  d->depth.resize(width*height);
+  d->amplitude.resize(width*height);
+  
+  std::mt19937 rng(5);
+  std::uniform_real_distribution<float> dist(0.1f, 5.0f);
+  
+  for(auto k = 0; k < width*height; k++)
+  {
+    d->depth[k] = dist(rng);
+    d->amplitude[k] = dist(rng);
+  }
+  
+  FramePtr aos, soa(new XYZIPointCloudSoAFrame());
+  
+  if(!generator.generate(depthFrame, aos) || !generator.generate(depthFrame, soa))
+  {
+    std::cerr << "Failed to generate point clouds" << std::endl;
+    return -1;
+  }
+  
+  XYZIPointCloudFrame *a = dynamic_cast<XYZIPointCloudFrame *>(aos.get());
+  XYZIPointCloudSoAFrame *s = dynamic_cast<XYZIPointCloudSoAFrame *>(soa.get());
+  
+  int failures = 0;
+  
+  if(!a || !s || !equal(*a, *s))
+  {
+    std::cerr << "FAIL: generated SoA point cloud differs from XYZI point cloud" << std::endl;
+    return -1;
+  }
+  
+  if(!isAligned(s->x.data()) || !isAligned(s->y.data()) || !isAligned(s->z.data()) || !isAligned(s->i.data()))
+  {
+    std::cerr << "FAIL: arrays are not aligned to cache line" << std::endl;
+    failures++;
+  }
+  
+  XYZIPointCloudSoAFrame converted;
+  XYZIPointCloudFrame back;
+  
+  converted.fromXYZIPointCloudFrame(*a);
+  converted.toXYZIPointCloudFrame(back);
+  
+  if(!equal(*a, converted) || !equal(back, converted))
+  {
+    std::cerr << "FAIL: conversion helpers" << std::endl;
+    failures++;
+  }
+  
+  SerializedObject object;
+  XYZIPointCloudSoAFrame deserialized;
+  
+  if(!s->serialize(object) || !deserialized.deserialize(object) || !equal(*a, deserialized))
+  {
+    std::cerr << "FAIL: serialize and deserialize" << std::endl;
+    failures++;
+  }
+  
+  SerializedObject truncated(object.size()/2);
+  memcpy(truncated.getBytes().data(), object.getBytes().data(), truncated.size());
+  
+  if(deserialized.deserialize(truncated))
+  {
+    std::cerr << "FAIL: deserialize of truncated data succeeded" << std::endl;
+    failures++;
+  }
+  
+  FramePtr c = s->copy();
+  XYZIPointCloudSoAFrame *copied = dynamic_cast<XYZIPointCloudSoAFrame *>(c.get());
+  
+  if(!copied || !equal(*a, *copied) || !copied->isSameType(*s) || !copied->isSameSize(*s) || s->isSameType(*a))
+  {
+    std::cerr << "FAIL: copy or type checks" << std::endl;
+    failures++;
+  }
+  
+  if(failures)
+  {
+    std::cerr << failures << " test(s) failed" << std::endl;
+    return -1;
+  }
+  
+  std::cout << "All tests passed" << std::endl;
+  return 0;
+}
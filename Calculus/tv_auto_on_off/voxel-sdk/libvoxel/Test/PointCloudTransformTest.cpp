@@ -0,0 +1,152 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#include "Common.h"
+#include "Timer.h"
+#include "PointCloudTransform.h"
+
+#include <iostream>
+#include <random>
+
+using namespace Voxel;
+
+struct TestCase
+{
+  uint32_t width, height, rowsToMerge, columnsToMerge;
+};
+
+// Loop as it was in PointCloudTransform::depthToPointCloud() before binned direction tables
+void referencePointCloud(PointCloudTransform &t, const Vector<float> &distances, Vector<IntensityPoint> &points)
+{
+  for(int v = 0; v < t.height; v += t.rowsToMerge)
+  {
+    for(int u = 0; u < t.width; u += t.columnsToMerge)
+    {
+      int idx = v * t.width + u;
+      int idx2 = v/t.rowsToMerge * t.width/t.columnsToMerge + u/t.columnsToMerge;
+      Point p = t.directions[idx] * distances[idx2];
+      
+      points[idx2].x = p.x;
+      points[idx2].y = p.y;
+      points[idx2].z = p.z;
+    }
+  }
+}
+
+bool runTest(const TestCase &c, std::mt19937 &rng, bool printTiming)
+{
+  PointCloudTransform t(0, 0, c.width, c.height, c.rowsToMerge, c.columnsToMerge, c.width*0.9f, c.width*0.9f,
+                        c.width/2.0f, c.height/2.0f, -0.1f, 0.01f, 0, 0.001f, -0.001f);
+  
+  SizeType count = (c.width/c.columnsToMerge)*(c.height/c.rowsToMerge);
+  
+  std::uniform_real_distribution<float> dist(0.1f, 5.0f);
+  
+  Vector<float> distances(count), intensities(count);
+  
+  for(auto i = 0; i < count; i++)
+  {
+    distances[i] = dist(rng);
+    intensities[i] = dist(rng);
+  }
+  
+  XYZIPointCloudFrame frame;
+  frame.points.resize(count);
+  
+  for(auto i = 0; i < count; i++)
+    frame.points[i].i = intensities[i];
+  
+  Vector<IntensityPoint> expected(count);
+  referencePointCloud(t, distances, expected);
+  
+  if(!t.depthToPointCloud(distances, frame))
+  {
+    std::cerr << "depthToPointCloud() failed" << std::endl;
+    return false;
+  }
+  
+  Vector<IntensityPoint> withIntensity(count);
+  Vector<float> x(count), y(count), z(count);
+  
+  t.depthToPointCloud(distances.data(), intensities.data(), 0, count, withIntensity.data());
+  t.depthToPointCloud(distances.data(), 0, count, x.data(), y.data(), z.data());
+  
+  for(auto i = 0; i < count; i++)
+  {
+    const IntensityPoint &e = expected[i], &a = frame.points[i], &b = withIntensity[i];
+    
+    if(e.x != a.x || e.y != a.y || e.z != a.z || a.i != intensities[i] || 
+      e.x != b.x || e.y != b.y || e.z != b.z || b.i != intensities[i] ||
+      e.x != x[i] || e.y != y[i] || e.z != z[i])
+    {
+      std::cerr << "Point " << i << " differs" << std::endl;
+      return false;
+    }
+  }
+  
+  if(printTiming)
+  {
+    const int iterations = 500;
+    Timer timer;
+    
+    TimeStampType start = timer.getCurentRealTime();
+    
+    for(auto i = 0; i < iterations; i++)
+      referencePointCloud(t, distances, expected);
+    
+    TimeStampType middle = timer.getCurentRealTime();
+    
+    for(auto i = 0; i < iterations; i++)
+      t.depthToPointCloud(distances, frame);
+    
+    TimeStampType end = timer.getCurentRealTime();
+    
+    for(auto i = 0; i < iterations; i++)
+      t.depthToPointCloud(distances.data(), 0, count, x.data(), y.data(), z.data());
+    
+    TimeStampType soa = timer.getCurentRealTime();
+    
+    std::cout << c.width/c.columnsToMerge << "x" << c.height/c.rowsToMerge << ": reference = " << (float)(middle - start)/iterations 
+      << " us/frame, XYZI = " << (float)(end - middle)/iterations << " us/frame, separate x/y/z = " 
+      << (float)(soa - end)/iterations << " us/frame" << std::endl;
+  }
+  
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  TestCase testCases[] =
+  {
+    { 320, 240, 1, 1 },
+    { 320, 240, 2, 2 },
+    { 81, 7, 1, 1 },
+    { 90, 40, 2, 3 },
+    { 3, 1, 1, 1 },
+  };
+  
+  std::mt19937 rng(99);
+  
+  int failures = 0;
+  
+  for(auto i = 0; i < sizeof(testCases)/sizeof(TestCase); i++)
+  {
+    if(!runTest(testCases[i], rng, i == 0))
+    {
+      std::cerr << "FAIL: test case " << i << std::endl;
+      failures++;
+    }
+  }
+  
+  if(failures)
+  {
+    std::cerr << failures << " test(s) failed" << std::endl;
+    return -1;
+  }
+  
+  std::cout << "All tests passed" << std::endl;
+  return 0;
+}
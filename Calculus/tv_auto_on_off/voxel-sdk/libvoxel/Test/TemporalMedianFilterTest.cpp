@@ -0,0 +1,224 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#include "Common.h"
+#include "Logger.h"
+#include "Timer.h"
+#include "CameraSystem.h"
+
+#include <random>
+#include <iomanip>
+
+using namespace Voxel;
+
+// TemporalMedianFilter as it was before history was kept in a ring of planes
+template <typename T>
+class ReferenceTemporalMedian
+{
+  uint _order;
+  float _deadband;
+  List<Vector<T>> _history;
+  Vector<T> _current;
+  
+public:
+  ReferenceTemporalMedian(uint order, float deadband): _order(order), _deadband(deadband) {}
+  
+  void filter(const Vector<T> &in, Vector<T> &out)
+  {
+    SizeType s = in.size();
+    
+    if(_current.size() != s)
+      _current.assign(s, 0);
+    
+    out.resize(s);
+    
+    if(_history.size() < _order)
+    {
+      _history.push_back(in);
+      _current = in;
+      out = in;
+      return;
+    }
+    
+    _history.pop_front();
+    _history.push_back(in);
+    
+    for(auto i = 0; i < s; i++)
+    {
+      Vector<T> v;
+      
+      for(auto &h: _history)
+        v.push_back(h[i]);
+      
+      std::nth_element(v.begin(), v.begin() + v.size()/2,  v.end());
+      
+      T m = v[v.size()/2];
+      
+      if(m > 0 && fabs(((float)m - _current[i])/_current[i]) > _deadband)
+        out[i] = _current[i] = m;
+      else
+        out[i] = _current[i];
+    }
+  }
+};
+
+// Phase with noise and outliers, or depth with noise. 'phase' selects between them
+FramePtr makeFrame(bool phase, int width, int height, std::mt19937 &rng)
+{
+  std::normal_distribution<float> noise(0, 0.02f);
+  std::uniform_int_distribution<int> phaseNoise(-3, 3), spike(0, 20), full(0, 4095);
+  
+  if(phase)
+  {
+    ToFRawFrameTemplate<uint16_t, uint8_t> *t = new ToFRawFrameTemplate<uint16_t, uint8_t>();
+    t->size.width = width;
+    t->size.height = height;
+    t->_phase.resize(width*height);
+    t->_amplitude.resize(width*height);
+    t->_ambient.resize(width*height);
+    t->_flags.resize(width*height);
+    
+    for(auto i = 0; i < width*height; i++)
+      t->_phase[i] = spike(rng)?(1000 + i % 500 + phaseNoise(rng)):full(rng);
+    
+    return FramePtr(t);
+  }
+  else
+  {
+    DepthFrame *d = new DepthFrame();
+    d->size.width = width;
+    d->size.height = height;
+    d->depth.resize(width*height);
+    d->amplitude.resize(width*height);
+    
+    for(auto i = 0; i < width*height; i++)
+      d->depth[i] = 1.0f + (i % 7)*0.1f + noise(rng);
+    
+    return FramePtr(d);
+  }
+}
+
+template <typename T>
+bool check(const FilterPtr &filter, ReferenceTemporalMedian<T> &reference, const FramePtr &in, const Vector<T> &input, 
+           const Vector<T> &(*output)(const FramePtr &))
+{
+  FramePtr out;
+  Vector<T> expected;
+  
+  reference.filter(input, expected);
+  
+  return filter->filter(in, out) && output(out) == expected;
+}
+
+const Vector<uint16_t> &phaseOf(const FramePtr &f) { return dynamic_cast<ToFRawFrameTemplate<uint16_t, uint8_t> *>(f.get())->_phase; }
+const Vector<float> &depthOf(const FramePtr &f) { return dynamic_cast<DepthFrame *>(f.get())->depth; }
+
+// Returns time per frame in micro-seconds
+float run(const FilterPtr &filter, const Vector<FramePtr> &frames)
+{
+  Timer t;
+  FramePtr out;
+  
+  TimeStampType start = t.getCurentRealTime();
+  
+  for(auto &f: frames)
+    filter->filter(f, out);
+  
+  return (float)(t.getCurentRealTime() - start)/frames.size();
+}
+
+int main(int argc, char *argv[])
+{
+  CameraSystem sys;
+  
+  struct { int width, height; } sizes[] = { {320, 240}, {37, 5}, {1, 1} };
+  
+  std::mt19937 rng(2014);
+  
+  int failures = 0;
+  
+  for(auto &sz: sizes)
+    for(uint order = 1; order <= 9; order++)
+      for(auto phase = 0; phase < 2; phase++)
+      {
+        FilterPtr filter = sys.createFilter("Voxel::TemporalMedianFilter", DepthCamera::FRAME_RAW_FRAME_PROCESSED);
+        
+        if(!filter || !filter->set("order", order) || !filter->set("deadband", 0.01f))
+        {
+          logger(LOG_ERROR) << "Could not create and configure TemporalMedianFilter" << std::endl;
+          return -1;
+        }
+        
+        ReferenceTemporalMedian<uint16_t> phaseReference(order, 0.01f);
+        ReferenceTemporalMedian<float> depthReference(order, 0.01f);
+        
+        for(auto n = 0; n < 3*order + 2; n++)
+        {
+          FramePtr in = makeFrame(phase, sz.width, sz.height, rng);
+          
+          bool ok = phase?check(filter, phaseReference, in, phaseOf(in), phaseOf):check(filter, depthReference, in, depthOf(in), depthOf);
+          
+          if(!ok)
+          {
+            std::cerr << "FAIL: " << sz.width << "x" << sz.height << (phase?" phase":" depth") << ", order = " << order 
+              << ", frame = " << n << std::endl;
+            failures++;
+            break;
+          }
+        }
+      }
+  
+  // Timing against the reference on QVGA
+  std::cout << std::fixed << std::setprecision(1);
+  
+  for(auto phase = 0; phase < 2; phase++)
+  {
+    Vector<FramePtr> frames;
+    
+    for(auto n = 0; n < 30; n++)
+      frames.push_back(makeFrame(phase, 320, 240, rng));
+    
+    for(uint order: {3, 5, 7, 9})
+    {
+      FilterPtr filter = sys.createFilter("Voxel::TemporalMedianFilter", DepthCamera::FRAME_RAW_FRAME_PROCESSED);
+      filter->set("order", order);
+      
+      float t1 = run(filter, frames);
+      
+      Timer t;
+      TimeStampType start = t.getCurentRealTime();
+      
+      if(phase)
+      {
+        ReferenceTemporalMedian<uint16_t> r(order, 0.05f);
+        Vector<uint16_t> out;
+        for(auto &f: frames)
+          r.filter(phaseOf(f), out);
+      }
+      else
+      {
+        ReferenceTemporalMedian<float> r(order, 0.05f);
+        Vector<float> out;
+        for(auto &f: frames)
+          r.filter(depthOf(f), out);
+      }
+      
+      float t2 = (float)(t.getCurentRealTime() - start)/frames.size();
+      
+      std::cout << "320x240 " << (phase?"phase":"depth") << ", order = " << order << ": " << t1 
+        << " us/frame, reference = " << t2 << " us/frame" << std::endl;
+    }
+  }
+  
+  if(failures)
+  {
+    std::cerr << failures << " test(s) failed" << std::endl;
+    return -1;
+  }
+  
+  std::cout << "All tests passed" << std::endl;
+  return 0;
+}
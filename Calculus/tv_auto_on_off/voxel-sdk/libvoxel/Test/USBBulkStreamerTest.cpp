@@ -0,0 +1,281 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#include "Common.h"
+#include "Logger.h"
+#include "Timer.h"
+#include "USBBulkStreamer.h"
+
+#include <iostream>
+#include <deque>
+#include <thread>
+#include <chrono>
+#include <cstring>
+
+using namespace Voxel;
+
+#define FRAME_SIZE (320*240*4)
+#define ENDPOINT 0x86
+
+// Completes queued transfers in order, filling each with a frame whose first word is a running sequence number
+class MockUSBIO: public USBIO
+{
+protected:
+  std::deque<uint8_t *> _queued;
+  BulkStreamCallback _callback;
+  long _transferLength = 0;
+
+  ThreadPtr _thread;
+  Atomic<bool> _running;
+
+  void _run()
+  {
+    while(_running && _queued.size())
+    {
+      if(interval)
+        std::this_thread::sleep_for(std::chrono::microseconds(interval));
+
+      maxQueued = std::max(maxQueued, _queued.size());
+
+      uint8_t *data = _queued.front();
+      _queued.pop_front();
+
+      uint32_t s = sequence++;
+      long length = (shortEvery && s % shortEvery == shortEvery - 1)?FRAME_SIZE/2:FRAME_SIZE;
+
+      if(length > _transferLength)
+        length = _transferLength;
+
+      memcpy(data, &s, sizeof(s));
+      memset(data + sizeof(s), s & 0xFF, length - sizeof(s));
+
+      uint8_t *next = _callback(data, length, true);
+
+      if(next)
+        _queued.push_back(next);
+    }
+  }
+
+public:
+  uint32_t sequence = 0;
+  SizeType shortEvery = 0; // Every 'shortEvery'th transfer is incomplete
+  TimeStampType interval = 0; // in micro-seconds, between completions
+  SizeType maxQueued = 0;
+
+  MockUSBIO() { _running = false; }
+
+  virtual bool isInitialized() { return true; }
+  virtual bool controlTransfer(Direction direction, RequestType requestType, RecipientType recipientType, uint8_t request, uint16_t value, uint16_t index,
+                               uint8_t *data, uint16_t length, long timeout) { return false; }
+  virtual bool bulkTransfer(uint8_t endpoint, uint8_t *data, long toTransferLength, long &transferredLength, long timeout) { return false; }
+  virtual bool resetBulkEndPoint(uint8_t endpoint) { return true; }
+
+  virtual bool startBulkStream(uint8_t endpoint, const Vector<uint8_t *> &buffers, long transferLength, BulkStreamCallback callback, long timeout)
+  {
+    if(_thread || endpoint != ENDPOINT)
+      return false;
+
+    _queued.assign(buffers.begin(), buffers.end());
+    _transferLength = transferLength;
+    _callback = callback;
+    maxQueued = 0;
+
+    _running = true;
+    _thread = ThreadPtr(new Thread(&MockUSBIO::_run, this));
+    return true;
+  }
+
+  virtual bool stopBulkStream()
+  {
+    if(!_thread)
+      return false;
+
+    _running = false;
+    _thread->join();
+    _thread = nullptr;
+    return true;
+  }
+
+  virtual ~MockUSBIO() { stopBulkStream(); }
+};
+
+bool isValidFrame(const RawDataFramePtr &p, uint32_t &s)
+{
+  if(p->rawDataSize() != FRAME_SIZE)
+    return false;
+
+  memcpy(&s, p->rawData(), sizeof(s));
+
+  const uint8_t *d = p->rawData();
+
+  for(auto i = sizeof(s); i < FRAME_SIZE; i += 997)
+    if(d[i] != (s & 0xFF))
+      return false;
+
+  return d[FRAME_SIZE - 1] == (s & 0xFF);
+}
+
+// Captures 'count' frames and checks their contents and ordering
+bool captureFrames(USBBulkStreamer &streamer, SizeType count, bool zeroCopy, SizeType &gaps)
+{
+  RawDataFramePtr p;
+  uint32_t s, last = 0;
+
+  gaps = 0;
+
+  for(auto i = 0; i < count; i++)
+  {
+    if(!streamer.capture(p) || p->isBorrowed() != zeroCopy || !isValidFrame(p, s) || (i && s <= last))
+    {
+      std::cerr << "FAIL: invalid frame " << i << std::endl;
+      return false;
+    }
+
+    if(i && s != last + 1)
+      gaps++;
+
+    last = s;
+  }
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  logger.setDefaultLogLevel(LOG_ERROR);
+
+  MockUSBIO *mock = new MockUSBIO();
+  USBIOPtr usbIO(mock);
+
+  USBBulkStreamer streamer(usbIO, DevicePtr(new USBDevice(0xFFFF, 0xFFFE, "")), ENDPOINT);
+
+  int failures = 0;
+  SizeType gaps;
+
+  streamer.setBufferSize(FRAME_SIZE);
+
+  if(streamer.isZeroCopy())
+  {
+    std::cerr << "FAIL: zero copy on by default" << std::endl;
+    failures++;
+  }
+
+  streamer.setZeroCopy(true);
+
+  // Paced at 1000 fps, so that capture keeps up and no frame is dropped
+  mock->interval = 1000;
+
+  if(!streamer.start() || !captureFrames(streamer, 100, true, gaps) || gaps || mock->maxQueued != streamer.getTransferCount())
+  {
+    std::cerr << "FAIL: zero copy streaming. Gaps = " << gaps << ", max queued transfers = " << mock->maxQueued << std::endl;
+    failures++;
+  }
+
+  // Borrowed frames held by consumer must not be overwritten by later transfers
+  {
+    RawDataFramePtr held[3];
+    uint32_t s[3], t;
+
+    for(auto i = 0; i < 3; i++)
+      if(!streamer.capture(held[i]) || !isValidFrame(held[i], s[i]))
+        failures++;
+
+    if(!captureFrames(streamer, 20, true, gaps))
+      failures++;
+
+    for(auto i = 0; i < 3; i++)
+    {
+      if(!isValidFrame(held[i], t) || t != s[i])
+      {
+        std::cerr << "FAIL: held frame " << i << " was overwritten" << std::endl;
+        failures++;
+      }
+    }
+  }
+
+  streamer.stop();
+
+  // Incomplete transfers are dropped
+  mock->shortEvery = 10;
+  mock->sequence = 0;
+
+  if(!streamer.start() || !captureFrames(streamer, 45, true, gaps) || gaps < 4 || streamer.getDroppedFrameCount() < 4)
+  {
+    std::cerr << "FAIL: incomplete transfers. Gaps = " << gaps << ", dropped = " << streamer.getDroppedFrameCount() << std::endl;
+    failures++;
+  }
+
+  streamer.stop();
+
+  // Capture fails without waiting once the streamer gives up on a device sending no complete frame
+  mock->shortEvery = 1;
+
+  if(streamer.start())
+  {
+    RawDataFramePtr p;
+    Timer timer;
+    TimeStampType start = timer.getCurentRealTime();
+    
+    for(auto i = 0; i < 3; i++)
+    {
+      if(streamer.capture(p))
+      {
+        std::cerr << "FAIL: capture succeeded with no complete transfer" << std::endl;
+        failures++;
+      }
+    }
+    
+    if(timer.getCurentRealTime() - start > 2000000)
+    {
+      std::cerr << "FAIL: capture waited on retired transfers" << std::endl;
+      failures++;
+    }
+  }
+  else
+    failures++;
+
+  streamer.stop();
+  mock->shortEvery = 0;
+
+  // Copy mode
+  if(!streamer.setZeroCopy(false) || !streamer.start() || !captureFrames(streamer, 50, false, gaps) || gaps)
+  {
+    std::cerr << "FAIL: copy mode streaming. Gaps = " << gaps << std::endl;
+    failures++;
+  }
+
+  streamer.stop();
+
+  // Unpaced: throughput of the streamer, with frames dropped when capture does not keep up
+  mock->interval = 0;
+  streamer.setZeroCopy(true);
+  streamer.setTransferCount(8);
+
+  Timer timer;
+  TimeStampType start = timer.getCurentRealTime();
+
+  if(!streamer.start() || !captureFrames(streamer, 1000, true, gaps) || mock->maxQueued != 8)
+  {
+    std::cerr << "FAIL: unpaced streaming" << std::endl;
+    failures++;
+  }
+  else
+  {
+    TimeStampType duration = timer.getCurentRealTime() - start;
+    std::cout << "Unpaced: 1000 frames of " << FRAME_SIZE << " bytes in " << duration << " us, "
+      << streamer.getDroppedFrameCount() << " dropped" << std::endl;
+  }
+
+  streamer.stop();
+
+  if(failures)
+  {
+    std::cerr << failures << " test(s) failed" << std::endl;
+    return -1;
+  }
+
+  std::cout << "All tests passed" << std::endl;
+  return 0;
+}
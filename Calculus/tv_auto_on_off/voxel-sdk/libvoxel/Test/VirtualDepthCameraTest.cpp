@@ -0,0 +1,533 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#include "Common.h"
+#include "Logger.h"
+#include "Timer.h"
+#include "CameraSystem.h"
+#include "VirtualDepthCamera.h"
+
+#include <iostream>
+#include <cstdio>
+#include <thread>
+#include <chrono>
+
+using namespace Voxel;
+
+#define TEST_PROCESSED_GENERATOR_ID 0x7F00
+#define TEST_DEPTH_GENERATOR_ID 0x7F01
+
+#define WIDTH 16
+#define HEIGHT 4
+#define FRAME_COUNT 10
+#define FRAME_INTERVAL 20000 // in micro-seconds, as recorded
+
+// Raw data is phase as uint16_t per pixel
+class TestProcessedGenerator: public FrameGenerator
+{
+protected:
+  FrameSize _size;
+
+  virtual bool _writeConfiguration(SerializedObject &object)
+  {
+    object.resize(_sizeOfVersion() + sizeof(_size));
+    return _writeVersion(object) && object.put((const char *)&_size, sizeof(_size)) == sizeof(_size);
+  }
+
+public:
+  TestProcessedGenerator(): FrameGenerator(TEST_PROCESSED_GENERATOR_ID, DepthCamera::FRAME_RAW_FRAME_PROCESSED, 0, 1)
+  {
+    _size.width = _size.height = 0;
+  }
+
+  inline void setSize(const FrameSize &s) { _size = s; }
+
+  virtual bool readConfiguration(SerializedObject &object)
+  {
+    return _readVersion(object) && object.get((char *)&_size, sizeof(_size)) == sizeof(_size);
+  }
+
+  virtual bool generate(const FramePtr &in, FramePtr &out)
+  {
+    const RawDataFrame *r = dynamic_cast<const RawDataFrame *>(in.get());
+
+    if(!r || r->data.size() != _size.width*_size.height*sizeof(uint16_t))
+      return false;
+
+    ToFRawFrameTemplate<uint16_t, uint8_t> *t = dynamic_cast<ToFRawFrameTemplate<uint16_t, uint8_t> *>(out.get());
+
+    if(!t)
+    {
+      t = new ToFRawFrameTemplate<uint16_t, uint8_t>();
+      out = FramePtr(t);
+    }
+
+    t->id = r->id;
+    t->timestamp = r->timestamp;
+    t->size = _size;
+    t->_phase.resize(_size.width*_size.height);
+    t->_amplitude.assign(_size.width*_size.height, 1);
+    t->_ambient.assign(_size.width*_size.height, 0);
+    t->_flags.assign(_size.width*_size.height, 0);
+    memcpy(t->_phase.data(), r->data.data(), r->data.size());
+    return true;
+  }
+};
+
+class TestDepthGenerator: public DepthFrameGenerator
+{
+protected:
+  virtual bool _writeConfiguration(SerializedObject &object)
+  {
+    object.resize(_sizeOfVersion());
+    return _writeVersion(object);
+  }
+
+public:
+  TestDepthGenerator(): DepthFrameGenerator(TEST_DEPTH_GENERATOR_ID, DepthCamera::FRAME_DEPTH_FRAME, 0, 1) {}
+
+  virtual bool setProcessedFrameGenerator(FrameGeneratorPtr &p) { return true; }
+
+  virtual bool readConfiguration(SerializedObject &object) { return _readVersion(object); }
+
+  virtual bool generate(const FramePtr &in, FramePtr &out)
+  {
+    const ToFRawFrameTemplate<uint16_t, uint8_t> *t = dynamic_cast<const ToFRawFrameTemplate<uint16_t, uint8_t> *>(in.get());
+
+    if(!t)
+      return false;
+
+    DepthFrame *d = dynamic_cast<DepthFrame *>(out.get());
+
+    if(!d)
+    {
+      d = new DepthFrame();
+      out = FramePtr(d);
+    }
+
+    d->id = t->id;
+    d->timestamp = t->timestamp;
+    d->size = t->size;
+    d->depth.resize(t->_phase.size());
+    d->amplitude.resize(t->_phase.size());
+
+    for(auto i = 0; i < t->_phase.size(); i++)
+    {
+      d->depth[i] = t->_phase[i]*0.001f;
+      d->amplitude[i] = t->_amplitude[i];
+    }
+    return true;
+  }
+};
+
+class TestFactory: public DepthCameraFactory
+{
+public:
+  TestFactory(): DepthCameraFactory("Test::Factory")
+  {
+    _addSupportedDevices({ DevicePtr(new USBDevice(0xFFFF, 0xFFFE, "")) });
+  }
+
+  virtual bool getChannels(Device &device, Vector<int> &channels) { channels = { 0 }; return true; }
+  virtual DepthCameraPtr getDepthCamera(DevicePtr device) { return nullptr; }
+
+  virtual bool getFrameGenerator(uint8_t frameType, GeneratorIDType generatorID, FrameGeneratorPtr &frameGenerator)
+  {
+    if(frameType == DepthCamera::FRAME_RAW_FRAME_PROCESSED && generatorID == TEST_PROCESSED_GENERATOR_ID)
+      frameGenerator = FrameGeneratorPtr(new TestProcessedGenerator());
+    else if(frameType == DepthCamera::FRAME_DEPTH_FRAME && generatorID == TEST_DEPTH_GENERATOR_ID)
+      frameGenerator = FrameGeneratorPtr(new TestDepthGenerator());
+    else
+      return false;
+    return true;
+  }
+
+  virtual Vector<GeneratorIDType> getSupportedGeneratorTypes() { return { TEST_PROCESSED_GENERATOR_ID, TEST_DEPTH_GENERATOR_ID }; }
+};
+
+uint16_t phaseOf(int frame, int pixel) { return 100*frame + pixel; }
+
+bool writeStream(const String &fileName)
+{
+  FrameSize size;
+  size.width = WIDTH;
+  size.height = HEIGHT;
+
+  TestProcessedGenerator processed;
+  TestDepthGenerator depth;
+  PointCloudFrameGenerator pointCloud;
+
+  processed.setSize(size);
+
+  if(!pointCloud.setParameters(0, 0, WIDTH, HEIGHT, 1, 1, WIDTH, WIDTH, WIDTH/2.0f, HEIGHT/2.0f, 0, 0, 0, 0, 0))
+    return false;
+
+  FrameStreamWriterPtr w(new FrameStreamWriter(fileName, processed.id(), depth.id(), pointCloud.id()));
+
+  processed.setFrameStreamWriter(w);
+  depth.setFrameStreamWriter(w);
+  pointCloud.setFrameStreamWriter(w);
+
+  if(!processed.writeConfiguration() || !depth.writeConfiguration() || !pointCloud.writeConfiguration())
+    return false;
+
+  for(auto f = 0; f < FRAME_COUNT; f++)
+  {
+    RawDataFrame *r = new RawDataFrame();
+    FramePtr p(r);
+
+    r->id = f;
+    r->timestamp = 1000000 + f*FRAME_INTERVAL;
+    r->data.resize(WIDTH*HEIGHT*sizeof(uint16_t));
+
+    uint16_t *phase = (uint16_t *)r->data.data();
+
+    for(auto i = 0; i < WIDTH*HEIGHT; i++)
+      phase[i] = phaseOf(f, i);
+
+    if(!w->write(p))
+      return false;
+  }
+
+  return w->close();
+}
+
+// Plays back the stream once (or till 'stopAfter' frames when looping) and returns the frame ids seen
+bool play(VirtualDepthCamera &camera, Vector<int> &ids, TimeStampType &duration, SizeType stopAfter = 0)
+{
+  bool valid = true;
+  ids.clear();
+
+  camera.clearAllCallbacks();
+  camera.registerCallback(DepthCamera::FRAME_DEPTH_FRAME, [&](DepthCamera &dc, const Frame &frame, DepthCamera::FrameType type) {
+    const DepthFrame *d = dynamic_cast<const DepthFrame *>(&frame);
+
+    if(!d || d->depth.size() != WIDTH*HEIGHT)
+      valid = false;
+    else
+    {
+      for(auto i = 0; i < WIDTH*HEIGHT; i++)
+        if(d->depth[i] != phaseOf(d->id, i)*0.001f)
+          valid = false;
+    }
+
+    ids.push_back(frame.id);
+
+    if(stopAfter && ids.size() == stopAfter)
+      dc.stop();
+  });
+
+  Timer t;
+  TimeStampType start = t.getCurentRealTime();
+
+  if(!camera.start())
+    return false;
+
+  camera.wait();
+
+  duration = t.getCurentRealTime() - start;
+  return valid;
+}
+
+bool inOrder(const Vector<int> &ids)
+{
+  for(auto i = 0; i < ids.size(); i++)
+    if(ids[i] != i % FRAME_COUNT)
+      return false;
+  return true;
+}
+
+bool checkLatency(const DepthCameraStatistics &stats, const String &name, uint64_t count)
+{
+  for(auto &s: stats.stages)
+  {
+    if(s.name != name)
+      continue;
+    
+    if(s.count != count || s.p50 > s.p99 || s.p99 > s.max || s.average() > s.max)
+    {
+      std::cerr << "FAIL: statistics of '" << name << "' has count = " << s.count << " (expected " << count << "), p50 = "
+        << s.p50 << ", p99 = " << s.p99 << ", max = " << s.max << std::endl;
+      return false;
+    }
+    return true;
+  }
+  
+  std::cerr << "FAIL: no statistics for '" << name << "'" << std::endl;
+  return false;
+}
+
+// Plays back the stream once through a depth filter and checks counters and latencies of each stage
+bool checkStatistics(CameraSystem &sys, VirtualDepthCamera &camera)
+{
+  FilterPtr filter = sys.createFilter("Voxel::MedianFilter", DepthCamera::FRAME_DEPTH_FRAME);
+  
+  if(!filter)
+  {
+    std::cerr << "FAIL: could not create median filter" << std::endl;
+    return false;
+  }
+  
+  int filterIndex = camera.addFilter(filter, DepthCamera::FRAME_DEPTH_FRAME);
+  
+  SizeType callbacks = 0;
+  DepthCameraStatistics stats;
+  bool result = true;
+  
+  camera.clearAllCallbacks();
+  camera.registerCallback(DepthCamera::FRAME_DEPTH_FRAME, [&](DepthCamera &dc, const Frame &frame, DepthCamera::FrameType type) {
+    callbacks++;
+  });
+  
+  camera.setLoop(false);
+  camera.setPlaybackMode(VirtualDepthCamera::PLAYBACK_MAX_SPEED);
+  camera.seekTo(0);
+  
+  // Counters are maintained even while statistics are disabled, but latencies are not
+  camera.resetStatistics();
+  camera.enableStatistics(false);
+  
+  if(!camera.start())
+    return false;
+  
+  camera.wait();
+  
+  if(!camera.getStatistics(stats) || stats.framesCaptured != FRAME_COUNT || stats.framesFailed || stats.framesDropped ||
+    !checkLatency(stats, "capture", 0) || !checkLatency(stats, "callback/depth", 0))
+  {
+    std::cerr << "FAIL: statistics while disabled gave captured = " << stats.framesCaptured << ", failed = " << stats.framesFailed << std::endl;
+    result = false;
+  }
+  
+  callbacks = 0;
+  camera.resetStatistics();
+  camera.enableStatistics(true);
+  
+  if(!camera.start())
+    return false;
+  
+  camera.wait();
+  
+  String filterName = "filter/depth/" + std::to_string(filterIndex) + ":" + filter->name();
+  
+  if(!camera.getStatistics(stats) || stats.framesCaptured != FRAME_COUNT || stats.framesFailed || stats.framesDropped ||
+    callbacks != FRAME_COUNT || stats.pipelineStages.size() != DepthCamera::PIPELINE_STAGE_COUNT ||
+    stats.pipelineStages[DepthCamera::PIPELINE_STAGE_DEPTH].frameCount != FRAME_COUNT ||
+    !checkLatency(stats, "capture", FRAME_COUNT) || !checkLatency(stats, "process", FRAME_COUNT) ||
+    !checkLatency(stats, "depth", FRAME_COUNT) || !checkLatency(stats, "point_cloud", 0) || !checkLatency(stats, "callback", 0) ||
+    !checkLatency(stats, filterName, FRAME_COUNT) || !checkLatency(stats, "callback/depth", FRAME_COUNT))
+  {
+    std::cerr << "FAIL: statistics while enabled gave captured = " << stats.framesCaptured << ", failed = " << stats.framesFailed
+      << ", callbacks = " << callbacks << std::endl;
+    result = false;
+  }
+  else
+  {
+    for(auto &s: stats.stages)
+      if(s.count)
+        std::cout << s.name << ": count = " << s.count << ", average = " << s.average() << " us, p99 = " << s.p99 << " us" << std::endl;
+  }
+  
+  // Callback slower than the recorded frame interval, in pipelined mode with a queue of one frame, makes the pipeline drop frames
+  callbacks = 0;
+  camera.clearAllCallbacks();
+  camera.registerCallback(DepthCamera::FRAME_DEPTH_FRAME, [&](DepthCamera &dc, const Frame &frame, DepthCamera::FrameType type) {
+    callbacks++;
+    std::this_thread::sleep_for(std::chrono::microseconds(3*FRAME_INTERVAL));
+  });
+  
+  camera.setPlaybackMode(VirtualDepthCamera::PLAYBACK_ORIGINAL_TIMING);
+  camera.resetStatistics();
+  
+  if(!camera.setPipelineMode(true, 1, DepthCamera::PIPELINE_DROP_NEWEST) || !camera.start())
+    return false;
+  
+  camera.wait();
+  
+  if(!camera.getStatistics(stats) || stats.framesCaptured != FRAME_COUNT || !stats.framesDropped || !callbacks ||
+    callbacks + stats.framesDropped > stats.framesCaptured ||
+    stats.pipelineStages[DepthCamera::PIPELINE_STAGE_CALLBACK].frameCount != callbacks ||
+    !checkLatency(stats, "callback", callbacks))
+  {
+    std::cerr << "FAIL: pipelined statistics gave captured = " << stats.framesCaptured << ", dropped = " << stats.framesDropped
+      << ", callbacks = " << callbacks << std::endl;
+    result = false;
+  }
+  else
+    std::cout << "Pipelined: captured = " << stats.framesCaptured << ", dropped = " << stats.framesDropped << ", called back = " << callbacks << std::endl;
+  
+  camera.setPipelineMode(false);
+  camera.enableStatistics(false);
+  camera.removeFilter(filterIndex, DepthCamera::FRAME_DEPTH_FRAME);
+  camera.clearAllCallbacks();
+  return result;
+}
+
+// Holds every frame given to a shared callback till the end of playback, and checks that none was overwritten by later frames.
+// Pipelined playback runs on a thread pool, as that delivers the frames still queued at the end of the stream.
+// Frames are handed over to 'kept' when given
+bool checkSharedFrames(VirtualDepthCamera &camera, bool pipelined, Vector<ConstFramePtr> *kept = nullptr)
+{
+  Vector<ConstFramePtr> held;
+  Mutex mutex;
+
+  camera.clearAllCallbacks();
+  camera.registerSharedCallback(DepthCamera::FRAME_DEPTH_FRAME, [&](DepthCamera &dc, const ConstFramePtr &frame, DepthCamera::FrameType type) {
+    Lock<Mutex> _(mutex);
+    held.push_back(frame);
+  });
+
+  camera.setLoop(false);
+  camera.setPlaybackMode(VirtualDepthCamera::PLAYBACK_MAX_SPEED);
+
+  if((pipelined && (!camera.setPipelineMode(true, FRAME_COUNT, DepthCamera::PIPELINE_BLOCK) ||
+    !camera.setPipelineThreadPool(ThreadPoolPtr(new ThreadPool(2))))) || !camera.start())
+    return false;
+
+  camera.wait();
+  camera.setPipelineThreadPool(nullptr);
+  camera.setPipelineMode(false);
+  camera.clearAllCallbacks();
+
+  bool valid = held.size() == FRAME_COUNT;
+
+  for(auto f = 0; valid && f < held.size(); f++)
+  {
+    const DepthFrame *d = dynamic_cast<const DepthFrame *>(held[f].get());
+
+    if(!d || d->id != f || d->depth.size() != WIDTH*HEIGHT)
+      valid = false;
+    else
+    {
+      for(auto i = 0; i < WIDTH*HEIGHT; i++)
+        if(d->depth[i] != phaseOf(f, i)*0.001f)
+          valid = false;
+    }
+  }
+
+  if(!valid)
+    std::cerr << "FAIL: " << (pipelined?"pipelined ":"") << "shared frames were not kept intact, held " << held.size() << " frames" << std::endl;
+
+  if(kept)
+    kept->swap(held);
+
+  return valid;
+}
+
+int main(int argc, char *argv[])
+{
+  String fileName = "VirtualDepthCameraTest.vxl";
+
+  CameraSystem sys;
+
+  if(!sys.addDepthCameraFactory(DepthCameraFactoryPtr(new TestFactory())) || !writeStream(fileName))
+  {
+    std::cerr << "Failed to write test stream" << std::endl;
+    return -1;
+  }
+
+  DepthCameraPtr depthCamera = sys.connect(DevicePtr(new VirtualDevice(fileName)));
+  VirtualDepthCameraPtr camera = std::dynamic_pointer_cast<VirtualDepthCamera>(depthCamera);
+
+  FrameSize size;
+  FrameRate rate;
+
+  if(!camera || !camera->isInitialized() || camera->getFrameCount() != FRAME_COUNT ||
+    !camera->getFrameSize(size) || size.width != WIDTH || size.height != HEIGHT ||
+    !camera->getFrameRate(rate) || (int)(rate.getFrameRate() + 0.5f) != 1000000/FRAME_INTERVAL)
+  {
+    std::cerr << "Virtual camera was not created as per the recorded stream" << std::endl;
+    return -1;
+  }
+
+  int failures = 0;
+  Vector<int> ids;
+  TimeStampType duration;
+
+  camera->setLoop(false);
+
+  camera->setPlaybackMode(VirtualDepthCamera::PLAYBACK_MAX_SPEED);
+
+  if(!play(*camera, ids, duration) || ids.size() != FRAME_COUNT || !inOrder(ids))
+  {
+    std::cerr << "FAIL: max speed playback gave " << ids.size() << " frames" << std::endl;
+    failures++;
+  }
+  else
+    std::cout << "Max speed: " << ids.size() << " frames in " << duration << " us" << std::endl;
+
+  camera->setPlaybackMode(VirtualDepthCamera::PLAYBACK_ORIGINAL_TIMING);
+
+  if(!play(*camera, ids, duration) || ids.size() != FRAME_COUNT || !inOrder(ids) ||
+    duration < (FRAME_COUNT - 1)*FRAME_INTERVAL)
+  {
+    std::cerr << "FAIL: original timing playback gave " << ids.size() << " frames in " << duration << " us" << std::endl;
+    failures++;
+  }
+  else
+    std::cout << "Original timing: " << ids.size() << " frames in " << duration << " us" << std::endl;
+
+  rate.numerator = 100;
+  rate.denominator = 1;
+
+  camera->setPlaybackMode(VirtualDepthCamera::PLAYBACK_FIXED_FRAME_RATE);
+
+  if(!camera->setFrameRate(rate) || !play(*camera, ids, duration) || ids.size() != FRAME_COUNT || !inOrder(ids) ||
+    duration < (FRAME_COUNT - 1)*10000)
+  {
+    std::cerr << "FAIL: fixed frame rate playback gave " << ids.size() << " frames in " << duration << " us" << std::endl;
+    failures++;
+  }
+  else
+    std::cout << "Fixed frame rate: " << ids.size() << " frames in " << duration << " us" << std::endl;
+
+  camera->setLoop(true);
+  camera->setPlaybackMode(VirtualDepthCamera::PLAYBACK_MAX_SPEED);
+
+  if(!play(*camera, ids, duration, 2*FRAME_COUNT + 5) || ids.size() != 2*FRAME_COUNT + 5 || !inOrder(ids))
+  {
+    std::cerr << "FAIL: looped playback gave " << ids.size() << " frames" << std::endl;
+    failures++;
+  }
+
+  if(!checkStatistics(sys, *camera))
+    failures++;
+
+  Vector<ConstFramePtr> kept;
+
+  if(!checkSharedFrames(*camera, false) || !checkSharedFrames(*camera, true, &kept))
+    failures++;
+  
+  sys.disconnect(depthCamera);
+  camera = nullptr;
+  depthCamera = nullptr;
+
+  // Shared frames outlive the camera, and release into its pool after it is gone
+  for(auto f = 0; f < kept.size(); f++)
+  {
+    const DepthFrame *d = dynamic_cast<const DepthFrame *>(kept[f].get());
+
+    if(!d || d->id != f || d->depth[0] != phaseOf(f, 0)*0.001f)
+    {
+      std::cerr << "FAIL: shared frame " << f << " changed after the camera was destroyed" << std::endl;
+      failures++;
+      break;
+    }
+  }
+
+  kept.clear();
+
+  std::remove(fileName.c_str());
+
+  if(failures)
+  {
+    std::cerr << failures << " test(s) failed" << std::endl;
+    return -1;
+  }
+
+  std::cout << "All tests passed" << std::endl;
+  return 0;
+}
@@ -9,6 +9,7 @@
 #include <Configuration.h>
 #include <Filter/VoxelFilterFactory.h>
 #include "PointCloudFrameGenerator.h"
+#include "VirtualDepthCamera.h"
 
 #include <fstream>
 
@@ -30,6 +31,7 @@ CameraSystem::CameraSystem()
 void CameraSystem::_init()
 {
   addFilterFactory(FilterFactoryPtr(new VoxelFilterFactory()));
+  addDepthCameraFactory(DepthCameraFactoryPtr(new VirtualDepthCameraFactory(*this)));
   
   Configuration c;
   
@@ -273,6 +275,8 @@ DepthCameraPtr CameraSystem::connect(const DevicePtr &device)
   if(f != _factories.end())
   {
     DepthCameraPtr p = f->second->getDepthCamera(device);
+    if(_threadSettingsSet)
+      p->setThreadSettings(_threadSettings);
     if(!p->refreshParams())
       logger(LOG_ERROR) << "CameraSystem: Could not refresh parameters for " << p->id() << "." << std::endl;
     else
@@ -317,6 +321,41 @@ bool CameraSystem::disconnect(const DepthCameraPtr &depthCamera, bool reset)
   return false;
 }
 
+bool CameraSystem::setThreadSettings(const DepthCamera::ThreadSettings &settings)
+{
+  _threadSettings = settings;
+  _threadSettingsSet = true;
+  
+  bool ret = true;
+  
+  for(auto &c: _depthCameras)
+    ret = c.second->setThreadSettings(settings) && ret;
+  
+  return ret;
+}
+
+void CameraSystem::setProcessingThreads(SizeType threadCount, CPUAffinityMask affinity)
+{
+  if(threadCount == 0)
+    threadCount = ThreadPool::getDefaultProcessingThreadCount();
+  
+  ThreadPool::setProcessingPool(ThreadPoolPtr(new ThreadPool(threadCount, affinity)));
+}
+
+MultiCameraSessionPtr CameraSystem::createSession(const Vector<DepthCameraPtr> &cameras, SizeType threadCount)
+{
+  for(auto &c: cameras)
+  {
+    if(!c || _depthCameras.find(c->getDevice()->id()) == _depthCameras.end())
+    {
+      logger(LOG_ERROR) << "CameraSystem: Session can only be created for cameras connected through this camera system" << std::endl;
+      return nullptr;
+    }
+  }
+  
+  return MultiCameraSessionPtr(new MultiCameraSession(cameras, threadCount));
+}
+
 Vector<DevicePtr> CameraSystem::getProgrammableDevices()
 {
   Vector<DevicePtr> devices = DeviceScanner::scan();
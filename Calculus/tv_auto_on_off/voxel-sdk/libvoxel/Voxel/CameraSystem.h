@@ -9,6 +9,7 @@
 
 #include <DepthCameraLibrary.h>
 #include "DownloaderFactory.h"
+#include "MultiCameraSession.h"
 
 namespace Voxel
 {
@@ -38,6 +39,9 @@ protected:
   
   Map<GeneratorIDType, DepthCameraFactoryPtr> _factoryForGeneratorID; // Key = frame generator ID
   
+  bool _threadSettingsSet = false;
+  DepthCamera::ThreadSettings _threadSettings;
+  
   void _init();
   
   void _loadLibraries(const Vector<String> &paths);
@@ -53,6 +57,16 @@ public:
   // Remove local reference. Outside calling function should remove reference to its DepthCamera as well
   bool disconnect(const DepthCameraPtr &depthCamera, bool reset = false);
   
+  // Session running 'cameras' together on a shared pool of 'threadCount' threads, 0 => one per hardware thread
+  MultiCameraSessionPtr createSession(const Vector<DepthCameraPtr> &cameras, SizeType threadCount = 0);
+  
+  // Thread settings of cameras connected through this camera system, now and later, in place of those from their
+  // configuration. Returns false if a camera could not take them, e.g., as it is running
+  bool setThreadSettings(const DepthCamera::ThreadSettings &settings);
+  
+  // Replaces the process-wide pool running data-parallel loops of filters and generators. 'threadCount' = 0 =>
+  // ThreadPool::getDefaultProcessingThreadCount()
+  void setProcessingThreads(SizeType threadCount, CPUAffinityMask affinity = 0);
   
   
   bool addFilterFactory(FilterFactoryPtr filterFactory);
@@ -7,9 +7,12 @@
 #include "Common.h"
 #include <sstream>
 #include <iomanip>
+#include <stdio.h>
 
 #ifdef LINUX
 #include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
 #elif defined(WINDOWS)
 #include <windows.h>
 #endif
@@ -128,6 +131,49 @@ int getFiles(const String &dir, const String &matchString, Vector<String> &files
   return files.size();
 }
 
+bool writeFileAtomically(const String &fileName, const Function<bool (OutputFileStream &)> &write)
+{
+  String tempFileName = fileName + ".tmp";
+  
+  {
+    OutputFileStream out(tempFileName, std::ios::binary | std::ios::out | std::ios::trunc);
+    
+    if(!out.good())
+      return false;
+    
+    if(!write(out) || !out.good())
+    {
+      out.close();
+      remove(tempFileName.c_str());
+      return false;
+    }
+  }
+  
+#ifdef WINDOWS
+  remove(fileName.c_str()); // rename() does not replace an existing file on Windows
+#endif
+  
+  if(rename(tempFileName.c_str(), fileName.c_str()) != 0)
+  {
+    remove(tempFileName.c_str());
+    return false;
+  }
+  
+  return true;
+}
+
+uint64_t fnv1a64(const void *data, SizeType size, uint64_t hash)
+{
+  const uint8_t *d = (const uint8_t *)data;
+  
+  for(auto i = 0; i < size; i++)
+  {
+    hash ^= d[i];
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
 //gcf function - return gcd of two numbers
 uint gcd(uint n, uint m)
 {
@@ -164,5 +210,110 @@ unsigned int nearestPowerOf2(unsigned int value)
     return result;
 }
 
+bool parseCPUList(const String &list, CPUAffinityMask &mask)
+{
+  mask = 0;
+  
+  for(std::size_t previous = 0, pos = 0; previous <= list.size(); previous = pos + 1)
+  {
+    pos = list.find(',', previous);
+    
+    if(pos == String::npos)
+      pos = list.size();
+    
+    String s = list.substr(previous, pos - previous);
+    trim(s);
+    
+    if(!s.size())
+      continue;
+    
+    char *end;
+    long first = strtol(s.c_str(), &end, 10), last = first;
+    
+    if(end == s.c_str())
+      return false;
+    
+    if(*end == '-')
+    {
+      const char *next = end + 1;
+      last = strtol(next, &end, 10);
+      
+      if(end == next)
+        return false;
+    }
+    
+    if(*end || first < 0 || last < first || last >= (long)sizeof(CPUAffinityMask)*8)
+      return false;
+    
+    for(auto c = first; c <= last; c++)
+      mask |= (CPUAffinityMask)1 << c;
+  }
+  return true;
+}
+
+#ifdef LINUX
+static bool setAffinity(pthread_t thread, CPUAffinityMask affinity)
+{
+  if(!affinity)
+    return true;
+  
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  
+  for(auto c = 0; c < sizeof(CPUAffinityMask)*8 && c < CPU_SETSIZE; c++)
+    if(affinity & ((CPUAffinityMask)1 << c))
+      CPU_SET(c, &set);
+  
+  return pthread_setaffinity_np(thread, sizeof(set), &set) == 0;
+}
+#elif defined(WINDOWS)
+static bool setAffinity(HANDLE thread, CPUAffinityMask affinity)
+{
+  if(!affinity)
+    return true;
+  
+  return SetThreadAffinityMask(thread, (DWORD_PTR)affinity) != 0;
+}
+#endif
+
+bool setThreadAffinity(Thread &thread, CPUAffinityMask affinity)
+{
+#ifdef LINUX
+  return setAffinity(thread.native_handle(), affinity);
+#elif defined(WINDOWS)
+  return setAffinity((HANDLE)thread.native_handle(), affinity);
+#else
+  return !affinity;
+#endif
+}
+
+bool setCurrentThreadAffinity(CPUAffinityMask affinity)
+{
+#ifdef LINUX
+  return setAffinity(pthread_self(), affinity);
+#elif defined(WINDOWS)
+  return setAffinity(GetCurrentThread(), affinity);
+#else
+  return !affinity;
+#endif
+}
+
+bool setCurrentThreadRealTimePriority(int priority)
+{
+  if(priority <= 0)
+    return true;
+  
+#ifdef LINUX
+  sched_param param;
+  param.sched_priority = std::min(std::max(priority, sched_get_priority_min(SCHED_FIFO)), sched_get_priority_max(SCHED_FIFO));
+  
+  return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+#elif defined(WINDOWS)
+  return SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL) != 0; // No finer levels of real-time priority
+#else
+  return false;
+#endif
+}
+
   
 }
\ No newline at end of file
@@ -100,6 +100,53 @@ typedef std::ofstream OutputFileStream;
 typedef std::ostream OutputStream;
 typedef std::ostringstream OutputStringStream;
 
+/// Allocator for containers whose data needs to start at an 'alignment' byte boundary, e.g., for SIMD loads.
+/// 'alignment' needs to be a power of 2 and atleast sizeof(void *)
+template <typename T, SizeType alignment>
+class AlignedAllocator
+{
+public:
+  typedef T value_type;
+  
+  template <typename U>
+  struct rebind { typedef AlignedAllocator<U, alignment> other; };
+  
+  AlignedAllocator() {}
+  
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, alignment> &other) {}
+  
+  // Pointer returned by operator new is kept just before the aligned block
+  T *allocate(SizeType n)
+  {
+    uint8_t *p = (uint8_t *)::operator new(n*sizeof(T) + alignment + sizeof(void *));
+    uint8_t *aligned = (uint8_t *)(((uintptr_t)p + sizeof(void *) + alignment - 1) & ~(uintptr_t)(alignment - 1));
+    ((void **)aligned)[-1] = p;
+    return (T *)aligned;
+  }
+  
+  void deallocate(T *p, SizeType n)
+  {
+    if(p)
+      ::operator delete(((void **)p)[-1]);
+  }
+  
+  template <typename U>
+  bool operator ==(const AlignedAllocator<U, alignment> &other) const { return true; }
+  
+  template <typename U>
+  bool operator !=(const AlignedAllocator<U, alignment> &other) const { return false; }
+};
+
+#define VOXEL_CACHE_LINE_SIZE 64
+
+#ifndef SWIG
+template <typename T>
+using AlignedVector = std::vector<T, AlignedAllocator<T, VOXEL_CACHE_LINE_SIZE>>; // Data starts at a cache line boundary
+#else
+#define AlignedVector std::vector
+#endif
+
 /// String functions
 String VOXEL_EXPORT getHex(uint16_t value);
 void VOXEL_EXPORT split(const String &str, const char delimiter, Vector<String> &split);
@@ -123,10 +170,31 @@ Ptr<T> byteAlloc(unsigned long sizeInBytes)
 /// Filesystem functions -- returns the number of files read or else -1 for error. Only those files whose name matches "matchString" partially (sub-string) are returned "files"
 int VOXEL_EXPORT getFiles(const String &dir, const String &matchString, Vector<String> &files);
 
+// Writes 'fileName' through a temporary file renamed over it, so that readers never see it partly written. 'write'
+// fills the stream and returns false on failure, which leaves 'fileName' as it was
+bool VOXEL_EXPORT writeFileAtomically(const String &fileName, const Function<bool (OutputFileStream &)> &write);
+
+/// FNV-1a 64-bit hash of 'size' bytes. Pass the previous result as 'hash' to continue it over more data
+#define FNV1A64_OFFSET_BASIS 14695981039346656037ULL
+uint64_t VOXEL_EXPORT fnv1a64(const void *data, SizeType size, uint64_t hash = FNV1A64_OFFSET_BASIS);
+
 uint VOXEL_EXPORT gcd(uint n, uint m);
 
 unsigned int VOXEL_EXPORT nearestPowerOf2(unsigned int value);
 
+/// Thread placement functions. Bit 'i' of an affinity mask set => thread may run on CPU 'i', and mask 0 => any CPU
+typedef uint64_t CPUAffinityMask;
+
+// Parses a list of CPUs like "0,2-3". Empty list gives 0
+bool VOXEL_EXPORT parseCPUList(const String &list, CPUAffinityMask &mask);
+
+// Affinity 0 leaves the affinity of the thread as it is
+bool VOXEL_EXPORT setThreadAffinity(Thread &thread, CPUAffinityMask affinity);
+bool VOXEL_EXPORT setCurrentThreadAffinity(CPUAffinityMask affinity);
+
+// 'priority' > 0 => real-time FIFO scheduling at 'priority', usually needing privileges. 0 leaves scheduling as it is
+bool VOXEL_EXPORT setCurrentThreadRealTimePriority(int priority);
+
 #define FLOAT_EPSILON 1E-5f
 
 inline bool floatEquals(float lhs, float rhs)
@@ -9,10 +9,14 @@
 
 #include <stdlib.h>
 #include <fstream>
+#include <algorithm>
 
 #include <string.h>
 #include <stdio.h>
 
+#include <sys/types.h>
+#include <sys/stat.h>
+
 #ifdef LINUX
 #define DIR_SEP "/"
 #define PATH_SEP ':'
@@ -24,6 +28,9 @@
 
 #define CAMERA_PROFILES_SECTION "camera_profiles"
 
+#define CONFIGURATION_CACHE_MAGIC "VXCC"
+#define CONFIGURATION_CACHE_VERSION 1
+
 namespace Voxel
 {
 
@@ -228,7 +235,7 @@ bool ConfigurationFile::getBoolean(const String &section, const String &name) co
 }
 
 
-bool ConfigurationFile::read(const String &filename)
+bool ConfigurationFile::_parse(const String &filename)
 {
   char buffer[2048];
   char name[1000];
@@ -236,16 +243,7 @@ bool ConfigurationFile::read(const String &filename)
   
   ConfigSet *currentSet = 0;
   
-  Configuration c;
-  String f = filename;
-  
-  if(!c.getConfFile(f))
-  {
-    logger(LOG_ERROR) << "ConfigurationFile: Failed to get configuration file '" << f << "'" << std::endl;
-    return false;
-  }
-  
-  InputFileStream fin(f, std::ios::binary | std::ios::in);
+  InputFileStream fin(filename, std::ios::binary | std::ios::in);
   
   if (!fin.good())
   {
@@ -291,8 +289,262 @@ bool ConfigurationFile::read(const String &filename)
   return true;
 }
 
+namespace
+{
+
+bool getFileInfo(const String &fileName, uint64_t &size, int64_t &time)
+{
+#ifdef WINDOWS
+  struct _stat64 s;
+  
+  if(_stat64(fileName.c_str(), &s) != 0)
+    return false;
+  
+  time = (int64_t)s.st_mtime;
+#else
+  struct stat s;
+  
+  if(stat(fileName.c_str(), &s) != 0)
+    return false;
+  
+  time = (int64_t)s.st_mtim.tv_sec*1000000000LL + s.st_mtim.tv_nsec;
+#endif
+  size = (uint64_t)s.st_size;
+  return true;
+}
+
+// Parsed files of this process, by full path
+struct CachedConfiguration
+{
+  uint64_t fileSize;
+  int64_t fileTime;
+  ConfigurationFile::ConfigSetMap configs;
+};
+
+Mutex cachedConfigurationsMutex;
+Map<String, CachedConfiguration> cachedConfigurations;
+
+template <typename T>
+inline void writeValue(OutputFileStream &out, const T &value)
+{
+  out.write((const char *)&value, sizeof(T));
+}
+
+template <typename T>
+inline bool readValue(InputFileStream &in, T &value)
+{
+  return in.read((char *)&value, sizeof(T)).good();
+}
+
+inline void writeString(OutputFileStream &out, const String &s)
+{
+  writeValue<uint32_t>(out, s.size());
+  out.write(s.data(), s.size());
+}
+
+inline bool readString(InputFileStream &in, String &s)
+{
+  uint32_t length;
+  
+  if(!readValue(in, length) || length > 65536)
+    return false;
+  
+  s.resize(length);
+  return length == 0 || in.read(&s[0], length).good();
+}
+
+void mergeConfigs(ConfigurationFile::ConfigSetMap &to, const ConfigurationFile::ConfigSetMap &from)
+{
+  for(auto &c: from)
+  {
+    ConfigSet &set = to[c.first];
+    
+    for(auto &n: c.second.paramNames)
+    {
+      set.paramNames.push_back(n);
+      set.params[n] = c.second.params.at(n);
+    }
+  }
+}
+
+}
+
+bool ConfigurationFile::_cacheEnabled = true;
+
+void ConfigurationFile::setCacheEnabled(bool enable)
+{
+  _cacheEnabled = enable;
+  
+  if(!enable)
+  {
+    Lock<Mutex> _(cachedConfigurationsMutex);
+    cachedConfigurations.clear();
+  }
+}
+
+uint64_t ConfigurationFile::hash() const
+{
+  uint64_t h = FNV1A64_OFFSET_BASIS;
+  
+  auto add = [&h](const String &s) {
+    static const uint8_t separator = 0xFF; // so that ("ab", "c") and ("a", "bc") differ
+    h = fnv1a64(s.data(), s.size(), h);
+    h = fnv1a64(&separator, 1, h);
+  };
+  
+  Vector<String> sections; // in sorted order, as order of 'configs' need not be the same for same contents
+  
+  for(auto &c: configs)
+    sections.push_back(c.first);
+  
+  std::sort(sections.begin(), sections.end());
+  
+  for(auto &section: sections)
+  {
+    const ConfigSet &set = configs.at(section);
+    
+    add(section);
+    
+    for(auto &n: set.paramNames)
+    {
+      add(n);
+      add(set.params.at(n));
+    }
+  }
+  
+  return h;
+}
+
+bool ConfigurationFile::_readCache(const String &cacheFileName, uint64_t fileSize, int64_t fileTime)
+{
+  InputFileStream in(cacheFileName, std::ios::binary | std::ios::in);
+  
+  if(!in.good())
+    return false;
+  
+  char magic[4];
+  uint32_t version, sectionCount;
+  uint64_t size, h;
+  int64_t time;
+  
+  if(!in.read(magic, sizeof(magic)).good() || memcmp(magic, CONFIGURATION_CACHE_MAGIC, sizeof(magic)) != 0 ||
+    !readValue(in, version) || version != CONFIGURATION_CACHE_VERSION ||
+    !readValue(in, size) || !readValue(in, time) || size != fileSize || time != fileTime ||
+    !readValue(in, h) || !readValue(in, sectionCount))
+    return false;
+  
+  configs.clear();
+  
+  for(auto i = 0; i < sectionCount; i++)
+  {
+    String section, name, value;
+    uint32_t count;
+    
+    if(!readString(in, section) || !readValue(in, count))
+      return false;
+    
+    ConfigSet &set = configs[section];
+    
+    for(auto j = 0; j < count; j++)
+    {
+      if(!readString(in, name) || !readString(in, value))
+        return false;
+      
+      set.paramNames.push_back(name);
+      set.params[name] = value;
+    }
+  }
+  
+  return hash() == h;
+}
+
+bool ConfigurationFile::_writeCache(const String &cacheFileName, uint64_t fileSize, int64_t fileTime) const
+{
+  return writeFileAtomically(cacheFileName, [this, fileSize, fileTime](OutputFileStream &out)
+  {
+    out.write(CONFIGURATION_CACHE_MAGIC, 4);
+    writeValue<uint32_t>(out, CONFIGURATION_CACHE_VERSION);
+    writeValue<uint64_t>(out, fileSize);
+    writeValue<int64_t>(out, fileTime);
+    writeValue<uint64_t>(out, hash());
+    writeValue<uint32_t>(out, configs.size());
+    
+    for(auto &c: configs)
+    {
+      writeString(out, c.first);
+      writeValue<uint32_t>(out, c.second.paramNames.size());
+      
+      for(auto &n: c.second.paramNames)
+      {
+        writeString(out, n);
+        writeString(out, c.second.params.at(n));
+      }
+    }
+    return out.good();
+  });
+}
+
+bool ConfigurationFile::read(const String &filename)
+{
+  Configuration c;
+  String f = filename;
+  
+  if(!c.getConfFile(f))
+  {
+    logger(LOG_ERROR) << "ConfigurationFile: Failed to get configuration file '" << f << "'" << std::endl;
+    return false;
+  }
+  
+  uint64_t fileSize;
+  int64_t fileTime;
+  
+  if(!_cacheEnabled || !getFileInfo(f, fileSize, fileTime))
+    return _parse(f);
+  
+  {
+    Lock<Mutex> _(cachedConfigurationsMutex);
+    
+    auto x = cachedConfigurations.find(f);
+    
+    if(x != cachedConfigurations.end() && x->second.fileSize == fileSize && x->second.fileTime == fileTime)
+    {
+      mergeConfigs(configs, x->second.configs);
+      return true;
+    }
+  }
+  
+  ConfigurationFile file;
+  String cacheFileName = f + CONFIGURATION_CACHE_SUFFIX;
+  
+  if(file._readCache(cacheFileName, fileSize, fileTime))
+    logger(LOG_DEBUG) << "ConfigurationFile: Read '" << f << "' from " << cacheFileName << std::endl;
+  else
+  {
+    file.configs.clear();
+    
+    if(!file._parse(f))
+      return false;
+    
+    if(!file._writeCache(cacheFileName, fileSize, fileTime))
+      logger(LOG_DEBUG) << "ConfigurationFile: Could not write cache file " << cacheFileName << std::endl;
+  }
+  
+  {
+    Lock<Mutex> _(cachedConfigurationsMutex);
+    CachedConfiguration &cached = cachedConfigurations[f];
+    cached.fileSize = fileSize;
+    cached.fileTime = fileTime;
+    cached.configs = file.configs;
+  }
+  
+  mergeConfigs(configs, file.configs);
+  return true;
+}
+
 bool MainConfigurationFile::read(const String &configFile)
 {
+  _revision++;
+  
   if(!ConfigurationFile::read(configFile))
     return false;
   
@@ -359,6 +611,7 @@ bool MainConfigurationFile::setCurrentCameraProfile(const String &profileName)
   {
     _currentCameraProfileName = profileName;
     _currentCameraProfile = &_cameraProfiles.at(profileName);
+    _revision++;
     return true;
   }
   
@@ -9,6 +9,8 @@
 
 #include "Common.h"
 
+#define CONFIGURATION_CACHE_SUFFIX ".cache"
+
 namespace Voxel
 {
 
@@ -58,10 +60,24 @@ public:
 
 class MainConfigurationFile;
 
+/**
+ * \brief Sections of name/value pairs, read from a .conf file.
+ * 
+ * Parsed contents of a file are kept in memory and in a binary cache file next to it (<file>.cache), so that
+ * reading an unchanged file again, say when connecting to another camera, does not parse it again. Both
+ * are validated against the size and modification time of the file.
+ */
 class VOXEL_EXPORT ConfigurationFile
 {
 protected:
   bool _get(const String &section, const String &name, String &value) const;
+  
+  bool _parse(const String &fileName);
+  bool _readCache(const String &cacheFileName, uint64_t fileSize, int64_t fileTime);
+  bool _writeCache(const String &cacheFileName, uint64_t fileSize, int64_t fileTime) const;
+  
+  static bool _cacheEnabled;
+  
 public:
   typedef Map<String, ConfigSet> ConfigSetMap;
   
@@ -76,6 +92,13 @@ public:
   
   virtual bool read(const String &configFile);
   
+  // Hash of the contents, including the order of names within a section
+  uint64_t hash() const;
+  
+  // Disabling does not remove existing cache files but ignores them
+  static void setCacheEnabled(bool enable);
+  inline static bool isCacheEnabled() { return _cacheEnabled; }
+  
   ConfigurationFile() {}
   virtual ~ConfigurationFile() {}
   
@@ -89,8 +112,9 @@ class VOXEL_EXPORT MainConfigurationFile: public ConfigurationFile
   String _defaultCameraProfileName;
   String _currentCameraProfileName;
   ConfigurationFile *_currentCameraProfile;
+  uint32_t _revision;
 public:
-  MainConfigurationFile(): _currentCameraProfile(0) {}
+  MainConfigurationFile(): _currentCameraProfile(0), _revision(0) {}
   
   virtual bool read(const String &configFile);
   
@@ -106,6 +130,10 @@ public:
   const String &getCurrentProfileName() { return _currentCameraProfileName; }
   const Vector<String> &getCameraProfileNames() { return _cameraProfileNames; }
   
+  // Changes whenever the values returned by get() may change, like on change of current profile. Values derived from
+  // the configuration need to be computed again only when this changes
+  inline uint32_t getRevision() const { return _revision; }
+  
   virtual ~MainConfigurationFile() {}
 };
 
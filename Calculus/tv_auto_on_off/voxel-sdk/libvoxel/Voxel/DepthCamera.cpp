@@ -14,24 +14,68 @@
 #include "Logger.h"
 #include "PointCloudFrameGenerator.h"
 
+#define PIPELINE_QUEUE_WAIT_TIMEOUT 10 // in milli-seconds. Bounds the time a stage thread takes to notice stop()
+
 namespace Voxel
 {
   
-DepthCamera::DepthCamera(const String &name, DevicePtr device): _device(device), _name(name),
-_rawFrameBuffers(MAX_FRAME_BUFFERS), _depthFrameBuffers(MAX_FRAME_BUFFERS), _pointCloudBuffers(MAX_FRAME_BUFFERS),
+DepthCamera::DepthCamera(const String &name, DevicePtr device, bool readConfiguration): _device(device), _name(name),
+_rawFrameBuffers(MAX_FRAME_BUFFERS), _depthFrameBuffers(MAX_FRAME_BUFFERS), _pointCloudBuffers(MAX_FRAME_BUFFERS), _pointCloudSoABuffers(MAX_FRAME_BUFFERS),
 _parameterInit(true), _running(false),
 _unprocessedFilters(_rawFrameBuffers), _processedFilters(_rawFrameBuffers), _depthFilters(_depthFrameBuffers),
 _pointCloudFrameGenerator(new PointCloudFrameGenerator())
 {
   _frameGenerators[2] = std::dynamic_pointer_cast<FrameGenerator>(_pointCloudFrameGenerator);
+  _pipelineRunning = false;
+  _pipelineTaskThread = std::thread::id();
+  _statisticsEnabled = false;
+  resetStatistics();
+  
+  // Return borrowed streamer buffers as soon as a raw frame is released to the pool
+  _rawFrameBuffers.setReleaseHandler([](RawFramePtr &rawFrame) {
+    RawDataFrame *r = dynamic_cast<RawDataFrame *>(rawFrame.get());
+    
+    if(r && r->isBorrowed())
+      r->releaseBorrowed();
+  });
+  
   _makeID();
   
-  configFile.read(name + ".conf"); // Read and keep the configuration ready for use. The file must be in VOXEL_CONF_PATH
+  if(readConfiguration)
+    configFile.read(name + ".conf"); // Read and keep the configuration ready for use. The file must be in VOXEL_CONF_PATH
 }
 
 bool DepthCamera::_init()
 {
-  return setCameraProfile(configFile.getDefaultCameraProfileName());
+  if(!setCameraProfile(configFile.getDefaultCameraProfileName()))
+    return false;
+  
+  _readThreadSettings();
+  return true;
+}
+
+void DepthCamera::_readThreadSettings()
+{
+  String list = configFile.get("threads", "capture_cpus");
+  
+  if(!parseCPUList(list, _threadSettings.captureAffinity))
+  {
+    logger(LOG_WARNING) << "DepthCamera: Invalid CPU list '" << list << "' for capture_cpus in " << _name << ".conf" << std::endl;
+    _threadSettings.captureAffinity = 0;
+  }
+  
+  _threadSettings.captureRealTimePriority = configFile.getInteger("threads", "capture_priority");
+}
+
+void DepthCamera::_applyThreadSettings()
+{
+  if(!setCurrentThreadAffinity(_threadSettings.captureAffinity))
+    logger(LOG_WARNING) << "DepthCamera: Could not set affinity of capture thread of " << id() << " to 0x" 
+      << std::hex << _threadSettings.captureAffinity << std::dec << std::endl;
+  
+  if(!setCurrentThreadRealTimePriority(_threadSettings.captureRealTimePriority))
+    logger(LOG_WARNING) << "DepthCamera: Could not set real-time priority " << _threadSettings.captureRealTimePriority 
+      << " for capture thread of " << id() << std::endl;
 }
   
 bool DepthCamera::_addParameters(const Vector<ParameterPtr> &params)
@@ -56,7 +100,10 @@ bool DepthCamera::_addParameters(const Vector<ParameterPtr> &params)
 bool DepthCamera::clearAllCallbacks()
 {
   for(auto i = 0; i < FRAME_TYPE_COUNT; i++)
+  {
     _callback[i] = nullptr;
+    _sharedCallback[i] = nullptr;
+  }
   return true;
 }
 
@@ -65,6 +112,7 @@ bool DepthCamera::clearCallback(FrameType type)
   if(type < FRAME_TYPE_COUNT)
   {
     _callback[type] = nullptr;
+    _sharedCallback[type] = nullptr;
     return true;
   }
   return false;
@@ -74,11 +122,28 @@ bool DepthCamera::registerCallback(FrameType type, CallbackType f)
 {
   if(type < FRAME_TYPE_COUNT)
   {
-    if(_callback[type])
+    if(_hasCallback(type))
       logger(LOG_WARNING) << "DepthCamera: " << id() << " already has a callback for this type = " << type << ". Overwriting it now." << std::endl;
     
     _callBackTypesRegistered |= (1 << type);
     _callback[type] = f;
+    _sharedCallback[type] = nullptr;
+    return true;
+  }
+  logger(LOG_ERROR) << "DepthCamera: Invalid callback type = " << type << " attempted for depth camera " << id() << std::endl;
+  return false;
+}
+
+bool DepthCamera::registerSharedCallback(FrameType type, SharedCallbackType f)
+{
+  if(type < FRAME_TYPE_COUNT)
+  {
+    if(_hasCallback(type))
+      logger(LOG_WARNING) << "DepthCamera: " << id() << " already has a callback for this type = " << type << ". Overwriting it now." << std::endl;
+    
+    _callBackTypesRegistered |= (1 << type);
+    _sharedCallback[type] = f;
+    _callback[type] = nullptr;
     return true;
   }
   logger(LOG_ERROR) << "DepthCamera: Invalid callback type = " << type << " attempted for depth camera " << id() << std::endl;
@@ -89,7 +154,11 @@ bool DepthCamera::_callbackAndContinue(uint32_t &callBackTypesToBeCalled, DepthC
 {
   if((callBackTypesToBeCalled | (1 << type)) && _callback[type])
   {
+    TimeStampType startTime = _statisticsStart();
+    
     _callback[type](*this, frame, type);
+    
+    _statisticsRecord(_callbackHistograms[type], startTime);
   }
   
   callBackTypesToBeCalled &= ~(1 << type);
@@ -100,6 +169,12 @@ bool DepthCamera::_callbackAndContinue(uint32_t &callBackTypesToBeCalled, DepthC
 
 void DepthCamera::_captureLoop()
 {
+  if(_pipelineEnabled)
+  {
+    _pipelinedCaptureLoop();
+    return;
+  }
+  
   uint consecutiveCaptureFails = 0;
   
   while(_running)
@@ -117,13 +192,17 @@ void DepthCamera::_captureLoop()
     {
       auto f = _rawFrameBuffers.get();
       
+      TimeStampType startTime = _statisticsStart();
+      
       if(!_captureRawUnprocessedFrame(*f))
       {
         consecutiveCaptureFails++;
+        if(_running) // Capture is expected to fail on stop()
+          _stageCounters[PIPELINE_STAGE_CAPTURE].errorCount++;
         continue;
       }
       
-      if(_callback[FRAME_RAW_FRAME_UNPROCESSED])
+      if(_hasCallback(FRAME_RAW_FRAME_UNPROCESSED))
       {
         FilterSet<RawFrame>::FrameSequence _frameBuffers;
         _frameBuffers.push_front(f);
@@ -132,15 +211,22 @@ void DepthCamera::_captureLoop()
         {
           logger(LOG_ERROR) << "DepthCamera: Failed to apply filters on raw unprocessed frame" << std::endl;
           consecutiveCaptureFails++;
+          _stageCounters[PIPELINE_STAGE_CAPTURE].errorCount++;
           continue;
         }
         
-        _callback[FRAME_RAW_FRAME_UNPROCESSED](*this, (Frame &)(**_frameBuffers.begin()), FRAME_RAW_FRAME_UNPROCESSED);
+        _stageRecord(PIPELINE_STAGE_CAPTURE, startTime);
+        
+        _ownRawData(**_frameBuffers.begin());
+        
+        _callbackAndContinue(callBackTypesToBeCalled, FRAME_RAW_FRAME_UNPROCESSED, *_frameBuffers.begin());
         
         _writeToFrameStream(**_frameBuffers.begin());
       }
       else
       {
+        _stageRecord(PIPELINE_STAGE_CAPTURE, startTime);
+        
         _writeToFrameStream(*f);
       }
       
@@ -149,9 +235,14 @@ void DepthCamera::_captureLoop()
     else
     {
       auto f1 = _rawFrameBuffers.get();
+      
+      TimeStampType startTime = _statisticsStart();
+      
       if(!_captureRawUnprocessedFrame(*f1))
       {
         consecutiveCaptureFails++;
+        if(_running) // Capture is expected to fail on stop()
+          _stageCounters[PIPELINE_STAGE_CAPTURE].errorCount++;
         continue;
       }
       
@@ -162,20 +253,51 @@ void DepthCamera::_captureLoop()
       {
         logger(LOG_ERROR) << "DepthCamera: Failed to apply filters on raw unprocessed frame" << std::endl;
         consecutiveCaptureFails++;
+        _stageCounters[PIPELINE_STAGE_CAPTURE].errorCount++;
+        continue;
+      }
+      
+      _stageRecord(PIPELINE_STAGE_CAPTURE, startTime);
+      
+      if(_hasCallback(FRAME_RAW_FRAME_UNPROCESSED))
+        _ownRawData(**_unprocessedFrameBuffers.begin());
+      
+      if(!_callbackAndContinue(callBackTypesToBeCalled, FRAME_RAW_FRAME_UNPROCESSED, *_unprocessedFrameBuffers.begin()) && !isSavingFrameStream())
+      {
+        consecutiveCaptureFails = 0;
         continue;
       }
       
-      if(!_callbackAndContinue(callBackTypesToBeCalled, FRAME_RAW_FRAME_UNPROCESSED, ***_unprocessedFrameBuffers.begin()) && !isSavingFrameStream())
+      if(_useFusedPointCloud(callBackTypesToBeCalled))
       {
+        auto p = _pointCloudBuffers.get();
+        
+        startTime = _statisticsStart();
+        
+        if(!_convertRawToPointCloudFrame(**_unprocessedFrameBuffers.begin(), *p))
+        {
+          consecutiveCaptureFails++;
+          _stageCounters[PIPELINE_STAGE_PROCESS].errorCount++;
+          continue;
+        }
+        
+        _stageRecord(PIPELINE_STAGE_PROCESS, startTime); // as in pipelined mode, where this is done by the process stage
+        
+        _callbackAndContinue(callBackTypesToBeCalled, FRAME_XYZI_POINT_CLOUD_FRAME, p);
         consecutiveCaptureFails = 0;
+        
+        _writeToFrameStream(**_unprocessedFrameBuffers.begin());
         continue;
       }
       
       auto f = _rawFrameBuffers.get();
       
+      startTime = _statisticsStart();
+      
       if(!_processRawFrame(**_unprocessedFrameBuffers.begin(), *f))
       {
         consecutiveCaptureFails++;
+        _stageCounters[PIPELINE_STAGE_PROCESS].errorCount++;
         continue;
       }
       
@@ -186,10 +308,13 @@ void DepthCamera::_captureLoop()
       {
         logger(LOG_ERROR) << "DepthCamera: Failed to apply filters on raw processed frame" << std::endl;
         consecutiveCaptureFails++;
+        _stageCounters[PIPELINE_STAGE_PROCESS].errorCount++;
         continue;
       }
       
-      if(!_callbackAndContinue(callBackTypesToBeCalled, FRAME_RAW_FRAME_PROCESSED, ***_processedFrameBuffers.begin())  && !isSavingFrameStream())
+      _stageRecord(PIPELINE_STAGE_PROCESS, startTime);
+      
+      if(!_callbackAndContinue(callBackTypesToBeCalled, FRAME_RAW_FRAME_PROCESSED, *_processedFrameBuffers.begin())  && !isSavingFrameStream())
       {
         consecutiveCaptureFails = 0;
         continue;
@@ -197,9 +322,12 @@ void DepthCamera::_captureLoop()
       
       auto d = _depthFrameBuffers.get();
       
+      startTime = _statisticsStart();
+      
       if(!_convertToDepthFrame(**_processedFrameBuffers.begin(), *d))
       {
         consecutiveCaptureFails++;
+        _stageCounters[PIPELINE_STAGE_DEPTH].errorCount++;
         continue;
       }
       
@@ -210,24 +338,59 @@ void DepthCamera::_captureLoop()
       {
         logger(LOG_ERROR) << "DepthCamera: Failed to apply filters on depth frame" << std::endl;
         consecutiveCaptureFails++;
+        _stageCounters[PIPELINE_STAGE_DEPTH].errorCount++;
         continue;
       }
       
-      if(!_callbackAndContinue(callBackTypesToBeCalled, FRAME_DEPTH_FRAME, ***_depthFrameBuffers.begin()) && !isSavingFrameStream())
+      _stageRecord(PIPELINE_STAGE_DEPTH, startTime);
+      
+      if(!_callbackAndContinue(callBackTypesToBeCalled, FRAME_DEPTH_FRAME, *_depthFrameBuffers.begin()) && !isSavingFrameStream())
       {
         consecutiveCaptureFails = 0;
         continue;
       }
       
-      auto p = _pointCloudBuffers.get();
-      
-      if(!_convertToPointCloudFrame(**_depthFrameBuffers.begin(), *p))
+      if(callBackTypesToBeCalled & ((1 << FRAME_XYZI_POINT_CLOUD_FRAME) | (1 << FRAME_XYZI_POINT_CLOUD_SOA_FRAME)))
       {
-        consecutiveCaptureFails++;
-        continue;
+        // Both point cloud frames are generated before calling back, so that the stage is timed once per frame
+        FrameBuffer<PointCloudFrame> p;
+        FrameBuffer<XYZIPointCloudSoAFrame> pSoA;
+        
+        startTime = _statisticsStart();
+        
+        if(callBackTypesToBeCalled & (1 << FRAME_XYZI_POINT_CLOUD_FRAME))
+        {
+          p = _pointCloudBuffers.get();
+          
+          if(!_convertToPointCloudFrame(**_depthFrameBuffers.begin(), *p))
+          {
+            consecutiveCaptureFails++;
+            _stageCounters[PIPELINE_STAGE_POINT_CLOUD].errorCount++;
+            continue;
+          }
+        }
+        
+        if(callBackTypesToBeCalled & (1 << FRAME_XYZI_POINT_CLOUD_SOA_FRAME))
+        {
+          pSoA = _pointCloudSoABuffers.get();
+          
+          if(!_convertToPointCloudSoAFrame(**_depthFrameBuffers.begin(), *pSoA))
+          {
+            consecutiveCaptureFails++;
+            _stageCounters[PIPELINE_STAGE_POINT_CLOUD].errorCount++;
+            continue;
+          }
+        }
+        
+        _stageRecord(PIPELINE_STAGE_POINT_CLOUD, startTime);
+        
+        if(p)
+          _callbackAndContinue(callBackTypesToBeCalled, FRAME_XYZI_POINT_CLOUD_FRAME, p);
+        
+        if(pSoA)
+          _callbackAndContinue(callBackTypesToBeCalled, FRAME_XYZI_POINT_CLOUD_SOA_FRAME, pSoA);
       }
       
-      _callbackAndContinue(callBackTypesToBeCalled, FRAME_XYZI_POINT_CLOUD_FRAME, **p);
       consecutiveCaptureFails = 0;
       
       _writeToFrameStream(**_unprocessedFrameBuffers.begin());
@@ -241,6 +404,467 @@ void DepthCamera::_captureLoop()
   }
 }
 
+void DepthCamera::_pipelinedCaptureLoop()
+{
+  for(auto i = (int)PIPELINE_STAGE_PROCESS; i < PIPELINE_STAGE_COUNT; i++)
+    _pipelineQueues[i].setCapacity(_pipelineQueueDepth);
+  
+  _pipelineRunning = true;
+  
+  for(auto i = (int)PIPELINE_STAGE_PROCESS; i < PIPELINE_STAGE_COUNT && !_pipelineThreadPool; i++)
+    _pipelineThreads[i] = ThreadPtr(new Thread(&DepthCamera::_pipelineStageLoop, this, (PipelineStage)i));
+  
+  uint consecutiveCaptureFails = 0;
+  
+  while(_running)
+  {
+    if(consecutiveCaptureFails > 100)
+    {
+      logger(LOG_ERROR) << "DepthCamera: 100 consecutive failures in capture of frame. Stopping stream for " << id() << std::endl;
+      _running = false;
+      continue;
+    }
+    
+    PipelineFrameSetPtr frameSet(new PipelineFrameSet());
+    
+    frameSet->callBackTypesToBeCalled = _callBackTypesRegistered;
+    frameSet->saveFrameStream = isSavingFrameStream();
+    frameSet->fused = _useFusedPointCloud(frameSet->callBackTypesToBeCalled);
+    
+    auto f = _rawFrameBuffers.get();
+    
+    TimeStampType startTime = _statisticsStart();
+    
+    if(!_captureRawUnprocessedFrame(*f))
+    {
+      consecutiveCaptureFails++;
+      if(_running) // Capture is expected to fail on stop()
+        _stageCounters[PIPELINE_STAGE_CAPTURE].errorCount++;
+      continue;
+    }
+    
+    frameSet->unprocessed.push_front(f);
+    
+    if(!_unprocessedFilters.applyFilter(frameSet->unprocessed))
+    {
+      logger(LOG_ERROR) << "DepthCamera: Failed to apply filters on raw unprocessed frame" << std::endl;
+      _stageCounters[PIPELINE_STAGE_CAPTURE].errorCount++;
+      consecutiveCaptureFails++;
+      continue;
+    }
+    
+    consecutiveCaptureFails = 0;
+    
+    _stageRecord(PIPELINE_STAGE_CAPTURE, startTime);
+    
+    if(_pipelineForward(PIPELINE_STAGE_PROCESS, frameSet) && _pipelineThreadPool)
+      _pipelineSchedule();
+  }
+  
+  if(_pipelineThreadPool) // Frames already handed to the pool are delivered, as there are at most 'queue depth' of them
+  {
+    Lock<Mutex> _(_pipelineTaskMutex);
+    _pipelineTaskDone.wait(_, [this]() { return !_pipelineTaskScheduled; });
+  }
+  
+  _pipelineRunning = false;
+  
+  for(auto i = (int)PIPELINE_STAGE_PROCESS; i < PIPELINE_STAGE_COUNT; i++)
+  {
+    if(_pipelineThreads[i] && _pipelineThreads[i]->joinable())
+      _pipelineThreads[i]->join();
+    
+    _pipelineThreads[i] = nullptr;
+    _pipelineQueues[i].clear(); // Frames still in the queues are dropped
+  }
+  
+  closeFrameStream();
+  _stop();
+}
+
+void DepthCamera::_pipelineStageLoop(PipelineStage stage)
+{
+  PipelineFrameSetPtr frameSet;
+  
+  while(_pipelineRunning)
+  {
+    if(!_pipelineQueues[stage].pop(frameSet, PIPELINE_QUEUE_WAIT_TIMEOUT))
+      continue;
+    
+    if(!_pipelineProcess(stage, frameSet))
+    {
+      _stageCounters[stage].errorCount++;
+      frameSet = nullptr;
+      continue;
+    }
+    
+    if(stage + 1 < PIPELINE_STAGE_COUNT)
+      _pipelineForward((PipelineStage)(stage + 1), frameSet);
+    
+    frameSet = nullptr; // Release the frame buffers held by this stage
+  }
+}
+
+void DepthCamera::_pipelineSchedule()
+{
+  Lock<Mutex> _(_pipelineTaskMutex);
+  
+  if(_pipelineTaskScheduled)
+    return;
+  
+  _pipelineTaskScheduled = true;
+  _pipelineThreadPool->submit(std::bind(&DepthCamera::_pipelineTask, this));
+}
+
+void DepthCamera::_pipelineTask()
+{
+  _pipelineTaskThread = std::this_thread::get_id();
+  
+  PipelineFrameSetPtr frameSet;
+  
+  // Bounded, so that a camera with a steady stream of frames does not hold on to a pool thread
+  for(auto count = 0; count < _pipelineQueueDepth && _pipelineRunning && _pipelineQueues[PIPELINE_STAGE_PROCESS].tryPop(frameSet); count++)
+  {
+    for(auto i = (int)PIPELINE_STAGE_PROCESS; i < PIPELINE_STAGE_COUNT; i++)
+    {
+      if(!_pipelineProcess((PipelineStage)i, frameSet))
+      {
+        _stageCounters[i].errorCount++;
+        break;
+      }
+    }
+    
+    frameSet = nullptr; // Release the frame buffers
+  }
+  
+  _pipelineTaskThread = std::thread::id();
+  
+  Lock<Mutex> _(_pipelineTaskMutex);
+  
+  if(_pipelineRunning && _pipelineQueues[PIPELINE_STAGE_PROCESS].size()) // Frames queued after the last tryPop() or left by the bound above
+  {
+    _pipelineThreadPool->submit(std::bind(&DepthCamera::_pipelineTask, this));
+    return;
+  }
+  
+  _pipelineTaskScheduled = false;
+  _pipelineTaskDone.notify_all();
+}
+
+bool DepthCamera::_pipelineProcess(PipelineStage stage, PipelineFrameSetPtr &frameSet)
+{
+  // All stages are required when saving frame stream, as in the serial capture loop
+  uint32_t required = frameSet->saveFrameStream?((1 << FRAME_TYPE_COUNT) - 1):frameSet->callBackTypesToBeCalled;
+  
+  if(stage == PIPELINE_STAGE_PROCESS)
+  {
+    if(!(required >> FRAME_RAW_FRAME_PROCESSED)) // Pass through
+      return true;
+    
+    if(frameSet->fused)
+    {
+      auto p = _pointCloudBuffers.get();
+      
+      TimeStampType startTime = _statisticsStart();
+      
+      if(!_convertRawToPointCloudFrame(**frameSet->unprocessed.begin(), *p))
+        return false;
+      
+      _stageRecord(stage, startTime);
+      
+      frameSet->pointCloud.push_front(p);
+      return true;
+    }
+    
+    auto f = _rawFrameBuffers.get();
+    
+    TimeStampType startTime = _statisticsStart();
+    
+    if(!_processRawFrame(**frameSet->unprocessed.begin(), *f))
+      return false;
+    
+    frameSet->processed.push_front(f);
+    
+    if(!_processedFilters.applyFilter(frameSet->processed))
+    {
+      logger(LOG_ERROR) << "DepthCamera: Failed to apply filters on raw processed frame" << std::endl;
+      return false;
+    }
+    
+    _stageRecord(stage, startTime);
+    return true;
+  }
+  else if(stage == PIPELINE_STAGE_DEPTH)
+  {
+    if(!(required >> FRAME_DEPTH_FRAME) || frameSet->fused)
+      return true;
+    
+    auto d = _depthFrameBuffers.get();
+    
+    TimeStampType startTime = _statisticsStart();
+    
+    if(!_convertToDepthFrame(**frameSet->processed.begin(), *d))
+      return false;
+    
+    frameSet->depth.push_front(d);
+    
+    if(!_depthFilters.applyFilter(frameSet->depth))
+    {
+      logger(LOG_ERROR) << "DepthCamera: Failed to apply filters on depth frame" << std::endl;
+      return false;
+    }
+    
+    _stageRecord(stage, startTime);
+    return true;
+  }
+  else if(stage == PIPELINE_STAGE_POINT_CLOUD)
+  {
+    if(frameSet->fused || !(frameSet->callBackTypesToBeCalled & ((1 << FRAME_XYZI_POINT_CLOUD_FRAME) | (1 << FRAME_XYZI_POINT_CLOUD_SOA_FRAME))))
+      return true;
+    
+    TimeStampType startTime = _statisticsStart();
+    
+    if(frameSet->callBackTypesToBeCalled & (1 << FRAME_XYZI_POINT_CLOUD_FRAME))
+    {
+      auto p = _pointCloudBuffers.get();
+      
+      if(!_convertToPointCloudFrame(**frameSet->depth.begin(), *p))
+        return false;
+      
+      frameSet->pointCloud.push_front(p);
+    }
+    
+    if(frameSet->callBackTypesToBeCalled & (1 << FRAME_XYZI_POINT_CLOUD_SOA_FRAME))
+    {
+      auto p = _pointCloudSoABuffers.get();
+      
+      if(!_convertToPointCloudSoAFrame(**frameSet->depth.begin(), *p))
+        return false;
+      
+      frameSet->pointCloudSoA.push_front(p);
+    }
+    
+    _stageRecord(stage, startTime);
+    return true;
+  }
+  else if(stage == PIPELINE_STAGE_CALLBACK)
+  {
+    uint32_t callBackTypesToBeCalled = frameSet->callBackTypesToBeCalled;
+    
+    TimeStampType startTime = _statisticsStart();
+    
+    if(frameSet->unprocessed.size() && _hasCallback(FRAME_RAW_FRAME_UNPROCESSED))
+      _ownRawData(**frameSet->unprocessed.begin());
+    
+    if(frameSet->unprocessed.size())
+      _callbackAndContinue(callBackTypesToBeCalled, FRAME_RAW_FRAME_UNPROCESSED, *frameSet->unprocessed.begin());
+    
+    if(frameSet->processed.size())
+      _callbackAndContinue(callBackTypesToBeCalled, FRAME_RAW_FRAME_PROCESSED, *frameSet->processed.begin());
+    
+    if(frameSet->depth.size())
+      _callbackAndContinue(callBackTypesToBeCalled, FRAME_DEPTH_FRAME, *frameSet->depth.begin());
+    
+    if(frameSet->pointCloud.size())
+      _callbackAndContinue(callBackTypesToBeCalled, FRAME_XYZI_POINT_CLOUD_FRAME, *frameSet->pointCloud.begin());
+    
+    if(frameSet->pointCloudSoA.size())
+      _callbackAndContinue(callBackTypesToBeCalled, FRAME_XYZI_POINT_CLOUD_SOA_FRAME, *frameSet->pointCloudSoA.begin());
+    
+    if(frameSet->saveFrameStream)
+      _writeToFrameStream(**frameSet->unprocessed.begin());
+    
+    _stageRecord(stage, startTime);
+    return true;
+  }
+  
+  return false;
+}
+
+bool DepthCamera::_pipelineForward(PipelineStage toStage, const PipelineFrameSetPtr &frameSet)
+{
+  SPSCQueue<PipelineFrameSetPtr> &queue = _pipelineQueues[toStage];
+  StageCounters &counters = _stageCounters[toStage];
+  
+  bool queued;
+  
+  if(_pipelineDropPolicy == PIPELINE_BLOCK)
+  {
+    while(!(queued = queue.push(frameSet, PIPELINE_QUEUE_WAIT_TIMEOUT)) && _pipelineRunning && _running);
+  }
+  else
+    queued = queue.tryPush(frameSet);
+  
+  if(!queued)
+  {
+    counters.dropCount++;
+    return false;
+  }
+  
+  SizeType depth = queue.size();
+  
+  if(depth > counters.maxQueueDepth) // Only producer of 'queue' updates this
+    counters.maxQueueDepth = depth;
+  
+  return true;
+}
+
+bool DepthCamera::_isPipelineThread() const
+{
+  auto id = std::this_thread::get_id();
+  
+  for(auto i = (int)PIPELINE_STAGE_PROCESS; i < PIPELINE_STAGE_COUNT; i++)
+    if(_pipelineThreads[i] && _pipelineThreads[i]->get_id() == id)
+      return true;
+  
+  return _pipelineTaskThread.load() == id;
+}
+
+bool DepthCamera::setPipelineMode(bool enable, SizeType queueDepth, PipelineDropPolicy dropPolicy)
+{
+  if(isRunning())
+  {
+    logger(LOG_ERROR) << "DepthCamera: Please stop the depth camera before changing pipeline mode" << std::endl;
+    return false;
+  }
+  
+  if(queueDepth < 1)
+  {
+    logger(LOG_ERROR) << "DepthCamera: Pipeline queue depth needs to be atleast 1" << std::endl;
+    return false;
+  }
+  
+  _pipelineEnabled = enable;
+  _pipelineQueueDepth = queueDepth;
+  _pipelineDropPolicy = dropPolicy;
+  return true;
+}
+
+bool DepthCamera::setPipelineThreadPool(const ThreadPoolPtr &pool)
+{
+  if(isRunning())
+  {
+    logger(LOG_ERROR) << "DepthCamera: Please stop the depth camera before changing pipeline thread pool" << std::endl;
+    return false;
+  }
+  
+  _pipelineThreadPool = pool;
+  return true;
+}
+
+bool DepthCamera::setThreadSettings(const ThreadSettings &settings)
+{
+  if(isRunning())
+  {
+    logger(LOG_ERROR) << "DepthCamera: Please stop the depth camera before changing thread settings" << std::endl;
+    return false;
+  }
+  
+  _threadSettings = settings;
+  return true;
+}
+
+bool DepthCamera::setFusedPointCloudMode(bool enable)
+{
+  if(isRunning())
+  {
+    logger(LOG_ERROR) << "DepthCamera: Please stop the depth camera before changing fused point cloud mode" << std::endl;
+    return false;
+  }
+  
+  if(enable && !_isFusedPointCloudSupported())
+  {
+    logger(LOG_ERROR) << "DepthCamera: Fused point cloud mode is not supported by " << id() << std::endl;
+    return false;
+  }
+  
+  _fusedPointCloudEnabled = enable;
+  return true;
+}
+
+bool DepthCamera::_useFusedPointCloud(uint32_t callBackTypes) const
+{
+  return _fusedPointCloudEnabled && callBackTypes == (1 << FRAME_XYZI_POINT_CLOUD_FRAME) &&
+    _processedFilters.size() == 0 && _depthFilters.size() == 0;
+}
+
+bool DepthCamera::_convertRawToPointCloudFrame(const RawFramePtr &rawFrame, PointCloudFramePtr &pointCloudFrame)
+{
+  logger(LOG_ERROR) << "DepthCamera: Fused conversion to point cloud frame is not implemented for " << id() << std::endl;
+  return false;
+}
+
+void DepthCamera::enableStatistics(bool enable)
+{
+  _statisticsEnabled = enable;
+  
+  _unprocessedFilters.enableStatistics(enable);
+  _processedFilters.enableStatistics(enable);
+  _depthFilters.enableStatistics(enable);
+}
+
+bool DepthCamera::getStatistics(DepthCameraStatistics &statistics) const
+{
+  static const char *stageNames[PIPELINE_STAGE_COUNT] = { "capture", "process", "depth", "point_cloud", "callback" };
+  static const char *callbackNames[FRAME_TYPE_COUNT] = { "raw_unprocessed", "raw_processed", "depth", "point_cloud", "point_cloud_soa" };
+  
+  statistics.framesDropped = statistics.framesFailed = 0;
+  
+  statistics.pipelineStages.resize(PIPELINE_STAGE_COUNT);
+  
+  statistics.stages.clear();
+  statistics.stages.reserve(PIPELINE_STAGE_COUNT + FRAME_TYPE_COUNT + _unprocessedFilters.size() + _processedFilters.size() + _depthFilters.size());
+  
+  for(auto i = 0; i < PIPELINE_STAGE_COUNT; i++)
+  {
+    const StageCounters &c = _stageCounters[i];
+    DepthCameraStageStatistics &s = statistics.pipelineStages[i];
+    
+    s.frameCount = c.frameCount;
+    s.dropCount = c.dropCount;
+    s.errorCount = c.errorCount;
+    s.queueDepth = (i == PIPELINE_STAGE_CAPTURE)?0:_pipelineQueues[i].size();
+    s.maxQueueDepth = c.maxQueueDepth;
+    
+    statistics.framesDropped += s.dropCount;
+    statistics.framesFailed += s.errorCount;
+    
+    LatencyStatistics l;
+    c.latency.snapshot(l);
+    l.name = stageNames[i];
+    statistics.stages.push_back(l);
+  }
+  
+  statistics.framesCaptured = statistics.pipelineStages[PIPELINE_STAGE_CAPTURE].frameCount;
+  
+  _unprocessedFilters.getStatistics("filter/unprocessed/", statistics.stages);
+  _processedFilters.getStatistics("filter/processed/", statistics.stages);
+  _depthFilters.getStatistics("filter/depth/", statistics.stages);
+  
+  for(auto i = 0; i < FRAME_TYPE_COUNT; i++)
+  {
+    LatencyStatistics s;
+    _callbackHistograms[i].snapshot(s);
+    s.name = String("callback/") + callbackNames[i];
+    statistics.stages.push_back(s);
+  }
+  
+  return true;
+}
+
+void DepthCamera::resetStatistics()
+{
+  for(auto i = 0; i < PIPELINE_STAGE_COUNT; i++)
+    _stageCounters[i].reset();
+  
+  for(auto i = 0; i < FRAME_TYPE_COUNT; i++)
+    _callbackHistograms[i].reset();
+  
+  _unprocessedFilters.resetStatistics();
+  _processedFilters.resetStatistics();
+  _depthFilters.resetStatistics();
+}
+
 bool DepthCamera::_convertToPointCloudFrame(const DepthFramePtr &depthFrame, PointCloudFramePtr &pointCloudFrame)
 {
   if(!depthFrame)
@@ -264,8 +888,72 @@ bool DepthCamera::_convertToPointCloudFrame(const DepthFramePtr &depthFrame, Poi
 }
 
 
+bool DepthCamera::_convertToPointCloudSoAFrame(const DepthFramePtr &depthFrame, XYZIPointCloudSoAFramePtr &pointCloudFrame)
+{
+  if(!depthFrame)
+  {
+    logger(LOG_ERROR) << "DepthCamera: Blank depth frame." << std::endl;
+    return false;
+  }
+  
+  if(!pointCloudFrame)
+    pointCloudFrame = XYZIPointCloudSoAFramePtr(new XYZIPointCloudSoAFrame());
+  
+  FramePtr p1 = std::dynamic_pointer_cast<Frame>(depthFrame);
+  FramePtr p2 = std::dynamic_pointer_cast<Frame>(pointCloudFrame);
+  
+  return _pointCloudFrameGenerator->generate(p1, p2); // Generator fills 'p2' in place as it is a XYZIPointCloudSoAFrame
+}
+
+void DepthCamera::_ownRawData(const RawFramePtr &rawFrame)
+{
+  RawDataFrame *r = dynamic_cast<RawDataFrame *>(rawFrame.get());
+  
+  if(r)
+    r->ownData();
+}
+
+void DepthCamera::_preallocateFrameBuffers()
+{
+  FrameSize s;
+  
+  if(!getFrameSize(s))
+    return; // Buffers get allocated on first use
+  
+  SizeType count = s.width*s.height;
+  
+  _depthFrameBuffers.preallocate([&s, count](DepthFramePtr &d) {
+    if(!d)
+      d = DepthFramePtr(new DepthFrame());
+    
+    d->size = s;
+    d->depth.resize(count);
+    d->amplitude.resize(count);
+  });
+  
+  _pointCloudBuffers.preallocate([count](PointCloudFramePtr &p) {
+    XYZIPointCloudFrame *f = dynamic_cast<XYZIPointCloudFrame *>(p.get());
+    
+    if(!f)
+    {
+      f = new XYZIPointCloudFrame();
+      p = PointCloudFramePtr(f);
+    }
+    
+    f->points.resize(count);
+  });
+  
+  _pointCloudSoABuffers.preallocate([count](XYZIPointCloudSoAFramePtr &p) {
+    if(!p)
+      p = XYZIPointCloudSoAFramePtr(new XYZIPointCloudSoAFrame());
+    
+    p->resize(count);
+  });
+}
+
 void DepthCamera::_captureThreadWrapper()
 {
+  _applyThreadSettings();
   _captureLoop();
 }
 
@@ -293,8 +981,18 @@ bool DepthCamera::start()
   
   resetFilters();
   
+  if(_streamer && !_streamer->setThreadSettings(_threadSettings.captureAffinity, _threadSettings.captureRealTimePriority))
+    logger(LOG_WARNING) << "DepthCamera: Could not set thread settings of streamer of " << id() << std::endl;
+  
+  // Raw frames reaching callbacks own their data (see _ownRawData()), so frames may borrow streamer buffers till then.
+  // Not all streamers support it, hence the result is ignored
+  if(_streamer)
+    _streamer->setZeroCopy(true);
+  
   if(!_start())
     return false;
+  
+  _preallocateFrameBuffers();
 
   _running = true;
   //_captureThreadWrapper();
@@ -318,17 +1016,25 @@ bool DepthCamera::stop()
 
 void DepthCamera::wait()
 {
+  if(_isPipelineThread()) // e.g., stop() from within a callback. Capture thread joins the stage threads
+    return;
+  
   if(_captureThread &&  _captureThread->get_id() != std::this_thread::get_id() && _captureThread->joinable())
     _captureThread->join();
 }
 
 DepthCamera::~DepthCamera()
 {
-  stop();
+  if(isRunning())
+    stop();
+  
+  wait(); // Capture thread may have stopped on its own, e.g., at the end of playback
   
+  // Frames still held by applications keep their pool slots till they are released
   _rawFrameBuffers.clear();
   _depthFrameBuffers.clear();
   _pointCloudBuffers.clear();
+  _pointCloudSoABuffers.clear();
   
   _parameters.clear();
 }
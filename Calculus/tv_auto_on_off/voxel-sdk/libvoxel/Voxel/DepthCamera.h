@@ -12,6 +12,10 @@
 #include <Frame.h>
 #include "VideoMode.h"
 #include <FrameBuffer.h>
+#include <SPSCQueue.h>
+#include <Timer.h>
+#include <LatencyHistogram.h>
+#include <ThreadPool.h>
 
 #include <RegisterProgrammer.h>
 #include <Streamer.h>
@@ -28,6 +32,38 @@
 namespace Voxel
 {
   
+/**
+ * \ingroup CamSys
+ * 
+ * \brief Counters of one DepthCamera::PipelineStage, as returned in DepthCameraStatistics
+ */
+struct DepthCameraStageStatistics
+{
+  uint64_t frameCount = 0; // frames which went through the stage
+  uint64_t dropCount = 0; // frames dropped as the input queue of the stage was full
+  uint64_t errorCount = 0; // frames discarded due to a failure in the stage
+  SizeType queueDepth = 0, maxQueueDepth = 0; // of the input queue of the stage. Always zero when not pipelined
+};
+
+/**
+ * \ingroup CamSys
+ * 
+ * \brief Counters and per-stage latencies of a depth camera, as returned by DepthCamera::getStatistics()
+ */
+struct DepthCameraStatistics
+{
+  uint64_t framesCaptured = 0; // frames which went through the capture stage
+  uint64_t framesDropped = 0; // sum of 'dropCount' of all stages
+  uint64_t framesFailed = 0; // sum of 'errorCount' of all stages
+  
+  Vector<DepthCameraStageStatistics> pipelineStages; // indexed by DepthCamera::PipelineStage
+  
+  // Latency histograms of each pipeline stage in order as "capture", "process", "depth", "point_cloud", "callback",
+  // followed by each filter as "filter/<set>/<index>:<name>" and each callback as "callback/<frame type>". These are
+  // populated only while statistics are enabled. The "callback" stage is used only in pipelined mode
+  Vector<LatencyStatistics> stages;
+};
+
 /**
   * \ingroup CamSys
   * 
@@ -45,11 +81,42 @@ public:
     FRAME_RAW_FRAME_PROCESSED = 1,
     FRAME_DEPTH_FRAME = 2,
     FRAME_XYZI_POINT_CLOUD_FRAME = 3,
-    FRAME_TYPE_COUNT = 4 // This is just used for number of callback types
+    FRAME_XYZI_POINT_CLOUD_SOA_FRAME = 4, // XYZIPointCloudSoAFrame, same points as FRAME_XYZI_POINT_CLOUD_FRAME
+    FRAME_TYPE_COUNT = 5 // This is just used for number of callback types
   };
   
   typedef Function<void (DepthCamera &camera, const Frame &frame, FrameType callBackType)> CallbackType;
   
+  // Frame given to this callback can be kept beyond the call without copying it. Its buffer goes back to the camera's
+  // pool when the last reference to it is dropped
+  typedef Function<void (DepthCamera &camera, const ConstFramePtr &frame, FrameType callBackType)> SharedCallbackType;
+  
+  // Stages of the pipelined capture mode. Each stage except capture has an input queue
+  enum PipelineStage
+  {
+    PIPELINE_STAGE_CAPTURE = 0, // capture + unprocessed raw filters
+    PIPELINE_STAGE_PROCESS = 1, // _processRawFrame() + processed raw filters, or _convertRawToPointCloudFrame() in fused point cloud mode
+    PIPELINE_STAGE_DEPTH = 2, // _convertToDepthFrame() + depth filters
+    PIPELINE_STAGE_POINT_CLOUD = 3, // _convertToPointCloudFrame() and/or _convertToPointCloudSoAFrame()
+    PIPELINE_STAGE_CALLBACK = 4, // user callbacks + frame stream writing
+    PIPELINE_STAGE_COUNT = 5
+  };
+  
+  // What a stage does when the input queue of the next stage is full
+  enum PipelineDropPolicy
+  {
+    PIPELINE_DROP_NEWEST = 0, // drop the frame which could not be queued
+    PIPELINE_BLOCK = 1 // wait for the next stage to make room. This back-pressures capture
+  };
+  
+  // Placement of the capture threads of a camera. Affinity 0 => any CPU. Threads shared by cameras, such as those of
+  // ThreadPool::getProcessingPool() or of a pipeline thread pool, are configured by the application instead
+  struct ThreadSettings
+  {
+    CPUAffinityMask captureAffinity = 0; // capture thread and the streamer's own threads, e.g., USB event thread
+    int captureRealTimePriority = 0; // > 0 => FIFO scheduling of capture threads at this priority, usually needing privileges
+  };
+  
 private:
   mutable Mutex _accessMutex; // This is locked by getters and setters which are public
   mutable Mutex _frameStreamWriterMutex;
@@ -74,6 +141,7 @@ protected:
   FrameBufferManager<RawFrame> _rawFrameBuffers;
   FrameBufferManager<DepthFrame> _depthFrameBuffers;
   FrameBufferManager<PointCloudFrame> _pointCloudBuffers;
+  FrameBufferManager<XYZIPointCloudSoAFrame> _pointCloudSoABuffers;
   
   FilterSet<RawFrame> _unprocessedFilters, _processedFilters;
   
@@ -84,9 +152,47 @@ protected:
   bool _addParameters(const Vector<ParameterPtr> &params);
   
   CallbackType _callback[FRAME_TYPE_COUNT];
+  SharedCallbackType _sharedCallback[FRAME_TYPE_COUNT]; // At most one of _callback and _sharedCallback is set for a type
   
   uint32_t _callBackTypesRegistered = 0;
   
+  inline bool _hasCallback(FrameType type) const { return _callback[type] || _sharedCallback[type]; }
+  
+  // Frame handed out to shared callbacks. It holds the pool buffer, and with it the pool, so that it may be kept beyond
+  // the life of the camera
+  template <typename T>
+  static ConstFramePtr _shareFrame(FrameBuffer<T> &buffer)
+  {
+    struct SharedFrame
+    {
+      FrameBuffer<T> buffer;
+      Ptr<T> frame;
+      
+      SharedFrame(FrameBuffer<T> &b): buffer(b), frame(*b) {}
+    };
+    
+    std::shared_ptr<SharedFrame> s = std::make_shared<SharedFrame>(buffer);
+    return ConstFramePtr(std::shared_ptr<const Frame>(s, s->frame.get()));
+  }
+  
+  // Same as below, but calls the shared callback for 'type' if that is the one registered
+  template <typename T>
+  bool _callbackAndContinue(uint32_t &callBackTypesToBeCalled, FrameType type, FrameBuffer<T> &buffer)
+  {
+    if(!_sharedCallback[type])
+      return _callbackAndContinue(callBackTypesToBeCalled, type, (const Frame &)**buffer);
+    
+    TimeStampType startTime = _statisticsStart();
+    
+    _sharedCallback[type](*this, _shareFrame(buffer), type);
+    
+    _statisticsRecord(_callbackHistograms[type], startTime);
+    
+    callBackTypesToBeCalled &= ~(1 << type);
+    
+    return callBackTypesToBeCalled != 0;
+  }
+  
   ThreadPtr _captureThread;
   
   // Callback the registered function for 'type' if present and decide whether continue processing or not
@@ -99,15 +205,123 @@ protected:
   virtual bool _processRawFrame(const RawFramePtr &rawFrameInput, RawFramePtr &rawFrameOutput) = 0; // here output raw frame will have processed data, like ToF data for ToF cameras
   virtual bool _convertToDepthFrame(const RawFramePtr &rawFrame, DepthFramePtr &depthFrame) = 0;
   virtual bool _convertToPointCloudFrame(const DepthFramePtr &depthFrame, PointCloudFramePtr &pointCloudFrame);
+  virtual bool _convertToPointCloudSoAFrame(const DepthFramePtr &depthFrame, XYZIPointCloudSoAFramePtr &pointCloudFrame);
+  
+  // Fused conversion of a raw unprocessed frame directly to point cloud frame, without producing the intermediate
+  // processed raw and depth frames. Cameras which implement it need to override _isFusedPointCloudSupported() too
+  virtual bool _convertRawToPointCloudFrame(const RawFramePtr &rawFrame, PointCloudFramePtr &pointCloudFrame);
+  virtual bool _isFusedPointCloudSupported() const { return false; }
+  
+  bool _fusedPointCloudEnabled = false;
+  
+  // Is fused conversion to be used for a frame for which 'callBackTypes' are to be called?
+  bool _useFusedPointCloud(uint32_t callBackTypes) const;
   
   virtual void _captureLoop(); // the main capture loop
   
   void _captureThreadWrapper(); // this is non-virtual and simply calls _captureLoop
   
+  // Raw unprocessed frames may borrow streamer's buffers. This copies the data into the frame for consumers, like callbacks, which could hold on to it
+  void _ownRawData(const RawFramePtr &rawFrame);
+  
+  // Sizes depth and point cloud frame buffers for current frame size, so that capture does not allocate them
+  virtual void _preallocateFrameBuffers();
+  
   bool _running; // is capture running?
   
   bool _writeToFrameStream(RawFramePtr &rawUnprocessed);
   
+  struct StageCounters
+  {
+    Atomic<uint64_t> frameCount, dropCount, errorCount;
+    Atomic<SizeType> maxQueueDepth;
+    LatencyHistogram latency;
+    
+    StageCounters() { reset(); }
+    
+    void reset()
+    {
+      frameCount = dropCount = errorCount = 0;
+      maxQueueDepth = 0;
+      latency.reset();
+    }
+  };
+  
+  // Counters are always updated. Latencies are recorded only when enabled, so that disabled statistics cost one relaxed load per stage
+  Atomic<bool> _statisticsEnabled;
+  StageCounters _stageCounters[PIPELINE_STAGE_COUNT]; // for both pipelined and serial capture
+  LatencyHistogram _callbackHistograms[FRAME_TYPE_COUNT];
+  Timer _statisticsTimer;
+  
+  // Returns 0 when statistics are disabled, in which case no latency is recorded
+  inline TimeStampType _statisticsStart()
+  {
+    return _statisticsEnabled.load(std::memory_order_relaxed)?_statisticsTimer.getCurentRealTime():0;
+  }
+  
+  inline void _statisticsRecord(LatencyHistogram &histogram, TimeStampType startTime)
+  {
+    if(startTime)
+      histogram.record(_statisticsTimer.getCurentRealTime() - startTime);
+  }
+  
+  // Counts a frame which went through 'stage', started at 'startTime' as given by _statisticsStart()
+  inline void _stageRecord(PipelineStage stage, TimeStampType startTime)
+  {
+    _stageCounters[stage].frameCount++;
+    _statisticsRecord(_stageCounters[stage].latency, startTime);
+  }
+  
+  // Frames of one capture, as they move through the pipeline stages
+  struct PipelineFrameSet
+  {
+    uint32_t callBackTypesToBeCalled;
+    bool saveFrameStream;
+    bool fused; // point cloud is generated directly from unprocessed frame in process stage
+    
+    FilterSet<RawFrame>::FrameSequence unprocessed, processed;
+    FilterSet<DepthFrame>::FrameSequence depth;
+    List<FrameBuffer<PointCloudFrame>> pointCloud;
+    List<FrameBuffer<XYZIPointCloudSoAFrame>> pointCloudSoA;
+  };
+  
+  typedef Ptr<PipelineFrameSet> PipelineFrameSetPtr;
+  
+  bool _pipelineEnabled = false;
+  SizeType _pipelineQueueDepth = 2;
+  PipelineDropPolicy _pipelineDropPolicy = PIPELINE_DROP_NEWEST;
+  
+  SPSCQueue<PipelineFrameSetPtr> _pipelineQueues[PIPELINE_STAGE_COUNT]; // _pipelineQueues[i] is input to stage 'i'. Capture stage has none
+  ThreadPtr _pipelineThreads[PIPELINE_STAGE_COUNT];
+  Atomic<bool> _pipelineRunning;
+  
+  // When set, stages after capture run as a task on this pool instead of on their own threads. At most one task
+  // per camera is scheduled at a time, so frames of a camera go through the stages in order
+  ThreadPoolPtr _pipelineThreadPool;
+  bool _pipelineTaskScheduled = false;
+  Atomic<std::thread::id> _pipelineTaskThread;
+  Mutex _pipelineTaskMutex;
+  ConditionVariable _pipelineTaskDone;
+  
+  virtual void _pipelinedCaptureLoop(); // capture stage, runs on the capture thread and owns the other stage threads
+  void _pipelineStageLoop(PipelineStage stage);
+  
+  ThreadSettings _threadSettings;
+  
+  void _readThreadSettings();
+  void _applyThreadSettings(); // on the calling thread, which is the capture thread
+  
+  void _pipelineSchedule();
+  void _pipelineTask(); // runs all stages after capture on frame sets queued for the process stage
+  
+  // Does the work of 'stage' on 'frameSet'. Returns false if the frame set is to be discarded
+  virtual bool _pipelineProcess(PipelineStage stage, PipelineFrameSetPtr &frameSet);
+  
+  // Hands over 'frameSet' to input queue of 'toStage' as per the drop policy
+  bool _pipelineForward(PipelineStage toStage, const PipelineFrameSetPtr &frameSet);
+  
+  bool _isPipelineThread() const;
+  
   // These protected getters and setters are not thread-safe. These are to be directly called only when nested calls are to be done from getter/setter to another. 
   // Otherwise use the public functions
   template <typename T>
@@ -146,7 +360,8 @@ protected:
 public:
   MainConfigurationFile configFile; // This corresponds to camera specific configuration file
   
-  DepthCamera(const String &name, DevicePtr device);
+  // 'readConfiguration' = false for cameras without a configuration file, like those playing back a stream
+  DepthCamera(const String &name, DevicePtr device, bool readConfiguration = true);
   
   virtual bool isInitialized() const
   {
@@ -198,6 +413,10 @@ public:
   virtual bool closeFrameStream();
   
   virtual bool registerCallback(FrameType type, CallbackType f);
+  
+  // Replaces any callback registered for 'type'. Frames may be kept after the camera is destroyed
+  virtual bool registerSharedCallback(FrameType type, SharedCallbackType f);
+  
   virtual bool clearAllCallbacks();
   virtual bool clearCallback(FrameType type);
   
@@ -219,6 +438,50 @@ public:
   
   bool reset();
   
+  /**
+   * Pipelined capture mode runs each stage of frame processing on its own thread, with
+   * a bounded queue of 'queueDepth' entries between consecutive stages. Callbacks are
+   * then called from the callback stage thread instead of the capture thread.
+   * Can only be changed while the camera is not running.
+   */
+  bool setPipelineMode(bool enable, SizeType queueDepth = 2, PipelineDropPolicy dropPolicy = PIPELINE_DROP_NEWEST);
+  inline bool isPipelineModeEnabled() const { return _pipelineEnabled; }
+  
+  /**
+   * In pipelined capture mode, runs the stages after capture on 'pool', which may be shared by many cameras, instead of
+   * on a thread per stage. Queue depth and drop policy then apply to frames waiting for the pool. Callbacks are called
+   * from the pool's threads. nullptr restores the stage threads. Can only be changed while the camera is not running.
+   */
+  bool setPipelineThreadPool(const ThreadPoolPtr &pool);
+  inline const ThreadPoolPtr &getPipelineThreadPool() const { return _pipelineThreadPool; }
+  
+  /**
+   * Defaults come from the [threads] section of the camera configuration: capture_cpus as a CPU list like "0,2-3",
+   * and capture_priority. Can only be changed while the camera is not running.
+   */
+  bool setThreadSettings(const ThreadSettings &settings);
+  inline const ThreadSettings &getThreadSettings() const { return _threadSettings; }
+  
+  /**
+   * Fused point cloud mode converts raw frames to point cloud frames in a single pass, skipping
+   * the processed raw and depth frames. It takes effect only while the point cloud callback is the
+   * only one registered and no processed raw or depth filters are added; otherwise frames go
+   * through the usual stages. Can only be changed while the camera is not running.
+   */
+  bool setFusedPointCloudMode(bool enable);
+  inline bool isFusedPointCloudModeEnabled() const { return _fusedPointCloudEnabled; }
+  
+  /**
+   * Statistics help locate where frames are lost or delayed: in capture, processing, filters or callbacks.
+   * Frame counters are always maintained. Latency histograms are recorded only after enableStatistics(true).
+   * Statistics can be enabled, read and reset while the camera is running.
+   */
+  void enableStatistics(bool enable);
+  inline bool isStatisticsEnabled() const { return _statisticsEnabled; }
+  
+  bool getStatistics(DepthCameraStatistics &statistics) const;
+  void resetStatistics();
+  
   inline Ptr<RegisterProgrammer> getProgrammer() { return _programmer; } // RegisterProgrammer is usually thread-safe to use outside directly
   inline Ptr<Streamer> getStreamer() { return _streamer; } // Streamer may not be thread-safe
   
@@ -24,7 +24,8 @@ public:
     USB = 0,
     LPT = 1,
     SERIAL = 2,
-    I2C = 3
+    I2C = 3,
+    VIRTUAL = 4
   };
 protected:
   String _id; // in the format interface::device::serialnumber. "device" for USB devices is "vendorid:productid"
@@ -92,6 +93,18 @@ public:
   virtual ~USBDevice() {}
 };
 
+// Recorded frame stream (.vxl) played back as a camera. Serial number holds the file name
+class VOXEL_EXPORT VirtualDevice : public Device
+{
+public:
+  VirtualDevice(const String &fileName): 
+    Device(Device::VIRTUAL, "file", fileName, -1, "Virtual camera for '" + fileName + "'") {}
+  
+  inline const String &fileName() const { return _serialNumber; }
+  
+  virtual ~VirtualDevice() {}
+};
+
 class VOXEL_EXPORT DeviceScanner
 {
 protected:
@@ -1,16 +1,40 @@
 
 #include "BilateralFilter.h"
+#include "ThreadPool.h"
 
 #include <memory.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BILATERAL_FILTER_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#define BILATERAL_FILTER_ROW_GRAIN 4 // Rows per task at least, on the processing thread pool
+
 namespace Voxel
 {
   
-BilateralFilter::BilateralFilter(float sigma): Filter("BilateralFilter"), _discreteGuassian(sigma)
+BilateralFilter::BilateralFilter(float sigma): Filter("BilateralFilter"), _discreteGuassian(sigma), _fast(true)
 {
   _addParameters({
     FilterParameterPtr(new FloatFilterParameter("sigma", "Sigma", "Standard deviation", sigma, "", 0, 100)),
+    FilterParameterPtr(new BoolFilterParameter("fast", "Fast", "Use precomputed weights and SIMD evaluation", _fast, 
+                                               {"Reference", "Fast"}, {"Evaluates Gaussian for every tap", "Uses weight tables"})),
   });
+  
+  _computeWeights();
+}
+
+void BilateralFilter::_computeWeights()
+{
+  for (int k = -2; k <= 2; k++) 
+    for (int m = -2; m <= 2; m++) 
+      _spatialWeights[(k + 2)*5 + m + 2] = _discreteGuassian.valueAt(k)*_discreteGuassian.valueAt(m);
+  
+  _rangeWeights.resize(_discreteGuassian.size() + 1);
+  
+  for(auto i = 0; i < _rangeWeights.size(); i++)
+    _rangeWeights[i] = _discreteGuassian.valueAt(i);
 }
 
 void BilateralFilter::reset() {}
@@ -25,119 +49,313 @@ void BilateralFilter::_onSet(const FilterParameterPtr &f)
       logger(LOG_WARNING) << "BilateralFilter: Could not get the recently updated 'sigma' parameter" << std::endl;
     }
     _discreteGuassian.setStandardDeviation(s);
+    _computeWeights();
   }
+  else if(f->name() == "fast")
+  {
+    if(!_get(f->name(), _fast))
+    {
+      logger(LOG_WARNING) << "BilateralFilter: Could not get the recently updated 'fast' parameter" << std::endl;
+    }
+  }
+}
+
+template <typename T, typename T2>
+bool BilateralFilter::_filter(const  T *in, const T2 *ref, T *out, int rowBegin, int rowEnd)
+{
+  ThreadPool::getProcessingPool()->parallelFor(rowBegin, rowEnd, [&](IndexType rowsBegin, IndexType rowsEnd)
+  {
+    for (int j = rowsBegin; j < rowsEnd; j++) 
+    {
+      for (int i = 0; i < _size.width; i++) 
+      {
+        int p = j*_size.width + i;
+        
+        float weight_sum = 0;
+        float sum = 0;
+        
+        for (int k = -2; k <= 2; k++) 
+        {
+          for (int m = -2; m <= 2; m++) 
+          {                         
+            int i2 = i+m;
+            int j2 = j+k;
+            if ((j2 >= 0 && j2 < _size.height) && (i2 >= 0 && i2 < _size.width)) 
+            {
+              int q = j2*_size.width + i2;
+              float weight = _discreteGuassian.valueAt(k)*_discreteGuassian.valueAt(m)*_discreteGuassian.valueAt(ref[p]-ref[q]);
+              weight_sum += weight;
+              sum += weight * in[q];
+            }
+          }
+        }
+        out[p] = (T)(sum / weight_sum);
+      }
+    }
+  }, BILATERAL_FILTER_ROW_GRAIN);
+  return true;
+}
+
+
+// |ref[p] - ref[q]| as range weight index, with the difference converted to int as in DiscreteGaussian::valueAt()
+template <typename T2>
+static inline uint32_t rangeIndex(const T2 &refP, const T2 &refQ, uint32_t maxIndex)
+{
+  int d = refP - refQ;
+  uint32_t a = (d < 0)?(0U - (uint32_t)d):(uint32_t)d;
+  
+  return (a < maxIndex)?a:maxIndex;
 }
 
 template <typename T, typename T2>
-bool BilateralFilter::_filter(const  T *in, const T2 *ref, T *out)
+inline void BilateralFilter::_fastFilterBorderPixel(const T *in, const T2 *ref, T *out, int i, int j)
 {
-  uint s = _size.width*_size.height;
+  int p = j*_size.width + i;
+  uint32_t maxIndex = _rangeWeights.size() - 1;
+  
+  float weight_sum = 0;
+  float sum = 0;
   
-  #pragma omp parallel for
-  for (int j = 0; j < _size.height; j++) 
+  for (int k = -2; k <= 2; k++) 
   {
-    for (int i = 0; i < _size.width; i++) 
+    for (int m = -2; m <= 2; m++) 
     {
-      int p = j*_size.width + i;
+      int i2 = i+m;
+      int j2 = j+k;
+      if ((j2 >= 0 && j2 < _size.height) && (i2 >= 0 && i2 < _size.width)) 
+      {
+        int q = j2*_size.width + i2;
+        float weight = _spatialWeights[(k + 2)*5 + m + 2]*_rangeWeights[rangeIndex(ref[p], ref[q], maxIndex)];
+        weight_sum += weight;
+        sum += weight * in[q];
+      }
+    }
+  }
+  out[p] = (T)(sum / weight_sum);
+}
+
+#ifdef BILATERAL_FILTER_SSE2
+// Loads 4 consecutive elements as floats. Only for types which convert to float exactly
+static inline __m128 loadFloat4(const float *v) { return _mm_loadu_ps(v); }
+
+static inline __m128 loadFloat4(const uint16_t *v)
+{
+  return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)v), _mm_setzero_si128()));
+}
+
+static inline __m128 loadFloat4(const uint8_t *v)
+{
+  int32_t x;
+  memcpy(&x, v, sizeof(x));
+  
+  __m128i zero = _mm_setzero_si128();
+  return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(x), zero), zero));
+}
+
+template <typename T>
+struct BilateralSIMDType { static const bool supported = false; };
+
+template <> struct BilateralSIMDType<float> { static const bool supported = true; };
+template <> struct BilateralSIMDType<uint16_t> { static const bool supported = true; };
+template <> struct BilateralSIMDType<uint8_t> { static const bool supported = true; };
+
+// 4 pixels at 'in'/'ref', all with full 5x5 window inside the frame. Taps are accumulated in the same order as 
+// the scalar code, so that the output is identical
+template <typename T, typename T2>
+static inline void filter4(const T *in, const T2 *ref, T *out, int width, const float *spatialWeights, 
+                           const float *rangeWeights, uint32_t maxIndex)
+{
+  const __m128 signMask = _mm_set1_ps(-0.0f), maxIndexV = _mm_set1_ps((float)maxIndex);
+  
+  __m128 refP = loadFloat4(ref), weightSum = _mm_setzero_ps(), sum = _mm_setzero_ps();
+  
+  int32_t index[4];
+  
+  for (int k = -2; k <= 2; k++) 
+  {
+    for (int m = -2; m <= 2; m++) 
+    {
+      int q = k*width + m;
+      
+      // Truncation of min(|d|, maxIndex) equals min(|int(d)|, maxIndex)
+      __m128 d = _mm_andnot_ps(signMask, _mm_sub_ps(refP, loadFloat4(ref + q)));
+      _mm_storeu_si128((__m128i *)index, _mm_cvttps_epi32(_mm_min_ps(d, maxIndexV)));
       
-      float weight_sum = 0;
-      float sum = 0;
+      __m128 weight = _mm_mul_ps(_mm_set1_ps(spatialWeights[(k + 2)*5 + m + 2]), 
+        _mm_set_ps(rangeWeights[index[3]], rangeWeights[index[2]], rangeWeights[index[1]], rangeWeights[index[0]]));
+      
+      weightSum = _mm_add_ps(weightSum, weight);
+      sum = _mm_add_ps(sum, _mm_mul_ps(weight, loadFloat4(in + q)));
+    }
+  }
+  
+  float result[4];
+  _mm_storeu_ps(result, _mm_div_ps(sum, weightSum));
+  
+  for(auto l = 0; l < 4; l++)
+    out[l] = (T)result[l];
+}
+
+// Filters pixels 'i' onwards in row 'j', 4 at a time, while they are before 'end'. Returns the first pixel not filtered
+template <typename T, typename T2, bool = BilateralSIMDType<T>::supported && BilateralSIMDType<T2>::supported>
+struct BilateralSIMDRow
+{
+  static inline int filter(const T *in, const T2 *ref, T *out, int width, int i, int j, int end, 
+                           const float *spatialWeights, const float *rangeWeights, uint32_t maxIndex) { return i; }
+};
+
+template <typename T, typename T2>
+struct BilateralSIMDRow<T, T2, true>
+{
+  static inline int filter(const T *in, const T2 *ref, T *out, int width, int i, int j, int end, 
+                           const float *spatialWeights, const float *rangeWeights, uint32_t maxIndex)
+  {
+    for (; i + 4 <= end; i += 4)
+    {
+      int p = j*width + i;
+      filter4(in + p, ref + p, out + p, width, spatialWeights, rangeWeights, maxIndex);
+    }
+    return i;
+  }
+};
+#endif
+
+template <typename T, typename T2>
+void BilateralFilter::_fastFilterInteriorRow(const T *in, const T2 *ref, T *out, int j)
+{
+  uint32_t maxIndex = _rangeWeights.size() - 1;
+  const float *rangeWeights = _rangeWeights.data();
+  
+  int width = _size.width, i = 2, end = width - 2;
+  
+#ifdef BILATERAL_FILTER_SSE2
+  i = BilateralSIMDRow<T, T2>::filter(in, ref, out, width, i, j, end, _spatialWeights, rangeWeights, maxIndex);
+#endif
+  
+  for (; i < end; i++)
+  {
+    int p = j*width + i;
+    
+    float weight_sum = 0;
+    float sum = 0;
+    
+    for (int k = -2; k <= 2; k++) 
+    {
+      // Signed row offset, as unsigned k*_size.width added to a pointer does not wrap around
+      const T *inRow = in + p + k*width;
+      const T2 *refRow = ref + p + k*width;
+      const float *spatialWeights = _spatialWeights + (k + 2)*5 + 2;
       
-      for (int k = -2; k <= 2; k++) 
+      for (int m = -2; m <= 2; m++) 
       {
-        for (int m = -2; m <= 2; m++) 
-        {                         
-          int i2 = i+m;
-          int j2 = j+k;
-          if ((j2 >= 0 && j2 < _size.height) && (i2 >= 0 && i2 < _size.width)) 
-          {
-            int q = j2*_size.width + i2;
-            float weight = _discreteGuassian.valueAt(k)*_discreteGuassian.valueAt(m)*_discreteGuassian.valueAt(ref[p]-ref[q]);
-            weight_sum += weight;
-            sum += weight * in[q];
-          }
-        }
+        float weight = spatialWeights[m]*rangeWeights[rangeIndex(ref[p], refRow[m], maxIndex)];
+        weight_sum += weight;
+        sum += weight * inRow[m];
       }
-      out[p] = (T)(sum / weight_sum);
     }
+    out[p] = (T)(sum / weight_sum);
   }
-  return true;
 }
 
+template <typename T, typename T2>
+bool BilateralFilter::_fastFilter(const T *in, const T2 *ref, T *out, int rowBegin, int rowEnd)
+{
+  int width = _size.width, height = _size.height;
+  
+  ThreadPool::getProcessingPool()->parallelFor(rowBegin, rowEnd, [&](IndexType rowsBegin, IndexType rowsEnd)
+  {
+    for (int j = rowsBegin; j < rowsEnd; j++) 
+    {
+      if(j < 2 || j >= height - 2 || width < 5)
+      {
+        for (int i = 0; i < width; i++)
+          _fastFilterBorderPixel(in, ref, out, i, j);
+      }
+      else
+      {
+        for (int i = 0; i < 2; i++)
+        {
+          _fastFilterBorderPixel(in, ref, out, i, j);
+          _fastFilterBorderPixel(in, ref, out, width - 1 - i, j);
+        }
+        
+        _fastFilterInteriorRow(in, ref, out, j);
+      }
+    }
+  }, BILATERAL_FILTER_ROW_GRAIN);
+  return true;
+}
 
 bool BilateralFilter::_filter(const FramePtr &in, FramePtr &out)
+{
+  return _beginBands(in, out) && _filterBand(in, out, 0, _size.height);
+}
+
+bool BilateralFilter::_beginBands(const FramePtr &in, FramePtr &out)
 {
   ToFRawFrame *tofFrame = dynamic_cast<ToFRawFrame *>(in.get());
   DepthFrame *depthFrame = dynamic_cast<DepthFrame *>(in.get());
   
   if((!tofFrame && !depthFrame) || !_prepareOutput(in, out))
   {
-    logger(LOG_ERROR) << "IIRFilter: Input frame type is not ToFRawFrame or DepthFrame or failed get the output ready" << std::endl;
+    logger(LOG_ERROR) << "BilateralFilter: Input frame type is not ToFRawFrame or DepthFrame or failed get the output ready" << std::endl;
+    return false;
+  }
+  
+  _size = tofFrame?tofFrame->size:depthFrame->size;
+  return true;
+}
+
+bool BilateralFilter::_filterBand(const FramePtr &in, FramePtr &out, int rowBegin, int rowEnd)
+{
+  ToFRawFrame *tofFrame = dynamic_cast<ToFRawFrame *>(in.get());
+  DepthFrame *depthFrame = dynamic_cast<DepthFrame *>(in.get());
+  
+  if(!_copyUnfilteredRows(in.get(), out.get(), rowBegin, rowEnd))
+  {
+    logger(LOG_ERROR) << "BilateralFilter: Invalid frame type. Expecting output of same type as input." << std::endl;
     return false;
   }
   
   if(tofFrame)
   {
-    _size = tofFrame->size;
     ToFRawFrame *o = dynamic_cast<ToFRawFrame *>(out.get());
     
-    if(!o)
-    {
-      logger(LOG_ERROR) << "IIRFilter: Invalid frame type. Expecting ToFRawFrame." << std::endl;
-      return false;
-    }
-    
-    //logger(LOG_INFO) << "IIRFilter: Applying filter with gain = " << _gain << " to ToFRawFrame id = " << tofFrame->id << std::endl;
-    
-    uint s = _size.width*_size.height;
-    memcpy(o->ambient(), tofFrame->ambient(), s*tofFrame->ambientWordWidth());
-    memcpy(o->amplitude(), tofFrame->amplitude(), s*tofFrame->amplitudeWordWidth());
-    memcpy(o->flags(), tofFrame->flags(), s*tofFrame->flagsWordWidth());
-    
     if(tofFrame->phaseWordWidth() == 2)
     {
       if(tofFrame->amplitudeWordWidth() == 1)
-        return _filter<uint16_t, uint8_t>((uint16_t *)tofFrame->phase(), (uint8_t *)tofFrame->amplitude(), (uint16_t *)o->phase());
+        return _filter<uint16_t, uint8_t>((uint16_t *)tofFrame->phase(), (uint8_t *)tofFrame->amplitude(), (uint16_t *)o->phase(), rowBegin, rowEnd, _fast);
       else if(tofFrame->amplitudeWordWidth() == 2)
-        return _filter<uint16_t, uint16_t>((uint16_t *)tofFrame->phase(), (uint16_t *)tofFrame->amplitude(), (uint16_t *)o->phase());
+        return _filter<uint16_t, uint16_t>((uint16_t *)tofFrame->phase(), (uint16_t *)tofFrame->amplitude(), (uint16_t *)o->phase(), rowBegin, rowEnd, _fast);
       else if(tofFrame->amplitudeWordWidth() == 4)
-        return _filter<uint16_t, uint32_t>((uint16_t *)tofFrame->phase(), (uint32_t *)tofFrame->amplitude(), (uint16_t *)o->phase());
+        return _filter<uint16_t, uint32_t>((uint16_t *)tofFrame->phase(), (uint32_t *)tofFrame->amplitude(), (uint16_t *)o->phase(), rowBegin, rowEnd, _fast);
     }
     else if(tofFrame->phaseWordWidth() == 1)
     {
       if(tofFrame->amplitudeWordWidth() == 1)
-        return _filter<uint8_t, uint8_t>((uint8_t *)tofFrame->phase(), (uint8_t *)tofFrame->amplitude(), (uint8_t *)o->phase());
+        return _filter<uint8_t, uint8_t>((uint8_t *)tofFrame->phase(), (uint8_t *)tofFrame->amplitude(), (uint8_t *)o->phase(), rowBegin, rowEnd, _fast);
       else if(tofFrame->amplitudeWordWidth() == 2)
-        return _filter<uint8_t, uint16_t>((uint8_t *)tofFrame->phase(), (uint16_t *)tofFrame->amplitude(), (uint8_t *)o->phase());
+        return _filter<uint8_t, uint16_t>((uint8_t *)tofFrame->phase(), (uint16_t *)tofFrame->amplitude(), (uint8_t *)o->phase(), rowBegin, rowEnd, _fast);
       else if(tofFrame->amplitudeWordWidth() == 4)
-        return _filter<uint8_t, uint32_t>((uint8_t *)tofFrame->phase(), (uint32_t *)tofFrame->amplitude(), (uint8_t *)o->phase());
+        return _filter<uint8_t, uint32_t>((uint8_t *)tofFrame->phase(), (uint32_t *)tofFrame->amplitude(), (uint8_t *)o->phase(), rowBegin, rowEnd, _fast);
     }
     else if(tofFrame->phaseWordWidth() == 4)
     {
       if(tofFrame->amplitudeWordWidth() == 1)
-        return _filter<uint32_t, uint8_t>((uint32_t *)tofFrame->phase(), (uint8_t *)tofFrame->amplitude(), (uint32_t *)o->phase());
+        return _filter<uint32_t, uint8_t>((uint32_t *)tofFrame->phase(), (uint8_t *)tofFrame->amplitude(), (uint32_t *)o->phase(), rowBegin, rowEnd, _fast);
       else if(tofFrame->amplitudeWordWidth() == 2)
-        return _filter<uint32_t, uint16_t>((uint32_t *)tofFrame->phase(), (uint16_t *)tofFrame->amplitude(), (uint32_t *)o->phase());
+        return _filter<uint32_t, uint16_t>((uint32_t *)tofFrame->phase(), (uint16_t *)tofFrame->amplitude(), (uint32_t *)o->phase(), rowBegin, rowEnd, _fast);
       else if(tofFrame->amplitudeWordWidth() == 4)
-        return _filter<uint32_t, uint32_t>((uint32_t *)tofFrame->phase(), (uint32_t *)tofFrame->amplitude(), (uint32_t *)o->phase());
+        return _filter<uint32_t, uint32_t>((uint32_t *)tofFrame->phase(), (uint32_t *)tofFrame->amplitude(), (uint32_t *)o->phase(), rowBegin, rowEnd, _fast);
     }
      
     return false;
   }
   else if(depthFrame)
   {
-    _size = depthFrame->size;
     DepthFrame *o = dynamic_cast<DepthFrame *>(out.get());
     
-    if(!o)
-    {
-      logger(LOG_ERROR) << "IIRFilter: Invalid frame type. Expecting DepthFrame." << std::endl;
-      return false;
-    }
-    
-    o->amplitude = depthFrame->amplitude;
-    
-    return _filter<float, float>(depthFrame->depth.data(), depthFrame->amplitude.data(), o->depth.data());
+    return _filter<float, float>(depthFrame->depth.data(), depthFrame->amplitude.data(), o->depth.data(), rowBegin, rowEnd, _fast);
   }
   else
     return false;
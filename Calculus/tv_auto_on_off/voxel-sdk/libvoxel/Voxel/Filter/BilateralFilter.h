@@ -26,13 +26,42 @@ protected:
   
   FrameSize _size;
   
+  bool _fast;
+  
+  // Used by fast mode. Spatial weights of the 5x5 window, row-major, and range weights indexed by |ref[p] - ref[q]|.
+  // Last entry of range weights is zero and is used for all differences beyond the extent of the Gaussian
+  float _spatialWeights[25];
+  Vector<float> _rangeWeights;
+  
+  void _computeWeights();
+  
   virtual void _onSet(const FilterParameterPtr &f);
   
   template <typename T, typename T2>
-  bool _filter(const T *in, const T2 *ref, T *out);
+  bool _filter(const T *in, const T2 *ref, T *out, int rowBegin, int rowEnd);
+  
+  // Same output as _filter() above. Border pixels are done separately so that the interior needs no bounds checks
+  template <typename T, typename T2>
+  bool _fastFilter(const T *in, const T2 *ref, T *out, int rowBegin, int rowEnd);
+  
+  template <typename T, typename T2>
+  inline void _fastFilterBorderPixel(const T *in, const T2 *ref, T *out, int i, int j);
+  
+  template <typename T, typename T2>
+  void _fastFilterInteriorRow(const T *in, const T2 *ref, T *out, int j);
+  
+  template <typename T, typename T2>
+  bool _filter(const T *in, const T2 *ref, T *out, int rowBegin, int rowEnd, bool fast) 
+  { 
+    return fast?_fastFilter(in, ref, out, rowBegin, rowEnd):_filter(in, ref, out, rowBegin, rowEnd); 
+  }
   
   virtual bool _filter(const FramePtr &in, FramePtr &out);
   
+  virtual int _bandHalo() const { return 2; }
+  virtual bool _beginBands(const FramePtr &in, FramePtr &out);
+  virtual bool _filterBand(const FramePtr &in, FramePtr &out, int rowBegin, int rowEnd);
+  
 public:
   BilateralFilter(float sigma = 0.5);
   virtual ~BilateralFilter() {}
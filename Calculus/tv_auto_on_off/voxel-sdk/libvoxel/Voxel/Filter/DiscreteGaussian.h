@@ -37,6 +37,9 @@ public:
   inline float getStandardDeviation() const { return _sigma; }
   inline float getSquaredStandardDeviation() const { return _squaredSigma; }
   
+  // valueAt() is zero at and beyond this distance
+  inline SizeType size() const { return _values.size(); }
+  
   inline float valueAt(int x)
   {
     int y = (x < 0)?-x:x;
@@ -6,6 +6,8 @@
 
 #include "Filter.h"
 
+#include <memory.h>
+
 namespace Voxel
 {
 
@@ -42,5 +44,65 @@ bool Filter::_prepareOutput(const FramePtr &in, FramePtr &out)
   return true;
 }
 
+bool Filter::_getBandLayout(const Frame *frame, FrameSize &size, SizeType &rowBytes)
+{
+  const ToFRawFrame *tofFrame = dynamic_cast<const ToFRawFrame *>(frame);
+  const DepthFrame *depthFrame = dynamic_cast<const DepthFrame *>(frame);
+  
+  if(tofFrame)
+  {
+    size = tofFrame->size;
+    rowBytes = size.width*(tofFrame->phaseWordWidth() + tofFrame->amplitudeWordWidth() + tofFrame->ambientWordWidth() + 
+      tofFrame->flagsWordWidth());
+    return true;
+  }
+  else if(depthFrame)
+  {
+    size = depthFrame->size;
+    rowBytes = size.width*2*sizeof(float);
+    return true;
+  }
+  else
+    return false;
+}
+
+bool Filter::_copyUnfilteredRows(const Frame *in, Frame *out, int rowBegin, int rowEnd)
+{
+  const ToFRawFrame *tofFrame = dynamic_cast<const ToFRawFrame *>(in);
+  const DepthFrame *depthFrame = dynamic_cast<const DepthFrame *>(in);
+  
+  if(tofFrame)
+  {
+    ToFRawFrame *o = dynamic_cast<ToFRawFrame *>(out);
+    
+    if(!o)
+      return false;
+    
+    SizeType offset = rowBegin*tofFrame->size.width, s = (rowEnd - rowBegin)*tofFrame->size.width;
+    
+    memcpy(o->ambient() + offset*tofFrame->ambientWordWidth(), tofFrame->ambient() + offset*tofFrame->ambientWordWidth(), 
+           s*tofFrame->ambientWordWidth());
+    memcpy(o->amplitude() + offset*tofFrame->amplitudeWordWidth(), tofFrame->amplitude() + offset*tofFrame->amplitudeWordWidth(), 
+           s*tofFrame->amplitudeWordWidth());
+    memcpy(o->flags() + offset*tofFrame->flagsWordWidth(), tofFrame->flags() + offset*tofFrame->flagsWordWidth(), 
+           s*tofFrame->flagsWordWidth());
+    return true;
+  }
+  else if(depthFrame)
+  {
+    DepthFrame *o = dynamic_cast<DepthFrame *>(out);
+    
+    if(!o)
+      return false;
+    
+    SizeType offset = rowBegin*depthFrame->size.width, s = (rowEnd - rowBegin)*depthFrame->size.width;
+    
+    memcpy(o->amplitude.data() + offset, depthFrame->amplitude.data() + offset, s*sizeof(float));
+    return true;
+  }
+  else
+    return false;
+}
+
   
 }
\ No newline at end of file
@@ -58,6 +58,24 @@ protected:
   
   virtual bool _filter(const FramePtr &in, FramePtr &out) = 0;
   
+  // Optional row band interface, used by FilterSet to run consecutive filters band by band so that the rows of a band
+  // are still in cache when the next filter reads them. Output rows of a band depend only on the input rows within 
+  // _bandHalo() rows of them. _beginBands() gets 'out' ready without writing to it other than via _prepareOutput(), as 
+  // it may still hold rows of the input of a previous filter. _filterBand() computes rows [rowBegin, rowEnd) of 'out', 
+  // for bands in order covering the frame, and _endBands() follows the last band. Planes which are not filtered 
+  // need to be passed through unchanged.
+  virtual int _bandHalo() const { return -1; } // -1 => filter works only on full frames
+  virtual bool _beginBands(const FramePtr &in, FramePtr &out) { return false; }
+  virtual bool _filterBand(const FramePtr &in, FramePtr &out, int rowBegin, int rowEnd) { return false; }
+  virtual bool _endBands() { return true; }
+  
+  // Size and bytes per row of frames supported by the band interface, i.e., ToFRawFrame and DepthFrame
+  static bool _getBandLayout(const Frame *frame, FrameSize &size, SizeType &rowBytes);
+  
+  // Copies rows [rowBegin, rowEnd) of the planes passed through by filters of phase and depth, i.e., ambient, 
+  // amplitude and flags of ToFRawFrame and amplitude of DepthFrame
+  static bool _copyUnfilteredRows(const Frame *in, Frame *out, int rowBegin, int rowEnd);
+  
   template <typename T>
   bool _get(const String &name, T &value);
   
@@ -95,6 +113,9 @@ public:
   bool set(const String &name, const T &value);
   
   virtual ~Filter() {}
+  
+  template <typename FrameType>
+  friend class FilterSet;
 };
 
 inline bool Filter::filter(const FramePtr &in, FramePtr &out)
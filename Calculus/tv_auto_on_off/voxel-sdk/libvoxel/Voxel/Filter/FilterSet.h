@@ -8,6 +8,10 @@
 #define VOXEL_FRAME_FILTER_SET_H
 
 #include <Filter/Filter.h>
+#include <LatencyHistogram.h>
+#include <Timer.h>
+
+#define FILTER_SET_BAND_BYTES (256*1024) // Suggested working set of a band of fused filters, to fit in L2 cache
 
 namespace Voxel
 {
@@ -43,6 +47,12 @@ protected:
   Vector<int> _indices;
   int _filterCounter;
   Map<int, FilterPtr> _filters;
+  Map<int, LatencyHistogramPtr> _statistics; // time taken by each filter, recorded only when enabled
+  
+  Atomic<bool> _statisticsEnabled;
+  Timer _statisticsTimer;
+  
+  SizeType _bandBytes;
   
   mutable Mutex _accessMutex;
   
@@ -59,7 +69,8 @@ public:
     }
   };
   
-  FilterSet(FrameBufferManager<FrameType> &m): _frameBufferManager(m), _filterCounter(0) { _indices.reserve(10); }
+  FilterSet(FrameBufferManager<FrameType> &m): _frameBufferManager(m), _filterCounter(0), _statisticsEnabled(false), 
+  _bandBytes(0) { _indices.reserve(10); }
   
   // position = -1 => at the end, otherwise at zero-indexed 'position'
   int addFilter(FilterPtr p, int position = -1);
@@ -71,11 +82,28 @@ public:
   
   // Populate one entry in 'seq' before calling this function. That entry will be used
   // as input to the first filter and then onwards till the last filter. Each filter will
-  // append one entry which contains the filter frame
+  // append one entry which contains the filter frame.
+  //
+  // With band bytes set, consecutive filters supporting row bands are fused instead. They are run band by band, with 
+  // each band sized to have its rows for all these filters within the band bytes, and with two 
+  // frames holding their outputs in turns. They append these two entries, the latter being the 
+  // output of the last of them
   bool applyFilter(FrameSequence &seq);
   
+  // 0 (default) => no fusion of filters. Otherwise, bytes of frame rows, of the input and outputs of fused filters, in
+  // a band. FILTER_SET_BAND_BYTES is a starting point; measure before enabling, as fusion need not be faster
+  inline void setBandBytes(SizeType bytes) { Lock<Mutex> _(_accessMutex); _bandBytes = bytes; }
+  inline SizeType getBandBytes() const { Lock<Mutex> _(_accessMutex); return _bandBytes; }
+  
   void reset();
   
+  inline void enableStatistics(bool enable) { _statisticsEnabled = enable; }
+  inline bool isStatisticsEnabled() const { return _statisticsEnabled; }
+  
+  // Appends one entry per filter, in the order of application, named as "<prefix><index>:<filter name>"
+  void getStatistics(const String &prefix, Vector<LatencyStatistics> &statistics) const;
+  void resetStatistics();
+  
   FilterSetIterator<FrameType> begin() const
   {
     return FilterSetIterator<FrameType>(*this, 0); 
@@ -86,6 +114,13 @@ public:
     return FilterSetIterator<FrameType>(*this, _indices.size());
   }
   
+protected:
+  bool _applyFilter(FrameSequence &seq, int position, bool statisticsEnabled);
+  
+  // Applies the filters from 'position' onwards which support the row band interface of Filter, band by band. 'count' 
+  // is the number of filters applied, and is zero when there are less than two such filters
+  bool _applyBands(FrameSequence &seq, int position, bool statisticsEnabled, int &count);
+  
   friend class FilterSetIterator<FrameType>;
 };
 
@@ -95,6 +130,7 @@ int FilterSet<FrameType>::addFilter(FilterPtr p, int position)
   Lock<Mutex> _(_accessMutex);
   
   _filters[_filterCounter] = p;
+  _statistics[_filterCounter] = LatencyHistogramPtr(new LatencyHistogram());
   
   if(position == -1 || position >= _indices.size())
     _indices.push_back(_filterCounter);
@@ -142,6 +178,7 @@ bool FilterSet<FrameType>::removeFilter(int index)
       }
     }
     _filters.erase(x);
+    _statistics.erase(index);
     _frameBufferManager.setMinimumBufferCount(_frameBufferManager.getMinimumBufferCount() - 1);
     
     return true;
@@ -157,6 +194,7 @@ bool FilterSet<FrameType>::removeAllFilters()
   
   _frameBufferManager.setMinimumBufferCount(_frameBufferManager.getMinimumBufferCount() - _filters.size());
   _filters.clear();
+  _statistics.clear();
   _indices.clear();
   
   return true;
@@ -173,28 +211,173 @@ bool FilterSet<FrameType>::applyFilter(FrameSequence &seq)
     return false;
   }
   
-  for(auto f: *this)
+  bool statisticsEnabled = _statisticsEnabled.load(std::memory_order_relaxed);
+  
+  for(auto i = 0; i < _indices.size();)
   {
-    auto g = _frameBufferManager.get();
+    int count;
+    
+    if(!_applyBands(seq, i, statisticsEnabled, count))
+      return false;
+    
+    if(count)
+      i += count;
+    else if(!_applyFilter(seq, i++, statisticsEnabled))
+      return false;
+  }
+  return true;
+}
+
+template <typename FrameType>
+bool FilterSet<FrameType>::_applyFilter(FrameSequence &seq, int position, bool statisticsEnabled)
+{
+  FilterPtr f = _filters.at(_indices[position]);
+  
+  auto g = _frameBufferManager.get();
+  
+  FramePtr p = std::dynamic_pointer_cast<Frame>(*g);
+  
+  TimeStampType startTime = statisticsEnabled?_statisticsTimer.getCurentRealTime():0;
+  
+  if(!f->filter(std::dynamic_pointer_cast<Frame>(**seq.begin()), p))
+  {
+    logger(LOG_ERROR) << "FilterSet: Could not apply filter '" << f->name() << "'" << std::endl;
+    return false;
+  }
+  
+  if(statisticsEnabled)
+    _statistics.at(_indices[position])->record(_statisticsTimer.getCurentRealTime() - startTime);
+  
+  *g = std::dynamic_pointer_cast<FrameType>(p);
+  
+  if(!*g)
+  {
+    logger(LOG_ERROR) << "FilterSet: Got an invalid frame from filter '" << f->name() << "'" << std::endl;
+    return false;
+  }
+  
+  seq.push_front(g);
+  return true;
+}
+
+template <typename FrameType>
+bool FilterSet<FrameType>::_applyBands(FrameSequence &seq, int position, bool statisticsEnabled, int &count)
+{
+  count = 0;
+  
+  FramePtr in = std::dynamic_pointer_cast<Frame>(**seq.begin());
+  FrameSize size;
+  SizeType rowBytes;
+  
+  if(!_bandBytes || position + 1 >= _indices.size() || !Filter::_getBandLayout(in.get(), size, rowBytes) || 
+    !size.height || !rowBytes)
+    return true;
+  
+  Vector<Filter *> filters;
+  Vector<Lock<Mutex>> locks; // Parameters and hence halos stay the same till all bands are done
+  Vector<int> halos;
+  
+  for(auto i = position; i < _indices.size(); i++)
+  {
+    Filter *f = _filters.at(_indices[i]).get();
+    
+    Lock<Mutex> l(f->_accessMutex);
     
-    FramePtr p = std::dynamic_pointer_cast<Frame>(*g);
+    int halo = f->_bandHalo();
     
-    if(!f->filter(std::dynamic_pointer_cast<Frame>(**seq.begin()), p))
+    if(halo < 0)
+      break;
+    
+    filters.push_back(f);
+    locks.push_back(std::move(l));
+    halos.push_back(halo);
+  }
+  
+  int n = filters.size(), height = size.height;
+  
+  if(n < 2)
+    return true;
+  
+  // Outputs of filters are in out[0] and out[1] in turns, so output of a filter overwrites that of the filter before 
+  // the previous one
+  FrameBuffer<FrameType> buffers[2] = { _frameBufferManager.get(), _frameBufferManager.get() };
+  FramePtr out[2] = { std::dynamic_pointer_cast<Frame>(*buffers[0]), std::dynamic_pointer_cast<Frame>(*buffers[1]) };
+  
+  Vector<TimeStampType> elapsed(n, 0);
+  
+  for(auto f = 0; f < n; f++)
+  {
+    if(!filters[f]->_beginBands(f?out[(f + 1) % 2]:in, out[f % 2]))
     {
-      logger(LOG_ERROR) << "FilterSet: Could not apply filter '" << f->name() << "'" << std::endl;
+      logger(LOG_ERROR) << "FilterSet: Could not apply filter '" << filters[f]->name() << "'" << std::endl;
       return false;
     }
+  }
+  
+  // done[0] is the rows of input made available so far and done[f + 1], the rows of output of filter 'f'. A filter 
+  // trails the previous one by its halo, for rows to read, and by the halo of the previous one, for the rows that 
+  // one still reads from the frame being overwritten
+  Vector<int> done(n + 1, 0);
+  
+  int rows = std::max<SizeType>(1, _bandBytes/(rowBytes*(n + 1)));
+  
+  for(auto end = rows; done[n] < height; end += rows)
+  {
+    done[0] = std::min(end, height);
     
-    *g = std::dynamic_pointer_cast<FrameType>(p);
-    
-    if(!*g)
+    for(auto f = 0; f < n; f++)
+    {
+      int lag = std::max(halos[f], (f >= 2)?halos[f - 1]:0);
+      int rowEnd = (done[f] == height)?height:(done[f] - lag);
+      
+      if(rowEnd <= done[f + 1])
+        continue;
+      
+      TimeStampType startTime = statisticsEnabled?_statisticsTimer.getCurentRealTime():0;
+      
+      if(!filters[f]->_filterBand(f?out[(f + 1) % 2]:in, out[f % 2], done[f + 1], rowEnd))
+      {
+        logger(LOG_ERROR) << "FilterSet: Could not apply filter '" << filters[f]->name() << "' on rows " << done[f + 1] 
+          << " to " << rowEnd << std::endl;
+        return false;
+      }
+      
+      if(statisticsEnabled)
+        elapsed[f] += _statisticsTimer.getCurentRealTime() - startTime;
+      
+      done[f + 1] = rowEnd;
+    }
+  }
+  
+  for(auto f = 0; f < n; f++)
+  {
+    if(!filters[f]->_endBands())
     {
-      logger(LOG_ERROR) << "FilterSet: Got an invalid frame from filter '" << f->name() << "'" << std::endl;
+      logger(LOG_ERROR) << "FilterSet: Could not apply filter '" << filters[f]->name() << "'" << std::endl;
       return false;
     }
     
-    seq.push_front(g);
+    if(statisticsEnabled)
+      _statistics.at(_indices[position + f])->record(elapsed[f]);
   }
+  
+  for(auto i = 0; i < 2; i++)
+  {
+    *buffers[i] = std::dynamic_pointer_cast<FrameType>(out[i]);
+    
+    if(!*buffers[i])
+    {
+      logger(LOG_ERROR) << "FilterSet: Got an invalid frame from filter '" << filters[i]->name() << "'" << std::endl;
+      return false;
+    }
+  }
+  
+  int last = (n - 1) % 2;
+  
+  seq.push_front(buffers[1 - last]);
+  seq.push_front(buffers[last]);
+  
+  count = n;
   return true;
 }
 
@@ -205,6 +388,30 @@ void FilterSet<FrameType>::reset()
     f->reset();
 }
 
+template <typename FrameType>
+void FilterSet<FrameType>::getStatistics(const String &prefix, Vector<LatencyStatistics> &statistics) const
+{
+  Lock<Mutex> _(_accessMutex);
+  
+  for(auto i = begin(); i != end(); ++i)
+  {
+    LatencyStatistics s;
+    
+    _statistics.at(i.index)->snapshot(s);
+    s.name = prefix + std::to_string(i.index) + ":" + (*i)->name();
+    statistics.push_back(s);
+  }
+}
+
+template <typename FrameType>
+void FilterSet<FrameType>::resetStatistics()
+{
+  Lock<Mutex> _(_accessMutex);
+  
+  for(auto &s: _statistics)
+    s.second->reset();
+}
+
 template <typename FrameType>
 FilterSetIterator<FrameType>::FilterSetIterator(const FilterSet<FrameType> &s, int i): s(s), i(i) 
 {
@@ -28,10 +28,14 @@ protected:
   FrameSize _size;
   
   template <typename T>
-  bool _filter(const T *in, T *out);
+  bool _filter(const T *in, T *out, int rowBegin, int rowEnd);
   
   virtual bool _filter(const FramePtr &in, FramePtr &out);
   
+  virtual int _bandHalo() const { return 0; }
+  virtual bool _beginBands(const FramePtr &in, FramePtr &out);
+  virtual bool _filterBand(const FramePtr &in, FramePtr &out, int rowBegin, int rowEnd);
+  
   virtual void _onSet(const FilterParameterPtr &f);
   
 public:
@@ -7,18 +7,30 @@
 #include "MedianFilter.h"
 
 #include <float.h>
+#include <algorithm>
+#include <limits>
+
+#define MEDIAN_HISTOGRAM_BINS 4096 // Covers 12-bit phase
+#define MEDIAN_HISTOGRAM_FINE_BINS 64 // Fine bins per coarse bin
+#define MEDIAN_HISTOGRAM_COARSE_BINS (MEDIAN_HISTOGRAM_BINS/MEDIAN_HISTOGRAM_FINE_BINS)
 
 namespace Voxel
 {
 
-MedianFilter::MedianFilter(float stability, float deadband, float deadbandStep, uint halfKernelSize): Filter("MedianFilter"), 
-  _stability(stability), _deadband(deadband), _deadbandStep(deadbandStep), _halfKernelSize(halfKernelSize)
+MedianFilter::MedianFilter(float stability, float deadband, float deadbandStep, uint halfKernelSize, int mode): Filter("MedianFilter"), 
+  _stability(stability), _deadband(deadband), _deadbandStep(deadbandStep), _halfKernelSize(halfKernelSize), _mode(mode), 
+  _histogramRow(-1), _stablePixels(0)
 {
   _addParameters({
     FilterParameterPtr(new FloatFilterParameter("stability", "Stability", "Stability factor", stability, "", 0, 1)),
     FilterParameterPtr(new FloatFilterParameter("deadband", "Dead band", "Dead band", deadband, "", 0, 1)),
     FilterParameterPtr(new FloatFilterParameter("deadbandStep", "Dead band step", "Dead band step", deadbandStep, "", 0, 1)),
-    FilterParameterPtr(new UnsignedFilterParameter("halfKernelSize", "Half kernel size", "Half kernel size", halfKernelSize, "", 1, 100))
+    FilterParameterPtr(new UnsignedFilterParameter("halfKernelSize", "Half kernel size", "Half kernel size", halfKernelSize, "", 1, 100)),
+    FilterParameterPtr(new EnumFilterParameter("mode", "Mode", "Method to compute median", mode, 
+                                               {MEDIAN_SELECT, MEDIAN_SORTING_NETWORK, MEDIAN_HISTOGRAM, MEDIAN_AUTO},
+                                               {"Select", "Sorting network", "Histogram", "Auto"},
+                                               {"Partial sort of each neighbourhood", "Sorting networks for 3x3 and 5x5 kernels",
+                                                "Sliding histogram for 12-bit integer data", "Histogram or sorting network as per kernel size and data"}))
   });
 }
 
@@ -54,139 +66,407 @@ void MedianFilter::_onSet(const FilterParameterPtr &f)
       logger(LOG_WARNING) << "MedianFilter: Could not get the recently updated 'halfKernelSize' parameter" << std::endl;
     }
   }
+  else if(f->name() == "mode")
+  {
+    if(!_get(f->name(), _mode))
+    {
+      logger(LOG_WARNING) << "MedianFilter: Could not get the recently updated 'mode' parameter" << std::endl;
+    }
+  }
 }
  
+// Median of in-frame pixels of the neighbourhood of (i, j). 'hist' needs to have space for full neighbourhood
 template <typename T>
-bool MedianFilter::_filter(const T *in, T *out)
+inline T MedianFilter::_selectMedian(const T *in, int i, int j, T *hist)
 {
-  uint s = _size.width*_size.height;
+  int index = 0;
   
-  T *cur, *hist;
+  for (int k = -(int)_halfKernelSize; k <= (int)_halfKernelSize; k++) 
+  {
+    for (int m = -(int)_halfKernelSize; m <= (int)_halfKernelSize; m++) 
+    {
+      int i2 = i+m; int j2 = j+k;
+      if ((j2 >= 0 && j2 < _size.height) && (i2 >= 0 && i2 < _size.width)) 
+      {
+        int q = j2*_size.width+i2;
+        hist[index++] = in[q];
+      }
+    }
+  }
+  std::nth_element(hist, hist + index/2, hist + index);
+  return hist[index/2];
+}
+
+template <typename T>
+void MedianFilter::_selectMedian(const T *in, T *median, int rowBegin, int rowEnd)
+{
+  T *hist = (T *)_hist.data();
   
-  if(_current.size() != s*sizeof(T))
+  for (int j = rowBegin; j < rowEnd; j++) 
+    for (int i = 0; i < _size.width; i++) 
+      median[j*_size.width + i] = _selectMedian(in, i, j, hist);
+}
+
+template <typename T>
+static inline void sortPair(T &a, T &b)
+{
+  T t = std::min(a, b);
+  b = std::max(a, b);
+  a = t;
+}
+
+// Median of 9 values with 19 compare-exchanges. 'p' is modified
+template <typename T>
+static inline T median9(T *p)
+{
+  sortPair(p[1], p[2]); sortPair(p[4], p[5]); sortPair(p[7], p[8]);
+  sortPair(p[0], p[1]); sortPair(p[3], p[4]); sortPair(p[6], p[7]);
+  sortPair(p[1], p[2]); sortPair(p[4], p[5]); sortPair(p[7], p[8]);
+  sortPair(p[0], p[3]); sortPair(p[5], p[8]); sortPair(p[4], p[7]);
+  sortPair(p[3], p[6]); sortPair(p[1], p[4]); sortPair(p[2], p[5]);
+  sortPair(p[4], p[7]); sortPair(p[4], p[2]); sortPair(p[6], p[4]);
+  sortPair(p[4], p[2]);
+  return p[4];
+}
+
+// Median of 25 values with 99 compare-exchanges. 'p' is modified
+template <typename T>
+static inline T median25(T *p)
+{
+  sortPair(p[0], p[1]);   sortPair(p[3], p[4]);   sortPair(p[2], p[4]);
+  sortPair(p[2], p[3]);   sortPair(p[6], p[7]);   sortPair(p[5], p[7]);
+  sortPair(p[5], p[6]);   sortPair(p[9], p[10]);  sortPair(p[8], p[10]);
+  sortPair(p[8], p[9]);   sortPair(p[12], p[13]); sortPair(p[11], p[13]);
+  sortPair(p[11], p[12]); sortPair(p[15], p[16]); sortPair(p[14], p[16]);
+  sortPair(p[14], p[15]); sortPair(p[18], p[19]); sortPair(p[17], p[19]);
+  sortPair(p[17], p[18]); sortPair(p[21], p[22]); sortPair(p[20], p[22]);
+  sortPair(p[20], p[21]); sortPair(p[23], p[24]); sortPair(p[2], p[5]);
+  sortPair(p[3], p[6]);   sortPair(p[0], p[6]);   sortPair(p[0], p[3]);
+  sortPair(p[4], p[7]);   sortPair(p[1], p[7]);   sortPair(p[1], p[4]);
+  sortPair(p[11], p[14]); sortPair(p[8], p[14]);  sortPair(p[8], p[11]);
+  sortPair(p[12], p[15]); sortPair(p[9], p[15]);  sortPair(p[9], p[12]);
+  sortPair(p[13], p[16]); sortPair(p[10], p[16]); sortPair(p[10], p[13]);
+  sortPair(p[20], p[23]); sortPair(p[17], p[23]); sortPair(p[17], p[20]);
+  sortPair(p[21], p[24]); sortPair(p[18], p[24]); sortPair(p[18], p[21]);
+  sortPair(p[19], p[22]); sortPair(p[8], p[17]);  sortPair(p[9], p[18]);
+  sortPair(p[0], p[18]);  sortPair(p[0], p[9]);   sortPair(p[10], p[19]);
+  sortPair(p[1], p[19]);  sortPair(p[1], p[10]);  sortPair(p[11], p[20]);
+  sortPair(p[2], p[20]);  sortPair(p[2], p[11]);  sortPair(p[12], p[21]);
+  sortPair(p[3], p[21]);  sortPair(p[3], p[12]);  sortPair(p[13], p[22]);
+  sortPair(p[4], p[22]);  sortPair(p[4], p[13]);  sortPair(p[14], p[23]);
+  sortPair(p[5], p[23]);  sortPair(p[5], p[14]);  sortPair(p[15], p[24]);
+  sortPair(p[6], p[24]);  sortPair(p[6], p[15]);  sortPair(p[7], p[16]);
+  sortPair(p[7], p[19]);  sortPair(p[13], p[21]); sortPair(p[15], p[23]);
+  sortPair(p[7], p[13]);  sortPair(p[7], p[15]);  sortPair(p[1], p[9]);
+  sortPair(p[3], p[11]);  sortPair(p[5], p[17]);  sortPair(p[11], p[17]);
+  sortPair(p[9], p[17]);  sortPair(p[4], p[10]);  sortPair(p[6], p[12]);
+  sortPair(p[7], p[14]);  sortPair(p[4], p[6]);   sortPair(p[4], p[7]);
+  sortPair(p[12], p[14]); sortPair(p[10], p[14]); sortPair(p[6], p[7]);
+  sortPair(p[10], p[12]); sortPair(p[6], p[10]);  sortPair(p[6], p[17]);
+  sortPair(p[12], p[17]); sortPair(p[7], p[17]);  sortPair(p[7], p[10]);
+  sortPair(p[12], p[18]); sortPair(p[7], p[12]);  sortPair(p[10], p[18]);
+  sortPair(p[12], p[20]); sortPair(p[10], p[20]); sortPair(p[10], p[12]);
+  return p[12];
+}
+
+template <typename T>
+void MedianFilter::_sortingNetworkMedian(const T *in, T *median, int rowBegin, int rowEnd)
+{
+  int k = _halfKernelSize, w = _size.width, h = _size.height;
+  
+  T *hist = (T *)_hist.data(), p[25];
+  
+  for (int j = rowBegin; j < rowEnd; j++) 
   {
-    _current.resize(s*sizeof(T));
-    memset(_current.data(), 0, s*sizeof(T));
+    bool interiorRow = (j >= k && j < h - k);
+    
+    for (int i = 0; i < w; i++) 
+    {
+      if(!interiorRow || i < k || i >= w - k) // Border pixels have partial neighbourhoods
+      {
+        median[j*w + i] = _selectMedian(in, i, j, hist);
+        continue;
+      }
+      
+      int index = 0;
+      
+      for (int y = j - k; y <= j + k; y++)
+        for (int x = i - k; x <= i + k; x++)
+          p[index++] = in[y*w + x];
+      
+      median[j*w + i] = (k == 1)?median9(p):median25(p);
+    }
+  }
+}
+
+// Perreault and Hebert's constant time median. Each column keeps a histogram of the pixels of the kernel rows in it.
+// Kernel histogram is updated by adding and removing column histograms as the kernel moves along a row. Histograms 
+// are two level so that only the coarse level needs to be updated for every pixel. The fine level of a coarse bin
+// is brought up to date only when the median falls in that bin.
+//
+// Row leaving the kernel is removed from column histograms right after the last row needing it, so that rows 
+// read for a band are within the half kernel size of it.
+template <typename T>
+bool MedianFilter::_histogramMedian(const T *in, T *median, int rowBegin, int rowEnd)
+{
+  int k = _halfKernelSize, w = _size.width, h = _size.height;
+  
+  _histogramRow = (_histogramRow == rowBegin)?rowBegin:-1;
+  
+  if(!std::numeric_limits<T>::is_integer)
+    return false;
+  
+  for (int p = std::max(0, rowBegin - k)*w; p < std::min(h, rowEnd + k)*w; p++)
+  {
+    if(in[p] < 0 || in[p] >= MEDIAN_HISTOGRAM_BINS)
+    {
+      _histogramRow = -1;
+      return false;
+    }
   }
   
-  uint histSize = (2*_halfKernelSize + 1)*(2*_halfKernelSize + 1);
+  bool rebuild = (_histogramRow < 0);
   
-  if(_hist.size() != histSize*sizeof(T))
+  if(rebuild)
   {
-    _hist.resize(histSize*sizeof(T));
-    memset(_hist.data(), 0, histSize*sizeof(T));
+    _columnCoarse.assign(w*MEDIAN_HISTOGRAM_COARSE_BINS, 0);
+    _columnFine.assign(w*MEDIAN_HISTOGRAM_BINS, 0);
   }
   
-  cur = (T *)_current.data();
-  hist = (T *)_hist.data();
+  _kernelFine.resize(MEDIAN_HISTOGRAM_BINS);
   
-  int stablePixel = _size.width*_size.height;
+  uint16_t coarse[MEDIAN_HISTOGRAM_COARSE_BINS];
+  int lastUpdated[MEDIAN_HISTOGRAM_COARSE_BINS]; // Column of the kernel for which fine level of a coarse bin was last updated
   
-  int index;
+  uint16_t *columnCoarse = _columnCoarse.data(), *columnFine = _columnFine.data(), *fine = _kernelFine.data();
   
-  for (int j = 0; j < _size.height; j++) 
+  auto updateColumns = [&](int row, int delta)
   {
-    for (int i = 0; i < _size.width; i++) 
+    const T *r = in + row*w;
+    
+    for (int c = 0; c < w; c++)
+    {
+      int v = (int)r[c];
+      columnCoarse[c*MEDIAN_HISTOGRAM_COARSE_BINS + v/MEDIAN_HISTOGRAM_FINE_BINS] += delta;
+      columnFine[c*MEDIAN_HISTOGRAM_BINS + v] += delta;
+    }
+  };
+  
+  auto addCoarse = [&](int column, int delta)
+  {
+    const uint16_t *c = columnCoarse + column*MEDIAN_HISTOGRAM_COARSE_BINS;
+    
+    for (int b = 0; b < MEDIAN_HISTOGRAM_COARSE_BINS; b++)
+      coarse[b] += delta*c[b];
+  };
+  
+  auto addFine = [&](int column, int bin, int delta)
+  {
+    const uint16_t *c = columnFine + column*MEDIAN_HISTOGRAM_BINS + bin*MEDIAN_HISTOGRAM_FINE_BINS;
+    uint16_t *f = fine + bin*MEDIAN_HISTOGRAM_FINE_BINS;
+    
+    for (int b = 0; b < MEDIAN_HISTOGRAM_FINE_BINS; b++)
+      f[b] += delta*c[b];
+  };
+  
+  if(rebuild)
+  {
+    for (int j = std::max(0, rowBegin - k); j <= rowBegin + k && j < h; j++)
+      updateColumns(j, 1);
+  }
+  
+  for (int j = rowBegin; j < rowEnd; j++)
+  {
+    if((j > rowBegin || !rebuild) && j + k < h)
+      updateColumns(j + k, 1);
+    
+    int rows = std::min(h - 1, j + k) - std::max(0, j - k) + 1;
+    
+    memset(coarse, 0, sizeof(coarse));
+    
+    for (int b = 0; b < MEDIAN_HISTOGRAM_COARSE_BINS; b++)
+      lastUpdated[b] = -1;
+    
+    for (int c = 0; c <= k && c < w; c++)
+      addCoarse(c, 1);
+    
+    for (int i = 0; i < w; i++)
     {
-      int p = j*_size.width + i;
-      index = 0;
+      int left = std::max(0, i - k), right = std::min(w - 1, i + k);
+      
+      int rank = rows*(right - left + 1)/2; // Same as index/2 in _selectMedian()
       
-      for (int k = -(int)_halfKernelSize; k <= (int)_halfKernelSize; k++) 
+      int bin = 0;
+      
+      while(rank >= coarse[bin])
+        rank -= coarse[bin++];
+      
+      if(lastUpdated[bin] < 0 || i - lastUpdated[bin] > k) // Cheaper to rebuild than to update
+      {
+        memset(fine + bin*MEDIAN_HISTOGRAM_FINE_BINS, 0, MEDIAN_HISTOGRAM_FINE_BINS*sizeof(uint16_t));
+        
+        for (int c = left; c <= right; c++)
+          addFine(c, bin, 1);
+      }
+      else
       {
-        for (int m = -(int)_halfKernelSize; m <= (int)_halfKernelSize; m++) 
+        for (int t = lastUpdated[bin] + 1; t <= i; t++)
         {
-          int i2 = i+m; int j2 = j+k;
-          if ((j2 >= 0 && j2 < _size.height) && (i2 >= 0 && i2 < _size.width)) 
-          {
-            int q = j2*_size.width+i2;
-            hist[index++] = in[q];
-          }
+          if(t + k < w)
+            addFine(t + k, bin, 1);
+          if(t - k - 1 >= 0)
+            addFine(t - k - 1, bin, -1);
         }
       }
-      std::nth_element(hist, hist + index/2, hist + index);
-      T val = hist[index/2];
       
-      // Output w/ deadband
-      float ferr = cur[p]?fabs((float)(val- cur[p])/cur[p]):FLT_MAX;
+      lastUpdated[bin] = i;
       
-      if (ferr > _deadband) 
-      {
-        out[p] = cur[p] = val;
-        stablePixel--;
-      }
-      else
-        out[p] = cur[p];
-    }  // for (i)
-  } // for (j)
+      const uint16_t *f = fine + bin*MEDIAN_HISTOGRAM_FINE_BINS;
+      int value = 0;
+      
+      while(rank >= f[value])
+        rank -= f[value++];
+      
+      median[j*w + i] = bin*MEDIAN_HISTOGRAM_FINE_BINS + value;
+      
+      if(i + k + 1 < w)
+        addCoarse(i + k + 1, 1);
+      if(i - k >= 0)
+        addCoarse(i - k, -1);
+    }
+    
+    if(j - k >= 0)
+      updateColumns(j - k, -1);
+  }
   
-  // Adjust deadband until ratio is achieved
-  float diff = (float)stablePixel - _stability*_size.width*_size.height;
-  if (diff < 0)
-    _deadband += _deadbandStep;
-  else
-    _deadband -= _deadbandStep;
+  _histogramRow = rowEnd;
+  return true;
+}
+
+template <typename T>
+bool MedianFilter::_filter(const T *in, T *out, int rowBegin, int rowEnd)
+{
+  T *cur = (T *)_current.data(), *median = (T *)_median.data();
   
-  _set("deadband", _deadband);
+  // Histogram wins over the 5x5 sorting network on 12-bit data. It falls back when data is out of its range
+  bool histogram = (_mode == MEDIAN_HISTOGRAM || (_mode == MEDIAN_AUTO && _halfKernelSize >= 2));
+  bool sortingNetwork = (_mode == MEDIAN_SORTING_NETWORK || _mode == MEDIAN_AUTO) && _halfKernelSize <= 2;
+  
+  if(!histogram || !_histogramMedian(in, median, rowBegin, rowEnd))
+  {
+    if(sortingNetwork)
+      _sortingNetworkMedian(in, median, rowBegin, rowEnd);
+    else
+      _selectMedian(in, median, rowBegin, rowEnd);
+  }
+  
+  for (int p = rowBegin*_size.width; p < rowEnd*_size.width; p++) 
+  {
+    T val = median[p];
+    
+    // Output w/ deadband
+    float ferr = cur[p]?fabs((float)(val- cur[p])/cur[p]):FLT_MAX;
+    
+    if (ferr > _deadband) 
+    {
+      out[p] = cur[p] = val;
+      _stablePixels--;
+    }
+    else
+      out[p] = cur[p];
+  }
   
   return true;
 }
 
-
 bool MedianFilter::_filter(const FramePtr &in, FramePtr &out)
+{
+  return _beginBands(in, out) && _filterBand(in, out, 0, _size.height) && _endBands();
+}
+
+bool MedianFilter::_beginBands(const FramePtr &in, FramePtr &out)
 {
   ToFRawFrame *tofFrame = dynamic_cast<ToFRawFrame *>(in.get());
   DepthFrame *depthFrame = dynamic_cast<DepthFrame *>(in.get());
   
   if((!tofFrame && !depthFrame) || !_prepareOutput(in, out))
   {
-    logger(LOG_ERROR) << "IIRFilter: Input frame type is not ToFRawFrame or DepthFrame or failed get the output ready" << std::endl;
+    logger(LOG_ERROR) << "MedianFilter: Input frame type is not ToFRawFrame or DepthFrame or failed get the output ready" << std::endl;
+    return false;
+  }
+  
+  _size = tofFrame?tofFrame->size:depthFrame->size;
+  
+  SizeType wordWidth = tofFrame?tofFrame->phaseWordWidth():sizeof(float);
+  uint s = _size.width*_size.height*wordWidth;
+  
+  if(_current.size() != s)
+  {
+    _current.resize(s);
+    memset(_current.data(), 0, s);
+  }
+  
+  uint histSize = (2*_halfKernelSize + 1)*(2*_halfKernelSize + 1)*wordWidth;
+  
+  if(_hist.size() != histSize)
+  {
+    _hist.resize(histSize);
+    memset(_hist.data(), 0, histSize);
+  }
+  
+  _median.resize(s);
+  
+  _histogramRow = -1;
+  _stablePixels = _size.width*_size.height;
+  return true;
+}
+
+bool MedianFilter::_filterBand(const FramePtr &in, FramePtr &out, int rowBegin, int rowEnd)
+{
+  ToFRawFrame *tofFrame = dynamic_cast<ToFRawFrame *>(in.get());
+  DepthFrame *depthFrame = dynamic_cast<DepthFrame *>(in.get());
+  
+  if(!_copyUnfilteredRows(in.get(), out.get(), rowBegin, rowEnd))
+  {
+    logger(LOG_ERROR) << "MedianFilter: Invalid frame type. Expecting output of same type as input." << std::endl;
     return false;
   }
   
   if(tofFrame)
   {
-    _size = tofFrame->size;
     ToFRawFrame *o = dynamic_cast<ToFRawFrame *>(out.get());
     
-    if(!o)
-    {
-      logger(LOG_ERROR) << "IIRFilter: Invalid frame type. Expecting ToFRawFrame." << std::endl;
-      return false;
-    }
-    
-    //logger(LOG_INFO) << "IIRFilter: Applying filter with gain = " << _gain << " to ToFRawFrame id = " << tofFrame->id << std::endl;
-    
-    uint s = _size.width*_size.height;
-    memcpy(o->ambient(), tofFrame->ambient(), s*tofFrame->ambientWordWidth());
-    memcpy(o->amplitude(), tofFrame->amplitude(), s*tofFrame->amplitudeWordWidth());
-    memcpy(o->flags(), tofFrame->flags(), s*tofFrame->flagsWordWidth());
-    
     if(tofFrame->phaseWordWidth() == 2)
-      return _filter<uint16_t>((uint16_t *)tofFrame->phase(), (uint16_t *)o->phase());
+      return _filter<uint16_t>((uint16_t *)tofFrame->phase(), (uint16_t *)o->phase(), rowBegin, rowEnd);
     else if(tofFrame->phaseWordWidth() == 1)
-      return _filter<uint8_t>((uint8_t *)tofFrame->phase(), (uint8_t *)o->phase());
+      return _filter<uint8_t>((uint8_t *)tofFrame->phase(), (uint8_t *)o->phase(), rowBegin, rowEnd);
     else if(tofFrame->phaseWordWidth() == 4)
-      return _filter<uint32_t>((uint32_t *)tofFrame->phase(), (uint32_t *)o->phase());
+      return _filter<uint32_t>((uint32_t *)tofFrame->phase(), (uint32_t *)o->phase(), rowBegin, rowEnd);
     else
       return false;
   }
   else if(depthFrame)
   {
-    _size = depthFrame->size;
     DepthFrame *o = dynamic_cast<DepthFrame *>(out.get());
     
-    if(!o)
-    {
-      logger(LOG_ERROR) << "IIRFilter: Invalid frame type. Expecting DepthFrame." << std::endl;
-      return false;
-    }
-    
-    o->amplitude = depthFrame->amplitude;
-    
-    return _filter<float>(depthFrame->depth.data(), o->depth.data());
+    return _filter<float>(depthFrame->depth.data(), o->depth.data(), rowBegin, rowEnd);
   }
   else
     return false;
 }
+
+bool MedianFilter::_endBands()
+{
+  // Adjust deadband until ratio is achieved
+  float diff = (float)_stablePixels - _stability*_size.width*_size.height;
+  if (diff < 0)
+    _deadband += _deadbandStep;
+  else
+    _deadband -= _deadbandStep;
+  
+  _set("deadband", _deadband);
+  
+  return true;
+}
   
 }
\ No newline at end of file
@@ -20,23 +20,58 @@ namespace Voxel
 
 class MedianFilter: public Filter
 {
+public:
+  // Values of 'mode' parameter. All modes give the same output
+  enum Mode
+  {
+    MEDIAN_SELECT = 0, // partial sort of each neighbourhood
+    MEDIAN_SORTING_NETWORK = 1, // sorting networks for 3x3 and 5x5 kernels. Same as MEDIAN_SELECT for other kernel sizes
+    MEDIAN_HISTOGRAM = 2, // constant time per pixel sliding histogram, for integer data below 4096 (12-bit phase). Same as MEDIAN_SELECT for other data
+    MEDIAN_AUTO = 3 // histogram for 5x5 and larger kernels where possible, else sorting network for 3x3 and 5x5 kernels
+  };
+  
 protected:
   float _stability, _deadband, _deadbandStep; 
   uint _halfKernelSize;
+  int _mode;
   
-  Vector<ByteType> _current, _hist;
+  Vector<ByteType> _current, _hist, _median;
+  
+  // Column and kernel histograms for MEDIAN_HISTOGRAM. Column histograms are carried over to the next band 
+  // of rows, starting at '_histogramRow'. -1 => they need to be rebuilt
+  Vector<uint16_t> _columnCoarse, _columnFine, _kernelFine;
+  int _histogramRow;
   
   FrameSize _size;
   
+  int _stablePixels; // In the frame being filtered
+  
   template <typename T>
-  bool _filter(const T *in, T *out);
+  bool _filter(const T *in, T *out, int rowBegin, int rowEnd);
+  
+  template <typename T>
+  inline T _selectMedian(const T *in, int i, int j, T *hist);
+  
+  template <typename T>
+  void _selectMedian(const T *in, T *median, int rowBegin, int rowEnd);
+  
+  template <typename T>
+  void _sortingNetworkMedian(const T *in, T *median, int rowBegin, int rowEnd);
+  
+  template <typename T>
+  bool _histogramMedian(const T *in, T *median, int rowBegin, int rowEnd);
   
   virtual void _onSet(const FilterParameterPtr &f);
   
   virtual bool _filter(const FramePtr &in, FramePtr &out);
   
+  virtual int _bandHalo() const { return _halfKernelSize; }
+  virtual bool _beginBands(const FramePtr &in, FramePtr &out);
+  virtual bool _filterBand(const FramePtr &in, FramePtr &out, int rowBegin, int rowEnd);
+  virtual bool _endBands();
+  
 public:
-  MedianFilter(float stability = 0.1, float deadband = 0.05, float deadbandStep = 0.01, uint halfKernelSize = 1);
+  MedianFilter(float stability = 0.1, float deadband = 0.05, float deadbandStep = 0.01, uint halfKernelSize = 1, int mode = MEDIAN_AUTO);
   virtual ~MedianFilter() {}
   
   virtual void reset();
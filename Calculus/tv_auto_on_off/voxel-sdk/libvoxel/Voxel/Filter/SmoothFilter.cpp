@@ -29,11 +29,9 @@ void SmoothFilter::_onSet(const FilterParameterPtr &f)
 void SmoothFilter::reset() {}
 
 template <typename T>
-bool SmoothFilter::_filter(const T *in, T *out)
+bool SmoothFilter::_filter(const T *in, T *out, int rowBegin, int rowEnd)
 {
-  uint s = _size.width*_size.height;
-  
-  for (int j = 0; j < _size.height; j++) {
+  for (int j = rowBegin; j < rowEnd; j++) {
     for (int i = 0; i < _size.width; i++) {
       int p = j*_size.width + i;
       float weight_sum = 0;
@@ -58,57 +56,54 @@ bool SmoothFilter::_filter(const T *in, T *out)
 }
 
 bool SmoothFilter::_filter(const FramePtr &in, FramePtr &out)
+{
+  return _beginBands(in, out) && _filterBand(in, out, 0, _size.height);
+}
+
+bool SmoothFilter::_beginBands(const FramePtr &in, FramePtr &out)
 {
   ToFRawFrame *tofFrame = dynamic_cast<ToFRawFrame *>(in.get());
   DepthFrame *depthFrame = dynamic_cast<DepthFrame *>(in.get());
   
   if((!tofFrame && !depthFrame) || !_prepareOutput(in, out))
   {
-    logger(LOG_ERROR) << "IIRFilter: Input frame type is not ToFRawFrame or DepthFrame or failed get the output ready" << std::endl;
+    logger(LOG_ERROR) << "SmoothFilter: Input frame type is not ToFRawFrame or DepthFrame or failed get the output ready" << std::endl;
+    return false;
+  }
+  
+  _size = tofFrame?tofFrame->size:depthFrame->size;
+  return true;
+}
+
+bool SmoothFilter::_filterBand(const FramePtr &in, FramePtr &out, int rowBegin, int rowEnd)
+{
+  ToFRawFrame *tofFrame = dynamic_cast<ToFRawFrame *>(in.get());
+  DepthFrame *depthFrame = dynamic_cast<DepthFrame *>(in.get());
+  
+  if(!_copyUnfilteredRows(in.get(), out.get(), rowBegin, rowEnd))
+  {
+    logger(LOG_ERROR) << "SmoothFilter: Invalid frame type. Expecting output of same type as input." << std::endl;
     return false;
   }
   
   if(tofFrame)
   {
-    _size = tofFrame->size;
     ToFRawFrame *o = dynamic_cast<ToFRawFrame *>(out.get());
     
-    if(!o)
-    {
-      logger(LOG_ERROR) << "IIRFilter: Invalid frame type. Expecting ToFRawFrame." << std::endl;
-      return false;
-    }
-    
-    //logger(LOG_INFO) << "IIRFilter: Applying filter with gain = " << _gain << " to ToFRawFrame id = " << tofFrame->id << std::endl;
-    
-    uint s = _size.width*_size.height;
-    memcpy(o->ambient(), tofFrame->ambient(), s*tofFrame->ambientWordWidth());
-    memcpy(o->amplitude(), tofFrame->amplitude(), s*tofFrame->amplitudeWordWidth());
-    memcpy(o->flags(), tofFrame->flags(), s*tofFrame->flagsWordWidth());
-    
     if(tofFrame->phaseWordWidth() == 2)
-      return _filter<uint16_t>((uint16_t *)tofFrame->phase(), (uint16_t *)o->phase());
+      return _filter<uint16_t>((uint16_t *)tofFrame->phase(), (uint16_t *)o->phase(), rowBegin, rowEnd);
     else if(tofFrame->phaseWordWidth() == 1)
-      return _filter<uint8_t>((uint8_t *)tofFrame->phase(), (uint8_t *)o->phase());
+      return _filter<uint8_t>((uint8_t *)tofFrame->phase(), (uint8_t *)o->phase(), rowBegin, rowEnd);
     else if(tofFrame->phaseWordWidth() == 4)
-      return _filter<uint32_t>((uint32_t *)tofFrame->phase(), (uint32_t *)o->phase());
+      return _filter<uint32_t>((uint32_t *)tofFrame->phase(), (uint32_t *)o->phase(), rowBegin, rowEnd);
     else
       return false;
   }
   else if(depthFrame)
   {
-    _size = depthFrame->size;
     DepthFrame *o = dynamic_cast<DepthFrame *>(out.get());
     
-    if(!o)
-    {
-      logger(LOG_ERROR) << "IIRFilter: Invalid frame type. Expecting DepthFrame." << std::endl;
-      return false;
-    }
-    
-    o->amplitude = depthFrame->amplitude;
-    
-    return _filter<float>(depthFrame->depth.data(), o->depth.data());
+    return _filter<float>(depthFrame->depth.data(), o->depth.data(), rowBegin, rowEnd);
   }
   else
     return false;
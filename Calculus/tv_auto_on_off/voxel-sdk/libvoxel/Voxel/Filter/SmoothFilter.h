@@ -31,10 +31,14 @@ protected:
   virtual void _onSet(const FilterParameterPtr &f);
   
   template <typename T>
-  bool _filter(const T *in, T *out);
+  bool _filter(const T *in, T *out, int rowBegin, int rowEnd);
   
   virtual bool _filter(const FramePtr &in, FramePtr &out);
   
+  virtual int _bandHalo() const { return 2; }
+  virtual bool _beginBands(const FramePtr &in, FramePtr &out);
+  virtual bool _filterBand(const FramePtr &in, FramePtr &out, int rowBegin, int rowEnd);
+  
 public:
   SmoothFilter(float sigma = 0.5);
   virtual ~SmoothFilter() {}
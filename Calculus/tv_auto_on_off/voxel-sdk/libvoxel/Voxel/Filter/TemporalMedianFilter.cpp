@@ -3,14 +3,28 @@
 #include "TemporalMedianFilter.h"
 
 #include <utility>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEMPORAL_MEDIAN_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define TEMPORAL_MEDIAN_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define TEMPORAL_MEDIAN_MAX_ORDER 100 // Same as maximum of 'order' parameter
 
 namespace Voxel
 {
   
-TemporalMedianFilter::TemporalMedianFilter(uint order, float deadband): Filter("TemporalMedianFilter"), _order(order), _deadband(deadband) 
+TemporalMedianFilter::TemporalMedianFilter(uint order, float deadband): Filter("TemporalMedianFilter"), _order(order), _deadband(deadband),
+  _historyCount(0), _historyNext(0)
 {
   _addParameters({
-    FilterParameterPtr(new UnsignedFilterParameter("order", "Order", "Order of the filter", _order, "", 1, 100)),
+    FilterParameterPtr(new UnsignedFilterParameter("order", "Order", "Order of the filter", _order, "", 1, TEMPORAL_MEDIAN_MAX_ORDER)),
     FilterParameterPtr(new FloatFilterParameter("deadband", "Dead band", "Dead band", _deadband, "", 0, 1)),
   });
 }
@@ -33,14 +47,14 @@ void TemporalMedianFilter::_onSet(const FilterParameterPtr &f)
   }
 }
 
-void TemporalMedianFilter::reset() { _history.clear(); _current.clear(); }
+void TemporalMedianFilter::reset() { _history.clear(); _historyCount = _historyNext = 0; _current.clear(); }
 
 template <typename T>
 bool TemporalMedianFilter::_filter(const T *in, T *out)
 {
   uint s = _size.width*_size.height;
   
-  T *cur, *hist;
+  T *cur, *history, *median;
   
   if(_current.size() != s*sizeof(T))
   {
@@ -48,36 +62,37 @@ bool TemporalMedianFilter::_filter(const T *in, T *out)
     memset(_current.data(), 0, s*sizeof(T));
   }
   
+  if(_history.size() != _order*s*sizeof(T)) // Frame size, type or order has changed. Start over
+  {
+    _history.resize(_order*s*sizeof(T));
+    _historyCount = _historyNext = 0;
+  }
+  
   cur = (T *)_current.data();
+  history = (T *)_history.data();
+  
+  memcpy(history + _historyNext*s, in, s*sizeof(T));
+  _historyNext = (_historyNext + 1) % _order;
   
-  if(_history.size() < _order)
+  if(_historyCount < _order)
   {
-    Vector<ByteType> h;
-    h.resize(s*sizeof(T));
-    
-    memcpy(h.data(), in, s*sizeof(T));
-    
-    _history.push_back(std::move(h));
+    _historyCount++;
     
     memcpy(cur, in, s*sizeof(T));
     memcpy(out, in, s*sizeof(T));
   }
   else
   {
-    _history.pop_front();
+    if(_median.size() != s*sizeof(T))
+      _median.resize(s*sizeof(T));
     
-    Vector<ByteType> h;
-    h.resize(s*sizeof(T));
+    median = (T *)_median.data();
     
-    memcpy(h.data(), in, s*sizeof(T));
-    
-    _history.push_back(std::move(h));
+    _getMedian(history, s, median);
     
     for(auto i = 0; i < s; i++)
     {
-      T v;
-      
-      _getMedian(i, v);
+      T v = median[i];
       
       if(v > 0 && fabs(((float)v - cur[i])/cur[i]) > _deadband)
         out[i] = cur[i] = v;
@@ -88,23 +103,200 @@ bool TemporalMedianFilter::_filter(const T *in, T *out)
   return true;
 }
 
-template <typename T>
-void TemporalMedianFilter::_getMedian(IndexType offset, T &value)
+// Minimum and maximum for the sorting networks below. SIMD types overload these
+template <typename V>
+static inline V minimum(const V &a, const V &b) { return std::min(a, b); }
+
+template <typename V>
+static inline V maximum(const V &a, const V &b) { return std::max(a, b); }
+
+template <typename V>
+static inline void sortPair(V &a, V &b)
+{
+  V t = minimum(a, b);
+  b = maximum(a, b);
+  a = t;
+}
+
+template <typename V>
+static inline V median3(V *p)
+{
+  return maximum(minimum(p[0], p[1]), minimum(maximum(p[0], p[1]), p[2]));
+}
+
+// 7 compare-exchanges. 'p' is modified
+template <typename V>
+static inline V median5(V *p)
+{
+  sortPair(p[0], p[1]); sortPair(p[3], p[4]); sortPair(p[0], p[3]);
+  sortPair(p[1], p[4]); sortPair(p[1], p[2]); sortPair(p[2], p[3]);
+  sortPair(p[1], p[2]);
+  return p[2];
+}
+
+// 13 compare-exchanges. 'p' is modified
+template <typename V>
+static inline V median7(V *p)
+{
+  sortPair(p[0], p[5]); sortPair(p[0], p[3]); sortPair(p[1], p[6]);
+  sortPair(p[2], p[4]); sortPair(p[0], p[1]); sortPair(p[3], p[5]);
+  sortPair(p[2], p[6]); sortPair(p[2], p[3]); sortPair(p[3], p[6]);
+  sortPair(p[4], p[5]); sortPair(p[1], p[4]); sortPair(p[1], p[3]);
+  sortPair(p[3], p[4]);
+  return p[3];
+}
+
+#ifdef TEMPORAL_MEDIAN_SSE2
+struct FloatSSE2
+{
+  __m128 v;
+  static const int lanes = 4;
+  
+  static inline FloatSSE2 load(const float *p) { FloatSSE2 r; r.v = _mm_loadu_ps(p); return r; }
+  inline void store(float *p) const { _mm_storeu_ps(p, v); }
+};
+
+static inline FloatSSE2 minimum(const FloatSSE2 &a, const FloatSSE2 &b) { FloatSSE2 r; r.v = _mm_min_ps(a.v, b.v); return r; }
+static inline FloatSSE2 maximum(const FloatSSE2 &a, const FloatSSE2 &b) { FloatSSE2 r; r.v = _mm_max_ps(a.v, b.v); return r; }
+
+// SSE2 has only signed 16-bit min/max. Values are offset by 0x8000 while in registers
+struct UInt16SSE2
+{
+  __m128i v;
+  static const int lanes = 8;
+  
+  static inline UInt16SSE2 load(const uint16_t *p) 
+  { 
+    UInt16SSE2 r; 
+    r.v = _mm_xor_si128(_mm_loadu_si128((const __m128i *)p), _mm_set1_epi16((short)0x8000)); 
+    return r; 
+  }
+  
+  inline void store(uint16_t *p) const { _mm_storeu_si128((__m128i *)p, _mm_xor_si128(v, _mm_set1_epi16((short)0x8000))); }
+};
+
+static inline UInt16SSE2 minimum(const UInt16SSE2 &a, const UInt16SSE2 &b) { UInt16SSE2 r; r.v = _mm_min_epi16(a.v, b.v); return r; }
+static inline UInt16SSE2 maximum(const UInt16SSE2 &a, const UInt16SSE2 &b) { UInt16SSE2 r; r.v = _mm_max_epi16(a.v, b.v); return r; }
+
+struct UInt8SSE2
+{
+  __m128i v;
+  static const int lanes = 16;
+  
+  static inline UInt8SSE2 load(const uint8_t *p) { UInt8SSE2 r; r.v = _mm_loadu_si128((const __m128i *)p); return r; }
+  inline void store(uint8_t *p) const { _mm_storeu_si128((__m128i *)p, v); }
+};
+
+static inline UInt8SSE2 minimum(const UInt8SSE2 &a, const UInt8SSE2 &b) { UInt8SSE2 r; r.v = _mm_min_epu8(a.v, b.v); return r; }
+static inline UInt8SSE2 maximum(const UInt8SSE2 &a, const UInt8SSE2 &b) { UInt8SSE2 r; r.v = _mm_max_epu8(a.v, b.v); return r; }
+
+template <typename T> struct TemporalMedianSIMDType { typedef void Type; };
+
+template <> struct TemporalMedianSIMDType<float> { typedef FloatSSE2 Type; };
+template <> struct TemporalMedianSIMDType<uint16_t> { typedef UInt16SSE2 Type; };
+template <> struct TemporalMedianSIMDType<uint8_t> { typedef UInt8SSE2 Type; };
+#elif defined(TEMPORAL_MEDIAN_NEON)
+struct FloatNEON
+{
+  float32x4_t v;
+  static const int lanes = 4;
+  
+  static inline FloatNEON load(const float *p) { FloatNEON r; r.v = vld1q_f32(p); return r; }
+  inline void store(float *p) const { vst1q_f32(p, v); }
+};
+
+static inline FloatNEON minimum(const FloatNEON &a, const FloatNEON &b) { FloatNEON r; r.v = vminq_f32(a.v, b.v); return r; }
+static inline FloatNEON maximum(const FloatNEON &a, const FloatNEON &b) { FloatNEON r; r.v = vmaxq_f32(a.v, b.v); return r; }
+
+struct UInt16NEON
 {
-  Vector<T> v;
+  uint16x8_t v;
+  static const int lanes = 8;
   
-  v.reserve(_order);
+  static inline UInt16NEON load(const uint16_t *p) { UInt16NEON r; r.v = vld1q_u16(p); return r; }
+  inline void store(uint16_t *p) const { vst1q_u16(p, v); }
+};
+
+static inline UInt16NEON minimum(const UInt16NEON &a, const UInt16NEON &b) { UInt16NEON r; r.v = vminq_u16(a.v, b.v); return r; }
+static inline UInt16NEON maximum(const UInt16NEON &a, const UInt16NEON &b) { UInt16NEON r; r.v = vmaxq_u16(a.v, b.v); return r; }
+
+struct UInt8NEON
+{
+  uint8x16_t v;
+  static const int lanes = 16;
   
-  for(auto &h: _history)
+  static inline UInt8NEON load(const uint8_t *p) { UInt8NEON r; r.v = vld1q_u8(p); return r; }
+  inline void store(uint8_t *p) const { vst1q_u8(p, v); }
+};
+
+static inline UInt8NEON minimum(const UInt8NEON &a, const UInt8NEON &b) { UInt8NEON r; r.v = vminq_u8(a.v, b.v); return r; }
+static inline UInt8NEON maximum(const UInt8NEON &a, const UInt8NEON &b) { UInt8NEON r; r.v = vmaxq_u8(a.v, b.v); return r; }
+
+template <typename T> struct TemporalMedianSIMDType { typedef void Type; };
+
+template <> struct TemporalMedianSIMDType<float> { typedef FloatNEON Type; };
+template <> struct TemporalMedianSIMDType<uint16_t> { typedef UInt16NEON Type; };
+template <> struct TemporalMedianSIMDType<uint8_t> { typedef UInt8NEON Type; };
+#else
+template <typename T> struct TemporalMedianSIMDType { typedef void Type; };
+#endif
+
+// Median of 'order' = 3, 5 or 7 planes of 'count' pixels each, a vector of pixels at a time. Returns the first 
+// pixel not done
+template <typename T, typename V = typename TemporalMedianSIMDType<T>::Type>
+struct TemporalMedianSIMD
+{
+  static inline SizeType median(const T *history, SizeType count, uint order, T *median)
   {
-    T *h1 = (T *)(h.data());
-    if(h.size() > offset*sizeof(T))
-      v.push_back(h1[offset]);
+    SizeType i = 0;
+    V v[7];
+    
+    for(; i + V::lanes <= count; i += V::lanes)
+    {
+      for(auto k = 0; k < order; k++)
+        v[k] = V::load(history + k*count + i);
+      
+      (order == 3?median3(v):(order == 5?median5(v):median7(v))).store(median + i);
+    }
+    return i;
   }
+};
+
+template <typename T>
+struct TemporalMedianSIMD<T, void>
+{
+  static inline SizeType median(const T *history, SizeType count, uint order, T *median) { return 0; }
+};
+
+template <typename T>
+void TemporalMedianFilter::_getMedian(const T *history, SizeType count, T *median)
+{
+  SizeType i = 0;
+  
+  if(_order == 3 || _order == 5 || _order == 7)
+    i = TemporalMedianSIMD<T>::median(history, count, _order, median);
   
-  std::nth_element(v.begin(), v.begin() + v.size()/2,  v.end());
+  T v[TEMPORAL_MEDIAN_MAX_ORDER];
   
-  value = v[v.size()/2];
+  for(; i < count; i++)
+  {
+    for(auto k = 0; k < _order; k++)
+      v[k] = history[k*count + i];
+    
+    if(_order == 1)
+      median[i] = v[0];
+    else if(_order == 3)
+      median[i] = median3(v);
+    else if(_order == 5)
+      median[i] = median5(v);
+    else if(_order == 7)
+      median[i] = median7(v);
+    else
+    {
+      std::nth_element(v, v + _order/2, v + _order);
+      median[i] = v[_order/2];
+    }
+  }
 }
 
 bool TemporalMedianFilter::_filter(const FramePtr &in, FramePtr &out)
@@ -24,13 +24,18 @@ protected:
   uint _order;
   
   FrameSize _size;
-  List<Vector<ByteType>> _history;
-  Vector<ByteType> _current;
+  
+  // Ring of last '_order' frames, each as a contiguous plane in one buffer so that the same pixel 
+  // of all frames can be loaded into vector registers lane by lane
+  Vector<ByteType> _history;
+  uint _historyCount, _historyNext;
+  
+  Vector<ByteType> _current, _median;
   
   virtual void _onSet(const FilterParameterPtr &f);
   
   template <typename T>
-  void _getMedian(IndexType offset, T &value);
+  void _getMedian(const T *history, SizeType count, T *median);
   
   template <typename T>
   bool _filter(const T *in, T *out);
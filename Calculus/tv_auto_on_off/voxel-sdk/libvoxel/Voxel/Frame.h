@@ -51,6 +51,9 @@ public:
 
 typedef Ptr<Frame> FramePtr;
 
+// Read-only frame shared between its producer and consumers, e.g., frames given to DepthCamera's shared callbacks
+typedef Ptr<const Frame> ConstFramePtr;
+
 class VOXEL_EXPORT DepthFrame: public Frame
 {
 public:
@@ -531,22 +534,60 @@ public:
 
 class VOXEL_EXPORT RawDataFrame : public RawFrame
 {
+protected:
+  // Buffer borrowed from the streamer, instead of 'data'. See borrow()
+  const ByteType *_borrowedData = nullptr;
+  SizeType _borrowedSize = 0;
+  Ptr<void> _borrowReference;
+  
 public:
-  Vector<ByteType> data;
+  Vector<ByteType> data; // Empty when the frame is borrowing a buffer. Use rawData() and rawDataSize() to read frame contents
+  
+  inline const ByteType *rawData() const { return _borrowedData?_borrowedData:data.data(); }
+  inline SizeType rawDataSize() const { return _borrowedData?_borrowedSize:data.size(); }
+  
+  inline bool isBorrowed() const { return _borrowedData != nullptr; }
+  
+  // Refer to 'buffer' without copying it. 'reference' is held till releaseBorrowed() or next borrow(). 
+  // Its deleter is expected to hand the buffer back to its owner
+  inline void borrow(const ByteType *buffer, SizeType size, const Ptr<void> &reference)
+  {
+    data.clear();
+    _borrowedData = buffer;
+    _borrowedSize = size;
+    _borrowReference = reference;
+  }
+  
+  inline void releaseBorrowed()
+  {
+    _borrowedData = nullptr;
+    _borrowedSize = 0;
+    _borrowReference.reset();
+  }
+  
+  // Copy the borrowed buffer into 'data' and release it
+  inline void ownData()
+  {
+    if(!_borrowedData)
+      return;
+    
+    data.assign(_borrowedData, _borrowedData + _borrowedSize);
+    releaseBorrowed();
+  }
   
   virtual Ptr<Frame> copy() const
   {
     RawDataFrame *r = new RawDataFrame();
     r->id = id;
     r->timestamp = timestamp;
-    r->data = data;
+    r->data.assign(rawData(), rawData() + rawDataSize());
     return FramePtr(r);
   }
   
   virtual Ptr<Frame> newFrame() const
   {
     RawDataFrame *r = new RawDataFrame();
-    r->data.resize(data.size());
+    r->data.resize(rawDataSize());
     return FramePtr(r);
   }
   
@@ -559,7 +600,7 @@ public:
   virtual bool isSameSize(const Frame &other) const
   {
     const RawDataFrame *f = dynamic_cast<const RawDataFrame *>(&other);
-    return f && data.size() == f->data.size();
+    return f && rawDataSize() == f->rawDataSize();
   }
   
   static Ptr<RawDataFrame> typeCast(FramePtr ptr)
@@ -569,17 +610,17 @@ public:
   
   virtual bool serialize(SerializedObject &object) const
   {
-    size_t s = sizeof(id) + sizeof(timestamp) + data.size()*sizeof(ByteType) + sizeof(size_t);
+    size_t s = sizeof(id) + sizeof(timestamp) + rawDataSize()*sizeof(ByteType) + sizeof(size_t);
     
     object.resize(s);
     
     object.put((const char *)&id, sizeof(id));
     object.put((const char *)&timestamp, sizeof(timestamp));
     
-    s = data.size();
+    s = rawDataSize();
     object.put((const char *)&s, sizeof(s));
     
-    object.put((const char *)data.data(), sizeof(ByteType)*data.size());
+    object.put((const char *)rawData(), sizeof(ByteType)*rawDataSize());
     return true;
   }
   
@@ -591,6 +632,7 @@ public:
     !object.get((char *)&s, sizeof(s)))
       return false;
     
+    releaseBorrowed();
     data.resize(s);
     
     return object.get((char *)data.data(), sizeof(ByteType)*data.size());
@@ -708,6 +750,139 @@ typedef PointCloudFrameTemplate<IntensityPoint> XYZIPointCloudFrame;
 
 typedef Ptr<XYZPointCloudFrame> XYZPointCloudFramePtr;
 
+/**
+ * \brief XYZI point cloud with x, y, z and intensity in separate cache line aligned arrays.
+ * 
+ * Consumers which scan only some of the coordinates, e.g., z for thresholding, touch only those arrays.
+ */
+class VOXEL_EXPORT XYZIPointCloudSoAFrame : public Frame
+{
+public:
+  AlignedVector<float> x, y, z, i;
+  
+  inline SizeType size() const { return z.size(); }
+  
+  inline void resize(SizeType count)
+  {
+    x.resize(count);
+    y.resize(count);
+    z.resize(count);
+    i.resize(count);
+  }
+  
+  // Conversion helpers
+  void fromXYZIPointCloudFrame(const XYZIPointCloudFrame &other)
+  {
+    id = other.id;
+    timestamp = other.timestamp;
+    resize(other.points.size());
+    
+    for(auto k = 0; k < other.points.size(); k++)
+    {
+      const IntensityPoint &p = other.points[k];
+      x[k] = p.x;
+      y[k] = p.y;
+      z[k] = p.z;
+      i[k] = p.i;
+    }
+  }
+  
+  void toXYZIPointCloudFrame(XYZIPointCloudFrame &other) const
+  {
+    other.id = id;
+    other.timestamp = timestamp;
+    other.points.resize(size());
+    
+    for(auto k = 0; k < size(); k++)
+    {
+      IntensityPoint &p = other.points[k];
+      p.x = x[k];
+      p.y = y[k];
+      p.z = z[k];
+      p.i = i[k];
+    }
+  }
+  
+  virtual Ptr<Frame> copy() const
+  {
+    XYZIPointCloudSoAFrame *f = new XYZIPointCloudSoAFrame();
+    f->id = id;
+    f->timestamp = timestamp;
+    f->x = x;
+    f->y = y;
+    f->z = z;
+    f->i = i;
+    return FramePtr(f);
+  }
+  
+  virtual Ptr<Frame> newFrame() const
+  {
+    XYZIPointCloudSoAFrame *f = new XYZIPointCloudSoAFrame();
+    f->resize(size());
+    return FramePtr(f);
+  }
+  
+  virtual bool isSameType(const Frame &other) const
+  {
+    const XYZIPointCloudSoAFrame *f = dynamic_cast<const XYZIPointCloudSoAFrame *>(&other);
+    return f;
+  }
+  
+  virtual bool isSameSize(const Frame &other) const
+  {
+    const XYZIPointCloudSoAFrame *f = dynamic_cast<const XYZIPointCloudSoAFrame *>(&other);
+    return f && f->size() == size();
+  }
+  
+  virtual bool serialize(SerializedObject &object) const
+  {
+    size_t s = sizeof(id) + sizeof(timestamp) + sizeof(size_t) + 4*size()*sizeof(float);
+    
+    object.resize(s);
+    
+    object.put((const char *)&id, sizeof(id));
+    object.put((const char *)&timestamp, sizeof(timestamp));
+    
+    s = size();
+    object.put((const char *)&s, sizeof(s));
+    
+    object.put((const char *)x.data(), sizeof(float)*s);
+    object.put((const char *)y.data(), sizeof(float)*s);
+    object.put((const char *)z.data(), sizeof(float)*s);
+    object.put((const char *)i.data(), sizeof(float)*s);
+    return true;
+  }
+  
+  virtual bool deserialize(SerializedObject &object)
+  {
+    size_t s;
+    
+    if(!object.get((char *)&id, sizeof(id)) ||
+      !object.get((char *)&timestamp, sizeof(timestamp)) ||
+      !object.get((char *)&s, sizeof(s)))
+      return false;
+    
+    if(4*s*sizeof(float) > object.size())
+      return false;
+    
+    resize(s);
+    
+    return object.get((char *)x.data(), sizeof(float)*s) == sizeof(float)*s &&
+      object.get((char *)y.data(), sizeof(float)*s) == sizeof(float)*s &&
+      object.get((char *)z.data(), sizeof(float)*s) == sizeof(float)*s &&
+      object.get((char *)i.data(), sizeof(float)*s) == sizeof(float)*s;
+  }
+  
+  static Ptr<XYZIPointCloudSoAFrame> typeCast(FramePtr ptr)
+  {
+    return std::dynamic_pointer_cast<XYZIPointCloudSoAFrame>(ptr);
+  }
+  
+  virtual ~XYZIPointCloudSoAFrame() {}
+};
+
+typedef Ptr<XYZIPointCloudSoAFrame> XYZIPointCloudSoAFramePtr;
+
 /**
  * @}
  */
@@ -9,14 +9,18 @@
 
 #include <Ptr.h>
 #include <Common.h>
+#include "Logger.h"
 
 #include <algorithm>
+#include <new>
 
 #define MAX_FRAME_BUFFERS 2
+#define FRAME_BUFFER_POOL_CAPACITY 16 // Fixed number of pooled buffers per FrameBufferManager
+#define FRAME_BUFFER_CACHE_LINE_SIZE 64
 
 namespace Voxel
 {
-  
+
 /**
  * \addtogroup Frm
  * @{
@@ -26,92 +30,319 @@ namespace Voxel
 template <typename BufferType>
 class FrameBufferManager;
 
-// Auto-releases the obtained buffer when FrameBuffer<> instance is terminated
 template <typename BufferType>
-class FrameBuffer: public Ptr<BufferType>
+class FrameBuffer;
+
+// Pool state of a FrameBufferManager<>. Shared by the manager and every pooled FrameBuffer<> handle, so that handles
+// kept beyond the life of the manager, e.g., frames held by an application after its camera is gone, still release
+// into a valid pool. The pool and its buffers are freed when the manager and the last of these handles are gone
+template <typename BufferType>
+class FrameBufferPool
 {
 public:
   typedef Ptr<BufferType> BufferPtr;
-  
+
 protected:
-  BufferPtr &_buffer;
-  
-  FrameBufferManager<BufferType> &_manager;
-  
+  // Padded to a multiple of cache line size so that handles on different threads do not share a line
+  struct Slot
+  {
+    BufferPtr buffer;
+    Atomic<int32_t> referenceCount;
+    Atomic<uint32_t> next;
+
+    char _padding[FRAME_BUFFER_CACHE_LINE_SIZE -
+      (sizeof(BufferPtr) + sizeof(Atomic<int32_t>) + sizeof(Atomic<uint32_t>)) % FRAME_BUFFER_CACHE_LINE_SIZE];
+  };
+
+  static const uint32_t _INVALID_INDEX = 0xFFFFFFFFU;
+
+  Vector<uint8_t> _storage;
+  Slot *_slots;
+  SizeType _capacity;
+
+  // Free list head. Upper 32-bits is a tag incremented on every update to avoid ABA, lower 32-bits is slot index
+  Atomic<uint64_t> _freeHead;
+
+  Atomic<SizeType> _inUseCount, _overflowCount;
+
+  Function<void (BufferPtr &)> _releaseHandler;
+
+  inline void _push(uint32_t index)
+  {
+    uint64_t head = _freeHead.load(std::memory_order_relaxed), newHead;
+
+    do
+    {
+      _slots[index].next.store((uint32_t)head, std::memory_order_relaxed);
+      newHead = (((head >> 32) + 1) << 32) | index;
+    } while(!_freeHead.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+  }
+
+  inline uint32_t _pop()
+  {
+    uint64_t head = _freeHead.load(std::memory_order_acquire), newHead;
+    uint32_t index;
+
+    do
+    {
+      index = (uint32_t)head;
+
+      if(index == _INVALID_INDEX)
+        return _INVALID_INDEX;
+
+      newHead = (((head >> 32) + 1) << 32) | _slots[index].next.load(std::memory_order_relaxed);
+    } while(!_freeHead.compare_exchange_weak(head, newHead, std::memory_order_acquire, std::memory_order_acquire));
+
+    return index;
+  }
+
+  // Takes a free slot with one reference, or returns _INVALID_INDEX if there is none
+  inline uint32_t _acquire()
+  {
+    uint32_t index = _pop();
+
+    if(index == _INVALID_INDEX)
+      return _INVALID_INDEX;
+
+    _slots[index].referenceCount.store(1, std::memory_order_relaxed);
+    _inUseCount++;
+    return index;
+  }
+
+  inline void _addReference(uint32_t index)
+  {
+    _slots[index].referenceCount.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  inline void _release(uint32_t index)
+  {
+    if(_slots[index].referenceCount.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+      if(_releaseHandler)
+        _releaseHandler(_slots[index].buffer);
+
+      _inUseCount--;
+      _push(index);
+    }
+  }
+
 public:
-  FrameBuffer(BufferPtr &buffer, FrameBufferManager<BufferType> &manager): _buffer(buffer), _manager(manager), 
-    Ptr<BufferType>(nullptr, [&manager, &buffer](BufferType *) { manager.release(buffer); }) // The deleter gets called when FrameBuffer<> goes out of scope. Deleter releases the held buffer
-    {}
-  
-  inline BufferPtr &operator *() { return _buffer; }
-  
-  virtual ~FrameBuffer() {}
+  FrameBufferPool(SizeType capacity): _capacity((capacity > 0)?capacity:1)
+  {
+    _storage.resize(_capacity*sizeof(Slot) + FRAME_BUFFER_CACHE_LINE_SIZE);
+
+    uintptr_t p = (uintptr_t)_storage.data();
+    p = (p + FRAME_BUFFER_CACHE_LINE_SIZE - 1) & ~(uintptr_t)(FRAME_BUFFER_CACHE_LINE_SIZE - 1);
+
+    _slots = (Slot *)p;
+
+    _freeHead = _INVALID_INDEX;
+    _inUseCount = 0;
+    _overflowCount = 0;
+
+    for(auto i = 0; i < _capacity; i++)
+    {
+      new (_slots + i) Slot();
+      _slots[i].referenceCount = 0;
+    }
+
+    for(int i = _capacity - 1; i >= 0; i--)
+      _push(i);
+  }
+
+  virtual ~FrameBufferPool()
+  {
+    for(auto i = 0; i < _capacity; i++)
+      _slots[i].~Slot();
+  }
+
+  friend class FrameBuffer<BufferType>;
+  friend class FrameBufferManager<BufferType>;
 };
-  
-// This maintains a minimum number of buffers for use and re-use.
-// Call to release() on unused buffers is important for it be either freed or reused 
+
+// Handle to a buffer obtained from FrameBufferManager<>. Copies share the buffer, which is returned
+// to the manager's pool when the last copy is destroyed or reset(). Copying and releasing do not allocate.
+// Handles may outlive the manager they were obtained from.
+template <typename BufferType>
+class FrameBuffer
+{
+public:
+  typedef Ptr<BufferType> BufferPtr;
+  typedef Ptr<FrameBufferPool<BufferType>> PoolPtr;
+
+protected:
+  PoolPtr _pool;
+  uint32_t _index; // Slot in the pool. Unused for overflow buffers
+
+  BufferPtr *_buffer;
+
+  Ptr<BufferPtr> _overflow; // Holds the buffer when the pool was exhausted at the time of get()
+
+  FrameBuffer(const PoolPtr &pool, uint32_t index): _pool(pool), _index(index), _buffer(&pool->_slots[index].buffer) {}
+
+  FrameBuffer(const Ptr<BufferPtr> &overflow): _index(0), _buffer(overflow.get()), _overflow(overflow) {}
+
+  inline void _acquire()
+  {
+    if(_pool)
+      _pool->_addReference(_index);
+  }
+
+public:
+  // Holds no buffer until assigned
+  FrameBuffer(): _index(0), _buffer(nullptr) {}
+
+  FrameBuffer(const FrameBuffer &other): _pool(other._pool), _index(other._index), _buffer(other._buffer), _overflow(other._overflow)
+  {
+    _acquire();
+  }
+
+  FrameBuffer &operator =(const FrameBuffer &other)
+  {
+    if(this != &other)
+    {
+      FrameBuffer copy(other);
+
+      reset();
+
+      std::swap(_pool, copy._pool);
+      std::swap(_index, copy._index);
+      std::swap(_buffer, copy._buffer);
+      std::swap(_overflow, copy._overflow);
+    }
+    return *this;
+  }
+
+  inline BufferPtr &operator *() { return *_buffer; }
+  inline BufferPtr *operator ->() { return _buffer; }
+
+  inline bool isPooled() const { return _pool != nullptr; }
+  inline explicit operator bool() const { return _buffer != nullptr; }
+
+  // Releases this handle's reference to the buffer. The handle must not be dereferenced after this
+  inline void reset()
+  {
+    if(_pool)
+    {
+      _pool->_release(_index);
+      _pool.reset();
+    }
+
+    _overflow.reset();
+    _buffer = nullptr;
+  }
+
+  virtual ~FrameBuffer() { reset(); }
+
+  friend class FrameBufferManager<BufferType>;
+};
+
+// This maintains a fixed-capacity pool of buffers for re-use. Buffers (and the frames they hold) are
+// kept in the pool after release so that steady state capture does not allocate.
+//
+// get() and release of FrameBuffer<> handles are lock-free and O(1), and can be done from different threads.
+// If all pooled buffers are in use, get() falls back to a buffer which is not pooled.
 template <typename BufferType>
 class FrameBufferManager
 {
 public:
   typedef Ptr<BufferType> BufferPtr;
   typedef FrameBuffer<BufferType> FrameBufferType;
-  
+  typedef FrameBufferPool<BufferType> PoolType;
+
 protected:
-  List<BufferPtr> _inUse;
-  List<BufferPtr> _available;
-  
+  Ptr<PoolType> _pool;
+
   SizeType _minimumBufferCount;
-  
+
 public:
-  FrameBufferManager(SizeType minBufferCount): _minimumBufferCount(minBufferCount)
-  {
-    for(auto i = 0; i < minBufferCount; i++)
-      _available.push_back(BufferPtr());
-  }
-  
+  FrameBufferManager(SizeType minBufferCount, SizeType capacity = FRAME_BUFFER_POOL_CAPACITY):
+    _pool(new PoolType(capacity)), _minimumBufferCount(minBufferCount) {}
+
+  // Minimum buffer count is now only a hint on the number of buffers expected to be in use at a time.
+  // Pool capacity is fixed at construction
   inline void setMinimumBufferCount(SizeType minBufferCount)
   {
     _minimumBufferCount = (minBufferCount > 0)?minBufferCount:MAX_FRAME_BUFFERS;
+
+    if(_minimumBufferCount > _pool->_capacity)
+      logger(LOG_WARNING) << "FrameBufferManager: Expected buffer count " << _minimumBufferCount
+        << " is more than pool capacity " << _pool->_capacity << ". Excess buffers will not be pooled." << std::endl;
   }
-  
+
   inline SizeType getMinimumBufferCount() const
   {
     return _minimumBufferCount;
   }
-  
+
+  inline SizeType capacity() const { return _pool->_capacity; }
+  inline SizeType inUseCount() const { return _pool->_inUseCount; }
+
+  // Number of times get() had to return a buffer outside the pool
+  inline SizeType overflowCount() const { return _pool->_overflowCount; }
+
   FrameBufferType get()
   {
-    if(_available.size() > 0)
-      _inUse.splice(_inUse.begin(), _available, _available.begin());
-    else
-      _inUse.push_front(BufferPtr());
-    
-    return FrameBufferType(*_inUse.begin(), *this);
-  }
-  
-  bool release(BufferPtr &p)
-  {
-    auto f = std::find(_inUse.begin(), _inUse.end(), p);
-    
-    if(f == _inUse.end())
-      return false;
-    
-    if(_available.size() < _minimumBufferCount)
-      _available.splice(_available.begin(), _inUse, f);
-    else
-      _inUse.erase(f);
-    
-    return true;
-  }
-  
+    uint32_t index = _pool->_acquire();
+
+    if(index == PoolType::_INVALID_INDEX)
+    {
+      _pool->_overflowCount++;
+      return FrameBufferType(Ptr<BufferPtr>(new BufferPtr()));
+    }
+
+    return FrameBufferType(_pool, index);
+  }
+
+  // 'handler' is called on a buffer when its last FrameBuffer<> handle goes away, before it is made
+  // available again. Use it to drop resources a pooled buffer should not hold while idle. Set before use.
+  // As handles may outlive the manager, 'handler' must not refer to the manager or its owner
+  inline void setReleaseHandler(const Function<void (BufferPtr &)> &handler) { _pool->_releaseHandler = handler; }
+
+  // Calls 'allocator' on the buffer held by each free slot of the pool, to populate buffers before
+  // streaming starts. Not thread-safe with respect to get(). Returns number of buffers allocated.
+  SizeType preallocate(const Function<void (BufferPtr &)> &allocator)
+  {
+    Vector<FrameBufferType> buffers;
+    buffers.reserve(_pool->_capacity);
+
+    for(auto i = 0; i < _pool->_capacity; i++)
+    {
+      uint32_t index = _pool->_acquire();
+
+      if(index == PoolType::_INVALID_INDEX)
+        break;
+
+      buffers.push_back(FrameBufferType(_pool, index));
+      allocator(*buffers.back());
+    }
+
+    return buffers.size();
+  }
+
+  // Frees the buffers held by free slots of the pool. Buffers in use are kept till their last handle goes away,
+  // and are freed with the pool if that happens after the manager is gone. Not thread-safe with respect to get()
   void clear()
   {
-    _inUse.clear();
-    _available.clear();
+    Vector<uint32_t> indices;
+    indices.reserve(_pool->_capacity);
+
+    uint32_t index;
+
+    while((index = _pool->_pop()) != PoolType::_INVALID_INDEX)
+    {
+      _pool->_slots[index].buffer = nullptr;
+      indices.push_back(index);
+    }
+
+    for(auto i = indices.rbegin(); i != indices.rend(); i++)
+      _pool->_push(*i);
+  }
+
+  virtual ~FrameBufferManager()
+  {
+    clear();
   }
-  
-  virtual ~FrameBufferManager() { clear(); }
 };
 
 /**
@@ -10,9 +10,24 @@
 
 #include "CameraSystem.h"
 #include "DepthCamera.h"
+#include "ThreadPool.h"
 
 #include <FrameGenerator.h>
 
+#include <algorithm>
+
+// All frame types but the SoA point cloud, which is generated only when asked for
+#define FRAME_STREAM_DEFAULT_FRAME_TYPES (((1 << DepthCamera::FRAME_TYPE_COUNT) - 1) & ~(1 << DepthCamera::FRAME_XYZI_POINT_CLOUD_SOA_FRAME))
+
+#ifdef LINUX
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#elif defined(WINDOWS)
+#include <windows.h>
+#endif
+
 namespace Voxel
 {
   
@@ -28,6 +43,7 @@ FrameStreamWriter::FrameStreamWriter(const String &filename, GeneratorIDType pro
 bool FrameStreamWriter::_init(GeneratorIDType processedRawFrameGeneratorID, GeneratorIDType depthFrameGeneratorID, GeneratorIDType pointCloudFrameGeneratorID)
 {
   _frameCount = 0;
+  _offset = 0;
   
   if(!_stream.good())
   {
@@ -71,18 +87,56 @@ bool FrameStreamWriter::write(Voxel::FramePtr rawUnprocessed)
   _rawpacket.type = FrameStreamPacket::PACKET_DATA;
   _rawpacket.size = _rawpacket.object.size();
   
-  return _rawpacket.write(_stream);
+  if(dynamic_cast<const RawDataFrame *>(rawUnprocessed.get()))
+  {
+    // Frame data follows id, timestamp and data size in a serialized RawDataFrame. Pad so that it starts at an aligned offset
+    FileOffsetType dataOffset = _offset + FRAME_STREAM_PACKET_HEADER_SIZE + sizeof(Frame::id) + sizeof(TimeStampType) + sizeof(size_t);
+    SizeType padding = (FRAME_STREAM_DATA_ALIGNMENT - dataOffset % FRAME_STREAM_DATA_ALIGNMENT) % FRAME_STREAM_DATA_ALIGNMENT;
+    
+    if(padding)
+    {
+      while(padding < FRAME_STREAM_PACKET_HEADER_SIZE)
+        padding += FRAME_STREAM_DATA_ALIGNMENT;
+      
+      _paddingPacket.type = FrameStreamPacket::PACKET_PADDING;
+      _paddingPacket.size = padding - FRAME_STREAM_PACKET_HEADER_SIZE;
+      _paddingPacket.object.resize(_paddingPacket.size);
+      
+      if(!_writePacket(_paddingPacket))
+        return false;
+    }
+  }
+  
+  FileOffsetType offset = _offset;
+  
+  if(!_writePacket(_rawpacket))
+    return false;
+  
+  _dataPacketOffsets.push_back(offset);
+  _frameCount++;
+  return true;
+}
+
+bool FrameStreamWriter::_writePacket(FrameStreamPacket &packet)
+{
+  if(!packet.write(_stream))
+    return false;
+  
+  _offset += FRAME_STREAM_PACKET_HEADER_SIZE + packet.size;
+  return true;
 }
 
 bool FrameStreamWriter::_writeHeader()
 {
-  _header.version[0] = 0;
-  _header.version[1] = 1;
+  _header.version[0] = FRAME_STREAM_VERSION_MAJOR;
+  _header.version[1] = FRAME_STREAM_VERSION_MINOR;
   
   _stream.write(_header.version, 2);
   
   _stream.write((const char *)_header.generatorIDs, sizeof(GeneratorIDType)*3);
   
+  _offset += FRAME_STREAM_HEADER_SIZE;
+  
   return true;
 }
 
@@ -101,7 +155,46 @@ bool FrameStreamWriter::writeGeneratorConfiguration(uint frameType)
   _generatorConfigSubPacket.write(_configPacket.object);
   _configPacket.size = _configPacket.object.size();
   
-  return _configPacket.write(_stream);
+  FrameStreamConfigEpoch epoch;
+  epoch.offset = _offset;
+  epoch.firstFrame = _frameCount;
+  epoch.frameType = frameType;
+  
+  if(!_writePacket(_configPacket))
+    return false;
+  
+  _configEpochs.push_back(epoch);
+  return true;
+}
+
+bool FrameStreamWriter::_writeIndex()
+{
+  FrameStreamPacket index;
+  FrameStreamIndexTrailer trailer;
+  
+  trailer.indexOffset = _offset;
+  trailer.dataPacketCount = _dataPacketOffsets.size();
+  trailer.configPacketCount = _configEpochs.size();
+  memcpy(trailer.magic, FRAME_STREAM_INDEX_MAGIC, sizeof(trailer.magic));
+  
+  SizeType epochSize = sizeof(FileOffsetType) + sizeof(uint32_t) + sizeof(uint8_t);
+  
+  index.type = FrameStreamPacket::PACKET_INDEX;
+  index.object.resize(_dataPacketOffsets.size()*sizeof(FileOffsetType) + _configEpochs.size()*epochSize + sizeof(trailer));
+  index.size = index.object.size();
+  
+  index.object.put((const char *)_dataPacketOffsets.data(), _dataPacketOffsets.size()*sizeof(FileOffsetType));
+  
+  for(auto &e: _configEpochs)
+  {
+    index.object.put((const char *)&e.offset, sizeof(e.offset));
+    index.object.put((const char *)&e.firstFrame, sizeof(e.firstFrame));
+    index.object.put((const char *)&e.frameType, sizeof(e.frameType));
+  }
+  
+  index.object.put((const char *)&trailer, sizeof(trailer));
+  
+  return _writePacket(index);
 }
 
 bool FrameStreamWriter::close()
@@ -109,7 +202,12 @@ bool FrameStreamWriter::close()
   Lock<Mutex> _(_mutex);
   
   if(_stream.is_open())
+  {
+    if(_stream.good() && !_writeIndex())
+      logger(LOG_ERROR) << "FrameStreamWriter: Failed to write stream index." << std::endl;
+    
     _stream.close();
+  }
   
   return !_stream.fail();
 }
@@ -190,16 +288,277 @@ bool GeneratorConfigurationSubPacket::write(SerializedObject &object)
 }
 
 
-FrameStreamReader::FrameStreamReader(InputFileStream &stream, CameraSystem &sys):_stream(stream), _sys(sys), frames(4)
+
+MappedFile::MappedFile(const String &fileName): _data(nullptr), _size(0)
+#ifdef WINDOWS
+, _fileHandle(nullptr), _mappingHandle(nullptr)
+#endif
+{
+#ifdef LINUX
+  int fd = ::open(fileName.c_str(), O_RDONLY);
+  
+  if(fd < 0)
+    return;
+  
+  struct stat s;
+  
+  if(fstat(fd, &s) == 0 && s.st_size > 0)
+  {
+    void *d = ::mmap(NULL, s.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    
+    if(d != MAP_FAILED)
+    {
+      _data = (const uint8_t *)d;
+      _size = s.st_size;
+    }
+  }
+  
+  ::close(fd); // Mapping stays valid after the file is closed
+#elif defined(WINDOWS)
+  HANDLE file = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  
+  if(file == INVALID_HANDLE_VALUE)
+    return;
+  
+  _fileHandle = file;
+  
+  LARGE_INTEGER s;
+  
+  if(!GetFileSizeEx(file, &s) || s.QuadPart == 0)
+    return;
+  
+  _mappingHandle = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+  
+  if(!_mappingHandle)
+    return;
+  
+  _data = (const uint8_t *)MapViewOfFile(_mappingHandle, FILE_MAP_READ, 0, 0, 0);
+  
+  if(_data)
+    _size = s.QuadPart;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef LINUX
+  if(_data)
+    ::munmap((void *)_data, _size);
+#elif defined(WINDOWS)
+  if(_data)
+    UnmapViewOfFile(_data);
+  
+  if(_mappingHandle)
+    CloseHandle(_mappingHandle);
+  
+  if(_fileHandle)
+    CloseHandle(_fileHandle);
+#endif
+}
+
+
+// Frame generators configured as per the stream at some frame, with buffers to read packets into
+class FrameStreamDecoder
+{
+public:
+  Ptr<FrameGenerator> frameGenerator[3]; // for processed raw, depth and point cloud
+  IndexType appliedConfigEpoch[3]; // last epoch applied to each frame generator, -1 if none
+  
+  FrameStreamPacket dataPacket, configPacket;
+  GeneratorConfigurationSubPacket configSubPacket;
+  
+  FrameStreamDecoder()
+  {
+    for(auto i = 0; i < 3; i++)
+      appliedConfigEpoch[i] = -1;
+  }
+};
+
+// LRU cache of generated frames, filled ahead of the reader by a thread pool
+class FrameStreamReadAhead
+{
+public:
+  struct Entry
+  {
+    Vector<FramePtr> frames;
+    uint32_t frameTypes;
+    IndexType configEpoch; // of the frame generators which generated the frames
+    List<size_t>::iterator lruPosition;
+  };
+  
+protected:
+  FrameStreamReader &_reader;
+  SizeType _readAhead, _cacheSize;
+  
+  Mutex _mutex;
+  ConditionVariable _decoded;
+  
+  Map<size_t, Entry> _cache; // Key = frame index
+  List<size_t> _lru; // most recently used first
+  Set<size_t> _decoding;
+  Vector<Ptr<FrameStreamDecoder>> _freeDecoders;
+  
+  uint64_t _hits = 0, _misses = 0;
+  
+  ThreadPoolPtr _threadPool;
+  
+  Entry *_find(size_t position, uint32_t frameTypes)
+  {
+    auto e = _cache.find(position);
+    
+    if(e == _cache.end() || (e->second.frameTypes & frameTypes) != frameTypes || 
+      e->second.configEpoch != _reader._configEpochOf(position))
+      return nullptr;
+    
+    return &e->second;
+  }
+  
+  Ptr<FrameStreamDecoder> _takeDecoder()
+  {
+    Lock<Mutex> _(_mutex);
+    
+    if(_freeDecoders.size())
+    {
+      Ptr<FrameStreamDecoder> d = _freeDecoders.back();
+      _freeDecoders.pop_back();
+      return d;
+    }
+    
+    Ptr<FrameStreamDecoder> d(new FrameStreamDecoder());
+    
+    if(!_reader._createDecoder(*d))
+      return nullptr;
+    return d;
+  }
+  
+  // Generates frames at 'position' and caches them
+  bool _decode(size_t position, uint32_t frameTypes, Vector<FramePtr> *frames = nullptr)
+  {
+    Ptr<FrameStreamDecoder> d = _takeDecoder();
+    
+    Entry e;
+    e.frames.resize(DepthCamera::FRAME_TYPE_COUNT);
+    e.frameTypes = frameTypes;
+    e.configEpoch = _reader._configEpochOf(position);
+    
+    bool result = d && _reader._decode(*d, position, e.frames, frameTypes);
+    
+    Lock<Mutex> _(_mutex);
+    
+    if(d)
+      _freeDecoders.push_back(d);
+    
+    _decoding.erase(position);
+    
+    if(result)
+    {
+      if(frames)
+        *frames = e.frames;
+      
+      auto f = _cache.find(position);
+      
+      if(f != _cache.end())
+      {
+        _lru.erase(f->second.lruPosition);
+        _cache.erase(f);
+      }
+      
+      _lru.push_front(position);
+      e.lruPosition = _lru.begin();
+      _cache[position] = std::move(e);
+      
+      while(_cache.size() > _cacheSize)
+      {
+        _cache.erase(_lru.back());
+        _lru.pop_back();
+      }
+    }
+    
+    _decoded.notify_all();
+    return result;
+  }
+  
+public:
+  FrameStreamReadAhead(FrameStreamReader &reader, SizeType readAhead, SizeType cacheSize, SizeType threadCount):
+  _reader(reader), _readAhead(readAhead), _cacheSize(cacheSize), _threadPool(new ThreadPool(threadCount)) {}
+  
+  // Frames at 'position', from the cache or generated now
+  bool get(size_t position, uint32_t frameTypes, Vector<FramePtr> &frames)
+  {
+    {
+      Lock<Mutex> _(_mutex);
+      
+      while(true)
+      {
+        Entry *e = _find(position, frameTypes);
+        
+        if(e)
+        {
+          _lru.splice(_lru.begin(), _lru, e->lruPosition);
+          frames = e->frames;
+          _hits++;
+          return true;
+        }
+        
+        if(!_decoding.count(position))
+          break;
+        
+        _decoded.wait(_); // Being generated by a worker
+      }
+      
+      _decoding.insert(position);
+      _misses++;
+    }
+    
+    return _decode(position, frameTypes, &frames);
+  }
+  
+  // Starts generating the frames from 'position' onwards which are not cached yet
+  void schedule(size_t position, uint32_t frameTypes)
+  {
+    Lock<Mutex> _(_mutex);
+    
+    for(auto i = position; i < position + _readAhead && i < _reader.size(); i++)
+    {
+      if(_decoding.count(i) || _find(i, frameTypes))
+        continue;
+      
+      _decoding.insert(i);
+      _threadPool->submit([this, i, frameTypes]() { _decode(i, frameTypes); });
+    }
+  }
+  
+  void getStatistics(uint64_t &hits, uint64_t &misses)
+  {
+    Lock<Mutex> _(_mutex);
+    hits = _hits;
+    misses = _misses;
+  }
+  
+  virtual ~FrameStreamReadAhead()
+  {
+    _threadPool = nullptr; // Completes the pending tasks
+  }
+};
+
+FrameStreamReader::FrameStreamReader(InputFileStream &stream, CameraSystem &sys):_stream(stream), _zeroCopy(false), _indexed(false), 
+_frameTypes(FRAME_STREAM_DEFAULT_FRAME_TYPES), _sys(sys), _decoder(new FrameStreamDecoder()), frames(DepthCamera::FRAME_TYPE_COUNT)
 {
   _init();
 }
 
-FrameStreamReader::FrameStreamReader(const String &fileName, CameraSystem &sys): _stream(_internalStream), _sys(sys), frames(4)
+FrameStreamReader::FrameStreamReader(const String &fileName, CameraSystem &sys): _stream(_internalStream), _zeroCopy(false), _indexed(false), 
+_frameTypes(FRAME_STREAM_DEFAULT_FRAME_TYPES), _sys(sys), _decoder(new FrameStreamDecoder()), frames(DepthCamera::FRAME_TYPE_COUNT)
 {
-  _stream.open(fileName, std::ios::binary | std::ios::in);
+  _mappedFile = MappedFilePtr(new MappedFile(fileName));
   
-  if(!_stream.good())
+  if(!_mappedFile->isValid()) // e.g., file larger than the address space. Read it as a stream instead
+  {
+    _mappedFile = nullptr;
+    _stream.open(fileName, std::ios::binary | std::ios::in);
+  }
+  
+  if(!isStreamGood())
   {
     logger(LOG_ERROR) << "FrameStreamReader: Failed to open file '" << fileName << "'" << std::endl;
   }
@@ -209,154 +568,417 @@ FrameStreamReader::FrameStreamReader(const String &fileName, CameraSystem &sys):
 
 bool FrameStreamReader::_init()
 {
-  if(!_stream.good())
+  if(!isStreamGood())
     return false;
   
-  _currentFrameIndex = _currentPacketIndex = 0;
+  _currentFrameIndex = _nextConfigEpoch = 0;
   
-  _stream.read(_header.version, 2);
-  _stream.read((char *)&_header.generatorIDs, sizeof(GeneratorIDType)*3);
+  if(_mappedFile)
+    _streamSize = _mappedFile->size();
+  else
+  {
+    _stream.seekg(0, std::ios::end);
+    _streamSize = _stream.tellg();
+  }
   
-  if(_stream.fail() | _stream.bad())
+  if(!_readBytes(0, _header.version, 2) || !_readBytes(2, (char *)&_header.generatorIDs, sizeof(GeneratorIDType)*3))
   {
     logger(LOG_ERROR) << "FrameStreamReader: Failed to read frame headers." << std::endl;
     return false;
   }
   
-  if(!_sys.getFrameGenerator(DepthCamera::FRAME_RAW_FRAME_PROCESSED, _header.generatorIDs[0], _frameGenerator[0]) ||
-  !_sys.getFrameGenerator(DepthCamera::FRAME_DEPTH_FRAME, _header.generatorIDs[1], _frameGenerator[1]) ||
-  !_sys.getFrameGenerator(DepthCamera::FRAME_XYZI_POINT_CLOUD_FRAME, _header.generatorIDs[2], _frameGenerator[2]))
+  if(!_createDecoder(*_decoder))
+    return false;
+  
+  if(!_readIndex())
+    return _scanPackets();
+  
+  return true;
+}
+
+bool FrameStreamReader::_createDecoder(FrameStreamDecoder &decoder)
+{
+  if(!_sys.getFrameGenerator(DepthCamera::FRAME_RAW_FRAME_PROCESSED, _header.generatorIDs[0], decoder.frameGenerator[0]) ||
+  !_sys.getFrameGenerator(DepthCamera::FRAME_DEPTH_FRAME, _header.generatorIDs[1], decoder.frameGenerator[1]) ||
+  !_sys.getFrameGenerator(DepthCamera::FRAME_XYZI_POINT_CLOUD_FRAME, _header.generatorIDs[2], decoder.frameGenerator[2]))
   {
     logger(LOG_ERROR) << "FrameStreamReader: Failed to get necessary frame generators to read stream." << std::endl;
     return false;
   }
   
-  DepthFrameGeneratorPtr p = std::dynamic_pointer_cast<DepthFrameGenerator>(_frameGenerator[1]);
+  DepthFrameGeneratorPtr p = std::dynamic_pointer_cast<DepthFrameGenerator>(decoder.frameGenerator[1]);
   
-  if(!p || !p->setProcessedFrameGenerator(_frameGenerator[0]))
+  if(!p || !p->setProcessedFrameGenerator(decoder.frameGenerator[0]))
   {
     logger(LOG_ERROR) << "FrameStreamReader: Could not initialize depth frame generator" << std::endl;
     return false;
   }
   
-  _allPacketOffsets.reserve(500);
-  _dataPacketLocation.reserve(500);
-  _configPacketLocation.reserve(500);
+  return true;
+}
+
+bool FrameStreamReader::_readBytes(FileOffsetType offset, char *bytes, SizeType size)
+{
+  if(offset + size > _streamSize)
+    return false;
   
-  while(!_stream.eof())
+  if(_mappedFile)
   {
-    uint offset = _stream.tellg();
-    if(!_dataPacket.readHeader(_stream))
-      break;
+    memcpy(bytes, _mappedFile->data() + offset, size);
+    return true;
+  }
+  
+  Lock<Mutex> _(_streamMutex);
+  
+  _stream.clear();
+  _stream.seekg(offset, std::ios::beg);
+  _stream.read(bytes, size);
+  
+  return !(_stream.fail() | _stream.bad());
+}
+
+bool FrameStreamReader::_readPacketHeader(FileOffsetType offset, FrameStreamPacket &packet)
+{
+  char header[FRAME_STREAM_PACKET_HEADER_SIZE];
+  
+  if(!_readBytes(offset, header, sizeof(header)))
+    return false;
+  
+  memcpy(packet.magic, header, 5);
+  memcpy(&packet.type, header + 5, sizeof(packet.type));
+  memcpy(&packet.size, header + 5 + sizeof(packet.type), sizeof(packet.size));
+  return true;
+}
+
+bool FrameStreamReader::_readIndex()
+{
+  if(_header.version[0] == 0 && _header.version[1] < 2) // Index is there only from version 0.2
+    return false;
+  
+  FrameStreamIndexTrailer trailer;
+  FrameStreamPacket index;
+  
+  // Stream without the trailer was not closed by its writer
+  if(_streamSize < FRAME_STREAM_HEADER_SIZE + FRAME_STREAM_PACKET_HEADER_SIZE + sizeof(trailer) ||
+    !_readBytes(_streamSize - sizeof(trailer), (char *)&trailer, sizeof(trailer)) ||
+    memcmp(trailer.magic, FRAME_STREAM_INDEX_MAGIC, sizeof(trailer.magic)))
+    return false;
+  
+  FileOffsetType epochSize = sizeof(FileOffsetType) + sizeof(uint32_t) + sizeof(uint8_t);
+  FileOffsetType indexSize = trailer.dataPacketCount*(FileOffsetType)sizeof(FileOffsetType) + trailer.configPacketCount*epochSize + sizeof(trailer);
+  
+  if(!_readPacketHeader(trailer.indexOffset, index) || !index.verifyMagic() ||
+    index.type != FrameStreamPacket::PACKET_INDEX || index.size != indexSize ||
+    trailer.indexOffset + FRAME_STREAM_PACKET_HEADER_SIZE + indexSize != _streamSize)
+  {
+    logger(LOG_WARNING) << "FrameStreamReader: Invalid stream index. Scanning the stream instead." << std::endl;
+    return false;
+  }
+  
+  FileOffsetType offset = trailer.indexOffset + FRAME_STREAM_PACKET_HEADER_SIZE;
+  
+  _dataPacketOffsets.resize(trailer.dataPacketCount);
+  _configEpochs.resize(trailer.configPacketCount);
+  
+  if(trailer.dataPacketCount && !_readBytes(offset, (char *)_dataPacketOffsets.data(), trailer.dataPacketCount*sizeof(FileOffsetType)))
+    return false;
+  
+  offset += trailer.dataPacketCount*sizeof(FileOffsetType);
+  
+  for(auto &e: _configEpochs)
+  {
+    if(!_readBytes(offset, (char *)&e.offset, sizeof(e.offset)) ||
+      !_readBytes(offset + sizeof(e.offset), (char *)&e.firstFrame, sizeof(e.firstFrame)) ||
+      !_readBytes(offset + sizeof(e.offset) + sizeof(e.firstFrame), (char *)&e.frameType, sizeof(e.frameType)))
+      return false;
     
-    if(!_dataPacket.verifyMagic())
+    offset += epochSize;
+  }
+  
+  _indexed = true;
+  return true;
+}
+
+bool FrameStreamReader::_scanPackets()
+{
+  _dataPacketOffsets.clear();
+  _configEpochs.clear();
+  
+  _dataPacketOffsets.reserve(500);
+  _configEpochs.reserve(10);
+  
+  FileOffsetType offset = FRAME_STREAM_HEADER_SIZE;
+  FrameStreamPacket packet;
+  
+  while(_readPacketHeader(offset, packet))
+  {
+    if(!packet.verifyMagic())
     {
-      logger(LOG_ERROR) << "FrameStreamReader: Got invalid packet at offset = " << _stream.tellg() << std::endl;
-      continue;
+      logger(LOG_ERROR) << "FrameStreamReader: Got invalid packet at offset = " << offset << ". Ignoring rest of the stream." << std::endl;
+      break;
     }
     
-    if(_dataPacket.type == FrameStreamPacket::PACKET_DATA)
+    if(offset + FRAME_STREAM_PACKET_HEADER_SIZE + packet.size > _streamSize) // Stream was cut short while writing this packet
+      break;
+    
+    if(packet.type == FrameStreamPacket::PACKET_DATA)
     {
-      _allPacketOffsets.push_back(offset);
-      _dataPacketLocation.push_back(_allPacketOffsets.size() - 1);
-      _stream.seekg(_dataPacket.size, std::ios::cur);
+      _dataPacketOffsets.push_back(offset);
     }
-    else if(_dataPacket.type == FrameStreamPacket::PACKET_GENERATOR_CONFIG)
+    else if(packet.type == FrameStreamPacket::PACKET_GENERATOR_CONFIG)
     {
-      _allPacketOffsets.push_back(offset);
-      _configPacketLocation.push_back(_allPacketOffsets.size() - 1);
-      _stream.seekg(_dataPacket.size, std::ios::cur);
+      FrameStreamConfigEpoch epoch;
+      epoch.offset = offset;
+      epoch.firstFrame = _dataPacketOffsets.size();
+      epoch.frameType = 0;
+      
+      // Frame type is the first byte of the configuration sub-packet
+      if(packet.size)
+        _readBytes(offset + FRAME_STREAM_PACKET_HEADER_SIZE, (char *)&epoch.frameType, sizeof(epoch.frameType));
+      
+      _configEpochs.push_back(epoch);
     }
-    else
+    else if(packet.type != FrameStreamPacket::PACKET_INDEX && packet.type != FrameStreamPacket::PACKET_PADDING)
     {
-      logger(LOG_ERROR) << "FrameStreamReader: Got invalid packet type = " << _dataPacket.type << std::endl;
+      logger(LOG_ERROR) << "FrameStreamReader: Got invalid packet type = " << (uint)packet.type << std::endl;
     }
+    
+    offset += FRAME_STREAM_PACKET_HEADER_SIZE + packet.size;
   }
+  
+  return true;
+}
 
-  _stream.clear();
-  if(_allPacketOffsets.size())
-    _stream.seekg(_allPacketOffsets[0], std::ios::beg);
+bool FrameStreamReader::_getPacket(FileOffsetType offset, FrameStreamPacket &packet)
+{
+  if(!_readPacketHeader(offset, packet))
+  {
+    logger(LOG_ERROR) << "FrameStreamReader: Failed to read packet at offset = " << offset << std::endl;
+    return false;
+  }
   
-  logger(LOG_ERROR) << "stream state: fail = " << _stream.fail() << ", bad = " << _stream.bad() << ", eof = " << _stream.eof() << std::endl;
+  if(!packet.verifyMagic())
+  {
+    logger(LOG_ERROR) << "FrameStreamReader: Found packet with invalid magic string" << std::endl;
+    return false;
+  }
+  
+  packet.object.resize(packet.size);
+  
+  if(packet.size && !_readBytes(offset + FRAME_STREAM_PACKET_HEADER_SIZE, packet.object.getBytes().data(), packet.size))
+  {
+    logger(LOG_ERROR) << "FrameStreamReader: Failed to read packet at offset = " << offset << std::endl;
+    return false;
+  }
   
   return true;
 }
 
-bool FrameStreamReader::_getPacket(size_t packetIndex, FrameStreamPacket &packet)
+bool FrameStreamReader::_readConfigPacket(FrameStreamDecoder &decoder, IndexType epoch)
 {
-  if(packetIndex < 0 || packetIndex >= _allPacketOffsets.size())
+  FrameStreamPacket &configPacket = decoder.configPacket;
+  GeneratorConfigurationSubPacket &configSubPacket = decoder.configSubPacket;
+  
+  if(!_getPacket(_configEpochs[epoch].offset, configPacket))
     return false;
   
-  _stream.seekg(_allPacketOffsets[packetIndex], std::ios::beg);
+  if(configPacket.type != FrameStreamPacket::PACKET_GENERATOR_CONFIG)
+  {
+    logger(LOG_ERROR) << "FrameStreamReader: Don't know how to handle config packet of type = '" << configPacket.type << "'. Skipping it."<< "'" << std::endl;
+    return false;
+  }
   
-  if(!_stream.good())
+  if(!configSubPacket.read(configPacket.object))
   {
-    logger(LOG_ERROR) << "FrameStreamReader: Failed to move the stream get position" << std::endl;
+    logger(LOG_ERROR) << "FrameStreamReader: Could not get extract the configuration for config packet of type = '" << configPacket.type << "'. Skipping it."<< "'" << std::endl;
     return false;
   }
   
-  if(!packet.read(_stream))
+  if(configSubPacket.frameType < 1 || configSubPacket.frameType > 3)
   {
-    logger(LOG_ERROR) << "FrameStreamReader: Failed to read packet with index = " << packetIndex << std::endl;
+    logger(LOG_ERROR) << "FrameStreamReader: Got configuration for unknown frame type = '" << (uint)configSubPacket.frameType << "'" << std::endl;
     return false;
   }
   
-  if(!packet.verifyMagic())
+  if(!decoder.frameGenerator[configSubPacket.frameType - 1]->readConfiguration(configSubPacket.config))
   {
-    logger(LOG_ERROR) << "FrameStreamReader: Found packet with invalid magic string" << std::endl;
+    logger(LOG_ERROR) << "FrameStreamReader: Failed to read configuration for frame type = '" << (uint)configSubPacket.frameType << "'. Skipping it."<< "'" << std::endl;
     return false;
   }
   
+  decoder.appliedConfigEpoch[configSubPacket.frameType - 1] = epoch;
   return true;
 }
 
-bool FrameStreamReader::_readConfigPacket(size_t packetIndex)
+IndexType FrameStreamReader::_configEpochOf(size_t position)
 {
-  if(!_getPacket(packetIndex, _configPacket))
-    return false;
+  return (IndexType)(std::upper_bound(_configEpochs.begin(), _configEpochs.end(), position, 
+    [](size_t p, const FrameStreamConfigEpoch &e) { return p < e.firstFrame; }) - _configEpochs.begin()) - 1;
+}
+
+size_t FrameStreamReader::_applyConfigurationAt(FrameStreamDecoder &decoder, size_t position)
+{
+  // Epochs starting at or before 'position'. These were recorded before the frame at 'position'
+  size_t end = _configEpochOf(position) + 1;
   
-  if(_configPacket.type != FrameStreamPacket::PACKET_GENERATOR_CONFIG)
+  // A configuration replaces the previous one of the same frame generator, so only the latest of each is applied
+  for(auto type = 0; type < 3; type++)
   {
-    logger(LOG_ERROR) << "FrameStreamReader: Don't know how to handle config packet of type = '" << _configPacket.type << "'. Skipping it."<< "'" << std::endl;
-    return false;
+    for(IndexType e = (IndexType)end - 1; e >= 0; e--)
+    {
+      if(_configEpochs[e].frameType != type + 1)
+        continue;
+      
+      if(decoder.appliedConfigEpoch[type] != e)
+        _readConfigPacket(decoder, e);
+      break;
+    }
   }
   
-  if(!_configSubPacket.read(_configPacket.object))
+  return end;
+}
+
+bool FrameStreamReader::_readRawFrame(FrameStreamDecoder &decoder, size_t position, RawDataFrame &rawFrame)
+{
+  FileOffsetType offset = _dataPacketOffsets[position];
+  
+  if(!_mappedFile)
   {
-    logger(LOG_ERROR) << "FrameStreamReader: Could not get extract the configuration for config packet of type = '" << _configPacket.type << "'. Skipping it."<< "'" << std::endl;
-    return false;
+    if(!_getPacket(offset, decoder.dataPacket))
+    {
+      logger(LOG_ERROR) << "FrameStreamReader: Failed to get data packet at index = " << position << std::endl;
+      return false;
+    }
+    
+    if(!rawFrame.deserialize(decoder.dataPacket.object))
+    {
+      logger(LOG_ERROR) << "FrameStreamReader: Failed to deserialize data packet at index = " << position << std::endl;
+      return false;
+    }
+    
+    return true;
   }
   
-  if(_configSubPacket.frameType > 3)
+  // Frame data is taken from the mapping as laid out by RawDataFrame::serialize()
+  size_t dataSize;
+  SizeType headerSize = sizeof(rawFrame.id) + sizeof(rawFrame.timestamp) + sizeof(dataSize);
+  
+  if(!_readPacketHeader(offset, decoder.dataPacket) || !decoder.dataPacket.verifyMagic() || decoder.dataPacket.type != FrameStreamPacket::PACKET_DATA ||
+    decoder.dataPacket.size < headerSize || offset + FRAME_STREAM_PACKET_HEADER_SIZE + decoder.dataPacket.size > _streamSize)
   {
-    logger(LOG_ERROR) << "FrameStreamReader: Got configuration for unknown frame type = '" << _configSubPacket.frameType << "'" << std::endl;
+    logger(LOG_ERROR) << "FrameStreamReader: Failed to get data packet at index = " << position << std::endl;
     return false;
   }
   
-  if(!_frameGenerator[_configSubPacket.frameType - 1]->readConfiguration(_configSubPacket.config))
+  const ByteType *p = _mappedFile->data() + offset + FRAME_STREAM_PACKET_HEADER_SIZE;
+  
+  memcpy(&rawFrame.id, p, sizeof(rawFrame.id));
+  memcpy(&rawFrame.timestamp, p + sizeof(rawFrame.id), sizeof(rawFrame.timestamp));
+  memcpy(&dataSize, p + sizeof(rawFrame.id) + sizeof(rawFrame.timestamp), sizeof(dataSize));
+  
+  if(dataSize > decoder.dataPacket.size - headerSize)
   {
-    logger(LOG_ERROR) << "FrameStreamReader: Failed to read configuration for frame type = '" << (uint)_configSubPacket.frameType << "'. Skipping it."<< "'" << std::endl;
+    logger(LOG_ERROR) << "FrameStreamReader: Failed to deserialize data packet at index = " << position << std::endl;
     return false;
   }
   
+  p += headerSize;
+  
+  // Data not at an aligned offset, as in streams before version 0.2, is copied so that it can be read as wider types
+  if(_zeroCopy && (uintptr_t)p % FRAME_STREAM_DATA_ALIGNMENT == 0)
+    rawFrame.borrow(p, dataSize, Ptr<void>(std::static_pointer_cast<void>(_mappedFile))); // Holds on to the mapping
+  else
+  {
+    rawFrame.releaseBorrowed();
+    rawFrame.data.assign(p, p + dataSize);
+  }
+  
   return true;
 }
 
+bool FrameStreamReader::_generateFrames(FrameStreamDecoder &decoder, size_t position, Vector<FramePtr> &frames, uint32_t frameTypes)
+{
+  // Point cloud is generated from depth, which in turn is generated from processed raw frame
+  uint32_t required = frameTypes;
+  
+  if(required & ((1 << DepthCamera::FRAME_XYZI_POINT_CLOUD_FRAME) | (1 << DepthCamera::FRAME_XYZI_POINT_CLOUD_SOA_FRAME)))
+    required |= (1 << DepthCamera::FRAME_DEPTH_FRAME);
+  
+  if(required & (1 << DepthCamera::FRAME_DEPTH_FRAME))
+    required |= (1 << DepthCamera::FRAME_RAW_FRAME_PROCESSED);
+  
+  if((required & (1 << DepthCamera::FRAME_XYZI_POINT_CLOUD_SOA_FRAME)) && 
+    !dynamic_cast<XYZIPointCloudSoAFrame *>(frames[DepthCamera::FRAME_XYZI_POINT_CLOUD_SOA_FRAME].get()))
+    frames[DepthCamera::FRAME_XYZI_POINT_CLOUD_SOA_FRAME] = FramePtr(new XYZIPointCloudSoAFrame());
+  
+  if(((required & (1 << DepthCamera::FRAME_RAW_FRAME_PROCESSED)) && !decoder.frameGenerator[0]->generate(frames[0], frames[1])) ||
+    ((required & (1 << DepthCamera::FRAME_DEPTH_FRAME)) && !decoder.frameGenerator[1]->generate(frames[1], frames[2])) ||
+    ((required & (1 << DepthCamera::FRAME_XYZI_POINT_CLOUD_FRAME)) && !decoder.frameGenerator[2]->generate(frames[2], frames[3])) ||
+    ((required & (1 << DepthCamera::FRAME_XYZI_POINT_CLOUD_SOA_FRAME)) && !decoder.frameGenerator[2]->generate(frames[2], frames[4])))
+  {
+    logger(LOG_ERROR) << "FrameStreamReader: Failed to process and generate subsequent frame types at index = " << position << std::endl;
+    return false;
+  }
+  
+  for(auto t = (int)DepthCamera::FRAME_RAW_FRAME_PROCESSED; t < DepthCamera::FRAME_TYPE_COUNT; t++)
+    if(!(required & (1 << t)))
+      frames[t] = nullptr;
+  
+  return true;
+}
 
+bool FrameStreamReader::_decode(FrameStreamDecoder &decoder, size_t position, Vector<FramePtr> &frames, uint32_t frameTypes)
+{
+  _applyConfigurationAt(decoder, position);
+  
+  RawDataFrame *r = new RawDataFrame();
+  frames[0] = FramePtr(r);
+  
+  return _readRawFrame(decoder, position, *r) && _generateFrames(decoder, position, frames, frameTypes);
+}
 
-bool FrameStreamReader::readNext()
+bool FrameStreamReader::_readNextRawFrame(RawDataFrame &rawFrame)
 {
   if(_currentFrameIndex >= size())
     return false;
   
-  size_t nextIndex = _dataPacketLocation[_currentFrameIndex];
+  // Configuration packets in between the previous and this data packet
+  for(; _nextConfigEpoch < _configEpochs.size() && _configEpochs[_nextConfigEpoch].firstFrame <= _currentFrameIndex; _nextConfigEpoch++)
+    _readConfigPacket(*_decoder, _nextConfigEpoch);
   
-  if(nextIndex > _currentPacketIndex) // some non-data packets in between?
+  return _readRawFrame(*_decoder, _currentFrameIndex++, rawFrame);
+}
+
+bool FrameStreamReader::readNextRaw(RawFramePtr &rawFrame)
+{
+  RawDataFrame *r = dynamic_cast<RawDataFrame *>(rawFrame.get());
+  if(!r)
   {
-    for(; _currentPacketIndex < nextIndex; _currentPacketIndex++)
-    {
-      _readConfigPacket(_currentPacketIndex);
-    }
+    r = new RawDataFrame();
+    rawFrame = RawFramePtr(r);
+  }
+  
+  return _readNextRawFrame(*r);
+}
+
+bool FrameStreamReader::readNext()
+{
+  if(_readAhead)
+  {
+    if(_currentFrameIndex >= size())
+      return false;
+    
+    // Generators of the reader are kept in step, as they are exposed by getFrameGenerator()
+    for(; _nextConfigEpoch < _configEpochs.size() && _configEpochs[_nextConfigEpoch].firstFrame <= _currentFrameIndex; _nextConfigEpoch++)
+      _readConfigPacket(*_decoder, _nextConfigEpoch);
+    
+    size_t position = _currentFrameIndex++;
+    
+    if(!_readAhead->get(position, _frameTypes, frames))
+      return false;
+    
+    _readAhead->schedule(position + 1, _frameTypes);
+    return true;
   }
   
   RawDataFrame *r = dynamic_cast<RawDataFrame *>(frames[0].get());
@@ -366,50 +988,70 @@ bool FrameStreamReader::readNext()
     frames[0] = FramePtr(r);
   }
   
-  if(!_getPacket(_currentPacketIndex, _dataPacket))
-  {
-    logger(LOG_ERROR) << "FrameStreamReader: Failed to get data packet at index = " << _currentFrameIndex << std::endl;
+  if(!_readNextRawFrame(*r))
     return false;
-  }
-  
-  _currentFrameIndex++;
-  _currentPacketIndex++;
   
-  if(!r->deserialize(_dataPacket.object))
+  return _generateFrames(*_decoder, _currentFrameIndex - 1, frames, _frameTypes);
+}
+
+bool FrameStreamReader::setReadAhead(SizeType readAhead, SizeType cacheSize, SizeType threadCount)
+{
+  if(readAhead && cacheSize <= readAhead)
   {
-    logger(LOG_ERROR) << "FrameStreamReader: Failed to deserialize data packet at index = " << _currentFrameIndex << std::endl;
+    logger(LOG_ERROR) << "FrameStreamReader: Cache size needs to be more than read-ahead" << std::endl;
     return false;
   }
   
-  if(!_frameGenerator[0]->generate(frames[0], frames[1]) ||
-    !_frameGenerator[1]->generate(frames[1], frames[2]) ||
-    !_frameGenerator[2]->generate(frames[2], frames[3]))
-  {
-    logger(LOG_ERROR) << "FrameStreamReader: Failed to process and generate subsequent frame types at index = " << _currentFrameIndex << std::endl;
+  _readAhead = nullptr;
+  
+  // Frames may be shared with the cache, so readNext() is not to generate into them
+  frames.assign(DepthCamera::FRAME_TYPE_COUNT, FramePtr());
+  
+  if(readAhead)
+    _readAhead = Ptr<FrameStreamReadAhead>(new FrameStreamReadAhead(*this, readAhead, cacheSize, threadCount));
+  
+  return true;
+}
+
+bool FrameStreamReader::getCacheStatistics(uint64_t &hits, uint64_t &misses)
+{
+  if(!_readAhead)
     return false;
-  }
-    
+  
+  _readAhead->getStatistics(hits, misses);
   return true;
 }
 
+const Ptr<FrameGenerator> &FrameStreamReader::getFrameGenerator(int index) const
+{
+  return _decoder->frameGenerator[index];
+}
+
 bool FrameStreamReader::close()
 {
+  _readAhead = nullptr;
+  _mappedFile = nullptr; // Frames still borrowing from the mapping keep it alive
+  
   if(_stream.is_open())
     _stream.close();
   
   return !_stream.fail();
 }
 
-// TODO: Handle config changes in between seek positions
 bool FrameStreamReader::seekTo(size_t position)
 {
-  if(position >= _dataPacketLocation.size())
+  if(position >= _dataPacketOffsets.size())
     return false;
   
+  _nextConfigEpoch = _applyConfigurationAt(*_decoder, position);
   _currentFrameIndex = position;
-  _currentPacketIndex = _dataPacketLocation[position];
   
   return true;
 }
+
+FrameStreamReader::~FrameStreamReader()
+{
+  _readAhead = nullptr; // Read-ahead workers use the reader
+}
   
-}
\ No newline at end of file
+}
@@ -10,6 +10,22 @@
 #include <Frame.h>
 #include <SerializedObject.h>
 
+/**
+ * Stream layout: FrameStreamHeader followed by packets, each with a FRAME_STREAM_PACKET_HEADER_SIZE byte header.
+ * 
+ * From version 0.2, the last packet is an index of data packet offsets and configuration epochs, which ends with
+ * FrameStreamIndexTrailer. It lets readers open the stream without scanning it. Padding packets are placed before 
+ * data packets so that raw frame data starts at a FRAME_STREAM_DATA_ALIGNMENT boundary in the file.
+ */
+#define FRAME_STREAM_VERSION_MAJOR 0
+#define FRAME_STREAM_VERSION_MINOR 2
+
+#define FRAME_STREAM_HEADER_SIZE (2 + 3*sizeof(GeneratorIDType))
+#define FRAME_STREAM_PACKET_HEADER_SIZE (5 + sizeof(uint8_t) + sizeof(uint32_t))
+#define FRAME_STREAM_DATA_ALIGNMENT 8
+
+#define FRAME_STREAM_INDEX_MAGIC "VXLINDEX"
+
 namespace Voxel
 {
   
@@ -23,6 +39,22 @@ struct VOXEL_EXPORT FrameStreamHeader
   GeneratorIDType generatorIDs[3]; // For raw (processed), depth and point cloud, in that order
 };
 
+// Generator configuration packet and the first data packet it applies to
+struct VOXEL_EXPORT FrameStreamConfigEpoch
+{
+  FileOffsetType offset;
+  uint32_t firstFrame;
+  uint8_t frameType;
+};
+
+// Last bytes of the index packet. Offsets are from the start of the stream
+struct VOXEL_EXPORT FrameStreamIndexTrailer
+{
+  FileOffsetType indexOffset; // of the index packet
+  uint32_t dataPacketCount, configPacketCount;
+  char magic[8]; // FRAME_STREAM_INDEX_MAGIC, not null terminated
+};
+
 struct VOXEL_EXPORT FrameStreamPacket
 {
   char magic[6]; // supposed to be VOXEL
@@ -30,7 +62,9 @@ struct VOXEL_EXPORT FrameStreamPacket
   enum PacketType
   {
     PACKET_DATA = 0,
-    PACKET_GENERATOR_CONFIG = 1
+    PACKET_GENERATOR_CONFIG = 1,
+    PACKET_INDEX = 2, // data packet offsets, then config epochs, then FrameStreamIndexTrailer
+    PACKET_PADDING = 3
   };
   
   uint8_t type; // PacketType
@@ -68,10 +102,16 @@ class VOXEL_EXPORT FrameStreamWriter
   
   size_t _frameCount;
   FrameStreamHeader _header;
-  FrameStreamPacket _rawpacket, _configPacket;
+  FrameStreamPacket _rawpacket, _configPacket, _paddingPacket;
   GeneratorConfigurationSubPacket _generatorConfigSubPacket;
   
+  FileOffsetType _offset; // of the next packet, from the start of the stream
+  Vector<FileOffsetType> _dataPacketOffsets;
+  Vector<FrameStreamConfigEpoch> _configEpochs;
+  
   bool _writeHeader();
+  bool _writePacket(FrameStreamPacket &packet);
+  bool _writeIndex();
   
   bool _init(GeneratorIDType processedRawFrameGeneratorID, GeneratorIDType depthFrameGeneratorID, GeneratorIDType pointCloudFrameGeneratorID);
   
@@ -87,6 +127,7 @@ public:
   bool writeGeneratorConfiguration(uint frameType);
   // Assumes the config sub-packet has been populated by using getConfigObject()
   
+  // Writes the index and closes the stream. A stream which is not closed can still be read, by scanning it
   bool close();
   
   virtual ~FrameStreamWriter() { close(); }
@@ -96,49 +137,140 @@ public:
 
 typedef Ptr<FrameStreamWriter> FrameStreamWriterPtr;
 
+// Read-only memory mapping of a whole file
+class VOXEL_EXPORT MappedFile
+{
+protected:
+  const uint8_t *_data;
+  SizeType _size;
+  
+#ifdef WINDOWS
+  void *_fileHandle, *_mappingHandle;
+#endif
+  
+public:
+  MappedFile(const String &fileName);
+  
+  inline bool isValid() const { return _data != nullptr; }
+  inline const uint8_t *data() const { return _data; }
+  inline SizeType size() const { return _size; }
+  
+  virtual ~MappedFile();
+};
+
+typedef Ptr<MappedFile> MappedFilePtr;
+
+/**
+ * \brief Reads frame streams (.vxl) of any version.
+ * 
+ * A stream opened by file name is memory mapped, and raw frames read from it refer to the mapping instead of
+ * copying it (see RawDataFrame::borrow()), unless zero copy is disabled or the frame data is not aligned. The mapping stays valid till such frames are
+ * released, even after the reader is closed. Streams with an index are opened without reading their packets, others
+ * are scanned once on open.
+ */
+class FrameStreamDecoder;
+class FrameStreamReadAhead;
+
 class VOXEL_EXPORT FrameStreamReader
 {
   InputFileStream &_stream;
   InputFileStream _internalStream;
+  Mutex _streamMutex; // _stream is shared with read-ahead workers
   
-  Vector<FileOffsetType> _allPacketOffsets;
+  MappedFilePtr _mappedFile; // Used instead of _stream when set
+  bool _zeroCopy;
+  bool _indexed; // Packet locations were read from the index of the stream
+  FileOffsetType _streamSize;
   
-  Vector<IndexType> _dataPacketLocation, _configPacketLocation;
+  Vector<FileOffsetType> _dataPacketOffsets;
+  Vector<FrameStreamConfigEpoch> _configEpochs;
   
   FrameStreamHeader _header;
   
-  size_t _currentPacketIndex; // index on _allPacketOffsets
-  size_t _currentFrameIndex; // index on _dataPacketLocation
+  size_t _currentFrameIndex; // index on _dataPacketOffsets
+  size_t _nextConfigEpoch; // index on _configEpochs, of the first epoch not applied while reading in sequence
   
-  CameraSystem &_sys;
+  uint32_t _frameTypes; // generated by readNext()
   
-  Ptr<FrameGenerator> _frameGenerator[3]; // for processed raw, depth and point cloud
+  CameraSystem &_sys;
   
-  FrameStreamPacket _dataPacket, _configPacket;
-  GeneratorConfigurationSubPacket _configSubPacket;
+  Ptr<FrameStreamDecoder> _decoder; // for reading in sequence. Its generators are the ones given by getFrameGenerator()
+  Ptr<FrameStreamReadAhead> _readAhead;
   
   bool _init();
   
-  bool _getPacket(size_t packetIndex, FrameStreamPacket &packet);
-  bool _readConfigPacket(size_t packetIndex);
+  bool _readBytes(FileOffsetType offset, char *bytes, SizeType size);
+  bool _readPacketHeader(FileOffsetType offset, FrameStreamPacket &packet);
+  bool _getPacket(FileOffsetType offset, FrameStreamPacket &packet);
+  
+  bool _readIndex();
+  bool _scanPackets();
+  
+  // Below can be called from read-ahead workers, each with its own decoder
+  bool _createDecoder(FrameStreamDecoder &decoder);
+  bool _readConfigPacket(FrameStreamDecoder &decoder, IndexType epoch);
+  IndexType _configEpochOf(size_t position); // last epoch recorded before the frame at 'position', -1 if none
+  size_t _applyConfigurationAt(FrameStreamDecoder &decoder, size_t position); // returns the number of epochs up to 'position'
+  bool _readRawFrame(FrameStreamDecoder &decoder, size_t position, RawDataFrame &rawFrame);
+  bool _generateFrames(FrameStreamDecoder &decoder, size_t position, Vector<FramePtr> &frames, uint32_t frameTypes);
+  bool _decode(FrameStreamDecoder &decoder, size_t position, Vector<FramePtr> &frames, uint32_t frameTypes);
+  
+  bool _readNextRawFrame(RawDataFrame &rawFrame);
+  
+  friend class FrameStreamReadAhead;
   
 public:
   FrameStreamReader(const String &fileName, CameraSystem &sys);
   FrameStreamReader(InputFileStream &stream, CameraSystem &sys);
   
-  inline bool isStreamGood() { return _stream.good(); }
+  inline bool isStreamGood() { return _mappedFile?_mappedFile->isValid():_stream.good(); }
+  
+  inline bool isMapped() const { return _mappedFile != nullptr; }
+  inline bool isIndexed() const { return _indexed; }
+  inline const FrameStreamHeader &getHeader() const { return _header; }
+  
+  // Raw frames borrow their data from the mapping instead of copying it to 'data', which is then empty. Consumers
+  // need to read raw frames with rawData() and rawDataSize(). Disabled by default. Applies only to memory mapped streams
+  inline void setZeroCopy(bool zeroCopy) { _zeroCopy = zeroCopy; }
+  inline bool isZeroCopy() const { return _zeroCopy; }
+  
+  Vector<FramePtr> frames; // DepthCamera::FRAME_TYPE_COUNT entries - raw (2 types), depth and point cloud (2 layouts) corresponding to currently read frame index
   
-  Vector<FramePtr> frames; // 4 entries - raw (2 types), depth and point cloud corresponding to currently read frame index
+  // Frame types generated by readNext(), as bits (1 << DepthCamera::FrameType). Types needed to generate these are 
+  // generated too, while the others are left empty in 'frames'. All types except FRAME_XYZI_POINT_CLOUD_SOA_FRAME by default
+  inline void setFrameTypes(uint32_t frameTypes) { _frameTypes = frameTypes; }
+  inline uint32_t getFrameTypes() const { return _frameTypes; }
+  
+  /**
+   * Read-ahead generates up to 'readAhead' frames after the one read by readNext() on 'threadCount' worker threads
+   * (0 => one per hardware thread), into a cache of the 'cacheSize' most recently used frames. Reading a cached 
+   * frame again, e.g., after seeking back to it, does not generate it again. 'readAhead' = 0 disables read-ahead
+   * and drops the cache.
+   * 
+   * With read-ahead, 'frames' are shared with the cache and should not be modified.
+   */
+  bool setReadAhead(SizeType readAhead, SizeType cacheSize = 32, SizeType threadCount = 0);
+  bool getCacheStatistics(uint64_t &hits, uint64_t &misses);
   
   bool readNext();
+  
+  // Reads the next frame into 'rawFrame' (as a RawDataFrame) without generating the other frame types.
+  // Configuration packets seen on the way are still applied to the frame generators.
+  bool readNextRaw(RawFramePtr &rawFrame);
+  
+  // Applies the latest configuration of each frame generator recorded before 'position', so that frames get 
+  // generated as they were recorded
   bool seekTo(size_t position);
   
+  // 0 -> processed raw, 1 -> depth, 2 -> point cloud. These are configured as per the stream being read
+  const Ptr<FrameGenerator> &getFrameGenerator(int index) const;
+  
   inline size_t currentPosition() { return _currentFrameIndex; }
-  inline size_t size() { return _dataPacketLocation.size(); }
+  inline size_t size() { return _dataPacketOffsets.size(); }
   
   bool close();
   
-  virtual ~FrameStreamReader() {}
+  virtual ~FrameStreamReader();
 };
 
 typedef Ptr<FrameStreamReader> FrameStreamReaderPtr;
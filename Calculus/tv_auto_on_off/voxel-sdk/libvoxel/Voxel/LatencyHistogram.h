@@ -0,0 +1,137 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#ifndef VOXEL_LATENCY_HISTOGRAM_H
+#define VOXEL_LATENCY_HISTOGRAM_H
+
+#include "Common.h"
+
+#include <atomic>
+#include <algorithm>
+
+#define LATENCY_HISTOGRAM_BUCKET_COUNT 32
+
+namespace Voxel
+{
+
+/**
+ * \addtogroup Util
+ * @{
+ */
+
+// Snapshot of a LatencyHistogram. All times are in micro-seconds
+struct LatencyStatistics
+{
+  String name;
+
+  uint64_t count = 0;
+  TimeStampType total = 0, max = 0;
+  TimeStampType p50 = 0, p90 = 0, p99 = 0; // upper bounds of the buckets holding these percentiles
+
+  inline TimeStampType average() const { return count?(total/count):0; }
+};
+
+/**
+ * \brief Lock-free histogram of latencies with power-of-two buckets.
+ *
+ * Bucket 0 holds latencies below 1us and bucket 'b' holds [2^(b - 1), 2^b) us. The last
+ * bucket also holds everything above. record() can be called concurrently with snapshot() and from
+ * multiple threads.
+ */
+class LatencyHistogram
+{
+protected:
+  Atomic<uint64_t> _buckets[LATENCY_HISTOGRAM_BUCKET_COUNT];
+  Atomic<uint64_t> _count;
+  Atomic<TimeStampType> _total, _max;
+
+  static inline int _bucketOf(TimeStampType latency)
+  {
+    int b = 0;
+
+    while(latency && b < LATENCY_HISTOGRAM_BUCKET_COUNT - 1)
+    {
+      latency >>= 1;
+      b++;
+    }
+    return b;
+  }
+
+  inline TimeStampType _percentile(const uint64_t *buckets, uint64_t count, TimeStampType max, float fraction) const
+  {
+    uint64_t rank = (uint64_t)(count*fraction + 0.5f), seen = 0;
+
+    if(rank < 1)
+      rank = 1;
+
+    for(auto b = 0; b < LATENCY_HISTOGRAM_BUCKET_COUNT; b++)
+    {
+      seen += buckets[b];
+
+      if(seen >= rank)
+        return std::min<TimeStampType>(((TimeStampType)1 << b), max);
+    }
+    return max;
+  }
+
+public:
+  LatencyHistogram() { reset(); }
+
+  inline void record(TimeStampType latency)
+  {
+    _buckets[_bucketOf(latency)].fetch_add(1, std::memory_order_relaxed);
+    _count.fetch_add(1, std::memory_order_relaxed);
+    _total.fetch_add(latency, std::memory_order_relaxed);
+
+    TimeStampType m = _max.load(std::memory_order_relaxed);
+
+    while(latency > m && !_max.compare_exchange_weak(m, latency, std::memory_order_relaxed));
+  }
+
+  inline uint64_t count() const { return _count.load(std::memory_order_relaxed); }
+
+  void reset()
+  {
+    for(auto b = 0; b < LATENCY_HISTOGRAM_BUCKET_COUNT; b++)
+      _buckets[b] = 0;
+
+    _count = 0;
+    _total = _max = 0;
+  }
+
+  // Values are read without stopping writers, so a snapshot taken while recording may be off by the frames in flight
+  void snapshot(LatencyStatistics &s) const
+  {
+    uint64_t buckets[LATENCY_HISTOGRAM_BUCKET_COUNT], count = 0;
+
+    for(auto b = 0; b < LATENCY_HISTOGRAM_BUCKET_COUNT; b++)
+      count += (buckets[b] = _buckets[b].load(std::memory_order_relaxed));
+
+    s.count = count;
+    s.total = _total.load(std::memory_order_relaxed);
+    s.max = _max.load(std::memory_order_relaxed);
+
+    if(!count)
+    {
+      s.p50 = s.p90 = s.p99 = 0;
+      return;
+    }
+
+    s.p50 = _percentile(buckets, count, s.max, 0.50f);
+    s.p90 = _percentile(buckets, count, s.max, 0.90f);
+    s.p99 = _percentile(buckets, count, s.max, 0.99f);
+  }
+};
+
+typedef Ptr<LatencyHistogram> LatencyHistogramPtr;
+
+/**
+ * @}
+ */
+
+}
+
+#endif // VOXEL_LATENCY_HISTOGRAM_H
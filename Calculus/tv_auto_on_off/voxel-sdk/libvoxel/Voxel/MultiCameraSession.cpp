@@ -0,0 +1,283 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#include "MultiCameraSession.h"
+#include "Logger.h"
+
+namespace Voxel
+{
+
+MultiCameraSession::MultiCameraSession(const Vector<DepthCameraPtr> &cameras, SizeType threadCount):
+_cameras(cameras), _threadPool(new ThreadPool(threadCount)), _pending(cameras.size()), _statistics(cameras.size())
+{
+}
+
+bool MultiCameraSession::registerCallback(DepthCamera::FrameType type, CallbackType f)
+{
+  if(_running)
+  {
+    logger(LOG_ERROR) << "MultiCameraSession: Please stop the session before registering a callback" << std::endl;
+    return false;
+  }
+
+  if(type < 0 || type >= DepthCamera::FRAME_TYPE_COUNT)
+  {
+    logger(LOG_ERROR) << "MultiCameraSession: Invalid frame type " << type << std::endl;
+    return false;
+  }
+
+  _frameType = type;
+  _callback = f;
+  return true;
+}
+
+bool MultiCameraSession::setSyncTolerance(TimeStampType tolerance)
+{
+  if(_running)
+  {
+    logger(LOG_ERROR) << "MultiCameraSession: Please stop the session before changing sync tolerance" << std::endl;
+    return false;
+  }
+
+  _syncTolerance = tolerance;
+  return true;
+}
+
+bool MultiCameraSession::setQueueDepth(SizeType queueDepth, DepthCamera::PipelineDropPolicy dropPolicy)
+{
+  if(_running)
+  {
+    logger(LOG_ERROR) << "MultiCameraSession: Please stop the session before changing queue depth" << std::endl;
+    return false;
+  }
+
+  if(queueDepth < 1)
+  {
+    logger(LOG_ERROR) << "MultiCameraSession: Queue depth needs to be atleast 1" << std::endl;
+    return false;
+  }
+
+  _queueDepth = queueDepth;
+  _dropPolicy = dropPolicy;
+  return true;
+}
+
+bool MultiCameraSession::setMaxPendingFrames(SizeType count)
+{
+  if(_running)
+  {
+    logger(LOG_ERROR) << "MultiCameraSession: Please stop the session before changing pending frame limit" << std::endl;
+    return false;
+  }
+
+  if(count < 1)
+  {
+    logger(LOG_ERROR) << "MultiCameraSession: Pending frame limit needs to be atleast 1" << std::endl;
+    return false;
+  }
+
+  _maxPendingFrames = count;
+  return true;
+}
+
+void MultiCameraSession::_onFrame(IndexType camera, const ConstFramePtr &frame)
+{
+  Lock<Mutex> _(_mutex);
+
+  MultiCameraStatistics &s = _statistics[camera];
+  std::deque<ConstFramePtr> &pending = _pending[camera];
+
+  s.framesReceived++;
+
+  if(pending.size() >= _maxPendingFrames)
+  {
+    pending.pop_front();
+    s.framesOverflowed++;
+  }
+
+  pending.push_back(frame); // Its buffer stays with the session till the frame set is delivered or dropped
+
+  _align();
+
+  if(_delivering)
+  {
+    // The delivering thread picks up sets made ready here. Wait for it when it falls behind, for back-pressure
+    _delivered.wait(_, [this]() { return _ready.size() < _maxPendingFrames || !_delivering; });
+    return;
+  }
+
+  _delivering = true;
+
+  while(!_ready.empty())
+  {
+    MultiCameraFrameSet frameSet = std::move(_ready.front());
+    _ready.pop_front();
+
+    _.unlock();
+    _delivered.notify_all();
+
+    if(_callback)
+      _callback(*this, frameSet);
+
+    _.lock();
+  }
+
+  _delivering = false;
+  _delivered.notify_all();
+}
+
+void MultiCameraSession::_align()
+{
+  while(true)
+  {
+    IndexType earliest = 0;
+    TimeStampType minTimeStamp = 0, maxTimeStamp = 0;
+
+    for(auto i = 0; i < _pending.size(); i++)
+    {
+      if(_pending[i].empty())
+        return;
+
+      TimeStampType t = _pending[i].front()->timestamp;
+
+      if(i == 0 || t < minTimeStamp)
+      {
+        minTimeStamp = t;
+        earliest = i;
+      }
+
+      if(i == 0 || t > maxTimeStamp)
+        maxTimeStamp = t;
+    }
+
+    if(maxTimeStamp - minTimeStamp > _syncTolerance)
+    {
+      // Earliest frame cannot be matched by any later frame of the camera which is ahead
+      _pending[earliest].pop_front();
+      _statistics[earliest].framesUnmatched++;
+      continue;
+    }
+
+    MultiCameraFrameSet frameSet;
+    frameSet.timestamp = minTimeStamp;
+    frameSet.frames.reserve(_pending.size());
+
+    for(auto &p: _pending)
+    {
+      frameSet.frames.push_back(p.front());
+      p.pop_front();
+    }
+
+    _frameSetCount++;
+    _ready.push_back(std::move(frameSet));
+  }
+}
+
+bool MultiCameraSession::start()
+{
+  if(_running)
+    return true;
+
+  if(_cameras.empty())
+  {
+    logger(LOG_ERROR) << "MultiCameraSession: No cameras to start" << std::endl;
+    return false;
+  }
+
+  {
+    Lock<Mutex> _(_mutex);
+
+    for(auto &p: _pending)
+      p.clear();
+
+    _ready.clear();
+  }
+
+  for(auto i = 0; i < _cameras.size(); i++)
+  {
+    DepthCameraPtr &camera = _cameras[i];
+
+    if(!camera->setPipelineMode(true, _queueDepth, _dropPolicy) || !camera->setPipelineThreadPool(_threadPool) ||
+      !camera->clearAllCallbacks() ||
+      !camera->registerSharedCallback(_frameType, [this, i](DepthCamera &dc, const ConstFramePtr &frame, DepthCamera::FrameType type) {
+        _onFrame(i, frame);
+      }) || !camera->start())
+    {
+      logger(LOG_ERROR) << "MultiCameraSession: Could not start camera " << camera->id() << std::endl;
+      _stopCameras(i + 1);
+      return false;
+    }
+  }
+
+  _running = true;
+  return true;
+}
+
+void MultiCameraSession::_stopCameras(SizeType count)
+{
+  for(auto i = 0; i < count; i++)
+  {
+    if(_cameras[i]->isRunning())
+      _cameras[i]->stop();
+    
+    _cameras[i]->clearAllCallbacks();
+    _cameras[i]->setPipelineThreadPool(nullptr);
+    _cameras[i]->setPipelineMode(false);
+  }
+}
+
+bool MultiCameraSession::stop()
+{
+  if(!_running)
+    return true;
+
+  _stopCameras(_cameras.size());
+  _running = false;
+
+  Lock<Mutex> _(_mutex);
+
+  for(auto &p: _pending)
+    p.clear();
+
+  _ready.clear();
+  return true;
+}
+
+void MultiCameraSession::wait()
+{
+  for(auto &c: _cameras)
+    c->wait();
+}
+
+bool MultiCameraSession::getStatistics(Vector<MultiCameraStatistics> &statistics)
+{
+  Lock<Mutex> _(_mutex);
+  statistics = _statistics;
+  return true;
+}
+
+uint64_t MultiCameraSession::getFrameSetCount()
+{
+  Lock<Mutex> _(_mutex);
+  return _frameSetCount;
+}
+
+void MultiCameraSession::resetStatistics()
+{
+  Lock<Mutex> _(_mutex);
+
+  for(auto &s: _statistics)
+    s = MultiCameraStatistics();
+
+  _frameSetCount = 0;
+}
+
+MultiCameraSession::~MultiCameraSession()
+{
+  stop();
+}
+
+}
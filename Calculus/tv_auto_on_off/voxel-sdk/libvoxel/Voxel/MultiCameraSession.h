@@ -0,0 +1,129 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#ifndef VOXEL_MULTICAMERA_SESSION_H
+#define VOXEL_MULTICAMERA_SESSION_H
+
+#include "DepthCamera.h"
+#include "ThreadPool.h"
+
+#include <deque>
+
+namespace Voxel
+{
+
+/**
+ * \addtogroup CamSys
+ * @{
+ */
+
+// Frames of all cameras of a session, one per camera in the order the cameras were given to the session. Frames are
+// shared with the cameras without copying, and hold on to the camera's frame buffers while kept
+struct MultiCameraFrameSet
+{
+  TimeStampType timestamp = 0; // of the earliest frame in the set
+  Vector<ConstFramePtr> frames;
+};
+
+struct MultiCameraStatistics
+{
+  uint64_t framesReceived = 0; // frames delivered by the camera to the session
+  uint64_t framesUnmatched = 0; // frames discarded as no frame of the other cameras was close enough in time
+  uint64_t framesOverflowed = 0; // frames discarded as the camera was too far ahead of the others
+};
+
+/**
+ * \brief Runs many cameras together, with their processing on one shared thread pool, and delivers time-aligned frame sets.
+ *
+ * Each camera keeps its capture thread, as capture blocks on I/O, while the stages after capture of all cameras run
+ * as tasks on a work-stealing ThreadPool sized to the machine. Frames of the registered type are held per camera until
+ * every camera has one within the sync tolerance of each other and are then given to the callback as a frame set.
+ *
+ * Backpressure is per camera: frames waiting for the pool are bounded by the pipeline queue depth and drop policy of
+ * the camera, and frames waiting for alignment by the pending frame limit. Frame timestamps of all cameras need to be
+ * on the same clock for alignment to be meaningful.
+ */
+class VOXEL_EXPORT MultiCameraSession
+{
+public:
+  typedef Function<void (MultiCameraSession &session, const MultiCameraFrameSet &frameSet)> CallbackType;
+
+protected:
+  Vector<DepthCameraPtr> _cameras;
+  ThreadPoolPtr _threadPool;
+
+  DepthCamera::FrameType _frameType = DepthCamera::FRAME_DEPTH_FRAME;
+  CallbackType _callback;
+
+  TimeStampType _syncTolerance = 5000; // in micro-seconds
+  SizeType _queueDepth = 2;
+  DepthCamera::PipelineDropPolicy _dropPolicy = DepthCamera::PIPELINE_DROP_NEWEST;
+  SizeType _maxPendingFrames = 4;
+
+  bool _running = false;
+
+  Mutex _mutex;
+  Vector<std::deque<ConstFramePtr>> _pending;
+  Vector<MultiCameraStatistics> _statistics;
+  uint64_t _frameSetCount = 0;
+
+  // Frame sets waiting for the callback. One thread at a time delivers them, without holding _mutex
+  std::deque<MultiCameraFrameSet> _ready;
+  bool _delivering = false;
+  ConditionVariable _delivered;
+
+  void _onFrame(IndexType camera, const ConstFramePtr &frame);
+  void _align(); // called with _mutex locked
+  void _stopCameras(SizeType count);
+
+public:
+  // 'threadCount' = 0 => one thread per hardware thread
+  MultiCameraSession(const Vector<DepthCameraPtr> &cameras, SizeType threadCount = 0);
+
+  inline const Vector<DepthCameraPtr> &getCameras() const { return _cameras; }
+  inline const ThreadPoolPtr &getThreadPool() const { return _threadPool; }
+
+  // Settings below can be changed only while the session is not running
+
+  // The callback is called from the pool's threads, one frame set at a time and in order. It may get statistics of the
+  // session, but should not stop it. Threads with frames for the session wait while the callback falls
+  // 'max pending frames' sets behind
+  bool registerCallback(DepthCamera::FrameType type, CallbackType f);
+
+  // Maximum difference between timestamps of frames in a set, in micro-seconds
+  bool setSyncTolerance(TimeStampType tolerance);
+  inline TimeStampType getSyncTolerance() const { return _syncTolerance; }
+
+  // Frames per camera waiting for the thread pool, and what to do when a camera gets ahead of the pool
+  bool setQueueDepth(SizeType queueDepth, DepthCamera::PipelineDropPolicy dropPolicy = DepthCamera::PIPELINE_DROP_NEWEST);
+
+  // Frames per camera waiting for the other cameras. The oldest is dropped when exceeded
+  bool setMaxPendingFrames(SizeType count);
+
+  bool start();
+  bool stop();
+
+  // Waits till all cameras stop on their own, e.g., at the end of recorded streams
+  void wait();
+
+  inline bool isRunning() const { return _running; }
+
+  bool getStatistics(Vector<MultiCameraStatistics> &statistics);
+  uint64_t getFrameSetCount();
+  void resetStatistics();
+
+  virtual ~MultiCameraSession();
+};
+
+typedef Ptr<MultiCameraSession> MultiCameraSessionPtr;
+
+/**
+ * @}
+ */
+
+}
+
+#endif // VOXEL_MULTICAMERA_SESSION_H
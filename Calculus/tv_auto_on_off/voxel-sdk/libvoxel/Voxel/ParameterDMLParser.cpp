@@ -7,12 +7,134 @@
 #include "ParameterDMLParser.h"
 
 
+#include <string.h>
+
+#define PARAMETER_DML_CACHE_MAGIC "VXDC"
+#define PARAMETER_DML_CACHE_VERSION 1
+
 namespace Voxel
 {
+
+namespace
+{
+
+struct CacheWriter
+{
+  Vector<char> buffer;
+  
+  inline void write(const void *data, SizeType size)
+  {
+    buffer.insert(buffer.end(), (const char *)data, (const char *)data + size);
+  }
+  
+  template <typename T>
+  inline void write(const T &value) { write(&value, sizeof(T)); }
+  
+  inline void write(const String &s)
+  {
+    write((uint32_t)s.size());
+    write(s.data(), s.size());
+  }
+  
+  template <typename T>
+  inline void write(const Vector<T> &v)
+  {
+    write((uint32_t)v.size());
+    
+    for(auto &x: v)
+      write(x);
+  }
+};
+
+// Reads from a buffer, failing on reads beyond its end
+class CacheReader
+{
+  const Vector<char> &_buffer;
+  SizeType _position = 0;
+  
+public:
+  CacheReader(const Vector<char> &buffer): _buffer(buffer) {}
   
+  inline SizeType position() const { return _position; }
+  
+  inline bool read(void *data, SizeType size)
+  {
+    if(size > _buffer.size() - _position)
+      return false;
+    
+    memcpy(data, _buffer.data() + _position, size);
+    _position += size;
+    return true;
+  }
+  
+  template <typename T>
+  inline bool read(T &value) { return read(&value, sizeof(T)); }
+  
+  inline bool read(String &s)
+  {
+    uint32_t size;
+    
+    if(!read(size) || size > _buffer.size() - _position)
+      return false;
+    
+    s.assign(_buffer.data() + _position, size);
+    _position += size;
+    return true;
+  }
+  
+  template <typename T>
+  inline bool read(Vector<T> &v)
+  {
+    uint32_t size;
+    
+    if(!read(size) || size > _buffer.size() - _position)
+      return false;
+    
+    v.resize(size);
+    
+    for(auto &x: v)
+      if(!read(x))
+        return false;
+    return true;
+  }
+};
+
+}
+  
+bool ParameterDMLParser::_cacheEnabled = true;
+
 ParameterDMLParser::ParameterDMLParser(RegisterProgrammer &registerProgrammer, const String &xmlFileName): _initialized(false), _xmlFileName(xmlFileName), _registerProgrammer(registerProgrammer)
 {
-  _doc.LoadFile(xmlFileName.c_str());
+  InputFileStream f(xmlFileName, std::ios::binary | std::ios::in | std::ios::ate);
+  
+  Vector<char> xml;
+  
+  if(f.good())
+  {
+    xml.resize(f.tellg());
+    f.seekg(0, std::ios::beg);
+    
+    if(xml.size() && !f.read(xml.data(), xml.size()).good())
+      xml.clear();
+  }
+  
+  if(!xml.size())
+  {
+    logger(LOG_ERROR) << "ParameterDMLParser: Could not read the XML file '" << xmlFileName.c_str() << "'" << std::endl;
+    return;
+  }
+  
+  _xmlFileSize = xml.size();
+  _xmlFileChecksum = fnv1a64(xml.data(), xml.size());
+  
+  if(_cacheEnabled && _readCache(xmlFileName + PARAMETER_DML_CACHE_SUFFIX))
+  {
+    logger(LOG_DEBUG) << "ParameterDMLParser: Read parameters of '" << xmlFileName << "' from cache" << std::endl;
+    _initialized = _parsed = _fromCache = true;
+    return;
+  }
+  
+  _doc.Parse(xml.data(), xml.size());
   
   if(_doc.Error())
   {
@@ -75,7 +197,7 @@ TinyXML2::XMLElement *ParameterDMLParser::_goTo(TinyXML2::XMLElement *current, c
   return x;
 }
 
-ParameterPtr ParameterDMLParser::_getParameter(TinyXML2::XMLElement *property, String &id, bool &skipIfNull)
+bool ParameterDMLParser::_getParameter(TinyXML2::XMLElement *property, String &id, bool &skipIfNull, _ParameterDescription &parameter)
 {
   TinyXML2::XMLElement *range, *value;
   
@@ -86,7 +208,7 @@ ParameterPtr ParameterDMLParser::_getParameter(TinyXML2::XMLElement *property, S
   if(!(s = property->Attribute("id")))
   {
     logger(LOG_ERROR) << "Found a 'property' with no 'id'. " << property->GetText() << std::endl;
-    return 0;
+    return false;
   }
   
   id = s;
@@ -103,7 +225,7 @@ ParameterPtr ParameterDMLParser::_getParameter(TinyXML2::XMLElement *property, S
     if(bitCount != 0)
       logger(LOG_ERROR) << "ParameterDMLParser: Could not get 'range' for parameter with id = '" << id << "' with bitCount = " << bitCount << std::endl;
     skipIfNull = true;
-    return 0; // No range => no valid parameter
+    return false; // No range => no valid parameter
   }
   
   uint address = range->UnsignedAttribute("address"),
@@ -114,7 +236,7 @@ ParameterPtr ParameterDMLParser::_getParameter(TinyXML2::XMLElement *property, S
   if(address >= 256)
   {
     logger(LOG_ERROR) << "ParameterDMLParser: Address value = '" << address << "' which is beyond 256 for parameter with id = '" << id << "'" << std::endl;
-    return 0;
+    return false;
   }
   
   address = (bankId << 8) + address;
@@ -122,7 +244,7 @@ ParameterPtr ParameterDMLParser::_getParameter(TinyXML2::XMLElement *property, S
   if(msb < lsb)
   {
     logger(LOG_ERROR) << "ParameterDMLParser: Found a parameter with id ='" << id << "' which has msb (" << msb << ") < lsb(" << lsb << ")" << std::endl;
-    return 0;
+    return false;
   }
   
   bool strobe = property->BoolAttribute("strobe"),
@@ -140,25 +262,38 @@ ParameterPtr ParameterDMLParser::_getParameter(TinyXML2::XMLElement *property, S
   if((s = property->Attribute("desc")))
     description = s;
   
+  parameter.ioType = ioType;
+  parameter.address = address;
+  parameter.msb = msb;
+  parameter.lsb = lsb;
+  parameter.min = min;
+  parameter.max = max;
+  parameter.units = units;
+  parameter.description = description;
+  parameter.values.clear();
+  parameter.valueMeaning.clear();
+  parameter.valueDescription.clear();
+  
   if(!(value = _goTo(property, { "valueList", "value" }, false))) // No value list present? => not enum
   {
     if(bitCount == 1) // This boolean does not have value descriptions :(
     {
       logger(LOG_DEBUG) << "ParameterDMLParser: Found a boolean parameter with id = '" << id << "' which does not have valueList" << std::endl;
       
-      bool defaultValue = property->BoolAttribute("default");
+      parameter.defaultValue = property->BoolAttribute("default");
+      parameter.valueMeaning = parameter.valueDescription = {"", ""};
       
       if(!strobe)
       {
         logger(LOG_DEBUG) << "ParameterDMLParser: Adding boolean parameter with id = '" << id << "'" << std::endl;
-        return ParameterPtr(new BoolParameter(_registerProgrammer, "", address, _wordLength, lsb, {"", ""}, {"", ""}, defaultValue, "", description,
-                                            ioType));
+        parameter.type = _ParameterDescription::BOOL;
+        return true;
       }
       else
       {
         logger(LOG_DEBUG) << "ParameterDMLParser: Adding strobe (boolean) parameter with id = '" << id << "'" << std::endl;
-        return ParameterPtr(new StrobeBoolParameter(_registerProgrammer, "", address, _wordLength, lsb, {"", ""}, {"", ""}, defaultValue, "", description,
-                                            ioType));
+        parameter.type = _ParameterDescription::STROBE_BOOL;
+        return true;
       }
     }
     else if(bitCount > 1)
@@ -171,42 +306,42 @@ ParameterPtr ParameterDMLParser::_getParameter(TinyXML2::XMLElement *property, S
         if((int)max < (int)min)
         {
           logger(LOG_ERROR) << "ParameterDMLParser: Found a parameter with id ='" << id << "' which has max (" << max << ") < min(" << min << ")" << std::endl;
-          return 0;
+          return false;
         }
         
         logger(LOG_DEBUG) << "ParameterDMLParser: Adding int parameter with id = '" << id << "'" << std::endl;
-        int defaultValue = property->IntAttribute("default");
-        return ParameterPtr(new IntegerParameter(_registerProgrammer, "", units, address, _wordLength, msb, lsb, min, max, defaultValue, "", description,
-                                              ioType));
+        parameter.type = _ParameterDescription::INTEGER;
+        parameter.defaultValue = (uint32_t)property->IntAttribute("default");
+        return true;
       }
       else
       {
         if(max < min)
         {
           logger(LOG_ERROR) << "ParameterDMLParser: Found a parameter with id ='" << id << "' which has max (" << max << ") < min(" << min << ")" << std::endl;
-          return 0;
+          return false;
         }
         
         logger(LOG_DEBUG) << "ParameterDMLParser: Adding unsigned int parameter with id = '" << id << "'" << std::endl;
-        uint defaultValue = property->UnsignedAttribute("default");
-        return ParameterPtr(new UnsignedIntegerParameter(_registerProgrammer, "", units, address, _wordLength, msb, lsb, min, max, defaultValue, "", description,
-                                                 ioType));
+        parameter.type = _ParameterDescription::UNSIGNED_INTEGER;
+        parameter.defaultValue = property->UnsignedAttribute("default");
+        return true;
       }
     }
     else //bitCount == 0
     {
       logger(LOG_WARNING) << "ParameterDMLParser: Found a parameter with id ='" << id << "' which has bitCount = 0." << std::endl;
       skipIfNull = true;
-      return 0;
+      return false;
     }
   }
   else // value list is present => enum
   {
     if(bitCount == 1) // boolean
     {
-      bool defaultValue = property->BoolAttribute("default");
+      parameter.defaultValue = property->BoolAttribute("default");
       
-      Vector<String> valueMeaning, valueDescription;
+      Vector<String> &valueMeaning = parameter.valueMeaning, &valueDescription = parameter.valueDescription;
       
       valueMeaning.resize(2);
       valueDescription.resize(2);
@@ -231,21 +366,21 @@ ParameterPtr ParameterDMLParser::_getParameter(TinyXML2::XMLElement *property, S
         else
         {
           logger(LOG_ERROR) << "ParameterDMLParser: Found a boolean parameter with id = '" << id << "' which has possible value as '" << v << "'" << std::endl;
-          return 0;
+          return false;
         }
       }
       
       if(!strobe)
       {
         logger(LOG_DEBUG) << "ParameterDMLParser: Adding boolean parameter with id = '" << id << "'" << std::endl;
-        return ParameterPtr(new BoolParameter(_registerProgrammer, "", address, _wordLength, lsb, valueDescription, valueMeaning, defaultValue, "", description,
-                                              ioType));
+        parameter.type = _ParameterDescription::BOOL;
+        return true;
       }
       else
       {
         logger(LOG_DEBUG) << "ParameterDMLParser: Adding strobe (boolean) parameter with id = '" << id << "'" << std::endl;
-        return ParameterPtr(new StrobeBoolParameter(_registerProgrammer, "", address, _wordLength, lsb, valueDescription, valueMeaning, defaultValue, "", description,
-                                              ioType));
+        parameter.type = _ParameterDescription::STROBE_BOOL;
+        return true;
       }
     }
     else if(bitCount > 1)
@@ -253,8 +388,8 @@ ParameterPtr ParameterDMLParser::_getParameter(TinyXML2::XMLElement *property, S
       if(strobe)
         logger(LOG_WARNING) << "ParameterDMLParser: Found a non-boolean parameter with id ='" << id << "' marked as strobe. Ignoring 'strobe' for this." << std::endl;
       
-      Vector<String> valueMeaning, valueDescription;
-      Vector<int> values;
+      Vector<String> &valueMeaning = parameter.valueMeaning, &valueDescription = parameter.valueDescription;
+      Vector<int> &values = parameter.values;
       
       for(; value; value = value->NextSiblingElement())
       {
@@ -273,45 +408,47 @@ ParameterPtr ParameterDMLParser::_getParameter(TinyXML2::XMLElement *property, S
       
       logger(LOG_DEBUG) << "ParameterDMLParser: Adding enum parameter with id = '" << id << "'" << std::endl;
       
-      int defaultValue = property->IntAttribute("default");
-      return ParameterPtr(new EnumParameter(_registerProgrammer, "", address, _wordLength, msb, lsb, values, valueDescription, valueMeaning, defaultValue, "", description,
-                                            ioType));
+      parameter.type = _ParameterDescription::ENUM;
+      parameter.defaultValue = (uint32_t)property->IntAttribute("default");
+      return true;
     }
     else //bitCount == 0
     {
       logger(LOG_ERROR) << "ParameterDMLParser: Found a parameter with id ='" << id << "' which has bitCount = 0 but has value list." << std::endl;
-      return 0;
+      return false;
     }
   }
 }
 
 
 
-bool ParameterDMLParser::getParameters(Vector<ParameterPtr> &parameters)
+bool ParameterDMLParser::_parse()
 {
-  if(!isInitialized())
-    return false;
-  
   if(!_prepare())
     return false;
   
-  Map<String, ParameterPtr> paramMap; // id -> paramter
+  Map<String, uint32_t> paramMap; // id -> index in _descriptions
   
   String id;
   
   TinyXML2::XMLElement *x = _propertyList->FirstChildElement("property");
   
-  ParameterPtr p;
+  _ParameterDescription p;
   
   bool skipIfNull = false;
   
+  _descriptions.clear();
+  _entries.clear();
+  
   for(; x; x = x->NextSiblingElement())
   {
-    if(!(p = _getParameter(x, id, skipIfNull)) && !skipIfNull)
+    if(!_getParameter(x, id, skipIfNull, p))
+    {
+      if(skipIfNull)
+        continue;
+      
       return false;
-    
-    if(!p)
-      continue;
+    }
     
     if(paramMap.find(id) != paramMap.end())
     {
@@ -319,7 +456,8 @@ bool ParameterDMLParser::getParameters(Vector<ParameterPtr> &parameters)
       return false;
     }
     
-    paramMap[id] = p;
+    paramMap[id] = _descriptions.size();
+    _descriptions.push_back(p);
   }
   
   logger(LOG_DEBUG) << "ParameterDMLParser: Total number of valid parameters = " << paramMap.size() << std::endl;
@@ -362,10 +500,7 @@ bool ParameterDMLParser::getParameters(Vector<ParameterPtr> &parameters)
         auto p = paramMap.find(id);
         
         if(p != paramMap.end())
-        {
-          p->second->setName(name);
-          parameters.push_back(p->second);
-        }
+          _entries.push_back({name, p->second});
         else if(name != "...")
         {
           logger(LOG_ERROR) << "ParameterDMLParser: Could not find a parameter with id = " << id << ", in " << section->Attribute("name") << "." << group->Attribute("name") << std::endl;
@@ -375,10 +510,182 @@ bool ParameterDMLParser::getParameters(Vector<ParameterPtr> &parameters)
     }
   }
   
-  logger(LOG_DEBUG) << "ParameterDMLParser: Total number of valid parameters = " << parameters.size() << std::endl;
+  logger(LOG_DEBUG) << "ParameterDMLParser: Total number of valid parameters = " << _entries.size() << std::endl;
+  
+  return true;
+}
+
+ParameterPtr ParameterDMLParser::_makeParameter(const _ParameterDescription &d)
+{
+  Parameter::IOType ioType = (Parameter::IOType)d.ioType;
+  
+  switch(d.type)
+  {
+    case _ParameterDescription::BOOL:
+      return ParameterPtr(new BoolParameter(_registerProgrammer, "", d.address, _wordLength, d.lsb, d.valueDescription, d.valueMeaning, 
+                                            d.defaultValue?true:false, "", d.description, ioType));
+    
+    case _ParameterDescription::STROBE_BOOL:
+      return ParameterPtr(new StrobeBoolParameter(_registerProgrammer, "", d.address, _wordLength, d.lsb, d.valueDescription, d.valueMeaning, 
+                                                  d.defaultValue?true:false, "", d.description, ioType));
+    
+    case _ParameterDescription::INTEGER:
+      return ParameterPtr(new IntegerParameter(_registerProgrammer, "", d.units, d.address, _wordLength, d.msb, d.lsb, (int)d.min, (int)d.max, 
+                                               (int)d.defaultValue, "", d.description, ioType));
+      
+    case _ParameterDescription::UNSIGNED_INTEGER:
+      return ParameterPtr(new UnsignedIntegerParameter(_registerProgrammer, "", d.units, d.address, _wordLength, d.msb, d.lsb, d.min, d.max, 
+                                                       d.defaultValue, "", d.description, ioType));
+      
+    case _ParameterDescription::ENUM:
+      return ParameterPtr(new EnumParameter(_registerProgrammer, "", d.address, _wordLength, d.msb, d.lsb, d.values, d.valueDescription, d.valueMeaning, 
+                                            (int)d.defaultValue, "", d.description, ioType));
+      
+    default:
+      return nullptr;
+  }
+}
+
+bool ParameterDMLParser::_readCache(const String &cacheFileName)
+{
+  InputFileStream f(cacheFileName, std::ios::binary | std::ios::in | std::ios::ate);
+  
+  if(!f.good())
+    return false;
+  
+  Vector<char> buffer(f.tellg());
+  f.seekg(0, std::ios::beg);
+  
+  if(!buffer.size() || !f.read(buffer.data(), buffer.size()).good())
+    return false;
+  
+  CacheReader r(buffer);
+  
+  char magic[4];
+  uint32_t version, count;
+  uint64_t xmlFileSize, xmlFileChecksum, checksum;
+  
+  if(!r.read(magic, sizeof(magic)) || memcmp(magic, PARAMETER_DML_CACHE_MAGIC, sizeof(magic)) != 0 ||
+    !r.read(version) || version != PARAMETER_DML_CACHE_VERSION ||
+    !r.read(xmlFileSize) || !r.read(xmlFileChecksum) || xmlFileSize != _xmlFileSize || xmlFileChecksum != _xmlFileChecksum ||
+    !r.read(checksum) || checksum != fnv1a64(buffer.data() + r.position(), buffer.size() - r.position()))
+    return false;
+  
+  Vector<_ParameterDescription> descriptions;
+  Vector<_Entry> entries;
+  uint8_t wordLength;
+  
+  if(!r.read(wordLength) || !r.read(count) || count > buffer.size())
+    return false;
+  
+  descriptions.resize(count);
+  
+  for(auto &d: descriptions)
+  {
+    if(!r.read(d.type) || !r.read(d.ioType) || !r.read(d.address) || !r.read(d.msb) || !r.read(d.lsb) ||
+      !r.read(d.min) || !r.read(d.max) || !r.read(d.defaultValue) || !r.read(d.units) || !r.read(d.description) ||
+      !r.read(d.values) || !r.read(d.valueMeaning) || !r.read(d.valueDescription))
+      return false;
+    
+    if(d.type > _ParameterDescription::ENUM)
+      return false;
+  }
+  
+  if(!r.read(count) || count > buffer.size())
+    return false;
+  
+  entries.resize(count);
+  
+  for(auto &e: entries)
+    if(!r.read(e.name) || !r.read(e.index) || e.index >= descriptions.size())
+      return false;
   
+  _wordLength = wordLength;
+  _descriptions = std::move(descriptions);
+  _entries = std::move(entries);
   return true;
 }
 
+bool ParameterDMLParser::_writeCache(const String &cacheFileName) const
+{
+  CacheWriter w;
+  
+  w.write(_wordLength);
+  w.write((uint32_t)_descriptions.size());
+  
+  for(auto &d: _descriptions)
+  {
+    w.write(d.type);
+    w.write(d.ioType);
+    w.write(d.address);
+    w.write(d.msb);
+    w.write(d.lsb);
+    w.write(d.min);
+    w.write(d.max);
+    w.write(d.defaultValue);
+    w.write(d.units);
+    w.write(d.description);
+    w.write(d.values);
+    w.write(d.valueMeaning);
+    w.write(d.valueDescription);
+  }
+  
+  w.write((uint32_t)_entries.size());
+  
+  for(auto &e: _entries)
+  {
+    w.write(e.name);
+    w.write(e.index);
+  }
+  
+  CacheWriter header;
+  
+  header.write(PARAMETER_DML_CACHE_MAGIC, 4);
+  header.write((uint32_t)PARAMETER_DML_CACHE_VERSION);
+  header.write(_xmlFileSize);
+  header.write(_xmlFileChecksum);
+  header.write(fnv1a64(w.buffer.data(), w.buffer.size()));
+  
+  return writeFileAtomically(cacheFileName, [&header, &w](OutputFileStream &f)
+  {
+    f.write(header.buffer.data(), header.buffer.size());
+    f.write(w.buffer.data(), w.buffer.size());
+    return f.good();
+  });
+}
+
+bool ParameterDMLParser::getParameters(Vector<ParameterPtr> &parameters)
+{
+  if(!isInitialized())
+    return false;
+  
+  if(!_parsed)
+  {
+    if(!_parse())
+      return false;
+    
+    _parsed = true;
+    
+    if(_cacheEnabled && !_writeCache(_xmlFileName + PARAMETER_DML_CACHE_SUFFIX))
+      logger(LOG_DEBUG) << "ParameterDMLParser: Could not write cache file for '" << _xmlFileName << "'" << std::endl;
+  }
+  
+  Vector<ParameterPtr> made(_descriptions.size());
+  
+  parameters.reserve(parameters.size() + _entries.size());
+  
+  for(auto &e: _entries)
+  {
+    ParameterPtr &p = made[e.index];
+    
+    if(!p && !(p = _makeParameter(_descriptions[e.index])))
+      return false;
+    
+    p->setName(e.name); // Last name wins, when a parameter is in more than one group
+    parameters.push_back(p);
+  }
+  
+  return true;
+}
   
 }
\ No newline at end of file
@@ -11,6 +11,8 @@
 #include "Common.h"
 #include "Parameter.h"
 
+#define PARAMETER_DML_CACHE_SUFFIX ".cache"
+
 namespace Voxel
 {
 /**
@@ -19,9 +21,44 @@ namespace Voxel
  */
 
 
+/**
+ * \brief Reads parameters from a DML file.
+ * 
+ * The parameter table parsed from a DML file is saved in a binary cache file next to it (<file>.cache) and used
+ * instead of the DML on later reads, as long as the checksum of the DML file matches the one in the cache.
+ */
 class VOXEL_EXPORT ParameterDMLParser
 {
 protected:
+  // A parameter as described in the DML file, from which Parameter is constructed
+  struct _ParameterDescription
+  {
+    enum Type
+    {
+      BOOL = 0,
+      STROBE_BOOL,
+      INTEGER,
+      UNSIGNED_INTEGER,
+      ENUM
+    };
+    
+    uint8_t type, ioType;
+    uint32_t address;
+    uint8_t msb, lsb;
+    uint32_t min, max, defaultValue; // hold 'int' values for INTEGER and ENUM
+    String units, description;
+    
+    Vector<int> values; // ENUM only
+    Vector<String> valueMeaning, valueDescription; // BOOL, STROBE_BOOL and ENUM
+  };
+  
+  // Property of a group in a section of the DML, in order
+  struct _Entry
+  {
+    String name;
+    uint32_t index; // into '_descriptions'. The same parameter may be in more than one group
+  };
+  
   TinyXML2::XMLDocument _doc;
   
   TinyXML2::XMLElement *_regMap, *_propertyList, *_sectionList;
@@ -34,19 +71,42 @@ protected:
   
   bool _initialized = false;
   
+  Vector<_ParameterDescription> _descriptions;
+  Vector<_Entry> _entries;
+  bool _parsed = false, _fromCache = false;
+  
+  uint64_t _xmlFileSize = 0, _xmlFileChecksum = 0;
+  
+  static bool _cacheEnabled;
+  
   bool _prepare();
   
   TinyXML2::XMLElement *_goTo(TinyXML2::XMLElement *current, const Vector<String> &nodeNameList, bool report = true); // by default report error
   
-  ParameterPtr _getParameter(TinyXML2::XMLElement *property, String &id, bool &skipIfNull); // Get parameter and ID
+  bool _getParameter(TinyXML2::XMLElement *property, String &id, bool &skipIfNull, _ParameterDescription &description); // Get parameter and ID
+  
+  bool _parse(); // DML into '_descriptions' and '_entries'
+  
+  ParameterPtr _makeParameter(const _ParameterDescription &description);
+  
+  bool _readCache(const String &cacheFileName);
+  bool _writeCache(const String &cacheFileName) const;
   
 public:
   ParameterDMLParser(RegisterProgrammer &registerProgrammer, const String &xmlFileName);
   
   inline bool isInitialized() { return _initialized; }
   
+  // Returns new Parameter objects on each call
   bool getParameters(Vector<ParameterPtr> &parameters);
   
+  // Whether the parameter table was read from the cache file rather than from the DML
+  inline bool isFromCache() const { return _fromCache; }
+  
+  // Disabling does not remove existing cache files but ignores them
+  inline static void setCacheEnabled(bool enable) { _cacheEnabled = enable; }
+  inline static bool isCacheEnabled() { return _cacheEnabled; }
+  
   virtual ~ParameterDMLParser() {}
 };
 
@@ -117,6 +117,28 @@ bool PointCloudFrameGenerator::generate(const FramePtr &in, FramePtr &out)
     return false;
   }
   
+  SizeType count = depthFrame->size.width*depthFrame->size.height;
+  
+  if(depthFrame->depth.size() != count || depthFrame->amplitude.size() != count || 
+    _pointCloudTransform->binnedDirectionsX.size() != count)
+  {
+    logger(LOG_ERROR) << "DepthCamera: Could not convert depth frame to point cloud frame" << std::endl;
+    return false;
+  }
+  
+  XYZIPointCloudSoAFrame *soa = dynamic_cast<XYZIPointCloudSoAFrame *>(out.get());
+  
+  if(soa) // Separate x, y, z and intensity arrays were asked for
+  {
+    soa->id = depthFrame->id;
+    soa->timestamp = depthFrame->timestamp;
+    soa->resize(count);
+    
+    _pointCloudTransform->depthToPointCloud(depthFrame->depth.data(), 0, count, soa->x.data(), soa->y.data(), soa->z.data());
+    memcpy(soa->i.data(), depthFrame->amplitude.data(), count*sizeof(float));
+    return true;
+  }
+  
   XYZIPointCloudFrame *f = dynamic_cast<XYZIPointCloudFrame *>(out.get());
   
   if(!f)
@@ -127,26 +149,10 @@ bool PointCloudFrameGenerator::generate(const FramePtr &in, FramePtr &out)
   
   f->id = depthFrame->id;
   f->timestamp = depthFrame->timestamp;
-  f->points.resize(depthFrame->size.width*depthFrame->size.height);
-  
-  if(!_pointCloudTransform->depthToPointCloud(depthFrame->depth, *f))
-  {
-    logger(LOG_ERROR) << "DepthCamera: Could not convert depth frame to point cloud frame" << std::endl;
-    return false;
-  }
+  f->points.resize(count);
   
   // Setting amplitude as intensity
-  auto index = 0;
-  
-  auto w = depthFrame->size.width;
-  auto h = depthFrame->size.height;
-  
-  for(auto y = 0; y < h; y++)
-    for(auto x = 0; x < w; x++, index++)
-    {
-      IntensityPoint &p = f->points[index];
-      p.i = depthFrame->amplitude[index];
-    }
+  _pointCloudTransform->depthToPointCloud(depthFrame->depth.data(), depthFrame->amplitude.data(), 0, count, f->points.data());
     
   return true;
 }
@@ -29,6 +29,8 @@ public:
   bool readConfiguration(SerializedObject &object);
   bool generate(const FramePtr &in, FramePtr &out);
   
+  inline const PointCloudTransformPtr &getPointCloudTransform() const { return _pointCloudTransform; }
+  
   virtual ~PointCloudFrameGenerator() {}
 };
   
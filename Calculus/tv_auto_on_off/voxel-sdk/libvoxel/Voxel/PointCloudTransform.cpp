@@ -14,6 +14,16 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define POINT_CLOUD_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define POINT_CLOUD_NEON 1
+#include <arm_neon.h>
+#endif
+
 namespace Voxel
 {
 
@@ -68,6 +78,9 @@ void PointCloudTransform::rescaleParameters(int width, int height)
   this->cx *= scaleCx;
   this->cy *= scaleCy;
   this->directions.clear();
+  this->binnedDirectionsX.clear();
+  this->binnedDirectionsY.clear();
+  this->binnedDirectionsZ.clear();
 }
 
 // Private methods
@@ -232,9 +245,31 @@ void PointCloudTransform::_init()
       directions.push_back(dir);
     }
   }
+  _computeBinnedDirections();
   _computeClippingPlanes();
 }
 
+void PointCloudTransform::_computeBinnedDirections()
+{
+  SizeType w = width/columnsToMerge, h = height/rowsToMerge;
+  
+  binnedDirectionsX.resize(w*h);
+  binnedDirectionsY.resize(w*h);
+  binnedDirectionsZ.resize(w*h);
+  
+  for(auto v = 0; v < h; v++)
+  {
+    for(auto u = 0; u < w; u++)
+    {
+      const Point &d = directions[v*rowsToMerge*width + u*columnsToMerge];
+      
+      binnedDirectionsX[v*w + u] = d.x;
+      binnedDirectionsY[v*w + u] = d.y;
+      binnedDirectionsZ[v*w + u] = d.z;
+    }
+  }
+}
+
 Point PointCloudTransform::_normalizedScreenToUnitWorld(const Point &normalizedScreen)
 {
   float _norm = 1.0f / (float)sqrt(normalizedScreen.x * normalizedScreen.x
@@ -343,28 +378,124 @@ Point PointCloudTransform::imageToWorld(const Point &p, float depth)
 
 bool PointCloudTransform::depthToPointCloud(const Vector<float> &distances, PointCloudFrame &pointCloudFrame)
 {
-  if(distances.size() != (width/columnsToMerge)*(height/rowsToMerge) ||
-    pointCloudFrame.size() != (width/columnsToMerge)*(height/rowsToMerge))
+  SizeType count = (width/columnsToMerge)*(height/rowsToMerge);
+  
+  if(distances.size() != count || pointCloudFrame.size() != count || binnedDirectionsX.size() != count)
     return false;
   
-  for(int v = 0; v < height; v += rowsToMerge)
+  XYZIPointCloudFrame *xyziFrame = dynamic_cast<XYZIPointCloudFrame *>(&pointCloudFrame);
+  
+  if(xyziFrame)
   {
-    for(int u = 0; u < width; u += columnsToMerge)
+    depthToPointCloud(distances.data(), 0, 0, count, xyziFrame->points.data());
+    return true;
+  }
+  
+  for(auto i = 0; i < count; i++)
+  {
+    Point *p = pointCloudFrame[i];
+    
+    if(p)
     {
-      int idx = v * width + u;
-      int idx2 = v/rowsToMerge * width/columnsToMerge + u/columnsToMerge;
-      Point *p = pointCloudFrame[idx2];
-      
-      if(p)
-        *p = directions[idx] * distances[idx2];
-      else
-      {
-        logger(LOG_ERROR) << "PointCloudTransform: Could not set point at (" << u << ", " << v << ")" << std::endl;
-        return false;
-      }
+      p->x = binnedDirectionsX[i]*distances[i];
+      p->y = binnedDirectionsY[i]*distances[i];
+      p->z = binnedDirectionsZ[i]*distances[i];
+    }
+    else
+    {
+      logger(LOG_ERROR) << "PointCloudTransform: Could not set point at index " << i << std::endl;
+      return false;
     }
   }
   return true;
 }
 
+void PointCloudTransform::depthToPointCloud(const float *distances, const float *intensities, IndexType offset, SizeType count, 
+                                            IntensityPoint *points) const
+{
+  const float *dx = binnedDirectionsX.data() + offset, *dy = binnedDirectionsY.data() + offset, *dz = binnedDirectionsZ.data() + offset;
+  
+  SizeType i = 0;
+  
+#ifdef POINT_CLOUD_SSE2
+  for(; i + 4 <= count; i += 4)
+  {
+    __m128 d = _mm_loadu_ps(distances + i);
+    __m128 x = _mm_mul_ps(_mm_loadu_ps(dx + i), d), y = _mm_mul_ps(_mm_loadu_ps(dy + i), d), z = _mm_mul_ps(_mm_loadu_ps(dz + i), d);
+    __m128 in = intensities?_mm_loadu_ps(intensities + i):_mm_set_ps(points[i + 3].i, points[i + 2].i, points[i + 1].i, points[i].i);
+    
+    _MM_TRANSPOSE4_PS(x, y, z, in);
+    
+    float *p = (float *)(points + i);
+    _mm_storeu_ps(p, x);
+    _mm_storeu_ps(p + 4, y);
+    _mm_storeu_ps(p + 8, z);
+    _mm_storeu_ps(p + 12, in);
+  }
+#elif defined(POINT_CLOUD_NEON)
+  for(; i + 4 <= count; i += 4)
+  {
+    float32x4_t d = vld1q_f32(distances + i);
+    float32x4x4_t v;
+    
+    v.val[0] = vmulq_f32(vld1q_f32(dx + i), d);
+    v.val[1] = vmulq_f32(vld1q_f32(dy + i), d);
+    v.val[2] = vmulq_f32(vld1q_f32(dz + i), d);
+    
+    if(intensities)
+      v.val[3] = vld1q_f32(intensities + i);
+    else
+    {
+      float in[4] = { points[i].i, points[i + 1].i, points[i + 2].i, points[i + 3].i };
+      v.val[3] = vld1q_f32(in);
+    }
+    
+    vst4q_f32((float *)(points + i), v);
+  }
+#endif
+  
+  for(; i < count; i++)
+  {
+    IntensityPoint &p = points[i];
+    p.x = dx[i]*distances[i];
+    p.y = dy[i]*distances[i];
+    p.z = dz[i]*distances[i];
+    
+    if(intensities)
+      p.i = intensities[i];
+  }
+}
+
+void PointCloudTransform::depthToPointCloud(const float *distances, IndexType offset, SizeType count, float *x, float *y, float *z) const
+{
+  const float *dx = binnedDirectionsX.data() + offset, *dy = binnedDirectionsY.data() + offset, *dz = binnedDirectionsZ.data() + offset;
+  
+  SizeType i = 0;
+  
+#ifdef POINT_CLOUD_SSE2
+  for(; i + 4 <= count; i += 4)
+  {
+    __m128 d = _mm_loadu_ps(distances + i);
+    _mm_storeu_ps(x + i, _mm_mul_ps(_mm_loadu_ps(dx + i), d));
+    _mm_storeu_ps(y + i, _mm_mul_ps(_mm_loadu_ps(dy + i), d));
+    _mm_storeu_ps(z + i, _mm_mul_ps(_mm_loadu_ps(dz + i), d));
+  }
+#elif defined(POINT_CLOUD_NEON)
+  for(; i + 4 <= count; i += 4)
+  {
+    float32x4_t d = vld1q_f32(distances + i);
+    vst1q_f32(x + i, vmulq_f32(vld1q_f32(dx + i), d));
+    vst1q_f32(y + i, vmulq_f32(vld1q_f32(dy + i), d));
+    vst1q_f32(z + i, vmulq_f32(vld1q_f32(dz + i), d));
+  }
+#endif
+  
+  for(; i < count; i++)
+  {
+    x[i] = dx[i]*distances[i];
+    y[i] = dy[i]*distances[i];
+    z[i] = dz[i]*distances[i];
+  }
+}
+
 }
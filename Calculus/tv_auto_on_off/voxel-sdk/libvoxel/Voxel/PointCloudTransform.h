@@ -36,6 +36,9 @@ public:
   float p1, p2;             // tangential distortion parameters
   
   Vector<Point> directions; // Directional array
+  
+  // Directions of binned pixels, (width/columnsToMerge) x (height/rowsToMerge), with x, y and z in separate arrays
+  Vector<float> binnedDirectionsX, binnedDirectionsY, binnedDirectionsZ;
 
   // Clippings
   Point leftClippingNormal;
@@ -69,6 +72,13 @@ public:
   
   bool depthToPointCloud(const Vector<float> &distances, PointCloudFrame &pointCloudFrame);
   
+  // Points of 'count' binned pixels starting at binned pixel 'offset'. Caller needs to make sure these are within binned directions.
+  // If 'intensities' is null, 'points[].i' is left unchanged
+  void depthToPointCloud(const float *distances, const float *intensities, IndexType offset, SizeType count, IntensityPoint *points) const;
+  
+  // Same as above, but with x, y and z of the points in separate arrays
+  void depthToPointCloud(const float *distances, IndexType offset, SizeType count, float *x, float *y, float *z) const;
+  
 private:
   Point _screenToNormalizedScreen(const Point &screen, bool verify);
   Point _normalizedScreenToScreen(const Point &normalizedScreen);
@@ -81,6 +91,7 @@ private:
                              Vector<double> &topArr, Vector<double> &bottomArr);
   
   void _init();
+  void _computeBinnedDirections();
   
   Point _normalizedScreenToUnitWorld(const Point &normalizedScreen);
   void _computeClippingPlanes();
@@ -35,6 +35,11 @@ public:
   
   virtual bool reset() = 0;
   
+  // Writes between beginBatch() and commit() may be held back and sent together on commit(). Batches nest and
+  // a batch needs to be committed in all cases. The default implementation writes through immediately
+  virtual bool beginBatch() { return true; }
+  virtual bool commit() { return true; }
+  
   virtual ~RegisterProgrammer() {}
 };
   
@@ -0,0 +1,152 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#ifndef VOXEL_SPSC_QUEUE_H
+#define VOXEL_SPSC_QUEUE_H
+
+#include <Common.h>
+
+#include <chrono>
+
+namespace Voxel
+{
+
+/**
+ * \addtogroup Util
+ * @{
+ */
+
+/**
+ * \brief Bounded single-producer/single-consumer queue.
+ *
+ * push() must only be called from one thread and pop() from one (other) thread. The ring
+ * itself is lock-free; the condition variables are only used to park an idle producer
+ * or consumer. Waits check the ring under '_waitMutex', which is also taken to notify,
+ * so an entry or slot made available just before a wait wakes it up.
+ */
+template <typename T>
+class SPSCQueue
+{
+protected:
+  Vector<T> _ring;
+  SizeType _capacity;
+
+  Atomic<SizeType> _head, _tail; // _head is written by consumer only, _tail by producer only
+
+  Mutex _waitMutex;
+  ConditionVariable _notEmpty, _notFull;
+
+  inline bool _hasEntry() const { return _head.load(std::memory_order_acquire) != _tail.load(std::memory_order_acquire); }
+  inline bool _hasSlot() const { return (_tail.load(std::memory_order_acquire) + 1) % _ring.size() != _head.load(std::memory_order_acquire); }
+
+  inline void _notify(ConditionVariable &condition)
+  {
+    Lock<Mutex> _(_waitMutex);
+    condition.notify_one();
+  }
+
+public:
+  SPSCQueue(SizeType capacity = 2): _head(0), _tail(0) { setCapacity(capacity); }
+
+  // Not thread-safe. Call only when neither producer nor consumer is active
+  inline void setCapacity(SizeType capacity)
+  {
+    _capacity = (capacity > 0)?capacity:1;
+    _ring.clear();
+    _ring.resize(_capacity + 1); // One slot is always kept free to distinguish full from empty
+    _head = 0;
+    _tail = 0;
+  }
+
+  inline SizeType capacity() const { return _capacity; }
+
+  inline SizeType size() const
+  {
+    SizeType head = _head.load(std::memory_order_acquire), tail = _tail.load(std::memory_order_acquire);
+    return (tail >= head)?(tail - head):(tail + _ring.size() - head);
+  }
+
+  inline bool empty() const { return size() == 0; }
+
+  // Producer side. Returns false if queue is full
+  bool tryPush(const T &value)
+  {
+    SizeType tail = _tail.load(std::memory_order_relaxed);
+    SizeType next = (tail + 1) % _ring.size();
+
+    if(next == _head.load(std::memory_order_acquire))
+      return false;
+
+    _ring[tail] = value;
+    _tail.store(next, std::memory_order_release);
+
+    _notify(_notEmpty);
+    return true;
+  }
+
+  // Producer side. Waits at most 'timeoutMs' for a free slot
+  bool push(const T &value, uint timeoutMs)
+  {
+    if(tryPush(value))
+      return true;
+
+    {
+      Lock<Mutex> _(_waitMutex);
+      _notFull.wait_for(_, std::chrono::milliseconds(timeoutMs), [this]() { return _hasSlot(); });
+    }
+
+    return tryPush(value);
+  }
+
+  // Consumer side. Returns false if queue is empty
+  bool tryPop(T &value)
+  {
+    SizeType head = _head.load(std::memory_order_relaxed);
+
+    if(head == _tail.load(std::memory_order_acquire))
+      return false;
+
+    value = _ring[head];
+    _ring[head] = T(); // Drop the reference held by the ring
+    _head.store((head + 1) % _ring.size(), std::memory_order_release);
+
+    _notify(_notFull);
+    return true;
+  }
+
+  // Consumer side. Waits at most 'timeoutMs' for an entry
+  bool pop(T &value, uint timeoutMs)
+  {
+    if(tryPop(value))
+      return true;
+
+    {
+      Lock<Mutex> _(_waitMutex);
+      _notEmpty.wait_for(_, std::chrono::milliseconds(timeoutMs), [this]() { return _hasEntry(); });
+    }
+
+    return tryPop(value);
+  }
+
+  // Not thread-safe. Call only when neither producer nor consumer is active
+  void clear()
+  {
+    for(auto &v: _ring)
+      v = T();
+    _head = 0;
+    _tail = 0;
+  }
+
+  virtual ~SPSCQueue() { clear(); }
+};
+
+/**
+ * @}
+ */
+
+}
+
+#endif // VOXEL_SPSC_QUEUE_H
@@ -26,6 +26,12 @@
 #define Py_TPFLAGS_DEFAULT (Py_TPFLAGS_DEFAULT_EXTERNAL|Py_TPFLAGS_HAVE_NEWBUFFER) 
 %}
 
+// Aligned arrays are not plain std::vector<float>. Use toXYZIPointCloudFrame() to get at the points from Python
+%ignore Voxel::XYZIPointCloudSoAFrame::x;
+%ignore Voxel::XYZIPointCloudSoAFrame::y;
+%ignore Voxel::XYZIPointCloudSoAFrame::z;
+%ignore Voxel::XYZIPointCloudSoAFrame::i;
+
 %include "../Frame.h"
 
 %extend Voxel::Frame {
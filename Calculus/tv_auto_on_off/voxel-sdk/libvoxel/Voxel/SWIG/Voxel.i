@@ -62,6 +62,7 @@
 %include "../FrameStream.h"
 %include "../FrameGenerator.h"
 %include "../Filter/FilterParameter.h"
+%include "../LatencyHistogram.h"
 
 namespace std 
 {
@@ -78,6 +79,7 @@ namespace std
 %template(IntegerVector) vector<int>;
 %template(UnsignedIntegerVector) vector<uint>;
 %template(FrameVector) vector<Voxel::FramePtr>;
+%template(LatencyStatisticsVector) vector<Voxel::LatencyStatistics>;
 }
 
 %handle_reference(std::vector<Voxel::SupportedVideoMode>);
@@ -163,6 +165,7 @@ namespace std
 %ignore Voxel::DepthCamera::wait();
 
 %include "../DepthCamera.h"
+%template(DepthCameraStageStatisticsVector) std::vector<Voxel::DepthCameraStageStatistics>;
 %include "../DepthCameraFactory.h"
 %include "../DownloaderFactory.h"
 %include "../CameraSystem.h"
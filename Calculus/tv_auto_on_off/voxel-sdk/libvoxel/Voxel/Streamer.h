@@ -48,6 +48,16 @@ public:
   virtual bool capture(RawDataFramePtr &p);
   virtual bool stop();
   
+  // When enabled, captured frames may borrow streamer's internal buffers (see RawDataFrame::borrow()) instead of copying 
+  // them. Off by default, as borrowed frames leave 'data' empty; DepthCamera enables it for its own streamer. Returns
+  // false if not supported
+  virtual bool setZeroCopy(bool enable) { return !enable; }
+  virtual bool isZeroCopy() { return false; }
+  
+  // CPUs and real-time priority of threads the streamer runs on its own, for streams started after this. Streamers
+  // capturing on the calling thread have none and run with the settings of that thread
+  virtual bool setThreadSettings(CPUAffinityMask affinity, int realTimePriority) { return true; }
+  
   virtual bool getSupportedVideoModes(Vector<VideoMode> &videoModes) = 0;
   
   virtual bool getCurrentVideoMode(VideoMode &videoMode) = 0;
@@ -0,0 +1,300 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#include "ThreadPool.h"
+#include "Logger.h"
+
+namespace Voxel
+{
+  
+ThreadPool::ThreadPool(SizeType threadCount, CPUAffinityMask affinity): _stopping(false), _affinity(affinity)
+{
+  if(threadCount == 0)
+    threadCount = std::max(1U, std::thread::hardware_concurrency());
+  
+  _queued = 0;
+  _pending = 0;
+  _nextWorker = 0;
+  
+  _workers.resize(threadCount);
+  
+  for(auto &w: _workers)
+    w = Ptr<_Worker>(new _Worker());
+  
+  {
+    // Workers look up _threads in _currentWorker(), so they need to wait till it is complete
+    Lock<Mutex> _(_mutex);
+    
+    _threads.resize(threadCount);
+    
+    for(auto i = 0; i < threadCount; i++)
+      _threads[i] = ThreadPtr(new Thread(&ThreadPool::_run, this, i));
+  }
+}
+
+IndexType ThreadPool::_currentWorker() const
+{
+  auto id = std::this_thread::get_id();
+  
+  for(auto i = 0; i < _threads.size(); i++)
+    if(_threads[i]->get_id() == id)
+      return i;
+  
+  return -1;
+}
+
+void ThreadPool::submit(const Task &task)
+{
+  IndexType w = _currentWorker();
+  
+  _pending++;
+  
+  if(w >= 0)
+  {
+    Lock<Mutex> _(_workers[w]->mutex);
+    _workers[w]->tasks.push_front(task);
+  }
+  else
+  {
+    _Worker &worker = *_workers[_nextWorker++ % _workers.size()];
+    
+    Lock<Mutex> _(worker.mutex);
+    worker.tasks.push_back(task);
+  }
+  
+  _queued++;
+  
+  {
+    Lock<Mutex> _(_mutex); // So that a worker between checking _queued and sleeping does not miss this
+  }
+  _taskAvailable.notify_one();
+}
+
+bool ThreadPool::_take(SizeType worker, Task &task)
+{
+  for(auto i = 0; i < _workers.size(); i++)
+  {
+    SizeType from = (worker + i) % _workers.size();
+    _Worker &w = *_workers[from];
+    
+    Lock<Mutex> _(w.mutex);
+    
+    if(w.tasks.empty())
+      continue;
+    
+    if(from == worker) // Own queue, newest first
+    {
+      task = std::move(w.tasks.front());
+      w.tasks.pop_front();
+    }
+    else // Steal the oldest
+    {
+      task = std::move(w.tasks.back());
+      w.tasks.pop_back();
+    }
+    
+    _queued--;
+    return true;
+  }
+  
+  return false;
+}
+
+bool ThreadPool::setAffinity(CPUAffinityMask affinity)
+{
+  Lock<Mutex> _(_mutex);
+  
+  _affinity = affinity;
+  
+  bool ret = true;
+  
+  for(auto &t: _threads)
+    ret = setThreadAffinity(*t, affinity) && ret;
+  
+  if(!ret)
+    logger(LOG_WARNING) << "ThreadPool: Could not set affinity of workers to 0x" << std::hex << affinity << std::dec << std::endl;
+  
+  return ret;
+}
+
+void ThreadPool::_run(SizeType worker)
+{
+  {
+    Lock<Mutex> _(_mutex);
+    
+    if(!setCurrentThreadAffinity(_affinity))
+      logger(LOG_WARNING) << "ThreadPool: Could not set affinity of worker " << worker << " to 0x" << std::hex << _affinity << std::dec << std::endl;
+  }
+  
+  Task task;
+  
+  while(true)
+  {
+    if(_take(worker, task))
+    {
+      task();
+      task = nullptr;
+      
+      if(--_pending == 0)
+      {
+        Lock<Mutex> _(_mutex);
+        _idle.notify_all();
+      }
+      continue;
+    }
+    
+    Lock<Mutex> _(_mutex);
+    
+    if(_stopping && _queued == 0)
+      break;
+    
+    _taskAvailable.wait(_, [this]() { return _queued > 0 || _stopping; });
+  }
+}
+
+void ThreadPool::wait()
+{
+  if(isWorkerThread())
+  {
+    logger(LOG_ERROR) << "ThreadPool: wait() called from a task of the same pool" << std::endl;
+    return;
+  }
+  
+  Lock<Mutex> _(_mutex);
+  _idle.wait(_, [this]() { return _pending == 0; });
+}
+
+void ThreadPool::parallelFor(IndexType begin, IndexType end, const Function<void (IndexType, IndexType)> &f, SizeType grain)
+{
+  if(end <= begin)
+    return;
+  
+  SizeType count = end - begin;
+  SizeType chunkCount = std::min(count/std::max<SizeType>(grain, 1), size() + 1); // rounded down, so that no chunk is below 'grain'
+  
+  if(chunkCount <= 1)
+  {
+    f(begin, end);
+    return;
+  }
+  
+  if(chunkCount > 0xFFFF)
+    chunkCount = 0xFFFF;
+  
+  _Loop *loop;
+  
+  {
+    Lock<Mutex> _(_loopMutex);
+    
+    if(_freeLoops.empty())
+    {
+      _loops.push_back(Ptr<_Loop>(new _Loop()));
+      _loops.back()->ticket = 0;
+      _freeLoops.reserve(_loops.size());
+      _freeLoops.push_back(_loops.back().get());
+    }
+    
+    loop = _freeLoops.back();
+    _freeLoops.pop_back();
+  }
+  
+  uint32_t generation = (uint32_t)(loop->ticket.load() >> 32) + 1;
+  
+  loop->f = &f;
+  loop->begin = begin;
+  loop->count = count;
+  loop->done = 0;
+  loop->ticket = ((uint64_t)generation << 32) | ((uint64_t)chunkCount << 16);
+  
+  // Captures fit in Task without a heap allocation
+  for(auto i = 1; i < chunkCount; i++)
+    submit([loop, generation]() { _runChunks(loop, generation); });
+  
+  _runChunks(loop, generation);
+  
+  {
+    Lock<Mutex> _(loop->mutex);
+    loop->finished.wait(_, [loop, chunkCount]() { return loop->done == chunkCount; });
+  }
+  
+  Lock<Mutex> _(_loopMutex);
+  _freeLoops.push_back(loop);
+}
+
+void ThreadPool::_runChunks(_Loop *loop, uint32_t generation)
+{
+  // Helpers which start after all chunks are taken, possibly after 'loop' is reused, return without touching the rest
+  // of 'loop'. Once a chunk is taken, the loop cannot complete and 'loop' stays as it is till that chunk is done
+  uint64_t ticket = loop->ticket.load();
+  
+  while(true)
+  {
+    SizeType chunkCount = (ticket >> 16) & 0xFFFF, c = ticket & 0xFFFF;
+    
+    if((uint32_t)(ticket >> 32) != generation || c >= chunkCount)
+      return;
+    
+    if(!loop->ticket.compare_exchange_weak(ticket, ticket + 1))
+      continue;
+    
+    (*loop->f)(loop->begin + (IndexType)(c*loop->count/chunkCount), loop->begin + (IndexType)((c + 1)*loop->count/chunkCount));
+    
+    if(++loop->done == chunkCount)
+    {
+      Lock<Mutex> _(loop->mutex);
+      loop->finished.notify_all();
+    }
+    
+    ticket = loop->ticket.load();
+  }
+}
+
+SizeType ThreadPool::getDefaultProcessingThreadCount()
+{
+  SizeType hardwareThreads = std::thread::hardware_concurrency();
+  return (hardwareThreads > 1)?(hardwareThreads - 1):1;
+}
+
+static Mutex processingPoolMutex;
+static ThreadPoolPtr processingPool;
+
+ThreadPoolPtr ThreadPool::getProcessingPool()
+{
+  Lock<Mutex> _(processingPoolMutex);
+  
+  if(!processingPool)
+    processingPool = ThreadPoolPtr(new ThreadPool(getDefaultProcessingThreadCount()));
+  
+  return processingPool;
+}
+
+void ThreadPool::setProcessingPool(const ThreadPoolPtr &pool)
+{
+  ThreadPoolPtr old;
+  
+  {
+    Lock<Mutex> _(processingPoolMutex);
+    old = processingPool;
+    processingPool = pool;
+  }
+  // 'old' is released outside the lock, as that may wait for its workers to complete
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    Lock<Mutex> _(_mutex);
+    _stopping = true;
+  }
+  
+  _taskAvailable.notify_all();
+  
+  for(auto &t: _threads)
+    if(t->joinable())
+      t->join();
+}
+  
+}
@@ -0,0 +1,124 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#ifndef VOXEL_THREAD_POOL_H
+#define VOXEL_THREAD_POOL_H
+
+#include "Common.h"
+
+#include <deque>
+
+namespace Voxel
+{
+
+/**
+ * \addtogroup Util
+ * @{
+ */
+
+/**
+ * \brief Fixed set of worker threads running submitted tasks, with work stealing.
+ * 
+ * Each worker has its own task queue. Tasks submitted from a worker go to its own queue and are run
+ * newest first, while tasks submitted from other threads are spread over the workers. A worker with an
+ * empty queue takes the oldest task of another worker. Tasks are not ordered with respect to each other.
+ *
+ * Data-parallel loops of filters and generators run on the process-wide pool from getProcessingPool() via parallelFor().
+ */
+class ThreadPool;
+typedef Ptr<ThreadPool> ThreadPoolPtr;
+
+class VOXEL_EXPORT ThreadPool
+{
+public:
+  typedef Function<void ()> Task;
+  
+protected:
+  struct _Worker
+  {
+    Mutex mutex;
+    std::deque<Task> tasks;
+  };
+  
+  // State of one parallelFor(), reused by later calls. 'ticket' holds generation (bits 32-63), chunk count (bits 16-31)
+  // and next chunk (bits 0-15), so that a helper queued for an earlier call finds it stale without touching the rest
+  struct _Loop
+  {
+    Atomic<uint64_t> ticket;
+    Atomic<SizeType> done;
+    Mutex mutex;
+    ConditionVariable finished;
+    
+    const Function<void (IndexType, IndexType)> *f;
+    IndexType begin;
+    SizeType count;
+  };
+  
+  Vector<Ptr<_Worker>> _workers;
+  Vector<ThreadPtr> _threads;
+  
+  Mutex _mutex;
+  ConditionVariable _taskAvailable, _idle;
+  
+  Atomic<SizeType> _queued; // tasks in worker queues
+  Atomic<SizeType> _pending; // tasks submitted and not yet completed
+  Atomic<SizeType> _nextWorker;
+  bool _stopping;
+  
+  CPUAffinityMask _affinity;
+  
+  Mutex _loopMutex;
+  Vector<Ptr<_Loop>> _loops;
+  Vector<_Loop *> _freeLoops;
+  
+  IndexType _currentWorker() const; // -1 if not called from a worker
+  static void _runChunks(_Loop *loop, uint32_t generation);
+  bool _take(SizeType worker, Task &task);
+  void _run(SizeType worker);
+  
+public:
+  // 'threadCount' = 0 => one thread per hardware thread. 'affinity' = 0 => workers may run on any CPU
+  ThreadPool(SizeType threadCount = 0, CPUAffinityMask affinity = 0);
+  
+  inline SizeType size() const { return _threads.size(); }
+  
+  bool setAffinity(CPUAffinityMask affinity);
+  inline CPUAffinityMask getAffinity() const { return _affinity; }
+  
+  void submit(const Task &task);
+  
+  // Is the calling thread one of the workers?
+  inline bool isWorkerThread() const { return _currentWorker() >= 0; }
+  
+  // Waits till all submitted tasks complete, including those submitted meanwhile. Not to be called from a task
+  void wait();
+  
+  /**
+   * Runs 'f' on sub-ranges covering [begin, end), each of at least 'grain' indices unless the whole range is smaller,
+   * and returns after all of them complete. The calling thread runs sub-ranges too, so this may be called from a task.
+   */
+  void parallelFor(IndexType begin, IndexType end, const Function<void (IndexType, IndexType)> &f, SizeType grain = 1);
+  
+  // One less than the hardware threads (at least 1), as the thread calling parallelFor() runs sub-ranges too
+  static SizeType getDefaultProcessingThreadCount();
+  
+  // Pool shared by filters and generators, created on first use with getDefaultProcessingThreadCount() threads
+  static ThreadPoolPtr getProcessingPool();
+  
+  // 'pool' = nullptr => a default pool is created again on next use. Loops already running keep the old pool
+  static void setProcessingPool(const ThreadPoolPtr &pool);
+  
+  // Completes the tasks already submitted
+  virtual ~ThreadPool();
+};
+
+/**
+ * @}
+ */
+
+}
+
+#endif // VOXEL_THREAD_POOL_H
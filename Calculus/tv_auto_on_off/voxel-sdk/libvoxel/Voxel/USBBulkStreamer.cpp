@@ -1,263 +1,380 @@
-/*
- *
- */
-
-#include "USBBulkStreamer.h"
-
-#include "FrameBuffer.h"
-#include "Logger.h"
-#include "USBSystem.h"
-#include <USBIO.h>
-
-// Ask for an extra 255 bytes of data to ensure we don't end on a 512 byte packet
-#define BULK_XFER_EXTRA_SIZE  255
-#define MAX_BUFFER_COUNT      2
-
-namespace Voxel
-{
-
-class USBBulkStreamer::USBBulkStreamerPrivate
-{
-public:
-  bool initialized = true;
-
-  USBIOPtr usbIO;
-
-  Ptr<Thread> captureThread;
-  bool captureRunning = false;
-
-  long transferred = 0, bufSize = 0;
-  Vector<uint8_t> usbBuffer;
-  
-  unsigned int validFrames = 0, droppedFrames = 0, resetCount = 0, retriesCount = 0;
-
-  uint8_t endpoint;
-
-  long timeout = 200;
-
-  USBBulkStreamerPrivate(USBIOPtr &usbIO, DevicePtr device, uint8_t endpoint): _rawBuffers(10),
-    usbBuffer(bufSize + BULK_XFER_EXTRA_SIZE), bufSize(bufSize), usbIO(usbIO), endpoint(endpoint)
-  {
-  }
-
-  ~USBBulkStreamerPrivate()
-  {
-  }
-
-  bool start()
-  {
-    //logger(LOG_INFO) << "USBBulkStreamer: Running Start" << std::endl;
-
-    if(!usbIO->isInitialized())
-    {
-      logger(LOG_ERROR) << "USBBulkStreamer: USBIO not initialized" << std::endl;
-      return false;
-    }
-    
-    if(!captureRunning)
-    {
-      validFrames = droppedFrames = resetCount = retriesCount = 0;
-      
-      captureThread = Ptr<Thread> (new Thread(&USBBulkStreamerPrivate::run, this));
-      captureRunning = true;
-      return true;
-    }
-
-    return false;
-  }
-
-  bool stop()
-  {
-    //logger(LOG_INFO) << "USBBulkStreamer: Running Stop" << std::endl;
-    if(captureRunning)
-    {
-      captureRunning = false;
-      captureThread->join();
-      return true;
-    }
-    return false;
-  }
-
-  void run()
-  {
-    //logger(LOG_INFO) << "USBBulkStreamer: Running Capture" << std::endl;
-    usbIO->resetBulkEndPoint(endpoint);
-
-    while(captureRunning)
-    {
-      if(usbIO->bulkTransfer(endpoint, usbBuffer.data(), bufSize + BULK_XFER_EXTRA_SIZE, transferred, timeout))
-      {
-        if(transferred == bufSize)
-        {
-          validFrames++;
-          retriesCount = 0;
-          putBuffer();
-        }
-        else
-        {
-          droppedFrames++;
-          if(droppedFrames % 100 == 0)
-            logger(LOG_ERROR) << "USBBulkStreamer: Dropped frames " << droppedFrames
-                              << " Valid frames " << validFrames << std::endl;
-        }
-      }
-      else
-      {
-        retriesCount++;
-        if(retriesCount == 3)
-        {
-          usbIO->resetBulkEndPoint(endpoint);
-          logger(LOG_WARNING) << "USBBulkStreamer: Resetting bulk endpoint at " << _timer.getCurentRealTime() << std::endl;
-          retriesCount = 0;
-          resetCount++;
-          if(resetCount % 100 == 0)
-          {
-            logger(LOG_ERROR) << "USBBulkStreamer: Did not get a frame in 100 attempts" << std::endl;
-            captureRunning = false;
-          }
-        }
-      }
-    }
-  }
-
-protected:
-  TimeStampType _sampleStart = 0;
-  Timer _timer;
-
-  FrameBufferManager<RawDataFrame> _rawBuffers;
-
-  List<FrameBuffer<RawDataFrame>> _inUseBuffers;
-
-  Mutex _dataAccessMutex;
-  ConditionVariable _dataAvailableCondition;
-
-public:
-  
-  bool setBufferSize(size_t bufSize)
-  {
-    if(captureRunning)
-      return false;
-    
-    this->bufSize = bufSize;
-    
-    this->usbBuffer.resize(bufSize);
-    
-    return true;
-  }
-
-  bool putBuffer()
-  {
-    Lock<Mutex> _(_dataAccessMutex);
-
-    if(_inUseBuffers.size() >= MAX_BUFFER_COUNT)
-    {
-      logger(LOG_WARNING) << "USBBulkStreamer: Dropping a frame because of slow forward pipeline." << std::endl;
-      _inUseBuffers.pop_front();
-    }
-
-    auto f = _rawBuffers.get();
-
-    RawDataFramePtr &raw = *f;
-
-    if(!raw || raw->data.size() != usbBuffer.size())
-    {
-      raw = RawDataFramePtr(new RawDataFrame());
-      raw->data.resize(usbBuffer.size());
-    }
-
-    memcpy(raw->data.data(), usbBuffer.data(), usbBuffer.size() - BULK_XFER_EXTRA_SIZE);
-
-    raw->timestamp = _timer.getCurentRealTime(); // in micro seconds
-    logger(LOG_DEBUG) << "USBBulkStreamer: Got sample buffer at " << raw->timestamp << std::endl;
-
-    _inUseBuffers.push_back(f);
-
-    _dataAvailableCondition.notify_all();
-
-    return true;
-  }
-
-  // timeout in milliseconds
-  bool getBuffer(long timeout, RawDataFramePtr &raw)
-  {
-    Lock<Mutex> _(_dataAccessMutex);
-
-    if(!_dataAvailableCondition.wait_for(_, std::chrono::milliseconds(timeout), [this] { return _inUseBuffers.size() > 0; }))
-      return false;
-
-    FrameBuffer<RawDataFrame> f = *_inUseBuffers.begin();
-
-    _inUseBuffers.pop_front();
-
-    if(!raw || raw->data.size() != (*f)->data.size())
-    {
-      raw = RawDataFramePtr(new RawDataFrame());
-      raw->data.resize((*f)->data.size());
-    }
-
-    memcpy(raw->data.data(), (*f)->data.data(), raw->data.size());
-    raw->timestamp = (*f)->timestamp;
-
-    f.reset();
-    return true;
-  }
-
-};
-
-USBBulkStreamer::USBBulkStreamer(USBIOPtr &usbIO, DevicePtr device, uint8_t endpoint): Streamer(device)
-{
-  _usbBulkStreamerPrivate = Ptr<USBBulkStreamerPrivate> (new USBBulkStreamerPrivate(usbIO, device, endpoint));
-}
-
-USBBulkStreamer::~USBBulkStreamer()
-{
-}
-
-bool USBBulkStreamer::_start()
-{
-  return _usbBulkStreamerPrivate->start();
-}
-
-bool USBBulkStreamer::_capture(RawDataFramePtr &p)
-{
-  if(_usbBulkStreamerPrivate->getBuffer(2000, p))
-  {
-    p->id = _currentID++;
-    return true;
-  }
-  return false;
-}
-
-bool USBBulkStreamer::_stop()
-{
-  return _usbBulkStreamerPrivate->stop();
-}
-
-bool USBBulkStreamer::isInitialized()
-{
-  return true;
-}
-
-bool USBBulkStreamer::getSupportedVideoModes(Vector<VideoMode> &videoModes)
-{
-  videoModes.clear();
-  return true; // No specific video modes
-}
-
-bool USBBulkStreamer::getCurrentVideoMode(VideoMode &videoMode)
-{
-  return false;
-}
-
-bool USBBulkStreamer::setVideoMode(const VideoMode &videoMode)
-{
-  return true;
-}
-
-bool USBBulkStreamer::setBufferSize(size_t bufferSize)
-{
-  return _usbBulkStreamerPrivate->setBufferSize(bufferSize);
-}
-
-
-}
+/*
+ *
+ */
+
+#include "USBBulkStreamer.h"
+
+#include "FrameBuffer.h"
+#include "Logger.h"
+#include "USBSystem.h"
+#include <USBIO.h>
+
+// Ask for an extra 255 bytes of data to ensure we don't end on a 512 byte packet
+#define BULK_XFER_EXTRA_SIZE  255
+#define MAX_BUFFER_COUNT      2 // Frames waiting for capture(). Older ones are dropped beyond this
+#define DEFAULT_TRANSFER_COUNT 4
+#define SPARE_BUFFER_COUNT    4 // Frame buffers which consumers can hold on to, in zero copy mode, without stalling transfers
+#define MAX_FAILED_TRANSFERS  300
+
+namespace Voxel
+{
+
+class USBBulkStreamer::USBBulkStreamerPrivate
+{
+public:
+  // Ring of frame buffers. Each buffer is either queued for a transfer, waiting in 'ready' for capture(), 
+  // held by a frame or in 'free'. Frames borrowing a buffer keep the pool alive, even beyond stop()
+  struct BufferPool
+  {
+    struct ReadyBuffer
+    {
+      uint8_t *data;
+      TimeStampType timestamp;
+    };
+    
+    Vector<Vector<uint8_t>> storage;
+    
+    Vector<uint8_t *> free;
+    List<ReadyBuffer> ready;
+    
+    Mutex mutex; // Held only to move buffer pointers around, never while copying or waiting on USB
+    ConditionVariable readyCondition;
+    
+    BufferPool(SizeType count, SizeType size): storage(count)
+    {
+      free.reserve(count);
+      
+      for(auto &b: storage)
+      {
+        b.resize(size);
+        free.push_back(b.data());
+      }
+    }
+    
+    inline void release(uint8_t *data)
+    {
+      Lock<Mutex> _(mutex);
+      free.push_back(data);
+    }
+  };
+  
+  typedef Ptr<BufferPool> BufferPoolPtr;
+  
+  bool initialized = true;
+
+  USBIOPtr usbIO;
+
+  bool captureRunning = false;
+
+  long bufSize = 0;
+  
+  SizeType transferCount = DEFAULT_TRANSFER_COUNT;
+  bool zeroCopy = false;
+  
+  BufferPoolPtr pool;
+  
+  Atomic<unsigned int> validFrames, droppedFrames;
+  unsigned int failedTransfers = 0; // consecutive ones. Touched only from USBIO's event thread
+  Atomic<bool> streamFailed; // transfers are retired, so capture fails till restarted
+
+  uint8_t endpoint;
+
+  long timeout = 200;
+
+  USBBulkStreamerPrivate(USBIOPtr &usbIO, DevicePtr device, uint8_t endpoint): usbIO(usbIO), endpoint(endpoint)
+  {
+    validFrames = droppedFrames = 0;
+    streamFailed = false;
+  }
+
+  ~USBBulkStreamerPrivate()
+  {
+    stop();
+  }
+
+  bool start()
+  {
+    //logger(LOG_INFO) << "USBBulkStreamer: Running Start" << std::endl;
+
+    if(!usbIO->isInitialized())
+    {
+      logger(LOG_ERROR) << "USBBulkStreamer: USBIO not initialized" << std::endl;
+      return false;
+    }
+    
+    if(captureRunning)
+      return false;
+    
+    if(bufSize <= 0)
+    {
+      logger(LOG_ERROR) << "USBBulkStreamer: Buffer size is not set" << std::endl;
+      return false;
+    }
+    
+    validFrames = droppedFrames = 0;
+    failedTransfers = 0;
+    streamFailed = false;
+    
+    // A fresh pool each time, as frames captured earlier may still be holding buffers of the previous one
+    pool = BufferPoolPtr(new BufferPool(transferCount + MAX_BUFFER_COUNT + SPARE_BUFFER_COUNT, bufSize + BULK_XFER_EXTRA_SIZE));
+    
+    Vector<uint8_t *> buffers(pool->free.end() - transferCount, pool->free.end());
+    pool->free.resize(pool->free.size() - transferCount);
+    
+    usbIO->resetBulkEndPoint(endpoint);
+    
+    if(!usbIO->startBulkStream(endpoint, buffers, bufSize + BULK_XFER_EXTRA_SIZE, 
+      std::bind(&USBBulkStreamerPrivate::onTransfer, this, std::placeholders::_1, std::placeholders::_2, std::placeholders::_3), timeout))
+    {
+      logger(LOG_ERROR) << "USBBulkStreamer: Could not start bulk stream on endpoint " << (uint)endpoint << std::endl;
+      pool = nullptr;
+      return false;
+    }
+    
+    captureRunning = true;
+    return true;
+  }
+
+  bool stop()
+  {
+    //logger(LOG_INFO) << "USBBulkStreamer: Running Stop" << std::endl;
+    if(captureRunning)
+    {
+      captureRunning = false;
+      usbIO->stopBulkStream();
+      
+      pool->readyCondition.notify_all();
+      pool = nullptr;
+      return true;
+    }
+    return false;
+  }
+
+  // Called from USBIO's event thread. Returns the buffer for the next transfer
+  uint8_t *onTransfer(uint8_t *data, long transferred, bool success)
+  {
+    if(streamFailed)
+      return nullptr; // Retire the other transfers as they come back
+    
+    if(!success || transferred != bufSize)
+    {
+      if(success)
+      {
+        droppedFrames++;
+        
+        if(droppedFrames % 100 == 0)
+          logger(LOG_ERROR) << "USBBulkStreamer: Dropped frames " << droppedFrames
+                            << " Valid frames " << validFrames << std::endl;
+      }
+      
+      if(++failedTransfers >= MAX_FAILED_TRANSFERS)
+      {
+        logger(LOG_ERROR) << "USBBulkStreamer: Did not get a frame in " << failedTransfers << " attempts. Stopping transfers" << std::endl;
+        
+        // Capture fails from now on, so that the depth camera stops the stream instead of waiting on it
+        Lock<Mutex> _(pool->mutex);
+        streamFailed = true;
+        pool->readyCondition.notify_all();
+        return nullptr; // Retire this transfer
+      }
+      return data; // Reuse the buffer for next transfer
+    }
+    
+    failedTransfers = 0;
+    validFrames++;
+    
+    BufferPool::ReadyBuffer r;
+    r.data = data;
+    r.timestamp = _timer.getCurentRealTime(); // in micro seconds
+    
+    Lock<Mutex> _(pool->mutex);
+    
+    if(pool->ready.size() >= MAX_BUFFER_COUNT)
+    {
+      logger(LOG_WARNING) << "USBBulkStreamer: Dropping a frame because of slow forward pipeline." << std::endl;
+      pool->free.push_back(pool->ready.front().data);
+      pool->ready.pop_front();
+      droppedFrames++;
+    }
+    
+    if(pool->free.empty()) // Consumers hold on to all the spare buffers
+    {
+      droppedFrames++;
+      return data;
+    }
+    
+    uint8_t *next = pool->free.back();
+    pool->free.pop_back();
+    
+    pool->ready.push_back(r);
+    pool->readyCondition.notify_all();
+    
+    return next;
+  }
+
+protected:
+  Timer _timer;
+
+public:
+  
+  bool setBufferSize(size_t bufSize)
+  {
+    if(captureRunning)
+      return false;
+    
+    this->bufSize = bufSize;
+    return true;
+  }
+
+  // timeout in milliseconds
+  bool getBuffer(long timeout, RawDataFramePtr &raw)
+  {
+    if(raw && raw->isBorrowed())
+      raw->releaseBorrowed(); // Hand back the buffer 'raw' holds before waiting for the next one
+    
+    BufferPoolPtr p = pool;
+    
+    if(!p)
+      return false;
+    
+    BufferPool::ReadyBuffer r;
+    
+    {
+      Lock<Mutex> _(p->mutex);
+
+      if(!p->readyCondition.wait_for(_, std::chrono::milliseconds(timeout), [this, &p] { return p->ready.size() > 0 || !captureRunning || streamFailed; }) || 
+        !p->ready.size())
+        return false;
+
+      r = p->ready.front();
+      p->ready.pop_front();
+    }
+    
+    if(!raw)
+      raw = RawDataFramePtr(new RawDataFrame());
+    
+    if(zeroCopy)
+    {
+      // The buffer goes back to the pool when the last holder of the frame lets go of it
+      raw->borrow(r.data, bufSize, Ptr<void>(r.data, [p](void *d) { p->release((uint8_t *)d); }));
+    }
+    else
+    {
+      raw->data.assign(r.data, r.data + bufSize);
+      p->release(r.data);
+    }
+    
+    raw->timestamp = r.timestamp;
+    logger(LOG_DEBUG) << "USBBulkStreamer: Got sample buffer at " << raw->timestamp << std::endl;
+    return true;
+  }
+
+};
+
+USBBulkStreamer::USBBulkStreamer(USBIOPtr &usbIO, DevicePtr device, uint8_t endpoint): Streamer(device)
+{
+  _usbBulkStreamerPrivate = Ptr<USBBulkStreamerPrivate> (new USBBulkStreamerPrivate(usbIO, device, endpoint));
+}
+
+USBBulkStreamer::~USBBulkStreamer()
+{
+}
+
+bool USBBulkStreamer::_start()
+{
+  return _usbBulkStreamerPrivate->start();
+}
+
+bool USBBulkStreamer::_capture(RawDataFramePtr &p)
+{
+  if(_usbBulkStreamerPrivate->getBuffer(2000, p))
+  {
+    p->id = _currentID++;
+    return true;
+  }
+  return false;
+}
+
+bool USBBulkStreamer::_stop()
+{
+  return _usbBulkStreamerPrivate->stop();
+}
+
+bool USBBulkStreamer::isInitialized()
+{
+  return true;
+}
+
+bool USBBulkStreamer::getSupportedVideoModes(Vector<VideoMode> &videoModes)
+{
+  videoModes.clear();
+  return true; // No specific video modes
+}
+
+bool USBBulkStreamer::getCurrentVideoMode(VideoMode &videoMode)
+{
+  return false;
+}
+
+bool USBBulkStreamer::setVideoMode(const VideoMode &videoMode)
+{
+  return true;
+}
+
+bool USBBulkStreamer::setBufferSize(size_t bufferSize)
+{
+  return _usbBulkStreamerPrivate->setBufferSize(bufferSize);
+}
+
+bool USBBulkStreamer::setTransferCount(SizeType count)
+{
+  if(isRunning() || count < 1)
+  {
+    logger(LOG_ERROR) << "USBBulkStreamer: Transfer count can be changed only when not streaming, and needs to be atleast 1" << std::endl;
+    return false;
+  }
+  
+  _usbBulkStreamerPrivate->transferCount = count;
+  return true;
+}
+
+SizeType USBBulkStreamer::getTransferCount() const
+{
+  return _usbBulkStreamerPrivate->transferCount;
+}
+
+bool USBBulkStreamer::setZeroCopy(bool enable)
+{
+  if(isRunning())
+  {
+    logger(LOG_ERROR) << "USBBulkStreamer: Cannot change zero copy mode while streaming" << std::endl;
+    return false;
+  }
+  
+  _usbBulkStreamerPrivate->zeroCopy = enable;
+  return true;
+}
+
+bool USBBulkStreamer::isZeroCopy()
+{
+  return _usbBulkStreamerPrivate->zeroCopy;
+}
+
+bool USBBulkStreamer::setThreadSettings(CPUAffinityMask affinity, int realTimePriority)
+{
+  if(isRunning())
+  {
+    logger(LOG_ERROR) << "USBBulkStreamer: Cannot change thread settings while streaming" << std::endl;
+    return false;
+  }
+  
+  return _usbBulkStreamerPrivate->usbIO->setBulkStreamThreadSettings(affinity, realTimePriority);
+}
+
+unsigned int USBBulkStreamer::getDroppedFrameCount() const
+{
+  return _usbBulkStreamerPrivate->droppedFrames;
+}
+
+
+}
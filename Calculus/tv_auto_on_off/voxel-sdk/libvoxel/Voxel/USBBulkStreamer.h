@@ -18,6 +18,12 @@ namespace Voxel
  */
 
 
+/**
+ * \brief Streams frames of fixed size from a bulk IN endpoint.
+ *
+ * A few bulk transfers are kept queued through USBIO::startBulkStream() on a ring of preallocated frame buffers.
+ * In zero copy mode (default), captured frames borrow these buffers, which return to the ring when the frame is released.
+ */
 class VOXEL_EXPORT USBBulkStreamer : public Streamer
 {
 protected:
@@ -37,6 +43,19 @@ public:
   
   virtual bool setBufferSize(size_t bufferSize);
   
+  // Number of bulk transfers to keep queued. Can be changed only when not streaming
+  bool setTransferCount(SizeType count);
+  SizeType getTransferCount() const;
+  
+  virtual bool setZeroCopy(bool enable);
+  virtual bool isZeroCopy();
+  
+  // Applies to USBIO's event thread, which completes the bulk transfers
+  virtual bool setThreadSettings(CPUAffinityMask affinity, int realTimePriority);
+  
+  // Frames dropped because of failed or incomplete transfers or because capture() was not called fast enough
+  unsigned int getDroppedFrameCount() const;
+  
   // All these three are dummy
   virtual bool getSupportedVideoModes(Vector<VideoMode> &videoModes);
   virtual bool getCurrentVideoMode(VideoMode &videoMode);
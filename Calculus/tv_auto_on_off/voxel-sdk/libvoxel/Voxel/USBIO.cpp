@@ -17,6 +17,8 @@
 #include "CyAPI.h"
 #endif
 
+#define BULK_STREAM_EVENT_TIMEOUT 100000 // in micro-seconds. Bounds the time the event thread takes to notice stopBulkStream()
+
 
 namespace Voxel
 {
@@ -52,6 +54,32 @@ typedef CCyUSBDevice *USBHandle;
   
   bool resetBulkEndPoint(uint8_t endpoint);
   
+  // Asynchronous bulk stream
+  BulkStreamCallback bulkStreamCallback;
+  Atomic<bool> bulkStreamRunning;
+  Mutex bulkStreamMutex; // Orders resubmission of a completed transfer against cancellation in stopBulkStream()
+  ThreadPtr bulkStreamThread;
+  CPUAffinityMask bulkStreamAffinity = 0;
+  int bulkStreamPriority = 0;
+  
+  void initBulkStreamThread(); // Called first on the event thread
+  
+#ifdef LINUX
+  Vector<libusb_transfer *> bulkStreamTransfers;
+  int pendingBulkTransfers = 0; // Touched only by the event thread, once it is started
+  
+  static void onBulkTransfer(libusb_transfer *transfer);
+  void bulkStreamEventLoop();
+#elif defined(WINDOWS)
+  Vector<uint8_t *> bulkStreamBuffers;
+  long bulkStreamTransferLength, bulkStreamTimeout;
+  
+  void bulkStreamLoop();
+#endif
+  
+  bool startBulkStream(uint8_t endpoint, const Vector<uint8_t *> &buffers, long transferLength, BulkStreamCallback callback, long timeout);
+  bool stopBulkStream();
+  
   ~USBIOPrivate();
 };
 
@@ -62,6 +90,8 @@ USBIO::USBIOPrivate::USBIOPrivate(DevicePtr device): device(device), handle(0),
   , deviceHandle(INVALID_HANDLE_VALUE)
 #endif
 {
+  bulkStreamRunning = false;
+  
   if(device->interfaceID() != Device::USB)
   {
     logger(LOG_ERROR) << "USBIO: cannot download to a non-USB device" << std::endl;
@@ -136,6 +166,9 @@ USBIO::USBIOPrivate::USBIOPrivate(DevicePtr device): device(device), handle(0),
 
 USBIO::USBIOPrivate::~USBIOPrivate()
 {
+  if(bulkStreamThread)
+    stopBulkStream();
+  
 #ifdef LINUX
   if(_initialized)
   {
@@ -255,6 +288,234 @@ bool USBIO::USBIOPrivate::resetBulkEndPoint(uint8_t endpoint)
 #endif
 }
 
+bool USBIO::USBIOPrivate::startBulkStream(uint8_t endpoint, const Vector<uint8_t *> &buffers, long transferLength, BulkStreamCallback callback, long timeout)
+{
+  if(bulkStreamThread)
+  {
+    logger(LOG_ERROR) << "USBIO: A bulk stream is already running" << std::endl;
+    return false;
+  }
+  
+  if(!buffers.size() || !callback)
+  {
+    logger(LOG_ERROR) << "USBIO: Need atleast one buffer and a callback to start a bulk stream" << std::endl;
+    return false;
+  }
+  
+  bulkStreamCallback = callback;
+  bulkStreamRunning = true;
+  
+#ifdef LINUX
+  bool submitted = true;
+  
+  pendingBulkTransfers = 0;
+  bulkStreamTransfers.reserve(buffers.size());
+  
+  for(auto i = 0; i < buffers.size(); i++)
+  {
+    libusb_transfer *transfer = libusb_alloc_transfer(0);
+    
+    if(!transfer)
+    {
+      logger(LOG_ERROR) << "USBIO: Could not allocate a bulk transfer" << std::endl;
+      submitted = false;
+      break;
+    }
+    
+    bulkStreamTransfers.push_back(transfer);
+    
+    libusb_fill_bulk_transfer(transfer, handle, endpoint, buffers[i], transferLength, &USBIOPrivate::onBulkTransfer, this, timeout);
+    
+    int rc = libusb_submit_transfer(transfer);
+    
+    if(rc != LIBUSB_SUCCESS)
+    {
+      logger(LOG_ERROR) << "USBIO: Could not submit bulk transfer. " << libusb_strerror((libusb_error)rc) << std::endl;
+      submitted = false;
+      break;
+    }
+    
+    pendingBulkTransfers++;
+  }
+  
+  bulkStreamThread = ThreadPtr(new Thread(&USBIOPrivate::bulkStreamEventLoop, this));
+  
+  if(!submitted)
+  {
+    stopBulkStream();
+    return false;
+  }
+  return true;
+#elif defined(WINDOWS)
+  if(!(endpoint & 0x80))
+  {
+    logger(LOG_ERROR) << "USBIO: Bulk stream is supported only on IN endpoints" << std::endl;
+    return false;
+  }
+  
+  bulkStreamBuffers = buffers;
+  bulkStreamTransferLength = transferLength;
+  bulkStreamTimeout = timeout;
+  
+  bulkStreamThread = ThreadPtr(new Thread(&USBIOPrivate::bulkStreamLoop, this));
+  return true;
+#endif
+}
+
+void USBIO::USBIOPrivate::initBulkStreamThread()
+{
+  if(!setCurrentThreadAffinity(bulkStreamAffinity))
+    logger(LOG_WARNING) << "USBIO: Could not set affinity of bulk stream thread to 0x" << std::hex << bulkStreamAffinity << std::dec << std::endl;
+  
+  if(!setCurrentThreadRealTimePriority(bulkStreamPriority))
+    logger(LOG_WARNING) << "USBIO: Could not set real-time priority " << bulkStreamPriority << " for bulk stream thread" << std::endl;
+}
+
+bool USBIO::USBIOPrivate::stopBulkStream()
+{
+  if(!bulkStreamThread)
+    return false;
+  
+  {
+    Lock<Mutex> _(bulkStreamMutex);
+    bulkStreamRunning = false;
+    
+#ifdef LINUX
+    for(auto transfer: bulkStreamTransfers)
+      libusb_cancel_transfer(transfer); // Fails harmlessly for transfers which are not pending
+#endif
+  }
+  
+  if(bulkStreamThread->joinable())
+    bulkStreamThread->join();
+  
+  bulkStreamThread = nullptr;
+  
+#ifdef LINUX
+  for(auto transfer: bulkStreamTransfers)
+    libusb_free_transfer(transfer);
+  
+  bulkStreamTransfers.clear();
+#endif
+  
+  bulkStreamCallback = nullptr;
+  return true;
+}
+
+#ifdef LINUX
+void USBIO::USBIOPrivate::onBulkTransfer(libusb_transfer *transfer)
+{
+  USBIOPrivate *p = (USBIOPrivate *)transfer->user_data;
+  
+  p->pendingBulkTransfers--;
+  
+  if(transfer->status == LIBUSB_TRANSFER_CANCELLED)
+    return;
+  
+  if(transfer->status == LIBUSB_TRANSFER_NO_DEVICE)
+  {
+    logger(LOG_ERROR) << "USBIO: Device disconnected during bulk stream" << std::endl;
+    return;
+  }
+  
+  uint8_t *next = p->bulkStreamCallback(transfer->buffer, transfer->actual_length, transfer->status == LIBUSB_TRANSFER_COMPLETED);
+  
+  if(!next)
+    return;
+  
+  Lock<Mutex> _(p->bulkStreamMutex);
+  
+  if(!p->bulkStreamRunning)
+    return;
+  
+  transfer->buffer = next;
+  
+  int rc = libusb_submit_transfer(transfer);
+  
+  if(rc != LIBUSB_SUCCESS)
+  {
+    logger(LOG_ERROR) << "USBIO: Could not resubmit bulk transfer. " << libusb_strerror((libusb_error)rc) << std::endl;
+    return;
+  }
+  
+  p->pendingBulkTransfers++;
+}
+
+void USBIO::USBIOPrivate::bulkStreamEventLoop()
+{
+  initBulkStreamThread();
+  
+  libusb_context *context = sys.getUSBSystemPrivate().getContext();
+  
+  // Keep handling events till cancelled transfers have come back, as their callbacks refer to this object
+  while(bulkStreamRunning || pendingBulkTransfers > 0)
+  {
+    struct timeval tv = { 0, BULK_STREAM_EVENT_TIMEOUT };
+    libusb_handle_events_timeout_completed(context, &tv, nullptr);
+  }
+}
+#elif defined(WINDOWS)
+void USBIO::USBIOPrivate::bulkStreamLoop()
+{
+  initBulkStreamThread();
+  
+  CCyBulkEndPoint *dataEP = handle->BulkInEndPt;
+  
+  SizeType count = bulkStreamBuffers.size();
+  
+  Vector<OVERLAPPED> overlapped(count);
+  Vector<PUCHAR> contexts(count, nullptr);
+  
+  dataEP->SetXferSize(nearestPowerOf2(bulkStreamTransferLength));
+  lastTransferSize = bulkStreamTransferLength;
+  
+  SizeType active = 0;
+  
+  for(auto i = 0; i < count; i++)
+  {
+    memset(&overlapped[i], 0, sizeof(OVERLAPPED));
+    overlapped[i].hEvent = CreateEvent(NULL, false, false, NULL);
+    
+    if((contexts[i] = dataEP->BeginDataXfer(bulkStreamBuffers[i], bulkStreamTransferLength, &overlapped[i])))
+      active++;
+  }
+  
+  // Transfers on an endpoint complete in the order in which they were queued
+  for(SizeType i = 0; active; i = (i + 1) % count)
+  {
+    if(!contexts[i])
+      continue;
+    
+    bool running = bulkStreamRunning;
+    
+    if(!dataEP->WaitForXfer(&overlapped[i], running?bulkStreamTimeout:0))
+    {
+      dataEP->Abort(); // Aborts all queued transfers. Others then complete immediately as failed
+      WaitForSingleObject(overlapped[i].hEvent, bulkStreamTimeout);
+    }
+    
+    long transferred = bulkStreamTransferLength;
+    bool success = dataEP->FinishDataXfer(bulkStreamBuffers[i], transferred, &overlapped[i], contexts[i]);
+    
+    contexts[i] = nullptr;
+    
+    uint8_t *next = running?bulkStreamCallback(bulkStreamBuffers[i], success?transferred:0, success):nullptr;
+    
+    if(next && bulkStreamRunning)
+    {
+      bulkStreamBuffers[i] = next;
+      contexts[i] = dataEP->BeginDataXfer(next, bulkStreamTransferLength, &overlapped[i]);
+    }
+    
+    if(!contexts[i])
+      active--;
+  }
+  
+  for(auto i = 0; i < count; i++)
+    CloseHandle(overlapped[i].hEvent);
+}
+#endif
+
 
 bool USBIO::isInitialized()
 {
@@ -299,6 +560,32 @@ bool USBIO::resetBulkEndPoint(uint8_t endpoint)
   return _usbIOPrivate->resetBulkEndPoint(endpoint);
 }
 
+bool USBIO::startBulkStream(uint8_t endpoint, const Vector<uint8_t *> &buffers, long transferLength, BulkStreamCallback callback, long timeout)
+{
+  if(!_usbIOPrivate->isInitialized())
+  {
+    logger(LOG_ERROR) << "USBIO: Not initialized." << std::endl;
+    return false;
+  }
+  
+  return _usbIOPrivate->startBulkStream(endpoint, buffers, transferLength, callback, timeout);
+}
+
+bool USBIO::stopBulkStream()
+{
+  return _usbIOPrivate->stopBulkStream();
+}
+
+bool USBIO::setBulkStreamThreadSettings(CPUAffinityMask affinity, int realTimePriority)
+{
+  if(!_usbIOPrivate)
+    return !affinity && !realTimePriority;
+  
+  _usbIOPrivate->bulkStreamAffinity = affinity;
+  _usbIOPrivate->bulkStreamPriority = realTimePriority;
+  return true;
+}
+
 USBSystem &USBIO::getUSBSystem()
 {
   return _usbIOPrivate->sys;
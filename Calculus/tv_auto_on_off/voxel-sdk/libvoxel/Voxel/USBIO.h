@@ -19,6 +19,8 @@ protected:
   class USBIOPrivate;
   Ptr<USBIOPrivate> _usbIOPrivate;
   
+  USBIO() {} // For USBIO implementations, like mocks in tests, which do not talk to a real device. These need to override all transfer functions
+  
 public:
   USBIO(DevicePtr device);
   
@@ -44,16 +46,35 @@ public:
     RECIPIENT_OTHER = 0x03,
   };
   
-  bool controlTransfer(Direction direction, RequestType requestType, RecipientType recipientType, uint8_t request, uint16_t value, uint16_t index, 
+  virtual bool controlTransfer(Direction direction, RequestType requestType, RecipientType recipientType, uint8_t request, uint16_t value, uint16_t index, 
                        uint8_t *data = 0, uint16_t length = 0, long timeout = 1000);
   
-  bool bulkTransfer(uint8_t endpoint, uint8_t *data, long toTransferLength, long &transferredLength, long timeout = 1000);
+  virtual bool bulkTransfer(uint8_t endpoint, uint8_t *data, long toTransferLength, long &transferredLength, long timeout = 1000);
+  
+  virtual bool resetBulkEndPoint(uint8_t endpoint);
+  
+  /**
+   * Called on completion of an asynchronous bulk transfer into 'data'. 'success' is false for failed or timed out transfers.
+   * Returns the buffer to be used for the next transfer in place of this one, or nullptr to not submit it again.
+   */
+  typedef Function<uint8_t *(uint8_t *data, long transferredLength, bool success)> BulkStreamCallback;
+  
+  /**
+   * Keeps one bulk transfer of 'transferLength' bytes queued on 'endpoint' for each of 'buffers', so that the bus does not
+   * idle between transfers. 'callback' is called from an event thread owned by USBIO, for one completion at a time.
+   * Only one bulk stream can be running on a USBIO at a time.
+   */
+  virtual bool startBulkStream(uint8_t endpoint, const Vector<uint8_t *> &buffers, long transferLength, BulkStreamCallback callback, long timeout = 1000);
+  
+  // Cancels pending transfers and returns after the last callback has returned
+  virtual bool stopBulkStream();
   
-  bool resetBulkEndPoint(uint8_t endpoint);
+  // CPUs and real-time priority of the event thread of bulk streams started after this. 0 for either leaves it as it is
+  virtual bool setBulkStreamThreadSettings(CPUAffinityMask affinity, int realTimePriority);
   
   USBSystem &getUSBSystem();
   
-  bool isInitialized();
+  virtual bool isInitialized();
   
   virtual ~USBIO() {}
 };
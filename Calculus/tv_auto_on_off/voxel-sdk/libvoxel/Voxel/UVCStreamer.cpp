@@ -13,6 +13,7 @@
 #include <assert.h>
 
 #define MAX_BUFFER_COUNT 2
+#define SPARE_BUFFER_COUNT 4 // Mapped buffers which frames can borrow, in zero copy mode, on top of those kept with the driver
 
 #ifdef LINUX
 #include <linux/videodev2.h>
@@ -97,6 +98,18 @@ public:
   Vector<UVCRawData> rawDataBuffers;
 
   size_t frameByteSize;
+  
+  bool zeroCopy = false; // When set, in CAPTURE_MMAP, frames borrow the mapped buffers instead of copying them
+  
+  // Exists while mapped buffers are streaming. Borrowed frames keep a weak reference to it, so that
+  // they queue back their buffer only to the stream they were dequeued from
+  struct StreamToken
+  {
+    Ptr<UVC> uvc;
+    Atomic<SizeType> borrowed; // buffers held by frames. Frames are copied instead when the driver would be left with too few
+  };
+  
+  Ptr<StreamToken> streamToken;
 
   void updateFrameByteSize(uint32_t width, uint32_t height, uint32_t bytesPerLine, uint32_t frameSize)
   {
@@ -678,7 +691,7 @@ bool UVCStreamer::_start()
     
     memset(&req, 0, sizeof(req));
     
-    req.count = MAX_BUFFER_COUNT;
+    req.count = MAX_BUFFER_COUNT + SPARE_BUFFER_COUNT;
     req.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     req.memory = V4L2_MEMORY_MMAP;
     
@@ -808,6 +821,13 @@ bool UVCStreamer::_start()
       logger(LOG_ERROR) << "UVCStreamer: Failed to start capture stream" << std::endl;
       return _uvcStreamerPrivate->initialized = false;
     }
+    
+    if(_uvcStreamerPrivate->captureMode == UVCStreamerPrivate::CAPTURE_MMAP)
+    {
+      _uvcStreamerPrivate->streamToken = Ptr<UVCStreamerPrivate::StreamToken>(new UVCStreamerPrivate::StreamToken());
+      _uvcStreamerPrivate->streamToken->uvc = _uvcStreamerPrivate->uvc;
+      _uvcStreamerPrivate->streamToken->borrowed = 0;
+    }
   }
 #elif defined(WINDOWS)
   HRESULT hr;
@@ -845,6 +865,9 @@ bool UVCStreamer::_stop()
     return false;
 
 #ifdef LINUX  
+  /// Borrowed frames released from here on, will not queue back their buffers
+  _uvcStreamerPrivate->streamToken = nullptr;
+  
   /// Stop streaming
   enum v4l2_buf_type type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
   
@@ -889,6 +912,9 @@ bool UVCStreamer::_capture(RawDataFramePtr &p)
   TimeStampType waitTime = 2000;//ms
   
 #ifdef LINUX
+  if(p && p->isBorrowed())
+    p->releaseBorrowed(); // Hand back the buffer 'p' holds before waiting for the next one
+  
   bool timedOut;
   if(!isInitialized() || !_uvcStreamerPrivate->uvc->getUVCPrivate().isReadReady(waitTime, timedOut))
   {
@@ -966,6 +992,37 @@ bool UVCStreamer::_capture(RawDataFramePtr &p)
       return false;
     }
     
+    // Atleast MAX_BUFFER_COUNT buffers are left with the driver, so that frames held downstream do not stall capture
+    if(_uvcStreamerPrivate->captureMode == UVCStreamerPrivate::CAPTURE_MMAP && _uvcStreamerPrivate->zeroCopy &&
+      _uvcStreamerPrivate->streamToken->borrowed + MAX_BUFFER_COUNT < _uvcStreamerPrivate->rawDataBuffers.size())
+    {
+      if(!p)
+        p = RawDataFramePtr(new RawDataFrame());
+      
+      std::weak_ptr<UVCStreamerPrivate::StreamToken> token = _uvcStreamerPrivate->streamToken;
+      ByteType *d = &*_uvcStreamerPrivate->rawDataBuffers[buf.index].data;
+      
+      _uvcStreamerPrivate->streamToken->borrowed++;
+      
+      // The buffer is queued back to the driver when the last holder of the frame lets go of it
+      p->borrow(d, buf.bytesused, Ptr<void>(d, [token, buf](void *) mutable {
+        Ptr<UVCStreamerPrivate::StreamToken> t = token.lock();
+        
+        if(!t)
+          return; // Streaming has stopped
+        
+        if(t->uvc->getUVCPrivate().xioctl(VIDIOC_QBUF, &buf) == -1)
+          logger(LOG_ERROR) << "UVCStreamer: Failed to enqueue back the raw frame buffer" << std::endl;
+        
+        t->borrowed--;
+      }));
+      
+      p->timestamp = _time.convertToRealTime(buf.timestamp.tv_sec*1000000L + buf.timestamp.tv_usec);
+      p->id = _currentID++;
+      
+      return true;
+    }
+    
     if(!p || p->data.size() != buf.bytesused)
     {
       p = RawDataFramePtr(new RawDataFrame());
@@ -996,6 +1053,31 @@ bool UVCStreamer::_capture(RawDataFramePtr &p)
 #endif
 }
 
+bool UVCStreamer::setZeroCopy(bool enable)
+{
+#ifdef LINUX
+  if(isRunning())
+  {
+    logger(LOG_ERROR) << "UVCStreamer: Cannot change zero copy mode while streaming" << std::endl;
+    return false;
+  }
+  
+  _uvcStreamerPrivate->zeroCopy = enable;
+  return true;
+#else
+  return !enable;
+#endif
+}
+
+bool UVCStreamer::isZeroCopy()
+{
+#ifdef LINUX
+  return _uvcStreamerPrivate->zeroCopy && _uvcStreamerPrivate->captureMode == UVCStreamerPrivate::CAPTURE_MMAP;
+#else
+  return false;
+#endif
+}
+
 bool UVCStreamer::getSupportedVideoModes(Vector<VideoMode> &videoModes)
 {
   if(!isInitialized())
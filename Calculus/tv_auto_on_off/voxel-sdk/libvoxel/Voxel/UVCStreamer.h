@@ -42,6 +42,10 @@ public:
   
   virtual bool isInitialized();
   
+  // Enabled by default. Applies only to mmap based capture on Linux
+  virtual bool setZeroCopy(bool enable);
+  virtual bool isZeroCopy();
+  
   virtual bool getSupportedVideoModes(Vector<VideoMode> &videoModes);
   
   virtual bool getCurrentVideoMode(VideoMode &videoMode);
@@ -0,0 +1,388 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#include "VirtualDepthCamera.h"
+#include "CameraSystem.h"
+#include "Logger.h"
+
+#include <thread>
+#include <chrono>
+#include <cmath>
+
+#define VIRTUAL_CAMERA_DEFAULT_FRAME_RATE 30
+#define VIRTUAL_CAMERA_MAX_SLEEP 10000 // in micro-seconds. Bounds the time capture thread takes to notice stop() while pacing
+
+namespace Voxel
+{
+
+VirtualDepthCamera::VirtualDepthCamera(DevicePtr device, CameraSystem &sys): DepthCamera("VirtualDepthCamera", device, false),
+_playbackMode(PLAYBACK_ORIGINAL_TIMING), _loop(true),
+_playbackStartTime(0), _firstFrameTimeStamp(0), _lastFrameTimeStamp(0), _framesSincePlaybackStart(0)
+{
+  _frameSize.width = _frameSize.height = 0;
+  _frameRate.numerator = VIRTUAL_CAMERA_DEFAULT_FRAME_RATE;
+  _frameRate.denominator = 1;
+
+  if(device->interfaceID() != Device::VIRTUAL)
+  {
+    logger(LOG_ERROR) << "VirtualDepthCamera: Device '" << device->id() << "' is not a virtual device" << std::endl;
+    return;
+  }
+
+  _reader = FrameStreamReaderPtr(new FrameStreamReader(device->serialNumber(), sys)); // Serial number holds the file name
+
+  if(!_openStream())
+    logger(LOG_ERROR) << "VirtualDepthCamera: Could not initialize playback of '" << device->serialNumber() << "'" << std::endl;
+}
+
+bool VirtualDepthCamera::_openStream()
+{
+  if(!_reader->isStreamGood() || !_reader->size() ||
+    !_reader->getFrameGenerator(0) || !_reader->getFrameGenerator(1) || !_reader->getFrameGenerator(2))
+    return false;
+
+  Ptr<PointCloudFrameGenerator> p = std::dynamic_pointer_cast<PointCloudFrameGenerator>(_reader->getFrameGenerator(2));
+
+  if(!p)
+    return false;
+
+  _frameGenerators[0] = _reader->getFrameGenerator(0);
+  _frameGenerators[1] = _reader->getFrameGenerator(1);
+  _frameGenerators[2] = _reader->getFrameGenerator(2);
+  _pointCloudFrameGenerator = p;
+
+  // Frame size is known only after going through the generators once
+  if(!_reader->readNext())
+    return false;
+
+  DepthFrame *depthFrame = dynamic_cast<DepthFrame *>(_reader->frames[DepthCamera::FRAME_DEPTH_FRAME].get());
+
+  if(!depthFrame)
+    return false;
+
+  _frameSize = depthFrame->size;
+
+  // Nominal frame rate from the first two frames. Used for PLAYBACK_FIXED_FRAME_RATE unless changed by setFrameRate()
+  TimeStampType firstTimeStamp = _reader->frames[DepthCamera::FRAME_RAW_FRAME_UNPROCESSED]->timestamp;
+  RawFramePtr next;
+
+  if(_reader->size() > 1 && _reader->readNextRaw(next) && next->timestamp > firstTimeStamp)
+  {
+    _frameRate.numerator = 1000000;
+    _frameRate.denominator = (uint32_t)(next->timestamp - firstTimeStamp);
+  }
+
+  return _reader->seekTo(0);
+}
+
+bool VirtualDepthCamera::isInitialized() const
+{
+  return _reader && _frameGenerators[0] && _frameSize.width && _frameSize.height;
+}
+
+bool VirtualDepthCamera::setPlaybackMode(PlaybackMode mode)
+{
+  if(isRunning())
+  {
+    logger(LOG_ERROR) << "VirtualDepthCamera: Please stop " << id() << " before changing playback mode" << std::endl;
+    return false;
+  }
+
+  _playbackMode = mode;
+  return true;
+}
+
+bool VirtualDepthCamera::setLoop(bool loop)
+{
+  if(isRunning())
+  {
+    logger(LOG_ERROR) << "VirtualDepthCamera: Please stop " << id() << " before changing looping" << std::endl;
+    return false;
+  }
+
+  _loop = loop;
+  return true;
+}
+
+bool VirtualDepthCamera::seekTo(IndexType frameIndex)
+{
+  if(isRunning())
+  {
+    logger(LOG_ERROR) << "VirtualDepthCamera: Please stop " << id() << " before seeking" << std::endl;
+    return false;
+  }
+
+  if(!isInitialized() || frameIndex < 0 || !_reader->seekTo(frameIndex))
+  {
+    logger(LOG_ERROR) << "VirtualDepthCamera: Could not seek to frame " << frameIndex << " of " << getFrameCount() << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+void VirtualDepthCamera::_restartPacing()
+{
+  _playbackStartTime = _timer.getCurentRealTime();
+  _framesSincePlaybackStart = 0;
+}
+
+void VirtualDepthCamera::_waitForFrame(TimeStampType frameTimeStamp)
+{
+  if(_playbackMode == PLAYBACK_MAX_SPEED)
+    return;
+
+  TimeStampType target;
+
+  if(_playbackMode == PLAYBACK_ORIGINAL_TIMING)
+  {
+    if(_framesSincePlaybackStart == 0 || frameTimeStamp < _lastFrameTimeStamp) // Started or looped around
+    {
+      _restartPacing();
+      _firstFrameTimeStamp = frameTimeStamp;
+    }
+
+    target = _playbackStartTime + (frameTimeStamp - _firstFrameTimeStamp);
+  }
+  else
+  {
+    float frameRate = _frameRate.getFrameRate();
+
+    if(frameRate <= 0)
+      frameRate = VIRTUAL_CAMERA_DEFAULT_FRAME_RATE;
+
+    target = _playbackStartTime + (TimeStampType)(_framesSincePlaybackStart*1000000.0/frameRate);
+  }
+
+  _lastFrameTimeStamp = frameTimeStamp;
+  _framesSincePlaybackStart++;
+
+  TimeStampType now;
+
+  while(_running && (now = _timer.getCurentRealTime()) < target)
+    std::this_thread::sleep_for(std::chrono::microseconds(std::min<TimeStampType>(target - now, VIRTUAL_CAMERA_MAX_SLEEP)));
+}
+
+bool VirtualDepthCamera::_start()
+{
+  if(!isInitialized())
+  {
+    logger(LOG_ERROR) << "VirtualDepthCamera: " << id() << " is not initialized" << std::endl;
+    return false;
+  }
+
+  if(_reader->currentPosition() >= _reader->size() && !_reader->seekTo(0)) // Previous playback ran till the end
+    return false;
+
+  _restartPacing();
+  return true;
+}
+
+bool VirtualDepthCamera::_stop()
+{
+  return true;
+}
+
+bool VirtualDepthCamera::_captureRawUnprocessedFrame(RawFramePtr &rawFrame)
+{
+  if(_reader->currentPosition() >= _reader->size())
+  {
+    if(!_loop)
+    {
+      logger(LOG_INFO) << "VirtualDepthCamera: Reached end of stream. Stopping " << id() << std::endl;
+      _running = false;
+      return false;
+    }
+
+    if(!_reader->seekTo(0))
+      return false;
+  }
+
+  if(!_reader->readNextRaw(rawFrame))
+    return false;
+
+  _waitForFrame(rawFrame->timestamp);
+  return true;
+}
+
+bool VirtualDepthCamera::_processRawFrame(const RawFramePtr &rawFrameInput, RawFramePtr &rawFrameOutput)
+{
+  FramePtr p1 = std::dynamic_pointer_cast<Frame>(rawFrameInput);
+  FramePtr p2 = std::dynamic_pointer_cast<Frame>(rawFrameOutput);
+
+  if(!_frameGenerators[0]->generate(p1, p2))
+    return false;
+
+  rawFrameOutput = std::dynamic_pointer_cast<RawFrame>(p2);
+  return true;
+}
+
+bool VirtualDepthCamera::_convertToDepthFrame(const RawFramePtr &rawFrame, DepthFramePtr &depthFrame)
+{
+  FramePtr p1 = std::dynamic_pointer_cast<Frame>(rawFrame);
+  FramePtr p2 = std::dynamic_pointer_cast<Frame>(depthFrame);
+
+  if(!_frameGenerators[1]->generate(p1, p2))
+    return false;
+
+  depthFrame = std::dynamic_pointer_cast<DepthFrame>(p2);
+  return true;
+}
+
+bool VirtualDepthCamera::_setFrameRate(const FrameRate &r)
+{
+  if(!r.numerator || !r.denominator)
+  {
+    logger(LOG_ERROR) << "VirtualDepthCamera: Invalid frame rate " << r.numerator << "/" << r.denominator << std::endl;
+    return false;
+  }
+
+  _frameRate = r;
+  return true;
+}
+
+bool VirtualDepthCamera::_getFrameRate(FrameRate &r) const
+{
+  r = _frameRate;
+  return true;
+}
+
+bool VirtualDepthCamera::_setFrameSize(const FrameSize &s)
+{
+  if(s != _frameSize)
+  {
+    logger(LOG_ERROR) << "VirtualDepthCamera: Frame size is fixed by the recorded stream to " << _frameSize.width << "x" << _frameSize.height << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool VirtualDepthCamera::_getFrameSize(FrameSize &s) const
+{
+  if(!isInitialized())
+    return false;
+
+  s = _frameSize;
+  return true;
+}
+
+bool VirtualDepthCamera::_getMaximumFrameSize(FrameSize &s) const
+{
+  return _getFrameSize(s);
+}
+
+bool VirtualDepthCamera::_getMaximumFrameRate(FrameRate &frameRate, const FrameSize &forFrameSize) const
+{
+  if(forFrameSize != _frameSize)
+    return false;
+
+  frameRate = _frameRate;
+  return true;
+}
+
+bool VirtualDepthCamera::_getSupportedVideoModes(Vector<SupportedVideoMode> &supportedVideoModes) const
+{
+  if(!isInitialized())
+    return false;
+
+  supportedVideoModes.clear();
+  supportedVideoModes.push_back(SupportedVideoMode(_frameSize.width, _frameSize.height, _frameRate.numerator, _frameRate.denominator, 0));
+  return true;
+}
+
+bool VirtualDepthCamera::_getMaximumVideoMode(VideoMode &videoMode) const
+{
+  videoMode.frameRate = _frameRate;
+  return _getFrameSize(videoMode.frameSize);
+}
+
+bool VirtualDepthCamera::_getBytesPerPixel(uint &bpp) const
+{
+  logger(LOG_ERROR) << "VirtualDepthCamera: Bytes per pixel is not known for a recorded stream" << std::endl;
+  return false;
+}
+
+bool VirtualDepthCamera::_setBytesPerPixel(const uint &bpp)
+{
+  logger(LOG_ERROR) << "VirtualDepthCamera: Bytes per pixel cannot be changed for a recorded stream" << std::endl;
+  return false;
+}
+
+bool VirtualDepthCamera::_getROI(RegionOfInterest &roi)
+{
+  if(!isInitialized())
+    return false;
+
+  const PointCloudTransformPtr &t = _pointCloudFrameGenerator->getPointCloudTransform();
+
+  roi.x = t->left;
+  roi.y = t->top;
+  roi.width = t->width;
+  roi.height = t->height;
+  return true;
+}
+
+bool VirtualDepthCamera::_setROI(const RegionOfInterest &roi)
+{
+  logger(LOG_ERROR) << "VirtualDepthCamera: ROI cannot be changed for a recorded stream" << std::endl;
+  return false;
+}
+
+bool VirtualDepthCamera::_allowedROI(String &message)
+{
+  message = "ROI is fixed by the recorded stream";
+  return false;
+}
+
+bool VirtualDepthCamera::_getFieldOfView(float &fovHalfAngle) const
+{
+  if(!isInitialized())
+    return false;
+
+  const PointCloudTransformPtr &t = _pointCloudFrameGenerator->getPointCloudTransform();
+
+  if(t->fx <= 0)
+    return false;
+
+  fovHalfAngle = atanf(t->width/(2.0f*t->fx));
+  return true;
+}
+
+bool VirtualDepthCamera::_reset()
+{
+  return !isInitialized() || _reader->seekTo(0);
+}
+
+bool VirtualDepthCamera::_onReset()
+{
+  return true;
+}
+
+VirtualDepthCamera::~VirtualDepthCamera()
+{
+  if(isRunning())
+    stop();
+}
+
+
+VirtualDepthCameraFactory::VirtualDepthCameraFactory(CameraSystem &sys): DepthCameraFactory("Voxel::VirtualDepthCamera"), _sys(sys)
+{
+  _addSupportedDevices({ DevicePtr(new VirtualDevice("")) });
+}
+
+bool VirtualDepthCameraFactory::getChannels(Device &device, Vector<int> &channels)
+{
+  channels.resize(1);
+  channels[0] = 0;
+  return true;
+}
+
+DepthCameraPtr VirtualDepthCameraFactory::getDepthCamera(DevicePtr device)
+{
+  return DepthCameraPtr(new VirtualDepthCamera(device, _sys));
+}
+
+}
@@ -0,0 +1,135 @@
+/*
+ * TI Voxel Lib component.
+ *
+ * Copyright (c) 2014 Texas Instruments Inc.
+ */
+
+#ifndef VOXEL_VIRTUAL_DEPTHCAMERA_H
+#define VOXEL_VIRTUAL_DEPTHCAMERA_H
+
+#include "DepthCamera.h"
+#include "DepthCameraFactory.h"
+#include "FrameStream.h"
+#include "Timer.h"
+
+namespace Voxel
+{
+
+/**
+ * \addtogroup CamSys
+ * @{
+ */
+
+/**
+ * \brief Depth camera which replays a recorded frame stream (.vxl) instead of talking to hardware.
+ *
+ * Frames read from the stream go through the usual capture loop, filters and callbacks of DepthCamera.
+ * Frame generators are the ones recorded in the stream, so the libraries which recorded it need to be loaded in CameraSystem.
+ */
+class VOXEL_EXPORT VirtualDepthCamera: public DepthCamera
+{
+public:
+  enum PlaybackMode
+  {
+    PLAYBACK_ORIGINAL_TIMING = 0, // Paced as per the recorded frame timestamps
+    PLAYBACK_FIXED_FRAME_RATE = 1, // Paced as per setFrameRate()
+    PLAYBACK_MAX_SPEED = 2 // As fast as frames can be read and processed
+  };
+
+protected:
+  FrameStreamReaderPtr _reader;
+
+  PlaybackMode _playbackMode;
+  bool _loop;
+
+  FrameSize _frameSize;
+  FrameRate _frameRate;
+
+  Timer _timer;
+  TimeStampType _playbackStartTime, _firstFrameTimeStamp, _lastFrameTimeStamp;
+  SizeType _framesSincePlaybackStart;
+
+  void _restartPacing();
+  void _waitForFrame(TimeStampType frameTimeStamp);
+
+  virtual bool _start();
+  virtual bool _stop();
+
+  virtual bool _captureRawUnprocessedFrame(RawFramePtr &rawFrame);
+  virtual bool _processRawFrame(const RawFramePtr &rawFrameInput, RawFramePtr &rawFrameOutput);
+  virtual bool _convertToDepthFrame(const RawFramePtr &rawFrame, DepthFramePtr &depthFrame);
+
+  virtual bool _setFrameRate(const FrameRate &r);
+  virtual bool _getFrameRate(FrameRate &r) const;
+
+  virtual bool _setFrameSize(const FrameSize &s);
+  virtual bool _getFrameSize(FrameSize &s) const;
+  virtual bool _getMaximumFrameSize(FrameSize &s) const;
+  virtual bool _getMaximumFrameRate(FrameRate &frameRate, const FrameSize &forFrameSize) const;
+  virtual bool _getSupportedVideoModes(Vector<SupportedVideoMode> &supportedVideoModes) const;
+  virtual bool _getMaximumVideoMode(VideoMode &videoMode) const;
+
+  virtual bool _getBytesPerPixel(uint &bpp) const;
+  virtual bool _setBytesPerPixel(const uint &bpp);
+
+  virtual bool _getROI(RegionOfInterest &roi);
+  virtual bool _setROI(const RegionOfInterest &roi);
+  virtual bool _allowedROI(String &message);
+
+  virtual bool _getFieldOfView(float &fovHalfAngle) const;
+
+  virtual bool _reset();
+  virtual bool _onReset();
+
+  bool _openStream();
+
+public:
+  VirtualDepthCamera(DevicePtr device, CameraSystem &sys);
+
+  virtual bool isInitialized() const;
+
+  // Playback settings can be changed only while the camera is not running
+  bool setPlaybackMode(PlaybackMode mode);
+  inline PlaybackMode getPlaybackMode() const { return _playbackMode; }
+
+  // When looping is disabled, the capture loop stops after the last frame of the stream
+  bool setLoop(bool loop);
+  inline bool isLooping() const { return _loop; }
+
+  inline SizeType getFrameCount() const { return _reader?_reader->size():0; }
+  bool seekTo(IndexType frameIndex);
+
+  virtual ~VirtualDepthCamera();
+};
+
+typedef Ptr<VirtualDepthCamera> VirtualDepthCameraPtr;
+
+/**
+ * \brief Factory for VirtualDepthCamera. Registered by CameraSystem for VirtualDevice.
+ */
+class VOXEL_EXPORT VirtualDepthCameraFactory: public DepthCameraFactory
+{
+protected:
+  CameraSystem &_sys;
+
+public:
+  VirtualDepthCameraFactory(CameraSystem &sys);
+
+  virtual bool getChannels(Device &device, Vector<int> &channels);
+
+  virtual DepthCameraPtr getDepthCamera(DevicePtr device);
+
+  // Generators are the ones of the recorded stream, obtained through CameraSystem
+  virtual bool getFrameGenerator(uint8_t frameType, GeneratorIDType generatorID, FrameGeneratorPtr &frameGenerator) { return false; }
+  virtual Vector<GeneratorIDType> getSupportedGeneratorTypes() { return Vector<GeneratorIDType>(); }
+
+  virtual ~VirtualDepthCameraFactory() {}
+};
+
+/**
+ * @}
+ */
+
+}
+
+#endif // VOXEL_VIRTUAL_DEPTHCAMERA_H